@@ -0,0 +1,154 @@
+//
+//  main.c
+//  ros_client
+//
+//  Created by Eduardo Poleo on 2023-03-06.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../ros_xcode/protocol.h"
+
+/*
+  Drop in replacement for `ros_xcode script.rb` that hands the script to a
+  running `ros_xcode --serve`. When no server is listening, or the script
+  is run with flags of ros_xcode, it just execs ros_xcode so callers keep
+  working either way.
+*/
+static int connectToServer(void) {
+    const char *socketPath = getenv(SOCKET_ENV);
+    if (socketPath == NULL) {
+        socketPath = DEFAULT_SOCKET_PATH;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int sendRequest(int fd, char *payload, int32_t length) {
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+
+    struct iovec iov = {&length, sizeof(length)};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    if (sendmsg(fd, &message, 0) != sizeof(length)) {
+        return -1;
+    }
+
+    while(length > 0) {
+        ssize_t bytes = write(fd, payload, length);
+        if (bytes <= 0) {
+            return -1;
+        }
+        payload += bytes;
+        length -= bytes;
+    }
+    return 0;
+}
+
+// Flags of ros_xcode followed by a value.
+static bool takesValue(const char *flag) {
+    const char *flags[] = {"--threads", "--workers", "--gc-pause", "--heap-quota", "--stack-budget"};
+    for(int i = 0; i < (int)(sizeof(flags) / sizeof(flags[0])); i++) {
+        if (strcmp(flag, flags[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void runLocally(char *argv[]) {
+    argv[0] = "ros_xcode";
+    execvp(argv[0], argv);
+    perror("ros_xcode");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    char *script = NULL;
+    bool flags = false;
+    for(int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) == 0) {
+            flags = true;
+            i += takesValue(argv[i]) ? 1 : 0;
+        } else if (script == NULL) {
+            script = argv[i];
+        } else {
+            // ros_xcode would run the last one as the script, and scripts
+            // have no way to read them anyway.
+            fprintf(stderr, "ros: scripts can't take arguments\n");
+            return 1;
+        }
+    }
+    if (script == NULL) {
+        printf("usage: ros [ros_xcode flags] script.rb\n");
+        return 1;
+    }
+
+    // The server's workers run with their own settings, a script run with
+    // flags runs here.
+    if (flags) {
+        runLocally(argv);
+    }
+    int fd = connectToServer();
+    if (fd < 0) {
+        runLocally(argv);
+    }
+
+    // The server does not share our working directory.
+    char path[PATH_MAX];
+    if (realpath(script, path) == NULL) {
+        perror(script);
+        return 1;
+    }
+
+    int32_t length = (int32_t)strlen(path) + 1;
+    if (sendRequest(fd, path, length) != 0) {
+        perror("ros");
+        return 1;
+    }
+
+    // The connection closes without a status when the worker died.
+    char status = 1;
+    if (read(fd, &status, 1) != 1) {
+        status = 1;
+    }
+    close(fd);
+
+    return status;
+}
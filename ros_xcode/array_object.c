@@ -0,0 +1,149 @@
+//
+//  array_object.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-13.
+//
+
+#include <string.h>
+#include "array_object.h"
+#include "gc.h"
+
+static size_t itemSize(ArrayKind kind) {
+    return kind == NUMBER_ARRAY ? sizeof(double) : sizeof(Object*);
+}
+
+Object *newArray(Heap *heap, ArrayKind kind, int capacity) {
+    Object *array = initObject(heap, ARRAY_OBJ);
+    array->as.array.kind = kind;
+    array->as.array.size = 0;
+    array->as.array.capacity = capacity;
+    array->as.array.items.numbers = capacity > 0 ? heapAllocate(heap, capacity * itemSize(kind), HEAP_ARRAY) : NULL;
+    return array;
+}
+
+static void reserve(Heap *heap, Object *array, int capacity) {
+    if (capacity <= array->as.array.capacity) {
+        return;
+    }
+
+    int newCapacity = array->as.array.capacity < 8 ? 8 : 2 * array->as.array.capacity;
+    if (newCapacity < capacity) {
+        newCapacity = capacity;
+    }
+
+    size_t size = itemSize(array->as.array.kind);
+    void *items = heapAllocate(heap, newCapacity * size, HEAP_ARRAY);
+    if (array->as.array.size > 0) {
+        memcpy(items, array->as.array.items.numbers, array->as.array.size * size);
+    }
+    heapFree(heap, array->as.array.items.numbers, array->as.array.capacity * size);
+    array->as.array.items.numbers = items;
+    array->as.array.capacity = newCapacity;
+}
+
+static Object *boxNumber(Heap *heap, double value) {
+    Object *object = initObject(heap, NUMBER_OBJ);
+    object->as.number.value = value;
+    return object;
+}
+
+// Switches a number array to holding objects.
+static void box(Heap *heap, Object *array) {
+    int capacity = array->as.array.capacity > 0 ? array->as.array.capacity : 8;
+    Object **values = heapAllocate(heap, capacity * sizeof(Object*), HEAP_ARRAY);
+    for (int i = 0; i < array->as.array.size; i++) {
+        values[i] = boxNumber(heap, array->as.array.items.numbers[i]);
+    }
+    heapFree(heap, array->as.array.items.numbers, array->as.array.capacity * sizeof(double));
+    array->as.array.kind = VALUE_ARRAY;
+    array->as.array.items.values = values;
+    array->as.array.capacity = capacity;
+}
+
+// Turns an array of objects that are all numbers back into a number array,
+// returns false if anything in it isn't a number.
+bool arrayUnbox(Heap *heap, Object *array) {
+    if (array->as.array.kind == NUMBER_ARRAY) {
+        return true;
+    }
+
+    Object **values = array->as.array.items.values;
+    for (int i = 0; i < array->as.array.size; i++) {
+        if (values[i]->type != NUMBER_OBJ) {
+            return false;
+        }
+    }
+
+    int capacity = array->as.array.capacity > 0 ? array->as.array.capacity : 8;
+    double *numbers = heapAllocate(heap, capacity * sizeof(double), HEAP_ARRAY);
+    for (int i = 0; i < array->as.array.size; i++) {
+        numbers[i] = values[i]->as.number.value;
+    }
+    heapFree(heap, values, array->as.array.capacity * sizeof(Object*));
+    array->as.array.kind = NUMBER_ARRAY;
+    array->as.array.items.numbers = numbers;
+    array->as.array.capacity = capacity;
+    return true;
+}
+
+void arrayPush(Heap *heap, Object *array, Object *value) {
+    writeBarrier(heap, value);
+    if (array->as.array.kind == NUMBER_ARRAY && value->type != NUMBER_OBJ) {
+        box(heap, array);
+    }
+    reserve(heap, array, array->as.array.size + 1);
+
+    if (array->as.array.kind == NUMBER_ARRAY) {
+        array->as.array.items.numbers[array->as.array.size] = value->as.number.value;
+    } else {
+        array->as.array.items.values[array->as.array.size] = value;
+    }
+    array->as.array.size++;
+}
+
+// Negative indexes count from the end, anything out of bounds is nil.
+Object *arrayGet(Heap *heap, Object *array, int index) {
+    if (index < 0) {
+        index += array->as.array.size;
+    }
+    if (index < 0 || index >= array->as.array.size) {
+        return initObject(heap, NIL_OBJECT);
+    }
+
+    if (array->as.array.kind == NUMBER_ARRAY) {
+        return boxNumber(heap, array->as.array.items.numbers[index]);
+    }
+    return array->as.array.items.values[index];
+}
+
+// Setting past the end fills the gap with nil. Returns false for a
+// negative index before the start of the array.
+bool arraySet(Heap *heap, Object *array, int index, Object *value) {
+    writeBarrier(heap, value);
+    if (index < 0) {
+        index += array->as.array.size;
+    }
+    if (index < 0) {
+        return false;
+    }
+
+    bool gap = index > array->as.array.size;
+    if (array->as.array.kind == NUMBER_ARRAY && (gap || value->type != NUMBER_OBJ)) {
+        box(heap, array);
+    }
+    while (array->as.array.size < index) {
+        arrayPush(heap, array, initObject(heap, NIL_OBJECT));
+    }
+    if (index == array->as.array.size) {
+        arrayPush(heap, array, value);
+        return true;
+    }
+
+    if (array->as.array.kind == NUMBER_ARRAY) {
+        array->as.array.items.numbers[index] = value->as.number.value;
+    } else {
+        array->as.array.items.values[index] = value;
+    }
+    return true;
+}
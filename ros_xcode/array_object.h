@@ -0,0 +1,27 @@
+//
+//  array_object.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-13.
+//
+
+#ifndef array_object_h
+#define array_object_h
+
+#include <stdio.h>
+#include "object.h"
+#include "heap.h"
+
+/*
+  Growable Array objects. Buffers come from the heap of the interpreter like
+  everything else, so a buffer that gets outgrown stays allocated until the
+  interpreter goes away; capacity doubles so that waste is bounded by the
+  size of the final buffer.
+*/
+Object *newArray(Heap *heap, ArrayKind kind, int capacity);
+void arrayPush(Heap *heap, Object *array, Object *value);
+Object *arrayGet(Heap *heap, Object *array, int index);
+bool arraySet(Heap *heap, Object *array, int index, Object *value);
+bool arrayUnbox(Heap *heap, Object *array);
+
+#endif /* array_object_h */
@@ -0,0 +1,689 @@
+//
+//  ast_cache.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-04.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ast_cache.h"
+#include "string_object.h"
+#include "type_inference.h"
+#include "stats.h"
+#include "inliner.h"
+#include "walk_stack.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct Writer {
+    char *buffer;
+    size_t size;
+    size_t capacity;
+    char *source;
+    size_t sourceLength;
+    bool ok;
+    WalkStack stack;
+} Writer;
+
+typedef struct Reader {
+    const char *current;
+    const char *end;
+    char *source;
+    size_t sourceLength;
+    bool ok;
+    // Innermost block being read, what local slots and upvalues are checked against.
+    Block *block;
+    WalkStack stack;
+} Reader;
+
+static void writeExpr(Writer *writer, Expr *exp);
+static void writeStmts(Writer *writer, StmtArray *statements);
+static void writeBlock(Writer *writer, Block *block);
+static Expr *readExpr(Reader *reader);
+static StmtArray *readStmts(Reader *reader);
+static Block *readBlock(Reader *reader);
+static void writeStmt(Writer *writer, Stmt *stmt);
+static Stmt *readStmt(Reader *reader);
+
+// A statement or an expression nested too deep for the stack, written or
+// read on a segment. Neither side raises errors, they clear `ok`.
+typedef struct DeepNode {
+    Writer *writer;
+    Reader *reader;
+    bool statement;
+    Stmt *stmt;
+    Expr *exp;
+} DeepNode;
+
+static void nodeSegment(void *context) {
+    DeepNode *node = context;
+    if (node->writer != NULL && node->statement) {
+        writeStmt(node->writer, node->stmt);
+    } else if (node->writer != NULL) {
+        writeExpr(node->writer, node->exp);
+    } else if (node->statement) {
+        node->stmt = readStmt(node->reader);
+    } else {
+        node->exp = readExpr(node->reader);
+    }
+}
+
+static DeepNode nodeOnNewSegment(WalkStack *stack, DeepNode node) {
+    walkOnNewSegment(stack, nodeSegment, &node);
+    return node;
+}
+
+uint64_t hashSource(const char *source, size_t length) {
+    uint64_t hash = FNV_OFFSET;
+    for(size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)source[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// The cache lives next to the script unless ROS_CACHE_DIR points somewhere else.
+char *astCachePath(const char *scriptPath) {
+    const char *dir = getenv("ROS_CACHE_DIR");
+    char *path;
+
+    if (dir != NULL && dir[0] != '\0') {
+        size_t length = strlen(dir) + 32;
+        path = malloc(length);
+        snprintf(path, length, "%s/%016llx.astc", dir,
+            (unsigned long long)hashSource(scriptPath, strlen(scriptPath)));
+    } else {
+        size_t length = strlen(scriptPath) + 6;
+        path = malloc(length);
+        snprintf(path, length, "%s.astc", scriptPath);
+    }
+
+    return path;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Writing
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static void writeBytes(Writer *writer, const void *bytes, size_t length) {
+    if (writer->size + length > writer->capacity) {
+        size_t newCapacity = writer->capacity < 256 ? 256 : writer->capacity;
+        while(newCapacity < writer->size + length) {
+            newCapacity *= 2;
+        }
+        writer->buffer = realloc(writer->buffer, newCapacity);
+        writer->capacity = newCapacity;
+    }
+    memcpy(writer->buffer + writer->size, bytes, length);
+    writer->size += length;
+}
+
+static void writeInt(Writer *writer, int32_t value) {
+    writeBytes(writer, &value, sizeof(value));
+}
+
+static void writeDouble(Writer *writer, double value) {
+    writeBytes(writer, &value, sizeof(value));
+}
+
+// Source slices are stored as an offset + length pair.
+static void writeSlice(Writer *writer, char *start, int length) {
+    if (start < writer->source || start + length > writer->source + writer->sourceLength) {
+        writer->ok = false;
+        return;
+    }
+    writeInt(writer, (int32_t)(start - writer->source));
+    writeInt(writer, length);
+}
+
+static void writeExprs(Writer *writer, ExprArray *exprs) {
+    writeInt(writer, exprs->size);
+    for(int i = 0; i < exprs->size; i++) {
+        writeExpr(writer, exprs->list[i]);
+    }
+}
+
+static void writeExpr(Writer *writer, Expr *exp) {
+    if (walkStackLow(&writer->stack)) {
+        nodeOnNewSegment(&writer->stack, (DeepNode){writer, NULL, false, NULL, exp});
+        return;
+    }
+    // The inliner runs again on load.
+    if (exp->type == INLINED_CALL) {
+        exp = exp->as.inlined.call;
+    }
+    writeInt(writer, exp->type);
+    writeInt(writer, exp->line);
+
+    switch (exp->type) {
+        case BINARY:
+            writeInt(writer, exp->as.binary.op);
+            writeExpr(writer, exp->as.binary.left);
+            writeExpr(writer, exp->as.binary.right);
+            break;
+        case NUMBER_LITERAL:
+            writeDouble(writer, exp->as.numberLiteral.number);
+            break;
+        case STRING_LITERAL:
+            writeSlice(writer, exp->as.stringLiteral.string, exp->as.stringLiteral.length);
+            break;
+        case BOOLEAN:
+            writeInt(writer, exp->as.boolExp.value);
+            break;
+        case IDENTIFIER_EXP:
+            writeSlice(writer, exp->as.identifierExp.string, exp->as.identifierExp.length);
+            writeInt(writer, exp->as.identifierExp.kind);
+            writeInt(writer, exp->as.identifierExp.slot);
+            break;
+        case METHOD_CALL_EXP:
+            writeSlice(writer, exp->as.methodCall.name, exp->as.methodCall.length);
+            writeExprs(writer, exp->as.methodCall.arguments);
+            break;
+        case VAR_ASSIGNMENT:
+            writeSlice(writer, exp->as.varAssignment.name, exp->as.varAssignment.length);
+            writeExpr(writer, exp->as.varAssignment.value);
+            writeInt(writer, exp->as.varAssignment.kind);
+            writeInt(writer, exp->as.varAssignment.slot);
+            break;
+        case LOGICAL:
+            writeInt(writer, exp->as.logical.op);
+            writeExpr(writer, exp->as.logical.left);
+            writeExpr(writer, exp->as.logical.right);
+            break;
+        case UNARY:
+            writeInt(writer, exp->as.unary.op);
+            writeExpr(writer, exp->as.unary.operand);
+            break;
+        case RANGE:
+            writeInt(writer, strcmp(exp->as.range.type, "inclusive") == 0);
+            writeExpr(writer, exp->as.range.start);
+            writeExpr(writer, exp->as.range.end);
+            break;
+        case ARRAY_LITERAL:
+            writeExprs(writer, exp->as.arrayLiteral.elements);
+            break;
+        case INDEX_EXP:
+            writeExpr(writer, exp->as.index.object);
+            writeExpr(writer, exp->as.index.index);
+            break;
+        case INDEX_ASSIGNMENT:
+            writeExpr(writer, exp->as.index.object);
+            writeExpr(writer, exp->as.index.index);
+            writeExpr(writer, exp->as.index.value);
+            break;
+        case INVOKE_EXP:
+            writeExpr(writer, exp->as.invoke.receiver);
+            writeSlice(writer, exp->as.invoke.name, exp->as.invoke.length);
+            writeExprs(writer, exp->as.invoke.arguments);
+            writeInt(writer, exp->as.invoke.block != NULL);
+            if (exp->as.invoke.block != NULL) {
+                writeBlock(writer, exp->as.invoke.block);
+            }
+            break;
+        case HASH_LITERAL:
+            writeExprs(writer, exp->as.hashLiteral.keys);
+            writeExprs(writer, exp->as.hashLiteral.values);
+            break;
+        case INTERPOLATION:
+            writeExprs(writer, exp->as.interpolation.parts);
+            break;
+        default:
+            // Node the format does not know about, never write a partial cache.
+            writer->ok = false;
+            break;
+    }
+}
+
+static void writeStmt(Writer *writer, Stmt *stmt) {
+    if (walkStackLow(&writer->stack)) {
+        nodeOnNewSegment(&writer->stack, (DeepNode){writer, NULL, true, stmt, NULL});
+        return;
+    }
+    writeInt(writer, stmt->type);
+    writeInt(writer, stmt->line);
+
+    switch (stmt->type) {
+        case PUTS_STMT:
+            writeExpr(writer, stmt->as.puts.exp);
+            break;
+        case EXPR_STMT:
+            writeExpr(writer, stmt->exprStmt);
+            break;
+        case IF_STMT: {
+            ConditionalArray *conditionals = stmt->as.ifStmt.conditionals;
+            writeInt(writer, conditionals->size);
+            for(int i = 0; i < conditionals->size; i++) {
+                writeExpr(writer, conditionals->list[i]->condition);
+                writeStmts(writer, conditionals->list[i]->statements);
+            }
+            break;
+        }
+        case WHILE_STMT:
+            writeExpr(writer, stmt->as.whileStmt.condition);
+            writeStmts(writer, stmt->as.whileStmt.statements);
+            break;
+        case FOR_STMT:
+        case PARALLEL_FOR_STMT:
+            writeExpr(writer, stmt->as.forStmt.identifier);
+            writeExpr(writer, stmt->as.forStmt.range);
+            writeStmts(writer, stmt->as.forStmt.statements);
+            writeInt(writer, stmt->as.forStmt.reduceOp);
+            if (stmt->as.forStmt.reduceOp != REDUCE_NONE) {
+                writeSlice(writer, stmt->as.forStmt.reduceName, stmt->as.forStmt.reduceLength);
+            }
+            break;
+        case DEF_STMT:
+            writeSlice(writer, stmt->as.defStmt.name, stmt->as.defStmt.nameLength);
+            writeExprs(writer, stmt->as.defStmt.arguments);
+            writeStmts(writer, stmt->as.defStmt.statements);
+            break;
+        default:
+            writer->ok = false;
+            break;
+    }
+}
+
+static void writeStmts(Writer *writer, StmtArray *statements) {
+    writeInt(writer, statements->size);
+    for(int i = 0; i < statements->size; i++) {
+        writeStmt(writer, statements->list[i]);
+    }
+}
+
+static void writeBlock(Writer *writer, Block *block) {
+    writeInt(writer, block->line);
+    writeInt(writer, block->paramCount);
+    writeInt(writer, block->localCount);
+    writeInt(writer, block->upvalues->size);
+    for(int i = 0; i < block->upvalues->size; i++) {
+        Upvalue *upvalue = block->upvalues->list[i];
+        writeInt(writer, upvalue->source);
+        writeInt(writer, upvalue->index);
+        writeSlice(writer, upvalue->name, upvalue->length);
+    }
+    writeStmts(writer, block->statements);
+}
+
+bool writeAstCache(const char *cachePath, char *source, StmtArray *statements) {
+    Writer writer = {NULL, 0, 0, source, strlen(source), true};
+    initWalkStack(&writer.stack);
+
+    AstCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AST_CACHE_MAGIC, sizeof(header.magic));
+    header.version = AST_CACHE_VERSION;
+    header.sourceLength = writer.sourceLength;
+    header.sourceHash = hashSource(source, writer.sourceLength);
+
+    writeBytes(&writer, &header, sizeof(header));
+    writeStmts(&writer, statements);
+
+    if (!writer.ok) {
+        free(writer.buffer);
+        return false;
+    }
+
+    // Write to a temporary file first so a concurrent reader never maps
+    // a half written cache.
+    size_t tmpLength = strlen(cachePath) + 32;
+    char *tmpPath = malloc(tmpLength);
+    snprintf(tmpPath, tmpLength, "%s.%d.tmp", cachePath, (int)getpid());
+
+    FILE *file = fopen(tmpPath, "wb");
+    bool written = false;
+    if (file != NULL) {
+        written = fwrite(writer.buffer, 1, writer.size, file) == writer.size;
+        written = (fclose(file) == 0) && written;
+        written = written && rename(tmpPath, cachePath) == 0;
+        if (!written) {
+            unlink(tmpPath);
+        }
+    }
+
+    free(tmpPath);
+    free(writer.buffer);
+    return written;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Reading
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static void readBytes(Reader *reader, void *bytes, size_t length) {
+    if (!reader->ok || (size_t)(reader->end - reader->current) < length) {
+        reader->ok = false;
+        memset(bytes, 0, length);
+        return;
+    }
+    memcpy(bytes, reader->current, length);
+    reader->current += length;
+}
+
+static int32_t readInt(Reader *reader) {
+    int32_t value;
+    readBytes(reader, &value, sizeof(value));
+    return value;
+}
+
+static double readDouble(Reader *reader) {
+    double value;
+    readBytes(reader, &value, sizeof(value));
+    return value;
+}
+
+static char *readSlice(Reader *reader, int *length) {
+    int32_t offset = readInt(reader);
+    *length = readInt(reader);
+
+    if (offset < 0 || *length < 0 || (size_t)offset + *length > reader->sourceLength) {
+        reader->ok = false;
+        return reader->source;
+    }
+    return reader->source + offset;
+}
+
+// A corrupt file would otherwise allow huge allocations.
+static int readCount(Reader *reader) {
+    int32_t count = readInt(reader);
+    if (count < 0 || count > reader->end - reader->current) {
+        reader->ok = false;
+        return 0;
+    }
+    return count;
+}
+
+static ExprArray *readExprs(Reader *reader) {
+    ExprArray *exprs = initExprArray();
+    int count = readCount(reader);
+    for(int i = 0; i < count && reader->ok; i++) {
+        Expr *exp = readExpr(reader);
+        ADD_ARRAY_ELEMENT(exprs, exp, Expr);
+    }
+    return exprs;
+}
+
+// A slot has to exist in the block the variable is read in.
+static bool validSlot(Block *block, VariableKind kind, int slot) {
+    switch (kind) {
+        case VARIABLE_NAMED:
+            return true;
+        case VARIABLE_LOCAL:
+            return block != NULL && slot >= 0 && slot < block->localCount;
+        case VARIABLE_UPVALUE:
+            return block != NULL && slot >= 0 && slot < block->upvalues->size;
+    }
+    return false;
+}
+
+static VariableKind readVariable(Reader *reader, int *slot) {
+    VariableKind kind = readInt(reader);
+    *slot = readInt(reader);
+
+    if (!validSlot(reader->block, kind, *slot)) {
+        reader->ok = false;
+        return VARIABLE_NAMED;
+    }
+    return kind;
+}
+
+static Block *readBlock(Reader *reader) {
+    Block *block = malloc(sizeof(Block));
+    stats.astBytes += sizeof(Block);
+    block->line = readInt(reader);
+    block->paramCount = readInt(reader);
+    block->localCount = readInt(reader);
+    block->upvalues = initUpvalueArray();
+
+    if (block->paramCount < 0 || block->localCount < block->paramCount ||
+        block->localCount > reader->end - reader->current)
+    {
+        reader->ok = false;
+        block->paramCount = block->localCount = 0;
+    }
+
+    int count = readCount(reader);
+    for(int i = 0; i < count && reader->ok; i++) {
+        Upvalue *upvalue = malloc(sizeof(Upvalue));
+        upvalue->source = readInt(reader);
+        upvalue->index = readInt(reader);
+        upvalue->name = readSlice(reader, &upvalue->length);
+        // Captured from the block around this one.
+        if (!validSlot(reader->block, upvalue->source, upvalue->index)) {
+            reader->ok = false;
+        }
+        ADD_ARRAY_ELEMENT(block->upvalues, upvalue, Upvalue);
+    }
+
+    Block *enclosing = reader->block;
+    reader->block = block;
+    block->statements = readStmts(reader);
+    reader->block = enclosing;
+    return block;
+}
+
+static Expr *readExpr(Reader *reader) {
+    if (walkStackLow(&reader->stack)) {
+        return nodeOnNewSegment(&reader->stack, (DeepNode){NULL, reader, false, NULL, NULL}).exp;
+    }
+    ExprType type = readInt(reader);
+    int line = readInt(reader);
+
+    // Inlined calls are written as the call they replaced.
+    if (!reader->ok || type < 0 || type >= EXPR_TYPE_COUNT || type == INLINED_CALL || type == INLINED_ARGUMENT) {
+        reader->ok = false;
+        type = BOOLEAN;
+    }
+
+    Expr *exp = newExpr(line, type);
+
+    switch (type) {
+        case BINARY:
+            exp->as.binary.op = readInt(reader);
+            exp->as.binary.left = readExpr(reader);
+            exp->as.binary.right = readExpr(reader);
+            exp->as.binary.kind = BINARY_UNSEEN;
+            exp->as.binary.samples = 0;
+            break;
+        case NUMBER_LITERAL:
+            exp->as.numberLiteral.number = readDouble(reader);
+            break;
+        case STRING_LITERAL:
+            exp->as.stringLiteral.string = readSlice(reader, &exp->as.stringLiteral.length);
+            exp->as.stringLiteral.object = newSharedString(exp->as.stringLiteral.string, exp->as.stringLiteral.length);
+            break;
+        case BOOLEAN:
+            exp->as.boolExp.value = readInt(reader);
+            break;
+        case IDENTIFIER_EXP:
+            exp->as.identifierExp.string = readSlice(reader, &exp->as.identifierExp.length);
+            exp->as.identifierExp.kind = readVariable(reader, &exp->as.identifierExp.slot);
+            break;
+        case METHOD_CALL_EXP:
+            exp->as.methodCall.name = readSlice(reader, &exp->as.methodCall.length);
+            exp->as.methodCall.arguments = readExprs(reader);
+            break;
+        case VAR_ASSIGNMENT:
+            exp->as.varAssignment.name = readSlice(reader, &exp->as.varAssignment.length);
+            exp->as.varAssignment.value = readExpr(reader);
+            exp->as.varAssignment.kind = readVariable(reader, &exp->as.varAssignment.slot);
+            break;
+        case LOGICAL:
+            exp->as.logical.op = readInt(reader);
+            exp->as.logical.left = readExpr(reader);
+            exp->as.logical.right = readExpr(reader);
+            break;
+        case UNARY:
+            exp->as.unary.op = readInt(reader);
+            exp->as.unary.operand = readExpr(reader);
+            break;
+        case RANGE:
+            exp->as.range.type = readInt(reader) ? "inclusive" : "exclusive";
+            exp->as.range.start = readExpr(reader);
+            exp->as.range.end = readExpr(reader);
+            break;
+        case ARRAY_LITERAL:
+            exp->as.arrayLiteral.elements = readExprs(reader);
+            break;
+        case INDEX_EXP:
+            exp->as.index.object = readExpr(reader);
+            exp->as.index.index = readExpr(reader);
+            exp->as.index.value = NULL;
+            break;
+        case INDEX_ASSIGNMENT:
+            exp->as.index.object = readExpr(reader);
+            exp->as.index.index = readExpr(reader);
+            exp->as.index.value = readExpr(reader);
+            break;
+        case INVOKE_EXP:
+            exp->as.invoke.receiver = readExpr(reader);
+            exp->as.invoke.name = readSlice(reader, &exp->as.invoke.length);
+            exp->as.invoke.arguments = readExprs(reader);
+            exp->as.invoke.block = readInt(reader) ? readBlock(reader) : NULL;
+            break;
+        case HASH_LITERAL:
+            exp->as.hashLiteral.keys = readExprs(reader);
+            exp->as.hashLiteral.values = readExprs(reader);
+            if (exp->as.hashLiteral.keys->size != exp->as.hashLiteral.values->size) {
+                reader->ok = false;
+            }
+            break;
+        case INTERPOLATION:
+            exp->as.interpolation.parts = readExprs(reader);
+            break;
+        case INLINED_CALL:
+        case INLINED_ARGUMENT:
+            // Never written, turned into a bad read above.
+            break;
+    }
+
+    return exp;
+}
+
+static Stmt *readStmt(Reader *reader) {
+    if (walkStackLow(&reader->stack)) {
+        return nodeOnNewSegment(&reader->stack, (DeepNode){NULL, reader, true, NULL, NULL}).stmt;
+    }
+    StmtType type = readInt(reader);
+    int line = readInt(reader);
+
+    if (!reader->ok || type < 0 || type >= STMT_TYPE_COUNT) {
+        reader->ok = false;
+        type = EXPR_STMT;
+    }
+
+    Stmt *stmt = newStmt(line, type);
+
+    switch (type) {
+        case PUTS_STMT:
+            stmt->as.puts.exp = readExpr(reader);
+            break;
+        case EXPR_STMT:
+            stmt->exprStmt = readExpr(reader);
+            break;
+        case IF_STMT: {
+            ConditionalArray *conditionals = initConditionalArray();
+            int count = readCount(reader);
+            for(int i = 0; i < count && reader->ok; i++) {
+                Conditional *conditional = newConditional();
+                conditional->condition = readExpr(reader);
+                free(conditional->statements);
+                conditional->statements = readStmts(reader);
+                ADD_ARRAY_ELEMENT(conditionals, conditional, Conditional);
+            }
+            stmt->as.ifStmt.conditionals = conditionals;
+            break;
+        }
+        case WHILE_STMT:
+            stmt->as.whileStmt.condition = readExpr(reader);
+            stmt->as.whileStmt.statements = readStmts(reader);
+            break;
+        case FOR_STMT:
+        case PARALLEL_FOR_STMT:
+            stmt->as.forStmt.identifier = readExpr(reader);
+            stmt->as.forStmt.range = readExpr(reader);
+            stmt->as.forStmt.statements = readStmts(reader);
+            stmt->as.forStmt.reduceOp = readInt(reader);
+            if (stmt->as.forStmt.reduceOp != REDUCE_NONE) {
+                stmt->as.forStmt.reduceName = readSlice(reader, &stmt->as.forStmt.reduceLength);
+            }
+            break;
+        case DEF_STMT:
+            stmt->as.defStmt.name = readSlice(reader, &stmt->as.defStmt.nameLength);
+            stmt->as.defStmt.arguments = readExprs(reader);
+            stmt->as.defStmt.statements = readStmts(reader);
+            stmt->as.defStmt.numeric = NULL;
+            stmt->as.defStmt.lazy = false;
+            stmt->as.defStmt.body = NULL;
+            break;
+    }
+
+    return stmt;
+}
+
+static StmtArray *readStmts(Reader *reader) {
+    StmtArray *statements = initStmtArray();
+    int count = readCount(reader);
+    for(int i = 0; i < count && reader->ok; i++) {
+        Stmt *stmt = readStmt(reader);
+        ADD_ARRAY_ELEMENT(statements, stmt, Stmt);
+    }
+    return statements;
+}
+
+// Returns NULL when there is no usable cache for this exact source so the
+// caller can fall back to a regular parse.
+StmtArray *loadAstCache(const char *cachePath, char *source) {
+    int fd = open(cachePath, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(AstCacheHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = info.st_size;
+    char *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return NULL;
+    }
+
+    AstCacheHeader header;
+    memcpy(&header, mapped, sizeof(header));
+    size_t sourceLength = strlen(source);
+
+    if (memcmp(header.magic, AST_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != AST_CACHE_VERSION ||
+        header.sourceLength != sourceLength ||
+        header.sourceHash != hashSource(source, sourceLength))
+    {
+        munmap(mapped, size);
+        return NULL;
+    }
+
+    Reader reader = {mapped + sizeof(header), mapped + size, source, sourceLength, true, NULL};
+    initWalkStack(&reader.stack);
+    StmtArray *statements = readStmts(&reader);
+    munmap(mapped, size);
+
+    if (!reader.ok || reader.current != reader.end) {
+        // Nodes are only partially freed by freeStatements, a corrupt cache is
+        // rare enough that leaking them here is fine.
+        return NULL;
+    }
+
+    // Inference and inlining aren't cached, they are quick to do again.
+    inferTypes(statements);
+    inlineCalls(statements);
+    return statements;
+}
@@ -0,0 +1,43 @@
+//
+//  ast_cache.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-04.
+//
+
+#ifndef ast_cache_h
+#define ast_cache_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "parser.h"
+
+/*
+  On disk format of a parsed program:
+
+  header: magic "ROSAST\0\0", format version, source length, source hash
+  body:   the statements, written depth first.
+
+  Every identifier and string in the AST points inside the source buffer so
+  they are stored as offsets into it. That keeps the file relocatable, the
+  loaded AST points into whatever buffer the source was read into.
+  Bump AST_CACHE_VERSION whenever the shape of Expr or Stmt changes.
+*/
+#define AST_CACHE_MAGIC "ROSAST\0\0"
+#define AST_CACHE_VERSION 9
+
+typedef struct AstCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t sourceLength;
+    uint64_t sourceHash;
+} AstCacheHeader;
+
+uint64_t hashSource(const char *source, size_t length);
+char *astCachePath(const char *scriptPath);
+bool writeAstCache(const char *cachePath, char *source, StmtArray *statements);
+StmtArray *loadAstCache(const char *cachePath, char *source);
+
+#endif /* ast_cache_h */
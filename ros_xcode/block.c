@@ -0,0 +1,115 @@
+//
+//  block.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-19.
+//
+
+#include <string.h>
+#include <stdint.h>
+#include "block.h"
+#include "scheduler.h"
+
+// The value slot of a variable of `env`. One only set in a parent (a
+// parallel for) is copied down first since parents are never written
+// through, and one that was never assigned starts out as nil.
+static Object **variableSlot(Interpreter *interp, HashTable *env, char *name, int length) {
+    Object **slot = getEntrySlot(name, length, env);
+    if (slot != NULL) {
+        return slot;
+    }
+
+    Object *value = getEntry(name, length, env);
+    insertEntry(env, name, length, value != NULL ? value : initObject(&interp->heap, NIL_OBJECT));
+    return getEntrySlot(name, length, env);
+}
+
+// `upvalues` has room for one per upvalue of the block, filled in here for
+// the block passed from code running against `env`.
+void initClosure(Interpreter *interp, Closure *closure, Block *block, HashTable *env, Object ***upvalues) {
+    closure->block = block;
+    closure->upvalues = upvalues;
+    closure->env = env;
+    closure->frame = NULL;
+    closure->frameId = 0;
+
+    for(int i = 0; i < block->upvalues->size; i++) {
+        Upvalue *upvalue = block->upvalues->list[i];
+
+        switch (upvalue->source) {
+            case VARIABLE_NAMED:
+                upvalues[i] = variableSlot(interp, env, upvalue->name, upvalue->length);
+                break;
+            case VARIABLE_LOCAL:
+                upvalues[i] = &interp->frame->locals[upvalue->index];
+                break;
+            case VARIABLE_UPVALUE:
+                upvalues[i] = interp->frame->upvalues[upvalue->index];
+                break;
+        }
+    }
+}
+
+// A copy that can be kept after the call the block was passed to returns.
+Closure *retainClosure(Interpreter *interp, Closure *closure) {
+    int count = closure->block->upvalues->size;
+    Closure *retained = heapAllocate(&interp->heap, sizeof(Closure), HEAP_CLOSURE);
+    *retained = *closure;
+    retained->upvalues = heapAllocate(&interp->heap, (count > 0 ? count : 1) * sizeof(Object**), HEAP_CLOSURE);
+    memcpy(retained->upvalues, closure->upvalues, count * sizeof(Object**));
+
+    // Variables of the top level or a method live in heap entries, the ones
+    // of blocks in their frames. Frames are left newest first so the first
+    // one pointed into is the first to go.
+    for(Frame *frame = interp->frame; frame != NULL && retained->frame == NULL; frame = frame->enclosing) {
+        for(int i = 0; i < count; i++) {
+            uintptr_t slot = (uintptr_t)closure->upvalues[i];
+            if (slot >= (uintptr_t)frame->locals && slot < (uintptr_t)(frame->locals + frame->localCount)) {
+                retained->frame = frame;
+                retained->frameId = frame->id;
+                break;
+            }
+        }
+    }
+    return retained;
+}
+
+static bool frameIsLive(Interpreter *interp, Closure *closure) {
+    for(Frame *frame = interp->frame; frame != NULL; frame = frame->enclosing) {
+        if (frame == closure->frame && frame->id == closure->frameId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Missing arguments are nil and extra ones are dropped, like in Ruby.
+Object *callBlock(Interpreter *interp, Closure *closure, Object **arguments, int count) {
+    Block *block = closure->block;
+    if (closure->frame != NULL && !frameIsLive(interp, closure)) {
+        runtimeError(interp, block->line, "block used after the block it was created in returned");
+    }
+
+    preemptionPoint(interp);
+    Object *locals[block->localCount > 0 ? block->localCount : 1];
+
+    for(int i = 0; i < block->localCount; i++) {
+        locals[i] = NULL;
+    }
+    for(int i = 0; i < block->paramCount; i++) {
+        locals[i] = i < count ? ownValue(interp, arguments[i]) : initObject(&interp->heap, NIL_OBJECT);
+    }
+
+    Frame *enclosing = interp->frame;
+    Frame frame = {locals, block->localCount, closure->upvalues, enclosing, ++interp->frameCount};
+    interp->frame = &frame;
+
+    Object *result = NULL;
+    StmtArray *statements = block->statements;
+    for(int i = 0; i < statements->size; i++) {
+        result = execute(interp, statements->list[i], closure->env);
+    }
+
+    interp->frame = enclosing;
+    return result != NULL ? result : initObject(&interp->heap, NIL_OBJECT);
+}
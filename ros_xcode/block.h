@@ -0,0 +1,49 @@
+//
+//  block.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-19.
+//
+
+#ifndef block_h
+#define block_h
+
+#include <stdio.h>
+#include "interpreter.h"
+
+/*
+  Blocks are flat closures. The parser numbers the variables a block
+  assigns and lists the ones it uses from outside (see Scope in parser.h),
+  so passing a block only captures a pointer to each of those, and calls
+  run against a frame of local slots on the C stack instead of a hash
+  table of their own.
+
+  Most blocks don't outlive the call they are passed to, which is what
+  makes pointing into the frames and environments around them safe. The
+  ones that do, kept by a lazy enumerator, are copied to the heap with
+  retainClosure() and refuse to run once a frame they point into is gone.
+*/
+typedef struct Frame {
+    Object **locals;
+    int localCount;
+    Object ***upvalues;
+    struct Frame *enclosing;
+    // Tells a frame apart from a later one at the same address.
+    long id;
+} Frame;
+
+typedef struct Closure {
+    Block *block;
+    Object ***upvalues;
+    // Where the block was written, for the names the parser left unresolved.
+    HashTable *env;
+    // Set on retained closures, the newest frame they point into.
+    Frame *frame;
+    long frameId;
+} Closure;
+
+void initClosure(Interpreter *interp, Closure *closure, Block *block, HashTable *env, Object ***upvalues);
+Closure *retainClosure(Interpreter *interp, Closure *closure);
+Object *callBlock(Interpreter *interp, Closure *closure, Object **arguments, int count);
+
+#endif /* block_h */
@@ -0,0 +1,638 @@
+//
+//  builtins.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-13.
+//
+
+#include <string.h>
+#include <math.h>
+#include "builtins.h"
+#include "array_object.h"
+#include "vector.h"
+#include "hash_object.h"
+#include "string_object.h"
+#include "block.h"
+#include "enumerator.h"
+#include "isolate.h"
+
+static Object *newNumber(Interpreter *interp, double value) {
+    Object *object = initObject(&interp->heap, NUMBER_OBJ);
+    object->as.number.value = value;
+    return object;
+}
+
+// The workers of a parallel for run at once, each with a heap of its own.
+// What the loop's interpreter owns they can only read.
+static bool outerObject(Interpreter *interp, Object *object) {
+    return interp->parallelWorker && findSlab(&interp->heap, object) == NULL;
+}
+
+void checkModifiable(Interpreter *interp, Expr *exp, Object *object) {
+    if (outerObject(interp, object)) {
+        runtimeError(interp, exp->line, "can't modify an outer %s inside a parallel for", objectTypeName(object->type));
+    }
+}
+
+// `array` with its numbers unboxed, NULL if it holds anything else.
+// Unboxing changes the array, so a parallel for worker unboxes a copy of
+// an outer one.
+static Object *unboxedArray(Interpreter *interp, Object *array) {
+    int size = array->as.array.size;
+    if (array->as.array.kind != NUMBER_ARRAY && size > 0 && outerObject(interp, array)) {
+        Object *copy = newArray(&interp->heap, VALUE_ARRAY, size);
+        memcpy(copy->as.array.items.values, array->as.array.items.values, size * sizeof(Object*));
+        copy->as.array.size = size;
+        array = copy;
+    }
+    return arrayUnbox(&interp->heap, array) ? array : NULL;
+}
+
+// The bulk operations only work on unboxed buffers.
+static double *numbersOf(Interpreter *interp, Expr *exp, Object *array, const char *method) {
+    Object *unboxed = unboxedArray(interp, array);
+    if (unboxed == NULL) {
+        runtimeError(interp, exp->line, "Array#%s needs an array of numbers", method);
+    }
+    return unboxed->as.array.items.numbers;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Array
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static Object *arrayLength(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    return newNumber(interp, self->as.array.size);
+}
+
+static Object *arrayPushMethod(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    checkModifiable(interp, exp, self);
+    arrayPush(&interp->heap, self, ownValue(interp, arguments[0]));
+    return self;
+}
+
+static Object *arraySum(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    double *numbers = numbersOf(interp, exp, self, "sum");
+    return newNumber(interp, vectorSum(numbers, self->as.array.size));
+}
+
+static Object *arrayMin(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    double *numbers = numbersOf(interp, exp, self, "min");
+    if (self->as.array.size == 0) {
+        return initObject(&interp->heap, NIL_OBJECT);
+    }
+    return newNumber(interp, vectorMin(numbers, self->as.array.size));
+}
+
+static Object *arrayMax(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    double *numbers = numbersOf(interp, exp, self, "max");
+    if (self->as.array.size == 0) {
+        return initObject(&interp->heap, NIL_OBJECT);
+    }
+    return newNumber(interp, vectorMax(numbers, self->as.array.size));
+}
+
+static int compareStrings(const void *a, const void *b) {
+    return stringCompare(*(Object **)a, *(Object **)b);
+}
+
+// Returns a sorted copy, the receiver is left as it was.
+static Object *arraySort(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    int size = self->as.array.size;
+    Object *unboxed = unboxedArray(interp, self);
+
+    if (unboxed == NULL) {
+        for (int i = 0; i < size; i++) {
+            if (self->as.array.items.values[i]->type != STRING_OBJ) {
+                runtimeError(interp, exp->line, "Array#sort needs an array of numbers or of strings");
+            }
+        }
+
+        Object *sorted = newArray(&interp->heap, VALUE_ARRAY, size);
+        memcpy(sorted->as.array.items.values, self->as.array.items.values, size * sizeof(Object*));
+        sorted->as.array.size = size;
+        qsort(sorted->as.array.items.values, size, sizeof(Object*), compareStrings);
+        return sorted;
+    }
+
+    double *numbers = unboxed->as.array.items.numbers;
+
+    Object *sorted = newArray(&interp->heap, NUMBER_ARRAY, size);
+    memcpy(sorted->as.array.items.numbers, numbers, size * sizeof(double));
+    sorted->as.array.size = size;
+    // The keys count towards the heap like any other array buffer.
+    size_t bufferSize = 2 * size * sizeof(uint64_t);
+    uint64_t *buffer = heapAllocate(&interp->heap, bufferSize, HEAP_ARRAY);
+    vectorSort(sorted->as.array.items.numbers, buffer, size);
+    heapFree(&interp->heap, buffer, bufferSize);
+    return sorted;
+}
+
+static Builtin arrayMethods[] = {
+    {"length", 0, arrayLength},
+    {"size", 0, arrayLength},
+    {"push", 1, arrayPushMethod},
+    {"sum", 0, arraySum},
+    {"min", 0, arrayMin},
+    {"max", 0, arrayMax},
+    {"sort", 0, arraySort},
+    {NULL, 0, NULL}
+};
+
+// Elements pushed by the block are visited too, like in Ruby.
+static Object *arrayEach(Interpreter *interp, Expr *exp, Object *self, Object **arguments, Closure *block) {
+    for(int i = 0; i < self->as.array.size; i++) {
+        Object *element = arrayGet(&interp->heap, self, i);
+        callBlock(interp, block, &element, 1);
+    }
+    return self;
+}
+
+static BlockBuiltin arrayBlockMethods[] = {
+    {"each", 0, arrayEach},
+    {NULL, 0, NULL}
+};
+
+/*
+  array + array and array * array work element by element, an array and a
+  number applies the number to every element.
+*/
+Object *arrayArithmetic(Interpreter *interp, Expr *exp, Object *left, Object *right) {
+    TokenType op = exp->as.binary.op;
+    const char *name = op == PLUS ? "+" : op == STAR ? "*" : NULL;
+    if (name == NULL) {
+        runtimeError(interp, exp->line, "arrays don't support this operator");
+    }
+
+    // Scalar operands go on the right, both operations commute.
+    if (left->type != ARRAY_OBJ) {
+        Object *swap = left;
+        left = right;
+        right = swap;
+    }
+
+    double *a = numbersOf(interp, exp, left, name);
+    int size = left->as.array.size;
+    Object *result = newArray(&interp->heap, NUMBER_ARRAY, size);
+    result->as.array.size = size;
+    double *out = result->as.array.items.numbers;
+
+    if (right->type == ARRAY_OBJ) {
+        double *b = numbersOf(interp, exp, right, name);
+        if (right->as.array.size != size) {
+            runtimeError(interp, exp->line, "Array#%s needs arrays of the same length (%d and %d)",
+                name, size, right->as.array.size);
+        }
+        if (op == PLUS) {
+            vectorAdd(out, a, b, size);
+        } else {
+            vectorMultiply(out, a, b, size);
+        }
+    } else if (right->type == NUMBER_OBJ) {
+        if (op == PLUS) {
+            vectorAddScalar(out, a, right->as.number.value, size);
+        } else {
+            vectorMultiplyScalar(out, a, right->as.number.value, size);
+        }
+    } else {
+        runtimeError(interp, exp->line, "%s can't be applied to an Array and %s",
+            name, objectTypeName(right->type));
+    }
+
+    return result;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// String
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static Object *newBoolean(Interpreter *interp, bool value) {
+    Object *object = initObject(&interp->heap, BOOLEAN_OBJ);
+    object->as.boolean.value = value;
+    return object;
+}
+
+// Binary operators other than == and != with a String on either side.
+Object *stringOperation(Interpreter *interp, Expr *exp, Object *left, Object *right) {
+    TokenType op = exp->as.binary.op;
+
+    if (left->type != STRING_OBJ) {
+        runtimeError(interp, exp->line, "String can't be coerced into %s", objectTypeName(left->type));
+    }
+    if (right->type != STRING_OBJ) {
+        runtimeError(interp, exp->line, "no implicit conversion of %s into String", objectTypeName(right->type));
+    }
+
+    switch (op) {
+        case PLUS:
+            return stringConcat(&interp->heap, left, right);
+        case GREATER:
+            return newBoolean(interp, stringCompare(left, right) > 0);
+        case GREATER_EQUAL:
+            return newBoolean(interp, stringCompare(left, right) >= 0);
+        case LESS:
+            return newBoolean(interp, stringCompare(left, right) < 0);
+        case LESS_EQUAL:
+            return newBoolean(interp, stringCompare(left, right) <= 0);
+        default:
+            runtimeError(interp, exp->line, "undefined operator for String");
+            return NULL;
+    }
+}
+
+// string << string appends in place, array << value pushes. Both return the
+// receiver so appends can be chained.
+Object *appendOperation(Interpreter *interp, Expr *exp, Object *left, Object *right) {
+    if (left->type == ARRAY_OBJ) {
+        checkModifiable(interp, exp, left);
+        arrayPush(&interp->heap, left, ownValue(interp, right));
+        return left;
+    }
+    if (left->type != STRING_OBJ) {
+        runtimeError(interp, exp->line, "undefined method '<<' for %s", objectTypeName(left->type));
+    }
+
+    left = ownString(&interp->heap, left);
+    if (left->as.string.frozen) {
+        runtimeError(interp, exp->line, "can't modify frozen String");
+    }
+    if (right->type != STRING_OBJ) {
+        runtimeError(interp, exp->line, "no implicit conversion of %s into String", objectTypeName(right->type));
+    }
+    checkModifiable(interp, exp, left);
+
+    stringAppend(&interp->heap, left, right);
+    return left;
+}
+
+static Object *stringLength(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    return newNumber(interp, self->as.string.length);
+}
+
+static Builtin stringMethods[] = {
+    {"length", 0, stringLength},
+    {"size", 0, stringLength},
+    {NULL, 0, NULL}
+};
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Hash
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static void checkKey(Interpreter *interp, Expr *exp, Object *key) {
+    if (!isHashableKey(key)) {
+        runtimeError(interp, exp->line, "%s can't be used as a Hash key", objectTypeName(key->type));
+    }
+}
+
+// Missing keys are nil.
+Object *hashLookup(Interpreter *interp, Expr *exp, Object *hash, Object *key) {
+    checkKey(interp, exp, key);
+    Object *value = hashMapGet(hash->as.hash.map, key);
+    return value != NULL ? value : initObject(&interp->heap, NIL_OBJECT);
+}
+
+void hashStore(Interpreter *interp, Expr *exp, Object *hash, Object *key, Object *value) {
+    checkKey(interp, exp, key);
+    checkModifiable(interp, exp, hash);
+    hashMapSet(hash->as.hash.map, key, ownValue(interp, value));
+}
+
+static Object *hashLength(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    return newNumber(interp, self->as.hash.map->size);
+}
+
+static Object *hashDelete(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    checkKey(interp, exp, arguments[0]);
+    checkModifiable(interp, exp, self);
+    Object *value = hashMapDelete(self->as.hash.map, arguments[0]);
+    return value != NULL ? value : initObject(&interp->heap, NIL_OBJECT);
+}
+
+static Object *hashHasKey(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    checkKey(interp, exp, arguments[0]);
+    return newBoolean(interp, hashMapGet(self->as.hash.map, arguments[0]) != NULL);
+}
+
+// Keys or values in insertion order.
+static Object *hashColumn(Interpreter *interp, Object *self, bool keys) {
+    HashMap *map = self->as.hash.map;
+    Object *array = newArray(&interp->heap, NUMBER_ARRAY, (int)map->size);
+    for (long i = 0; i < map->entryCount; i++) {
+        if (map->entries[i].key != NULL) {
+            arrayPush(&interp->heap, array, keys ? map->entries[i].key : map->entries[i].value);
+        }
+    }
+    return array;
+}
+
+static Object *hashKeys(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    return hashColumn(interp, self, true);
+}
+
+static Object *hashValues(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    return hashColumn(interp, self, false);
+}
+
+static Builtin hashMethods[] = {
+    {"length", 0, hashLength},
+    {"size", 0, hashLength},
+    {"delete", 1, hashDelete},
+    {"key?", 1, hashHasKey},
+    {"keys", 0, hashKeys},
+    {"values", 0, hashValues},
+    {NULL, 0, NULL}
+};
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Number and Range
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static Object *numberTimes(Interpreter *interp, Expr *exp, Object *self, Object **arguments, Closure *block) {
+    double count = self->as.number.value;
+    for(double i = 0; i < count; i++) {
+        Object *index = newNumber(interp, i);
+        callBlock(interp, block, &index, 1);
+    }
+    return self;
+}
+
+static BlockBuiltin numberBlockMethods[] = {
+    {"times", 0, numberTimes},
+    {NULL, 0, NULL}
+};
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Range and Enumerator::Lazy
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+// A range is treated as an enumerator with no stages, made in `scratch`.
+static Enumerator *enumeratorOf(Object *self, Enumerator *scratch) {
+    if (self->type == ENUMERATOR_OBJ) {
+        return self->as.enumerator.enumerator;
+    }
+    rangeEnumerator(scratch, self, 1);
+    return scratch;
+}
+
+static Object *rangeStep(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    Object *step = arguments[0];
+    if (step->type != NUMBER_OBJ || !(step->as.number.value > 0) || isinf(step->as.number.value)) {
+        runtimeError(interp, exp->line, "step has to be a positive number");
+    }
+
+    Enumerator enumerator;
+    rangeEnumerator(&enumerator, self, step->as.number.value);
+    return newEnumerator(interp, &enumerator);
+}
+
+static bool collect(Interpreter *interp, Object *value, void *context) {
+    arrayPush(&interp->heap, context, ownValue(interp, value));
+    return true;
+}
+
+static Object *enumeratorToArray(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    Enumerator scratch;
+    Object *array = newArray(&interp->heap, NUMBER_ARRAY, 0);
+    runEnumerator(interp, enumeratorOf(self, &scratch), collect, array);
+    return array;
+}
+
+typedef struct FirstContext {
+    Object *array;
+    int remaining;
+} FirstContext;
+
+static bool collectFirst(Interpreter *interp, Object *value, void *context) {
+    FirstContext *first = context;
+    arrayPush(&interp->heap, first->array, ownValue(interp, value));
+    return --first->remaining > 0;
+}
+
+// Stops pulling values once it has n of them.
+static Object *enumeratorFirst(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    if (arguments[0]->type != NUMBER_OBJ || arguments[0]->as.number.value < 0) {
+        runtimeError(interp, exp->line, "first needs a number that isn't negative");
+    }
+
+    Enumerator scratch;
+    FirstContext first = {newArray(&interp->heap, NUMBER_ARRAY, 0), (int)arguments[0]->as.number.value};
+    if (first.remaining > 0) {
+        runEnumerator(interp, enumeratorOf(self, &scratch), collectFirst, &first);
+    }
+    return first.array;
+}
+
+static bool yieldValue(Interpreter *interp, Object *value, void *context) {
+    callBlock(interp, context, &value, 1);
+    return true;
+}
+
+static Object *enumeratorEach(Interpreter *interp, Expr *exp, Object *self, Object **arguments, Closure *block) {
+    Enumerator scratch;
+    runEnumerator(interp, enumeratorOf(self, &scratch), yieldValue, block);
+    return self;
+}
+
+static Object *enumeratorMap(Interpreter *interp, Expr *exp, Object *self, Object **arguments, Closure *block) {
+    Enumerator scratch;
+    return addStage(interp, enumeratorOf(self, &scratch), STAGE_MAP, block);
+}
+
+static Object *enumeratorSelect(Interpreter *interp, Expr *exp, Object *self, Object **arguments, Closure *block) {
+    Enumerator scratch;
+    return addStage(interp, enumeratorOf(self, &scratch), STAGE_SELECT, block);
+}
+
+typedef struct ReduceContext {
+    Closure *block;
+    Object *accumulator;
+} ReduceContext;
+
+static bool accumulate(Interpreter *interp, Object *value, void *context) {
+    ReduceContext *reduce = context;
+    Object *arguments[2] = {reduce->accumulator, value};
+    reduce->accumulator = callBlock(interp, reduce->block, arguments, 2);
+    return true;
+}
+
+// reduce(initial) { |accumulator, value| ... }
+static Object *enumeratorReduce(Interpreter *interp, Expr *exp, Object *self, Object **arguments, Closure *block) {
+    Enumerator scratch;
+    ReduceContext reduce = {block, arguments[0]};
+    runEnumerator(interp, enumeratorOf(self, &scratch), accumulate, &reduce);
+    return reduce.accumulator;
+}
+
+static Builtin rangeMethods[] = {
+    {"step", 1, rangeStep},
+    {"to_a", 0, enumeratorToArray},
+    {"first", 1, enumeratorFirst},
+    {NULL, 0, NULL}
+};
+
+static Builtin enumeratorMethods[] = {
+    {"to_a", 0, enumeratorToArray},
+    {"first", 1, enumeratorFirst},
+    {NULL, 0, NULL}
+};
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Channel and Isolate
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static Object *channelSendMethod(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    channelSend(interp, exp, self->as.channel.channel, arguments[0]);
+    return self;
+}
+
+static Object *channelReceiveMethod(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    return channelReceive(interp, self->as.channel.channel);
+}
+
+static Object *channelCloseMethod(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    channelClose(self->as.channel.channel);
+    return initObject(&interp->heap, NIL_OBJECT);
+}
+
+static Builtin channelMethods[] = {
+    {"send", 1, channelSendMethod},
+    {"receive", 0, channelReceiveMethod},
+    {"close", 0, channelCloseMethod},
+    {NULL, 0, NULL}
+};
+
+static Object *isolateValueMethod(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    return isolateValue(interp, exp, self->as.isolate.isolate);
+}
+
+static Builtin isolateMethods[] = {
+    {"value", 0, isolateValueMethod},
+    {NULL, 0, NULL}
+};
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Kernel
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static Object *kernelChannel(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    return newChannel(interp, exp);
+}
+
+static Object *kernelSpawn(Interpreter *interp, Expr *exp, Object *self, Object **arguments) {
+    return spawnIsolate(interp, exp, arguments, exp->as.methodCall.arguments->size);
+}
+
+// Called without a receiver when no def has the name. An arity of -1
+// takes any number of arguments.
+static Builtin kernelFunctions[] = {
+    {"channel", 0, kernelChannel},
+    {"spawn", -1, kernelSpawn},
+    {NULL, 0, NULL}
+};
+
+Builtin *findKernelFunction(char *name, int length) {
+    for (Builtin *function = kernelFunctions; function->name != NULL; function++) {
+        if ((int)strlen(function->name) == length && memcmp(function->name, name, length) == 0) {
+            return function;
+        }
+    }
+    return NULL;
+}
+
+// Ranges and enumerators share these, map and select on a range are lazy.
+static BlockBuiltin enumeratorBlockMethods[] = {
+    {"each", 0, enumeratorEach},
+    {"map", 0, enumeratorMap},
+    {"select", 0, enumeratorSelect},
+    {"reduce", 1, enumeratorReduce},
+    {NULL, 0, NULL}
+};
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Dispatch
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static BlockBuiltin *blockMethodsFor(ObjectType type) {
+    switch (type) {
+        case NUMBER_OBJ:
+            return numberBlockMethods;
+        case RANGE_OBJ:
+        case ENUMERATOR_OBJ:
+            return enumeratorBlockMethods;
+        case ARRAY_OBJ:
+            return arrayBlockMethods;
+        default:
+            return NULL;
+    }
+}
+
+static BlockBuiltin *findBlockMethod(ObjectType type, char *name, int length) {
+    for (BlockBuiltin *method = blockMethodsFor(type); method != NULL && method->name != NULL; method++) {
+        if ((int)strlen(method->name) == length && memcmp(method->name, name, length) == 0) {
+            return method;
+        }
+    }
+    return NULL;
+}
+
+static Builtin *methodsFor(ObjectType type) {
+    switch (type) {
+        case ARRAY_OBJ:
+            return arrayMethods;
+        case HASH_OBJ:
+            return hashMethods;
+        case STRING_OBJ:
+            return stringMethods;
+        case RANGE_OBJ:
+            return rangeMethods;
+        case ENUMERATOR_OBJ:
+            return enumeratorMethods;
+        case CHANNEL_OBJ:
+            return channelMethods;
+        case ISOLATE_OBJ:
+            return isolateMethods;
+        default:
+            return NULL;
+    }
+}
+
+// `block` is NULL when the call has none.
+Object *invokeBuiltin(Interpreter *interp, Expr *exp, Object *receiver, Object **arguments, int count, Closure *block) {
+    char *name = exp->as.invoke.name;
+    int length = exp->as.invoke.length;
+
+    BlockBuiltin *blockMethod = findBlockMethod(receiver->type, name, length);
+    if (blockMethod != NULL) {
+        if (block == NULL) {
+            runtimeError(interp, exp->line, "no block given to '%.*s'", length, name);
+        }
+        if (blockMethod->arity != count) {
+            runtimeError(interp, exp->line, "wrong number of arguments for '%.*s' (given %d, expected %d)",
+                length, name, count, blockMethod->arity);
+        }
+        return blockMethod->function(interp, exp, receiver, arguments, block);
+    }
+
+    Builtin *method = methodsFor(receiver->type);
+    for (; method != NULL && method->name != NULL; method++) {
+        if ((int)strlen(method->name) == length && memcmp(method->name, name, length) == 0) {
+            break;
+        }
+    }
+
+    if (method == NULL || method->name == NULL) {
+        runtimeError(interp, exp->line, "undefined method '%.*s' for %s",
+            length, name, objectTypeName(receiver->type));
+    }
+    if (block != NULL) {
+        runtimeError(interp, exp->line, "'%.*s' for %s doesn't take a block",
+            length, name, objectTypeName(receiver->type));
+    }
+    if (method->arity != count) {
+        runtimeError(interp, exp->line, "wrong number of arguments for '%.*s' (given %d, expected %d)",
+            length, name, count, method->arity);
+    }
+
+    return method->function(interp, exp, receiver, arguments);
+}
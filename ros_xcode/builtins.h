@@ -0,0 +1,48 @@
+//
+//  builtins.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-13.
+//
+
+#ifndef builtins_h
+#define builtins_h
+
+#include <stdio.h>
+#include "interpreter.h"
+
+struct Closure;
+
+/*
+  Methods that values respond to, receiver.name(arguments). Each type has
+  a table of them, looked up by name on every call.
+*/
+typedef Object *(*BuiltinFunction)(Interpreter *interp, Expr *exp, Object *self, Object **arguments);
+
+typedef struct Builtin {
+    const char *name;
+    int arity;
+    BuiltinFunction function;
+} Builtin;
+
+// Methods that need a block, kept in tables of their own.
+typedef Object *(*BlockBuiltinFunction)(Interpreter *interp, Expr *exp, Object *self, Object **arguments, struct Closure *block);
+
+typedef struct BlockBuiltin {
+    const char *name;
+    int arity;
+    BlockBuiltinFunction function;
+} BlockBuiltin;
+
+Builtin *findKernelFunction(char *name, int length);
+Object *invokeBuiltin(Interpreter *interp, Expr *exp, Object *receiver, Object **arguments, int count, struct Closure *block);
+Object *arrayArithmetic(Interpreter *interp, Expr *exp, Object *left, Object *right);
+Object *appendOperation(Interpreter *interp, Expr *exp, Object *left, Object *right);
+Object *stringOperation(Interpreter *interp, Expr *exp, Object *left, Object *right);
+Object *hashLookup(Interpreter *interp, Expr *exp, Object *hash, Object *key);
+void hashStore(Interpreter *interp, Expr *exp, Object *hash, Object *key, Object *value);
+// Raises a runtime error when a parallel for worker is about to change an
+// array, hash or string the loop's interpreter owns.
+void checkModifiable(Interpreter *interp, Expr *exp, Object *object);
+
+#endif /* builtins_h */
@@ -0,0 +1,77 @@
+//
+//  enumerator.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-21.
+//
+
+#include <string.h>
+#include "enumerator.h"
+#include "block.h"
+
+// An enumerator over a range with no stages yet.
+void rangeEnumerator(Enumerator *enumerator, Object *range, double step) {
+    enumerator->start = range->as.range.start;
+    enumerator->end = range->as.range.end;
+    enumerator->step = step;
+    enumerator->inclusive = strcmp(range->as.range.type, "inclusive") == 0;
+    enumerator->last = NULL;
+    enumerator->stageCount = 0;
+}
+
+Object *newEnumerator(Interpreter *interp, Enumerator *source) {
+    Object *object = initObject(&interp->heap, ENUMERATOR_OBJ);
+    object->as.enumerator.enumerator = heapAllocate(&interp->heap, sizeof(Enumerator), HEAP_ENUMERATOR);
+    *object->as.enumerator.enumerator = *source;
+    return object;
+}
+
+// The block is kept, so it is retained first.
+Object *addStage(Interpreter *interp, Enumerator *source, StageKind kind, Closure *block) {
+    Stage *stage = heapAllocate(&interp->heap, sizeof(Stage), HEAP_ENUMERATOR);
+    stage->kind = kind;
+    stage->block = retainClosure(interp, block);
+    stage->previous = source->last;
+
+    Object *object = newEnumerator(interp, source);
+    object->as.enumerator.enumerator->last = stage;
+    object->as.enumerator.enumerator->stageCount++;
+    return object;
+}
+
+/*
+  The values are worked out as start + i * step rather than by adding the
+  step up so fractional steps don't drift.
+*/
+void runEnumerator(Interpreter *interp, Enumerator *enumerator, EnumeratorSink sink, void *context) {
+    int count = enumerator->stageCount;
+    Stage *stages[count > 0 ? count : 1];
+    int position = count;
+    for(Stage *stage = enumerator->last; stage != NULL; stage = stage->previous) {
+        stages[--position] = stage;
+    }
+
+    for(long i = 0; ; i++) {
+        double number = enumerator->start + i * enumerator->step;
+        if (enumerator->inclusive ? number > enumerator->end : number >= enumerator->end) {
+            break;
+        }
+
+        Object *value = initObject(&interp->heap, NUMBER_OBJ);
+        value->as.number.value = number;
+
+        bool keep = true;
+        for(int j = 0; j < count && keep; j++) {
+            Object *result = callBlock(interp, stages[j]->block, &value, 1);
+            if (stages[j]->kind == STAGE_MAP) {
+                value = result;
+            } else {
+                keep = isTruthy(result);
+            }
+        }
+
+        if (keep && !sink(interp, value, context)) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,54 @@
+//
+//  enumerator.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-21.
+//
+
+#ifndef enumerator_h
+#define enumerator_h
+
+#include <stdio.h>
+#include "interpreter.h"
+
+struct Closure;
+
+/*
+  (1..n).step(3).select { ... }.map { ... } builds a lazy enumerator: the
+  range it walks and the list of blocks to push every value through.
+  Nothing runs until a method like reduce, each or to_a pulls the values,
+  one at a time through all the stages, so no collection is built between
+  them however large the range is.
+
+  Stages are shared, adding one makes a new enumerator pointing at the
+  previous last stage and leaves the receiver as it was.
+*/
+typedef enum StageKind {
+    STAGE_MAP,
+    STAGE_SELECT
+} StageKind;
+
+typedef struct Stage {
+    StageKind kind;
+    struct Closure *block;
+    struct Stage *previous;
+} Stage;
+
+typedef struct Enumerator {
+    double start;
+    double end;
+    double step;
+    bool inclusive;
+    Stage *last;
+    int stageCount;
+} Enumerator;
+
+// Gets every value that makes it through the stages, returns false to stop.
+typedef bool (*EnumeratorSink)(Interpreter *interp, Object *value, void *context);
+
+void rangeEnumerator(Enumerator *enumerator, Object *range, double step);
+Object *newEnumerator(Interpreter *interp, Enumerator *source);
+Object *addStage(Interpreter *interp, Enumerator *source, StageKind kind, struct Closure *block);
+void runEnumerator(Interpreter *interp, Enumerator *enumerator, EnumeratorSink sink, void *context);
+
+#endif /* enumerator_h */
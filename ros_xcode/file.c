@@ -11,6 +11,9 @@
 
 char* readFile(const char* path) {
   FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
 
   fseek(file, 0L, SEEK_END);
   size_t fileSize = ftell(file);
@@ -9,6 +9,7 @@
 #define file_h
 
 #include <stdio.h>
+// Returns NULL when the file can't be opened.
 char* readFile(const char* path);
 
 #endif /* file_h */
@@ -0,0 +1,469 @@
+//
+//  gc.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-29.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+#include <limits.h>
+#include <float.h>
+#include "gc.h"
+#include "interpreter.h"
+#include "segmented_stack.h"
+#include "stats.h"
+
+const long pauseBuckets[GC_PAUSE_BUCKETS] = {50, 100, 250, 500, 1000, 2500, 5000, LONG_MAX};
+
+// How many ranges are scanned between looks at the clock, and the most
+// bytes a range has so that none takes long.
+#define GC_CLOCK_INTERVAL 8
+#define GC_RANGE_SIZE 4096
+
+void enableCollector(Interpreter *interp, long pauseBudget) {
+    Collector *gc = malloc(sizeof(Collector));
+    gc->interp = interp;
+    gc->phase = GC_IDLE;
+    gc->pauseBudget = pauseBudget > 0 ? pauseBudget : GC_DEFAULT_PAUSE;
+    gc->threshold = GC_MIN_THRESHOLD;
+    gc->allocated = 0;
+    gc->markedAllocated = 0;
+    gc->sliceAllocated = 0;
+    gc->sliceBytes = GC_SLICE_BYTES;
+    gc->gray = NULL;
+    gc->graySize = 0;
+    gc->grayCapacity = 0;
+    gc->blocks = NULL;
+    gc->blockCount = 0;
+    gc->sweepClass = 0;
+    interp->heap.collector = gc;
+}
+
+void freeCollector(Heap *heap) {
+    Collector *gc = heap->collector;
+    if (gc == NULL) {
+        return;
+    }
+
+    free(gc->gray);
+    free(gc->blocks);
+    free(gc);
+    heap->collector = NULL;
+}
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+}
+
+static void recordPause(double micros) {
+    int bucket = 0;
+    while (micros > pauseBuckets[bucket]) {
+        bucket++;
+    }
+    stats.gcPauses[bucket]++;
+    if (micros > stats.gcMaxPause) {
+        stats.gcMaxPause = micros;
+    }
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Marking
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static void pushGray(Collector *gc, char *start, size_t size) {
+    for(size_t offset = 0; offset < size; offset += GC_RANGE_SIZE) {
+        if (gc->graySize == gc->grayCapacity) {
+            gc->grayCapacity = gc->grayCapacity < 256 ? 256 : 2 * gc->grayCapacity;
+            gc->gray = realloc(gc->gray, gc->grayCapacity * sizeof(GrayRange));
+        }
+        gc->gray[gc->graySize].start = start + offset;
+        gc->gray[gc->graySize].size = size - offset < GC_RANGE_SIZE ? size - offset : GC_RANGE_SIZE;
+        gc->graySize++;
+    }
+}
+
+// The block `pointer` points into, among the ones there were when marking
+// started. Later ones are never swept by this collection.
+static HeapBlock *findBlock(Collector *gc, uintptr_t pointer) {
+    long low = 0;
+    long high = gc->blockCount - 1;
+    while (low <= high) {
+        long middle = (low + high) / 2;
+        HeapBlock *block = gc->blocks[middle];
+        uintptr_t start = (uintptr_t)(block + 1);
+
+        if (pointer < start) {
+            high = middle - 1;
+        } else if (pointer >= start + block->size) {
+            low = middle + 1;
+        } else {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+static void shade(Heap *heap, uintptr_t word) {
+    Collector *gc = heap->collector;
+
+    Slab *slab = findSlab(heap, (void *)word);
+    if (slab != NULL) {
+        int index = slotIndex(slab, (void *)word);
+        if (index < 0 || !testBit(slab->allocated, index) || testBit(slab->marked, index)) {
+            return;
+        }
+        setBit(slab->marked, index);
+        int size = sizeClasses[slab->sizeClass];
+        pushGray(gc, slab->slots + (long)index * size, size);
+        return;
+    }
+
+    HeapBlock *block = findBlock(gc, word);
+    if (block != NULL && !block->marked) {
+        block->marked = true;
+        pushGray(gc, (char *)(block + 1), block->size);
+    }
+}
+
+void shadeValue(Heap *heap, const void *value) {
+    shade(heap, (uintptr_t)value);
+}
+
+// Stacks have redzones under the address sanitizer, they are read anyway.
+__attribute__((no_sanitize_address))
+static void scanRange(Heap *heap, char *low, char *high) {
+    uintptr_t *word = (uintptr_t *)(((uintptr_t)low + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1));
+    for(; (char *)(word + 1) <= high; word++) {
+        shade(heap, *word);
+    }
+}
+
+/*
+  The running stack from here up, and the part of every stack the
+  evaluation left for a new segment that was in use when it did. Callee
+  saved registers are spilled into this frame first so values only held
+  in them are seen too.
+*/
+__attribute__((noinline))
+static void scanRoots(Heap *heap) {
+    Interpreter *interp = heap->collector->interp;
+    jmp_buf registers;
+    __builtin_unwind_init();
+    setjmp(registers);
+
+    char *low = (char *)&registers;
+    if ((char *)&interp < low) {
+        low = (char *)&interp;
+    }
+
+    SegmentStack *segments = interp->segments;
+    int depth = segments != NULL ? segments->depth : 0;
+    for(int i = depth; i >= 0; i--) {
+        char *top = i == 0 ? interp->stackTop : segments->list[i - 1] + STACK_SEGMENT_SIZE;
+        scanRange(heap, i == depth ? low : segments->resume[i], top);
+    }
+
+    scanRange(heap, (char *)interp, (char *)(interp + 1));
+}
+
+static int compareBlocks(const void *a, const void *b) {
+    uintptr_t left = (uintptr_t)*(HeapBlock **)a;
+    uintptr_t right = (uintptr_t)*(HeapBlock **)b;
+    return (left > right) - (left < right);
+}
+
+static void startMarking(Heap *heap) {
+    Collector *gc = heap->collector;
+
+    gc->blockCount = 0;
+    for(HeapBlock *block = heap->blocks; block != NULL; block = block->next) {
+        gc->blockCount++;
+    }
+    gc->blocks = malloc((gc->blockCount > 0 ? gc->blockCount : 1) * sizeof(HeapBlock *));
+    long i = 0;
+    for(HeapBlock *block = heap->blocks; block != NULL; block = block->next) {
+        gc->blocks[i++] = block;
+    }
+    qsort(gc->blocks, gc->blockCount, sizeof(HeapBlock *), compareBlocks);
+
+    gc->phase = GC_MARKING;
+    gc->sliceAllocated = 0;
+    stats.gcCycles++;
+    scanRoots(heap);
+}
+
+// Scans gray ranges until there are none or, with a deadline, time is up.
+// Adds the bytes it scanned to `bytes`.
+static bool drainGray(Heap *heap, double deadline, size_t *bytes) {
+    Collector *gc = heap->collector;
+    int scanned = 0;
+
+    while (gc->graySize > 0) {
+        GrayRange range = gc->gray[--gc->graySize];
+        scanRange(heap, range.start, range.start + range.size);
+        *bytes += range.size;
+
+        if (deadline > 0 && ++scanned % GC_CLOCK_INTERVAL == 0 && now() > deadline) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void sweepBlocks(Heap *heap) {
+    HeapBlock *previous = NULL;
+    HeapBlock *block = heap->blocks;
+
+    while (block != NULL) {
+        HeapBlock *next = block->next;
+        if (block->marked) {
+            block->marked = false;
+            previous = block;
+        } else {
+            if (previous == NULL) {
+                heap->blocks = next;
+            } else {
+                previous->next = next;
+            }
+            if (heap->last == block) {
+                heap->last = previous;
+            }
+            heap->live -= block->size;
+            heap->kindBytes[block->kind] -= block->size;
+            stats.gcFreedBytes += block->size;
+            stats.largeBlocks--;
+            stats.largeBytes -= block->size;
+            free(block);
+        }
+        block = next;
+    }
+}
+
+static void endMarking(Heap *heap) {
+    Collector *gc = heap->collector;
+
+    scanRoots(heap);
+    size_t scanned = 0;
+    drainGray(heap, 0, &scanned);
+    sweepBlocks(heap);
+    gc->markedAllocated = gc->allocated;
+
+    free(gc->blocks);
+    gc->blocks = NULL;
+    gc->blockCount = 0;
+
+    for(int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        for(Slab *slab = heap->classes[i].slabs; slab != NULL; slab = slab->next) {
+            slab->swept = false;
+        }
+        heap->classes[i].sweep = heap->classes[i].slabs;
+    }
+    gc->phase = GC_SWEEPING;
+}
+
+// Parallel loops share the heap's values with other threads, which can't
+// shade them, so marking is done before one starts.
+void finishMarking(Heap *heap) {
+    if (heap->collector == NULL || heap->collector->phase != GC_MARKING) {
+        return;
+    }
+
+    double start = now();
+    endMarking(heap);
+    recordPause(now() - start);
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Sweeping
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static void sweepSlab(Heap *heap, Slab *slab) {
+    int size = sizeClasses[slab->sizeClass];
+
+    for(int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+        uint64_t garbage = slab->allocated[word] & ~slab->marked[word];
+        while (garbage != 0) {
+            int index = word * 64 + __builtin_ctzll(garbage);
+            garbage &= garbage - 1;
+            freeSlot(heap, slab, index);
+            stats.gcFreedSlots++;
+            stats.gcFreedBytes += size;
+        }
+        slab->marked[word] = 0;
+    }
+    slab->swept = true;
+}
+
+// Slabs merged or created since marking ended are at the front of the
+// lists, before where sweeping started.
+static bool sweepNext(Heap *heap, int sizeClass) {
+    SizeClass *class = &heap->classes[sizeClass];
+    while (class->sweep != NULL && class->sweep->swept) {
+        class->sweep = class->sweep->next;
+    }
+    if (class->sweep == NULL) {
+        return false;
+    }
+
+    sweepSlab(heap, class->sweep);
+    class->sweep = class->sweep->next;
+    return true;
+}
+
+static void endSweeping(Heap *heap) {
+    Collector *gc = heap->collector;
+    size_t live = 0;
+    for(int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        for(Slab *slab = heap->classes[i].slabs; slab != NULL; slab = slab->next) {
+            for(int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+                live += __builtin_popcountll(slab->allocated[word]) * sizeClasses[i];
+            }
+        }
+    }
+    for(HeapBlock *block = heap->blocks; block != NULL; block = block->next) {
+        live += block->size;
+    }
+
+    // What was allocated while sweeping didn't survive anything yet, it
+    // counts towards the next collection instead.
+    size_t sweepAllocated = gc->allocated - gc->markedAllocated;
+    live = live > sweepAllocated ? live - sweepAllocated : 0;
+
+    gc->phase = GC_IDLE;
+    gc->allocated = sweepAllocated;
+    gc->threshold = live > GC_MIN_THRESHOLD ? live : GC_MIN_THRESHOLD;
+}
+
+void sweepForSlots(Heap *heap, int sizeClass) {
+    if (heap->collector->phase != GC_SWEEPING) {
+        return;
+    }
+    while (heap->classes[sizeClass].free == NULL && sweepNext(heap, sizeClass));
+}
+
+static void sweepSlice(Heap *heap, double deadline) {
+    Collector *gc = heap->collector;
+
+    while (gc->sweepClass < SIZE_CLASS_COUNT) {
+        if (!sweepNext(heap, gc->sweepClass)) {
+            gc->sweepClass++;
+        } else if (now() > deadline) {
+            return;
+        }
+    }
+    gc->sweepClass = 0;
+    endSweeping(heap);
+}
+
+// A whole collection in one pause, for a heap that is about to go over
+// its quota. One already running is finished first, since what it marked
+// may have died since.
+void collectGarbage(Heap *heap) {
+    Collector *gc = heap->collector;
+    if (gc->interp->stackTop == NULL) {
+        return;
+    }
+
+    double start = now();
+    stats.gcSlices++;
+    if (gc->phase == GC_MARKING) {
+        endMarking(heap);
+    }
+    if (gc->phase == GC_SWEEPING) {
+        sweepSlice(heap, DBL_MAX);
+    }
+    startMarking(heap);
+    endMarking(heap);
+    sweepSlice(heap, DBL_MAX);
+    recordPause(now() - start);
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Heap hooks
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+void collectorStep(Heap *heap, size_t size) {
+    Collector *gc = heap->collector;
+    // Before the first program runs the stacks aren't known.
+    if (gc->interp->stackTop == NULL) {
+        return;
+    }
+
+    gc->allocated += size;
+    gc->sliceAllocated += size;
+    if (gc->phase == GC_IDLE ? gc->allocated < gc->threshold : gc->sliceAllocated < gc->sliceBytes) {
+        return;
+    }
+
+    double start = now();
+    double deadline = start + gc->pauseBudget;
+    gc->sliceAllocated = 0;
+    stats.gcSlices++;
+
+    switch (gc->phase) {
+        case GC_IDLE:
+            startMarking(heap);
+            break;
+        case GC_MARKING: {
+            size_t scanned = 0;
+            if (drainGray(heap, deadline, &scanned)) {
+                endMarking(heap);
+                gc->sliceBytes = GC_SLICE_BYTES;
+            } else {
+                // What gets allocated until the next slice is gray too, so
+                // it has to be less than a slice scans or marking falls
+                // behind and never ends.
+                gc->sliceBytes = scanned / 2 > 0 ? scanned / 2 : 1;
+            }
+            break;
+        }
+        case GC_SWEEPING:
+            sweepSlice(heap, deadline);
+            break;
+    }
+    recordPause(now() - start);
+}
+
+/*
+  New memory is marked while marking, and scanned by a later slice once
+  it is filled in. It also survives a sweep that hasn't reached its slab.
+*/
+void slotAllocated(Heap *heap, Slab *slab, int index) {
+    Collector *gc = heap->collector;
+    GcPhase phase = gc->phase;
+    if (phase == GC_MARKING) {
+        int size = sizeClasses[slab->sizeClass];
+        setBit(slab->marked, index);
+        pushGray(gc, slab->slots + (long)index * size, size);
+    } else if (phase == GC_SWEEPING && !slab->swept) {
+        setBit(slab->marked, index);
+    }
+}
+
+void blockAllocated(Heap *heap, HeapBlock *block) {
+    if (heap->collector->phase == GC_MARKING) {
+        block->marked = true;
+        pushGray(heap->collector, (char *)(block + 1), block->size);
+    }
+}
+
+// A parallel worker's memory joins the heap as if it was just allocated.
+void slabMerged(Heap *heap, Slab *slab) {
+    slab->swept = true;
+    if (heap->collector->phase != GC_MARKING) {
+        return;
+    }
+
+    int size = sizeClasses[slab->sizeClass];
+    for(int index = 0; index < slab->slotCount; index++) {
+        if (testBit(slab->allocated, index)) {
+            setBit(slab->marked, index);
+            pushGray(heap->collector, slab->slots + (long)index * size, size);
+        }
+    }
+}
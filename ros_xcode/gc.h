@@ -0,0 +1,101 @@
+//
+//  gc.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-29.
+//
+
+#ifndef gc_h
+#define gc_h
+
+#include <stdio.h>
+#include "heap.h"
+
+/*
+  Incremental mark and sweep for the heap of an interpreter run with --gc.
+  Without it nothing is freed until the interpreter goes away.
+
+  Once GC_MIN_THRESHOLD bytes (or as many as survived the last collection)
+  have been allocated, a collection starts by marking what the stacks and
+  the interpreter point to. Then every GC_SLICE_BYTES of allocation does
+  a slice of marking, stopping once the pause budget is used up. A slice
+  that runs out of time brings the next one closer, to half of what it
+  scanned, since what gets allocated meanwhile has to be scanned too.
+  Marking is conservative, any word that points into a slot or block keeps it and
+  everything it points to, so runtime code needs no changes to keep its
+  values alive.
+
+  Stores into memory that already existed go through writeBarrier(), so
+  what they store gets marked too. Memory allocated while marking is
+  marked right away and scanned by a later slice, once it is filled in.
+  Marking ends with one more look at the stacks, which have no barrier,
+  so deep recursion makes that last pause longer.
+  Sweeping is lazy: a size class that runs out of slots sweeps its next
+  slab, and slices sweep the rest within their budget.
+*/
+#define GC_MIN_THRESHOLD (4 * 1024 * 1024)
+#define GC_SLICE_BYTES (256 * 1024)
+#define GC_DEFAULT_PAUSE 1000
+#define GC_PAUSE_BUCKETS 8
+
+typedef enum {
+    GC_IDLE,
+    GC_MARKING,
+    GC_SWEEPING,
+} GcPhase;
+
+typedef struct GrayRange {
+    char *start;
+    size_t size;
+} GrayRange;
+
+typedef struct Collector {
+    struct Interpreter *interp;
+    GcPhase phase;
+    // Longest a slice runs, in microseconds.
+    long pauseBudget;
+    size_t threshold;
+    size_t allocated;
+    // `allocated` when marking ended.
+    size_t markedAllocated;
+    size_t sliceAllocated;
+    // Allocation between two slices.
+    size_t sliceBytes;
+
+    // Marked but not scanned yet.
+    GrayRange *gray;
+    long graySize;
+    long grayCapacity;
+
+    // Big blocks when marking started, by address.
+    HeapBlock **blocks;
+    long blockCount;
+
+    // Size class the next sweeping slice starts with.
+    int sweepClass;
+} Collector;
+
+// Upper bounds of the pause histogram, in microseconds.
+extern const long pauseBuckets[GC_PAUSE_BUCKETS];
+
+void enableCollector(struct Interpreter *interp, long pauseBudget);
+void freeCollector(Heap *heap);
+void finishMarking(Heap *heap);
+void collectGarbage(Heap *heap);
+
+// Called by the heap.
+void collectorStep(Heap *heap, size_t size);
+void slotAllocated(Heap *heap, Slab *slab, int index);
+void blockAllocated(Heap *heap, HeapBlock *block);
+void slabMerged(Heap *heap, Slab *slab);
+void sweepForSlots(Heap *heap, int sizeClass);
+
+void shadeValue(Heap *heap, const void *value);
+
+static inline void writeBarrier(Heap *heap, const void *value) {
+    if (heap->collector != NULL && heap->collector->phase == GC_MARKING) {
+        shadeValue(heap, value);
+    }
+}
+
+#endif /* gc_h */
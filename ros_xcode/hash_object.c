@@ -0,0 +1,321 @@
+//
+//  hash_object.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-15.
+//
+
+#include <string.h>
+#include "hash_object.h"
+#include "string_object.h"
+#include "gc.h"
+
+#define CONTROL_EMPTY ((int8_t)-128)
+#define CONTROL_DELETED ((int8_t)-2)
+#define MIN_CAPACITY 16
+
+/*
+  Group matching returns a bit mask with one bit, or byte, per matching
+  slot. SSE2 looks at 16 control bytes at once, elsewhere 8 bytes are
+  matched inside a 64 bit integer.
+*/
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+#define GROUP_WIDTH 16
+#define MASK_SHIFT 0
+typedef uint32_t GroupMask;
+
+static inline GroupMask matchByte(const int8_t *group, int8_t value) {
+    __m128i control = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(value)));
+}
+
+static inline GroupMask matchEmpty(const int8_t *group) {
+    return matchByte(group, CONTROL_EMPTY);
+}
+
+// Empty and deleted are the only negative values below -1.
+static inline GroupMask matchFree(const int8_t *group) {
+    __m128i control = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), control));
+}
+#else
+#define GROUP_WIDTH 8
+#define MASK_SHIFT 3
+typedef uint64_t GroupMask;
+
+#define LOW_BITS 0x0101010101010101ULL
+#define HIGH_BITS 0x8080808080808080ULL
+
+static inline uint64_t loadGroup(const int8_t *group) {
+    uint64_t control;
+    memcpy(&control, group, sizeof(control));
+    return control;
+}
+
+// Can report a slot that doesn't match, which only costs a key compare.
+static inline GroupMask matchByte(const int8_t *group, int8_t value) {
+    uint64_t x = loadGroup(group) ^ (LOW_BITS * (uint8_t)value);
+    return (x - LOW_BITS) & ~x & HIGH_BITS;
+}
+
+static inline GroupMask matchEmpty(const int8_t *group) {
+    uint64_t control = loadGroup(group);
+    return control & (~control << 6) & HIGH_BITS;
+}
+
+static inline GroupMask matchFree(const int8_t *group) {
+    uint64_t control = loadGroup(group);
+    return control & ~(control << 7) & HIGH_BITS;
+}
+#endif
+
+static inline int firstSlot(GroupMask mask) {
+    return __builtin_ctzll(mask) >> MASK_SHIFT;
+}
+
+static inline GroupMask nextMatch(GroupMask mask) {
+    return mask & (mask - 1);
+}
+
+static inline int8_t h2(uint64_t hash) {
+    return hash & 0x7f;
+}
+
+static inline long h1(uint64_t hash) {
+    return (long)(hash >> 7);
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Keys
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+// Spreads every input bit over the whole word (murmur3 finalizer).
+static inline uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool isHashableKey(Object *key) {
+    switch (key->type) {
+        case NUMBER_OBJ:
+        case STRING_OBJ:
+        case BOOLEAN_OBJ:
+        case NIL_OBJECT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint64_t hashKey(Object *key) {
+    switch (key->type) {
+        case NUMBER_OBJ: {
+            // 0.0 and -0.0 are the same key.
+            double value = key->as.number.value == 0 ? 0 : key->as.number.value;
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            return mix(bits);
+        }
+        case STRING_OBJ:
+            return stringHash(key);
+        case BOOLEAN_OBJ:
+            return mix(key->as.boolean.value ? 2 : 1);
+        default:
+            return mix(0);
+    }
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Table
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+// Allocates first, a quota error leaves the map as it was.
+static void allocateSlots(HashMap *map, long capacity) {
+    int8_t *control = heapAllocate(map->heap, capacity, HEAP_HASH);
+    int32_t *slots = heapAllocate(map->heap, capacity * sizeof(int32_t), HEAP_HASH);
+    map->capacity = capacity;
+    map->used = 0;
+    map->control = control;
+    map->slots = slots;
+    memset(map->control, CONTROL_EMPTY, capacity);
+}
+
+HashMap *newHashMap(Heap *heap) {
+    HashMap *map = heapAllocate(heap, sizeof(HashMap), HEAP_HASH);
+    map->heap = heap;
+    map->entries = NULL;
+    map->entryCount = 0;
+    map->entryCapacity = 0;
+    map->size = 0;
+    allocateSlots(map, MIN_CAPACITY);
+    return map;
+}
+
+/*
+  Groups are visited in triangular order: 1, 2, 3... groups past the first
+  one. With a power of two number of groups that reaches all of them.
+*/
+typedef struct Probe {
+    long group;
+    long mask;
+    long step;
+} Probe;
+
+static inline Probe startProbe(HashMap *map, uint64_t hash) {
+    long groups = map->capacity / GROUP_WIDTH;
+    Probe probe = {h1(hash) & (groups - 1), groups - 1, 0};
+    return probe;
+}
+
+static inline void nextGroup(Probe *probe) {
+    probe->step++;
+    probe->group = (probe->group + probe->step) & probe->mask;
+}
+
+// Slot holding the key, or -1.
+static long findSlot(HashMap *map, Object *key, uint64_t hash) {
+    for (Probe probe = startProbe(map, hash); ; nextGroup(&probe)) {
+        long base = probe.group * GROUP_WIDTH;
+        const int8_t *group = map->control + base;
+
+        for (GroupMask mask = matchByte(group, h2(hash)); mask != 0; mask = nextMatch(mask)) {
+            long slot = base + firstSlot(mask);
+            HashMapEntry *entry = &map->entries[map->slots[slot]];
+            if (entry->hash == hash && objectsEqual(entry->key, key)) {
+                return slot;
+            }
+        }
+
+        // The key would have gone into this empty slot.
+        if (matchEmpty(group) != 0) {
+            return -1;
+        }
+    }
+}
+
+static long findFreeSlot(HashMap *map, uint64_t hash) {
+    for (Probe probe = startProbe(map, hash); ; nextGroup(&probe)) {
+        GroupMask mask = matchFree(map->control + probe.group * GROUP_WIDTH);
+        if (mask != 0) {
+            return probe.group * GROUP_WIDTH + firstSlot(mask);
+        }
+    }
+}
+
+static void placeEntry(HashMap *map, long index) {
+    uint64_t hash = map->entries[index].hash;
+    long slot = findFreeSlot(map, hash);
+    if (map->control[slot] == CONTROL_EMPTY) {
+        map->used++;
+    }
+    map->control[slot] = h2(hash);
+    map->slots[slot] = (int32_t)index;
+}
+
+// Drops deleted entries and rebuilds the slots with `capacity` of them.
+static void rehash(HashMap *map, long capacity) {
+    long live = 0;
+    for (long i = 0; i < map->entryCount; i++) {
+        if (map->entries[i].key != NULL) {
+            map->entries[live++] = map->entries[i];
+        }
+    }
+    map->entryCount = live;
+
+    allocateSlots(map, capacity);
+    for (long i = 0; i < live; i++) {
+        placeEntry(map, i);
+    }
+}
+
+// Keeps the table at most 7/8 full, counting deleted slots.
+static void reserveSlot(HashMap *map) {
+    if ((map->used + 1) * 8 <= map->capacity * 7) {
+        return;
+    }
+
+    long capacity = MIN_CAPACITY;
+    while ((map->size + 1) * 16 > capacity * 7) {
+        capacity *= 2;
+    }
+    rehash(map, capacity);
+}
+
+static void reserveEntry(HashMap *map) {
+    if (map->entryCount < map->entryCapacity) {
+        return;
+    }
+
+    // Mostly deleted entries, compacting is enough.
+    if (map->size * 2 < map->entryCount) {
+        rehash(map, map->capacity);
+        return;
+    }
+
+    long capacity = map->entryCapacity < 8 ? 8 : map->entryCapacity * 2;
+    HashMapEntry *entries = heapAllocate(map->heap, capacity * sizeof(HashMapEntry), HEAP_HASH);
+    if (map->entryCount > 0) {
+        memcpy(entries, map->entries, map->entryCount * sizeof(HashMapEntry));
+    }
+    map->entries = entries;
+    map->entryCapacity = capacity;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Operations
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+// NULL when the key is missing.
+Object *hashMapGet(HashMap *map, Object *key) {
+    long slot = findSlot(map, key, hashKey(key));
+    return slot < 0 ? NULL : map->entries[map->slots[slot]].value;
+}
+
+void hashMapSet(HashMap *map, Object *key, Object *value) {
+    writeBarrier(map->heap, value);
+    uint64_t hash = hashKey(key);
+    long slot = findSlot(map, key, hash);
+    if (slot >= 0) {
+        map->entries[map->slots[slot]].value = value;
+        return;
+    }
+
+    reserveEntry(map);
+    reserveSlot(map);
+
+    // Keys can't change under the table, like Ruby it keeps a frozen copy
+    // of a string that could.
+    if (key->type == STRING_OBJ) {
+        key = frozenString(map->heap, key);
+    }
+
+    writeBarrier(map->heap, key);
+    long index = map->entryCount++;
+    map->entries[index].key = key;
+    map->entries[index].value = value;
+    map->entries[index].hash = hash;
+    placeEntry(map, index);
+    map->size++;
+}
+
+// Returns the value the key had, NULL when it was missing.
+Object *hashMapDelete(HashMap *map, Object *key) {
+    long slot = findSlot(map, key, hashKey(key));
+    if (slot < 0) {
+        return NULL;
+    }
+
+    HashMapEntry *entry = &map->entries[map->slots[slot]];
+    Object *value = entry->value;
+    entry->key = NULL;
+    entry->value = NULL;
+    map->control[slot] = CONTROL_DELETED;
+    map->size--;
+    return value;
+}
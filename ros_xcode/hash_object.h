@@ -0,0 +1,62 @@
+//
+//  hash_object.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-15.
+//
+
+#ifndef hash_object_h
+#define hash_object_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include "object.h"
+#include "heap.h"
+
+/*
+  Backing store of Hash objects, an open addressing table in the style of
+  Swiss tables.
+
+  Entries live in a dense array in insertion order, which is also the order
+  they are iterated in. The table itself is an array of slots holding the
+  index of an entry, plus one control byte per slot: empty, deleted, or the
+  low 7 bits of the hash of the entry in it. Lookups compare a whole group
+  of control bytes against those 7 bits at once, so only slots that are very
+  likely to hold the key are looked at.
+
+  Every entry keeps the hash of its key, growing the table never hashes a
+  key again.
+*/
+typedef struct HashMapEntry {
+    // NULL once the entry has been deleted.
+    Object *key;
+    Object *value;
+    uint64_t hash;
+} HashMapEntry;
+
+typedef struct HashMap {
+    int8_t *control;
+    int32_t *slots;
+    // Number of slots, a power of two and a multiple of the group width.
+    long capacity;
+    // Slots that are not empty, deleted ones included.
+    long used;
+
+    HashMapEntry *entries;
+    // Entries in use, deleted ones included.
+    long entryCount;
+    long entryCapacity;
+    // Live keys.
+    long size;
+
+    Heap *heap;
+} HashMap;
+
+HashMap *newHashMap(Heap *heap);
+bool isHashableKey(Object *key);
+uint64_t hashKey(Object *key);
+Object *hashMapGet(HashMap *map, Object *key);
+void hashMapSet(HashMap *map, Object *key, Object *value);
+Object *hashMapDelete(HashMap *map, Object *key);
+
+#endif /* hash_object_h */
@@ -7,62 +7,63 @@
 
 #include "hash_table.h"
 #include "object.h"
+#include "string_object.h"
+#include "heap.h"
+#include "gc.h"
+#include "stats.h"
 
-HashTable *initHashTable(void) {
-    HashTable *table = malloc(sizeof(HashTable));
+HashTable *initHashTable(Heap *heap) {
+    HashTable *table = heapAllocate(heap, sizeof(HashTable), HEAP_TABLE);
     table->num_bins = INITIAL_BINS;
     table->num_entries = 0;
-    table->bins = calloc(table->num_bins, sizeof(HashTableEntry));
+    table->heap = heap;
+    table->parent = NULL;
+    table->bins = heapAllocate(heap, table->num_bins * sizeof(HashTableEntry*), HEAP_TABLE);
+    memset(table->bins, 0, table->num_bins * sizeof(HashTableEntry*));
     return table;
 }
 
-HashTableEntry *initEntry(char *key, int keyLength, Object *value) {
-    HashTableEntry *entry = malloc(sizeof(HashTableEntry));
+HashTableEntry *initEntry(Heap *heap, char *key, int keyLength, Object *value) {
+    HashTableEntry *entry = heapAllocate(heap, sizeof(HashTableEntry), HEAP_ENTRY);
     entry->key = key;
     entry->keyLength = keyLength;
     entry->value = value;
+    entry->next = NULL;
     
     return entry;
 }
 
-void insertEntry(HashTable *table, char *key, int keyLength, Object *value) {
-    HashTableEntry *newEntry = initEntry(key, keyLength, value);
+static bool sameKey(HashTableEntry *entry, char *key, int keyLength) {
+    return entry->keyLength == keyLength && memcmp(entry->key, key, keyLength) == 0;
+}
 
+void insertEntry(HashTable *table, char *key, int keyLength, Object *value) {
+    writeBarrier(table->heap, value);
     int bucketIndex = hashIndex(key, keyLength, table->num_bins);
-    HashTableEntry *currentEntry = table->bins[bucketIndex];
 
-    if (currentEntry == NULL) {
-        table->bins[bucketIndex] = newEntry;
-    } else {
-        resolveEntryCollision(currentEntry, newEntry);
+    for(HashTableEntry *current = table->bins[bucketIndex]; current != NULL; current = current->next) {
+        if (sameKey(current, key, keyLength)) {
+            current->value = value;
+            return;
+        }
     }
 
+    HashTableEntry *newEntry = initEntry(table->heap, key, keyLength, value);
+    newEntry->next = table->bins[bucketIndex];
+    table->bins[bucketIndex] = newEntry;
     table->num_entries++;
 }
 
 int hashIndex(char *key, int keyLength, int numBin) {
-    long hash = 0;
+    // Same polynomial as summing the powers, but wrapping instead of
+    // overflowing for names of 8 characters or more.
+    unsigned long hash = 0;
 
     for(int i = 0; i < keyLength; i++) {
-        hash += pow(HASH_PRIME, keyLength - (i+1)) * (int)key[i];
-    }
-
-    return hash % numBin;
-}
-
-void resolveEntryCollision(HashTableEntry *currentEntry, HashTableEntry *newEntry) {
-    HashTableEntry *current = currentEntry;
-    HashTableEntry *prev;
-    while(current != NULL) {
-        if(strncmp(current->key, newEntry->key, current->keyLength) == 0) {
-            current->value = newEntry->value;
-            return;
-        }
-        prev = current;
-        current = current->next;
+        hash = hash * HASH_PRIME + (unsigned char)key[i];
     }
 
-    prev->next = newEntry;
+    return (int)(hash % numBin);
 }
 
 void printTable(HashTable *table) {
@@ -85,7 +86,7 @@ void printObject(Object *object) {
             printf("  %*.*s\n",
                 (int)object->as.string.length,
                 (int)object->as.string.length,
-                object->as.string.value
+                stringChars(object)
             );
     }
 }
@@ -94,21 +95,30 @@ Object *getEntry(char *key, int keyLength, HashTable *table) {
     int bucketIndex = hashIndex(key, keyLength, table->num_bins);
     
     HashTableEntry *current = table->bins[bucketIndex];
+    stats.lookups++;
 
-    if (current == NULL) {
-        printf("Value not found in hash table\n");
-        exit(1);
+    while(current != NULL) {
+        stats.lookupProbes++;
+        if (sameKey(current, key, keyLength)) {
+            return current->value;
+        }
+        current = current->next;
     }
 
-    while(strncmp(key, current->key, keyLength) != 0) {
-        
-        current = current->next;
-        
-        if (current == NULL) {
-            printf("Value not found in hash table\n");
-            exit(1);
-        }
+    if (table->parent != NULL) {
+        return getEntry(key, keyLength, table->parent);
     }
 
-    return current->value;
+    return NULL;
+}
+
+struct Object **getEntrySlot(char *key, int keyLength, HashTable *table) {
+    int bucketIndex = hashIndex(key, keyLength, table->num_bins);
+
+    for(HashTableEntry *current = table->bins[bucketIndex]; current != NULL; current = current->next) {
+        if (sameKey(current, key, keyLength)) {
+            return &current->value;
+        }
+    }
+    return NULL;
 }
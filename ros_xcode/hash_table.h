@@ -14,6 +14,7 @@
 #include <string.h>
 
 struct Object;
+struct Heap;
 
 typedef struct HashTableEntry {
     int keyLength;
@@ -26,19 +27,25 @@ typedef struct HashTable {
     int num_bins;
     int num_entries;
     HashTableEntry **bins;
-    
+    // Entries are allocated from the heap the table was created with.
+    struct Heap *heap;
+    // Looked up when a key is missing here, never written through.
+    struct HashTable *parent;
 } HashTable;
 
 #define INITIAL_BINS 10
 #define HASH_PRIME 499
 
-HashTable *initHashTable(void);
-HashTableEntry *initEntry(char *key, int keyLength, struct Object *value);
+HashTable *initHashTable(struct Heap *heap);
+HashTableEntry *initEntry(struct Heap *heap, char *key, int keyLength, struct Object *value);
 void insertEntry(HashTable *table, char *key, int keyLength, struct Object *value);
 int hashIndex(char *key, int keyLength, int numBin);
-void resolveEntryCollision(HashTableEntry *firstEntry, HashTableEntry *newEntry);
 void printObject(struct Object *object);
 void printTable(HashTable *table);
+// Returns NULL when the key is neither in the table nor in its parents.
 struct Object *getEntry(char *key, int keyLength, HashTable *table);
+// Where the value of `key` is stored in this table, not its parents. Entries
+// never move so it stays valid for as long as the table does.
+struct Object **getEntrySlot(char *key, int keyLength, HashTable *table);
 
 #endif /* hash_table_h */
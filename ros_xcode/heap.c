@@ -0,0 +1,359 @@
+//
+//  heap.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-08.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "heap.h"
+#include "gc.h"
+#include "stats.h"
+#include "interpreter.h"
+
+// Multiples of the alignment, Object and HashTableEntry fit the small ones.
+const int sizeClasses[SIZE_CLASS_COUNT] = {16, 32, 48, 64, 96, 128, 192, 256};
+
+const char *heapKindNames[HEAP_KIND_COUNT] = {
+    "object",
+    "table",
+    "entry",
+    "string",
+    "array",
+    "hash",
+    "closure",
+    "enumerator",
+    "ast"
+};
+
+// Slots start after the slab's header, aligned like any allocation.
+#define SLAB_HEADER_SIZE ((sizeof(Slab) + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t))
+
+void initHeap(Heap *heap) {
+    heap->blocks = NULL;
+    heap->last = NULL;
+    heap->bytes = 0;
+    heap->count = 0;
+    for(int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        heap->classes[i].free = NULL;
+        heap->classes[i].next = NULL;
+        heap->classes[i].end = NULL;
+        heap->classes[i].slabs = NULL;
+        heap->classes[i].sweep = NULL;
+    }
+    heap->slabSet = NULL;
+    heap->slabSetCapacity = 0;
+    heap->slabCount = 0;
+    heap->collector = NULL;
+    heap->live = 0;
+    heap->peak = 0;
+    memset(heap->kindBytes, 0, sizeof(heap->kindBytes));
+    heap->quota = 0;
+    heap->owner = NULL;
+}
+
+static int sizeClass(size_t size) {
+    int i = 0;
+    while (sizeClasses[i] < size) {
+        i++;
+    }
+    return i;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Slabs
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static long slabHash(const void *slab, long capacity) {
+    return (long)(((uintptr_t)slab / SLAB_SIZE * 11400714819323198485u) >> 32) & (capacity - 1);
+}
+
+static void addToSet(Heap *heap, Slab *slab) {
+    if (2 * (heap->slabCount + 1) > heap->slabSetCapacity) {
+        Slab **old = heap->slabSet;
+        long oldCapacity = heap->slabSetCapacity;
+
+        heap->slabSetCapacity = oldCapacity < 16 ? 16 : 2 * oldCapacity;
+        heap->slabSet = calloc(heap->slabSetCapacity, sizeof(Slab *));
+        heap->slabCount = 0;
+        for(long i = 0; i < oldCapacity; i++) {
+            if (old[i] != NULL) {
+                addToSet(heap, old[i]);
+            }
+        }
+        free(old);
+    }
+
+    long i = slabHash(slab, heap->slabSetCapacity);
+    while (heap->slabSet[i] != NULL) {
+        i = (i + 1) & (heap->slabSetCapacity - 1);
+    }
+    heap->slabSet[i] = slab;
+    heap->slabCount++;
+}
+
+// The slab `pointer` points into, NULL when it isn't one of this heap's.
+Slab *findSlab(Heap *heap, const void *pointer) {
+    if (heap->slabCount == 0) {
+        return NULL;
+    }
+
+    Slab *slab = (Slab *)((uintptr_t)pointer & ~(uintptr_t)(SLAB_SIZE - 1));
+    long i = slabHash(slab, heap->slabSetCapacity);
+    while (heap->slabSet[i] != NULL) {
+        if (heap->slabSet[i] == slab) {
+            return slab;
+        }
+        i = (i + 1) & (heap->slabSetCapacity - 1);
+    }
+    return NULL;
+}
+
+// -1 when the pointer is into the header or past the last slot.
+int slotIndex(Slab *slab, const void *pointer) {
+    if ((char *)pointer < slab->slots) {
+        return -1;
+    }
+    long index = ((char *)pointer - slab->slots) / sizeClasses[slab->sizeClass];
+    return index < slab->slotCount ? (int)index : -1;
+}
+
+// Whatever is left of the previous slab of the class is dropped.
+static void newSlab(Heap *heap, SizeClass *class, int index) {
+    Slab *slab = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+    slab->sizeClass = index;
+    slab->slots = (char *)slab + SLAB_HEADER_SIZE;
+    slab->slotCount = (int)((SLAB_SIZE - SLAB_HEADER_SIZE) / sizeClasses[index]);
+    slab->swept = true;
+    slab->kinds = malloc(slab->slotCount);
+    memset(slab->allocated, 0, sizeof(slab->allocated));
+    memset(slab->marked, 0, sizeof(slab->marked));
+
+    slab->next = class->slabs;
+    class->slabs = slab;
+    addToSet(heap, slab);
+
+    class->next = slab->slots;
+    class->end = slab->slots + slab->slotCount * sizeClasses[index];
+    stats.slabs++;
+}
+
+void freeSlot(Heap *heap, Slab *slab, int index) {
+    int size = sizeClasses[slab->sizeClass];
+    FreeSlot *slot = (FreeSlot *)(slab->slots + (long)index * size);
+    clearBit(slab->allocated, index);
+    heap->live -= size;
+    heap->kindBytes[slab->kinds[index]] -= size;
+    clearBit(slab->marked, index);
+
+    slot->next = heap->classes[slab->sizeClass].free;
+    heap->classes[slab->sizeClass].free = slot;
+    stats.slotsLive[slab->sizeClass]--;
+    stats.slotsFree[slab->sizeClass]++;
+}
+
+static void *takeSlot(Heap *heap, int index) {
+    SizeClass *class = &heap->classes[index];
+
+    // A collected heap sweeps for free slots before it grows.
+    if (class->free == NULL && class->next + sizeClasses[index] > class->end && heap->collector != NULL) {
+        sweepForSlots(heap, index);
+    }
+
+    if (class->free != NULL) {
+        FreeSlot *slot = class->free;
+        class->free = slot->next;
+        stats.slotsFree[index]--;
+        stats.slotsReused++;
+        return slot;
+    }
+
+    if (class->next + sizeClasses[index] > class->end) {
+        newSlab(heap, class, index);
+    }
+    void *slot = class->next;
+    class->next += sizeClasses[index];
+    return slot;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Allocation
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static HeapBlock *newBlock(Heap *heap, size_t size, HeapKind kind) {
+    HeapBlock *block = malloc(sizeof(HeapBlock) + size);
+    block->size = size;
+    block->marked = false;
+    block->kind = kind;
+    block->next = heap->blocks;
+    heap->blocks = block;
+    if (heap->last == NULL) {
+        heap->last = block;
+    }
+    return block;
+}
+
+void heapAccount(Heap *heap, size_t bytes, HeapKind kind) {
+    heap->live += bytes;
+    heap->kindBytes[kind] += bytes;
+    if (heap->live > heap->peak) {
+        heap->peak = heap->live;
+    }
+}
+
+// Bytes accounted for that aren't held anymore.
+void heapRelease(Heap *heap, size_t bytes, HeapKind kind) {
+    heap->live -= bytes;
+    heap->kindBytes[kind] -= bytes;
+}
+
+// Raised before anything is allocated, so whatever was being built is
+// left as it was.
+static void quotaExceeded(Heap *heap, size_t granted) {
+    if (heap->collector != NULL) {
+        collectGarbage(heap);
+        if (heap->live + granted <= heap->quota) {
+            return;
+        }
+    }
+
+    Interpreter *interp = heap->owner;
+    runtimeError(interp, interp->line, "heap quota of %zu bytes exceeded, %zu bytes are live",
+                 heap->quota, heap->live);
+}
+
+void *heapAllocate(Heap *heap, size_t size, HeapKind kind) {
+    int index = size > SLAB_MAX_SIZE ? -1 : sizeClass(size);
+    size_t granted = index < 0 ? size : sizeClasses[index];
+    if (heap->quota > 0 && heap->live + granted > heap->quota) {
+        quotaExceeded(heap, granted);
+    }
+
+    heap->bytes += size;
+    heap->count++;
+    if (heap->collector != NULL) {
+        collectorStep(heap, size);
+    }
+    heapAccount(heap, granted, kind);
+
+    if (index < 0) {
+        HeapBlock *block = newBlock(heap, size, kind);
+        if (heap->collector != NULL) {
+            blockAllocated(heap, block);
+        }
+        stats.largeBlocks++;
+        stats.largeBytes += size;
+        return block + 1;
+    }
+
+    void *pointer = takeSlot(heap, index);
+    Slab *slab = (Slab *)((uintptr_t)pointer & ~(uintptr_t)(SLAB_SIZE - 1));
+    int slot = slotIndex(slab, pointer);
+    setBit(slab->allocated, slot);
+    slab->kinds[slot] = kind;
+    if (heap->collector != NULL) {
+        slotAllocated(heap, slab, slot);
+    }
+
+    stats.slotsLive[index]++;
+    stats.slotRequested += size;
+    stats.slotGranted += sizeClasses[index];
+    return pointer;
+}
+
+// `size` is the one the memory was allocated with. Big blocks stay where
+// they are until the whole heap goes.
+void heapFree(Heap *heap, void *pointer, size_t size) {
+    if (pointer == NULL || size > SLAB_MAX_SIZE) {
+        return;
+    }
+
+    Slab *slab = (Slab *)((uintptr_t)pointer & ~(uintptr_t)(SLAB_SIZE - 1));
+    freeSlot(heap, slab, slotIndex(slab, pointer));
+}
+
+// Moves every block of `from` into `heap`, leaving `from` empty. Its free
+// slots stay usable, the rest of its slabs is dropped.
+void mergeHeap(Heap *heap, Heap *from) {
+    for(int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        SizeClass *class = &from->classes[i];
+
+        if (class->free != NULL) {
+            FreeSlot *tail = class->free;
+            while (tail->next != NULL) {
+                tail = tail->next;
+            }
+            tail->next = heap->classes[i].free;
+            heap->classes[i].free = class->free;
+        }
+
+        if (class->slabs != NULL) {
+            Slab *tail = class->slabs;
+            while (true) {
+                addToSet(heap, tail);
+                if (heap->collector != NULL) {
+                    slabMerged(heap, tail);
+                }
+                if (tail->next == NULL) {
+                    break;
+                }
+                tail = tail->next;
+            }
+            tail->next = heap->classes[i].slabs;
+            heap->classes[i].slabs = class->slabs;
+        }
+    }
+
+    if (from->blocks != NULL) {
+        if (heap->collector != NULL) {
+            for(HeapBlock *block = from->blocks; block != NULL; block = block->next) {
+                blockAllocated(heap, block);
+            }
+        }
+        from->last->next = heap->blocks;
+        heap->blocks = from->blocks;
+        if (heap->last == NULL) {
+            heap->last = from->last;
+        }
+    }
+    heap->bytes += from->bytes;
+    heap->count += from->count;
+    for(int i = 0; i < HEAP_KIND_COUNT; i++) {
+        heapAccount(heap, from->kindBytes[i], i);
+    }
+    free(from->slabSet);
+    initHeap(from);
+}
+
+// Takes back what the heap added to the stats, an isolate's heap is freed
+// by the thread its stats were handed over to.
+void freeHeap(Heap *heap) {
+    HeapBlock *block = heap->blocks;
+    while(block != NULL) {
+        HeapBlock *next = block->next;
+        stats.largeBlocks--;
+        stats.largeBytes -= block->size;
+        free(block);
+        block = next;
+    }
+
+    for(int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        for(FreeSlot *slot = heap->classes[i].free; slot != NULL; slot = slot->next) {
+            stats.slotsFree[i]--;
+        }
+        Slab *slab = heap->classes[i].slabs;
+        while (slab != NULL) {
+            Slab *next = slab->next;
+            for(int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+                stats.slotsLive[i] -= __builtin_popcountll(slab->allocated[word]);
+            }
+            stats.slabs--;
+            free(slab->kinds);
+            free(slab);
+            slab = next;
+        }
+    }
+    free(heap->slabSet);
+    initHeap(heap);
+}
@@ -0,0 +1,147 @@
+//
+//  heap.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-08.
+//
+
+#ifndef heap_h
+#define heap_h
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+  Every runtime allocation (objects, environments and their entries) is
+  made through the heap of the interpreter that owns it so that all of it
+  can be released at once when the interpreter goes away.
+
+  Allocations up to SLAB_MAX_SIZE are rounded up to one of the size
+  classes and carved out of SLAB_SIZE blocks, so objects, table entries
+  and small array and string buffers don't pay for a malloc each. Bigger
+  ones get a block of their own. Slots given back with heapFree() go on
+  the free list of their class and are handed out again first. A heap is
+  only used by one thread at a time, so none of this is locked.
+
+  Slabs are aligned to their size and keep a bit per slot, which lets the
+  collector (gc.h) tell whether any word points into the heap.
+
+  Every allocation says what it is for, and the heap keeps the bytes live
+  in total and by kind, counting what was handed out rather than asked
+  for. Parsed programs are counted in as HEAP_AST. With a quota set, an
+  allocation that would take the live bytes past it first runs a full
+  collection if the heap has a collector, then raises a runtime error in
+  the interpreter that owns the heap.
+*/
+#define SLAB_SIZE (64 * 1024)
+#define SLAB_MAX_SIZE 256
+#define SIZE_CLASS_COUNT 8
+#define SLAB_BITMAP_WORDS (SLAB_SIZE / 16 / 64)
+
+typedef enum {
+    HEAP_OBJECT,
+    HEAP_TABLE,
+    HEAP_ENTRY,
+    HEAP_STRING,
+    HEAP_ARRAY,
+    HEAP_HASH,
+    HEAP_CLOSURE,
+    HEAP_ENUMERATOR,
+    HEAP_AST,
+    HEAP_KIND_COUNT
+} HeapKind;
+
+typedef struct Slab {
+    struct Slab *next;
+    int sizeClass;
+    int slotCount;
+    char *slots;
+    // Swept since the collector last finished marking.
+    bool swept;
+    // HeapKind of every slot.
+    uint8_t *kinds;
+    uint64_t allocated[SLAB_BITMAP_WORDS];
+    uint64_t marked[SLAB_BITMAP_WORDS];
+} Slab;
+
+// Header of an allocation too big for the slabs.
+typedef union HeapBlock {
+    struct {
+        union HeapBlock *next;
+        size_t size;
+        bool marked;
+        uint8_t kind;
+    };
+    // Keeps the memory handed out after the header aligned for anything.
+    max_align_t align;
+} HeapBlock;
+
+typedef struct FreeSlot {
+    struct FreeSlot *next;
+} FreeSlot;
+
+typedef struct SizeClass {
+    FreeSlot *free;
+    // Unused part of the newest slab of the class.
+    char *next;
+    char *end;
+    Slab *slabs;
+    // Next slab the collector sweeps.
+    Slab *sweep;
+} SizeClass;
+
+typedef struct Heap {
+    HeapBlock *blocks;
+    // Oldest block, lets another heap be appended in constant time.
+    HeapBlock *last;
+    size_t bytes;
+    long count;
+    SizeClass classes[SIZE_CLASS_COUNT];
+
+    // Every slab by address, open addressing.
+    Slab **slabSet;
+    long slabSetCapacity;
+    long slabCount;
+
+    // NULL unless the heap is garbage collected.
+    struct Collector *collector;
+
+    size_t live;
+    size_t peak;
+    size_t kindBytes[HEAP_KIND_COUNT];
+    // Most live bytes allowed, 0 for no limit. Going over it is an error
+    // of `owner`.
+    size_t quota;
+    struct Interpreter *owner;
+} Heap;
+
+extern const int sizeClasses[SIZE_CLASS_COUNT];
+extern const char *heapKindNames[HEAP_KIND_COUNT];
+
+void initHeap(Heap *heap);
+void *heapAllocate(Heap *heap, size_t size, HeapKind kind);
+void heapAccount(Heap *heap, size_t bytes, HeapKind kind);
+void heapRelease(Heap *heap, size_t bytes, HeapKind kind);
+void heapFree(Heap *heap, void *pointer, size_t size);
+void mergeHeap(Heap *heap, Heap *from);
+void freeHeap(Heap *heap);
+
+Slab *findSlab(Heap *heap, const void *pointer);
+int slotIndex(Slab *slab, const void *pointer);
+void freeSlot(Heap *heap, Slab *slab, int index);
+
+static inline bool testBit(const uint64_t *bits, int index) {
+    return (bits[index / 64] >> (index % 64)) & 1;
+}
+
+static inline void setBit(uint64_t *bits, int index) {
+    bits[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+static inline void clearBit(uint64_t *bits, int index) {
+    bits[index / 64] &= ~((uint64_t)1 << (index % 64));
+}
+
+#endif /* heap_h */
@@ -0,0 +1,423 @@
+//
+//  inliner.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-25.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "inliner.h"
+#include "walk_stack.h"
+
+typedef enum InlinerPass {
+    COLLECT_PASS,
+    INLINE_PASS,
+    REPORT_PASS
+} InlinerPass;
+
+typedef struct DefArray {
+    Stmt **list;
+    int size;
+    int capacity;
+} DefArray;
+
+typedef struct Inliner {
+    InlinerPass pass;
+    DefArray defs;
+    // The defs walked past so far in the second pass.
+    DefArray seen;
+    // Every name something is assigned to, methods sharing one are left alone.
+    char **names;
+    int *lengths;
+    int nameCount;
+    int nameCapacity;
+    FILE *out;
+    WalkStack stack;
+} Inliner;
+
+static bool sameName(char *a, int aLength, char *b, int bLength) {
+    return aLength == bLength && memcmp(a, b, aLength) == 0;
+}
+
+static void addName(Inliner *inliner, char *name, int length) {
+    if (inliner->nameCount == inliner->nameCapacity) {
+        inliner->nameCapacity = inliner->nameCapacity < 8 ? 8 : inliner->nameCapacity * 2;
+        inliner->names = realloc(inliner->names, inliner->nameCapacity * sizeof(char *));
+        inliner->lengths = realloc(inliner->lengths, inliner->nameCapacity * sizeof(int));
+    }
+    inliner->names[inliner->nameCount] = name;
+    inliner->lengths[inliner->nameCount] = length;
+    inliner->nameCount++;
+}
+
+static bool isAssigned(Inliner *inliner, char *name, int length) {
+    for(int i = 0; i < inliner->nameCount; i++) {
+        if (sameName(inliner->names[i], inliner->lengths[i], name, length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Deciding
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static int parameterIndex(Stmt *def, Expr *identifier) {
+    ExprArray *arguments = def->as.defStmt.arguments;
+    for(int i = 0; i < arguments->size; i++) {
+        Expr *argument = arguments->list[i];
+        if (argument->type == IDENTIFIER_EXP &&
+            sameName(argument->as.identifierExp.string, argument->as.identifierExp.length,
+                     identifier->as.identifierExp.string, identifier->as.identifierExp.length)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+  Nodes in the body, or -1 when it has anything but numbers, booleans,
+  operators and the arguments. << is left out since it changes its left
+  side.
+*/
+static int bodySize(Expr *exp, Stmt *def) {
+    int left, right;
+
+    switch (exp->type) {
+        case NUMBER_LITERAL:
+        case BOOLEAN:
+            return 1;
+        case IDENTIFIER_EXP:
+            return parameterIndex(def, exp) >= 0 ? 1 : -1;
+        case BINARY:
+            if (exp->as.binary.op == LESS_LESS) {
+                return -1;
+            }
+            left = bodySize(exp->as.binary.left, def);
+            right = bodySize(exp->as.binary.right, def);
+            return left < 0 || right < 0 ? -1 : left + right + 1;
+        case LOGICAL:
+            left = bodySize(exp->as.logical.left, def);
+            right = bodySize(exp->as.logical.right, def);
+            return left < 0 || right < 0 ? -1 : left + right + 1;
+        case UNARY:
+            left = bodySize(exp->as.unary.operand, def);
+            return left < 0 ? -1 : left + 1;
+        default:
+            return -1;
+    }
+}
+
+static bool sameDefName(Stmt *def, Expr *call) {
+    return sameName(def->as.defStmt.name, def->as.defStmt.nameLength,
+                    call->as.methodCall.name, call->as.methodCall.length);
+}
+
+// The last def of the name walked past, or the first one in the program.
+static Stmt *defFor(Inliner *inliner, Expr *call) {
+    for(int i = inliner->seen.size - 1; i >= 0; i--) {
+        if (sameDefName(inliner->seen.list[i], call)) {
+            return inliner->seen.list[i];
+        }
+    }
+    for(int i = 0; i < inliner->defs.size; i++) {
+        if (sameDefName(inliner->defs.list[i], call)) {
+            return inliner->defs.list[i];
+        }
+    }
+    return NULL;
+}
+
+// Why `call` can't be inlined, NULL when it can. `found` is set to the
+// def it would come from, if there is one.
+static const char *inlineBlocker(Inliner *inliner, Expr *call, Stmt **found) {
+    Stmt *def = defFor(inliner, call);
+
+    *found = def;
+    if (def == NULL) {
+        return "the method isn't defined in this program";
+    }
+    if (isAssigned(inliner, call->as.methodCall.name, call->as.methodCall.length)) {
+        return "a variable has the same name";
+    }
+
+    if (def->as.defStmt.body != NULL) {
+        return "the body isn't parsed until the method is first called";
+    }
+
+    StmtArray *statements = def->as.defStmt.statements;
+    if (statements->size != 1 || statements->list[0]->type != EXPR_STMT) {
+        return "the body isn't a single expression";
+    }
+
+    int size = bodySize(statements->list[0]->exprStmt, def);
+    if (size < 0) {
+        return "the body has more than numbers, booleans, arguments and operators";
+    }
+    if (size > INLINE_MAX_NODES) {
+        return "the body is too big";
+    }
+    if (call->as.methodCall.arguments->size != def->as.defStmt.arguments->size) {
+        return "wrong number of arguments";
+    }
+
+    return NULL;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Rewriting
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+// Every call site gets its own copy, so its operators specialize on
+// what that site passes.
+static Expr *copyBody(Expr *exp, Stmt *def) {
+    Expr *copy;
+
+    switch (exp->type) {
+        case BINARY:
+            return newBinary(copyBody(exp->as.binary.left, def), copyBody(exp->as.binary.right, def),
+                             exp->as.binary.op, exp->line);
+        case LOGICAL:
+            return newLogical(copyBody(exp->as.logical.left, def), copyBody(exp->as.logical.right, def),
+                              exp->as.logical.op, exp->line);
+        case UNARY:
+            return newUnary(copyBody(exp->as.unary.operand, def), exp->as.unary.op, exp->line);
+        case IDENTIFIER_EXP:
+            copy = newExpr(exp->line, INLINED_ARGUMENT);
+            copy->as.inlinedArgument.index = parameterIndex(def, exp);
+            return copy;
+        default:
+            copy = newExpr(exp->line, exp->type);
+            copy->as = exp->as;
+            return copy;
+    }
+}
+
+// The call node becomes the INLINED_CALL so nothing pointing at it has
+// to change.
+static void inlineCall(Expr *call, Stmt *def) {
+    Expr *original = newExpr(call->line, METHOD_CALL_EXP);
+    original->as = call->as;
+
+    call->type = INLINED_CALL;
+    call->as.inlined.call = original;
+    call->as.inlined.body = copyBody(def->as.defStmt.statements->list[0]->exprStmt, def);
+    call->as.inlined.def = def;
+    call->as.inlined.epoch = 0;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Walking
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static void walkStatements(Inliner *inliner, StmtArray *statements);
+
+static void walkExpressions(Inliner *inliner, ExprArray *exprs);
+static void walkExpression(Inliner *inliner, Expr *exp);
+static void walkStatement(Inliner *inliner, Stmt *stmt);
+
+// A statement or an expression nested too deep for the stack.
+typedef struct DeepWalk {
+    Inliner *inliner;
+    Stmt *stmt;
+    Expr *exp;
+} DeepWalk;
+
+static void walkSegment(void *context) {
+    DeepWalk *walk = context;
+    if (walk->stmt != NULL) {
+        walkStatement(walk->inliner, walk->stmt);
+    } else {
+        walkExpression(walk->inliner, walk->exp);
+    }
+}
+
+static void walkDeep(Inliner *inliner, Stmt *stmt, Expr *exp) {
+    DeepWalk walk = {inliner, stmt, exp};
+    walkOnNewSegment(&inliner->stack, walkSegment, &walk);
+}
+
+// Children first, so arguments are inlined before the call they are in.
+static void walkExpression(Inliner *inliner, Expr *exp) {
+    Stmt *def;
+    const char *blocker;
+
+    if (walkStackLow(&inliner->stack)) {
+        walkDeep(inliner, NULL, exp);
+        return;
+    }
+
+    switch (exp->type) {
+        case BINARY:
+            walkExpression(inliner, exp->as.binary.left);
+            walkExpression(inliner, exp->as.binary.right);
+            break;
+        case LOGICAL:
+            walkExpression(inliner, exp->as.logical.left);
+            walkExpression(inliner, exp->as.logical.right);
+            break;
+        case UNARY:
+            walkExpression(inliner, exp->as.unary.operand);
+            break;
+        case RANGE:
+            walkExpression(inliner, exp->as.range.start);
+            walkExpression(inliner, exp->as.range.end);
+            break;
+        case VAR_ASSIGNMENT:
+            walkExpression(inliner, exp->as.varAssignment.value);
+            if (inliner->pass == COLLECT_PASS) {
+                addName(inliner, exp->as.varAssignment.name, exp->as.varAssignment.length);
+            }
+            break;
+        case ARRAY_LITERAL:
+            walkExpressions(inliner, exp->as.arrayLiteral.elements);
+            break;
+        case HASH_LITERAL:
+            walkExpressions(inliner, exp->as.hashLiteral.keys);
+            walkExpressions(inliner, exp->as.hashLiteral.values);
+            break;
+        case INTERPOLATION:
+            walkExpressions(inliner, exp->as.interpolation.parts);
+            break;
+        case INDEX_EXP:
+        case INDEX_ASSIGNMENT:
+            walkExpression(inliner, exp->as.index.object);
+            walkExpression(inliner, exp->as.index.index);
+            if (exp->as.index.value != NULL) {
+                walkExpression(inliner, exp->as.index.value);
+            }
+            break;
+        case INVOKE_EXP:
+            walkExpression(inliner, exp->as.invoke.receiver);
+            walkExpressions(inliner, exp->as.invoke.arguments);
+            if (exp->as.invoke.block != NULL) {
+                walkStatements(inliner, exp->as.invoke.block->statements);
+            }
+            break;
+        case METHOD_CALL_EXP:
+            walkExpressions(inliner, exp->as.methodCall.arguments);
+            if (inliner->pass == COLLECT_PASS) {
+                break;
+            }
+
+            blocker = inlineBlocker(inliner, exp, &def);
+            if (inliner->pass == INLINE_PASS && blocker == NULL) {
+                inlineCall(exp, def);
+            } else if (inliner->pass == REPORT_PASS && def != NULL) {
+                fprintf(inliner->out, "line %d: '%.*s' not inlined, %s\n",
+                    exp->line, exp->as.methodCall.length, exp->as.methodCall.name, blocker);
+            }
+            break;
+        case INLINED_CALL:
+            walkExpressions(inliner, exp->as.inlined.call->as.methodCall.arguments);
+            if (inliner->pass == REPORT_PASS) {
+                def = exp->as.inlined.def;
+                fprintf(inliner->out, "line %d: '%.*s' inlined from the def on line %d\n",
+                    exp->line, def->as.defStmt.nameLength, def->as.defStmt.name, def->line);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void walkExpressions(Inliner *inliner, ExprArray *exprs) {
+    for(int i = 0; i < exprs->size; i++) {
+        walkExpression(inliner, exprs->list[i]);
+    }
+}
+
+static void walkStatement(Inliner *inliner, Stmt *stmt) {
+    bool collecting = inliner->pass == COLLECT_PASS;
+
+    if (walkStackLow(&inliner->stack)) {
+        walkDeep(inliner, stmt, NULL);
+        return;
+    }
+
+    switch (stmt->type) {
+        case PUTS_STMT:
+            walkExpression(inliner, stmt->as.puts.exp);
+            break;
+        case EXPR_STMT:
+            walkExpression(inliner, stmt->exprStmt);
+            break;
+        case IF_STMT:
+            for(int i = 0; i < stmt->as.ifStmt.conditionals->size; i++) {
+                Conditional *conditional = stmt->as.ifStmt.conditionals->list[i];
+                walkExpression(inliner, conditional->condition);
+                walkStatements(inliner, conditional->statements);
+            }
+            break;
+        case WHILE_STMT:
+            walkExpression(inliner, stmt->as.whileStmt.condition);
+            walkStatements(inliner, stmt->as.whileStmt.statements);
+            break;
+        case FOR_STMT:
+        case PARALLEL_FOR_STMT:
+            if (collecting) {
+                Expr *identifier = stmt->as.forStmt.identifier;
+                addName(inliner, identifier->as.identifierExp.string, identifier->as.identifierExp.length);
+                if (stmt->as.forStmt.reduceOp != REDUCE_NONE) {
+                    addName(inliner, stmt->as.forStmt.reduceName, stmt->as.forStmt.reduceLength);
+                }
+            }
+            walkExpression(inliner, stmt->as.forStmt.range);
+            walkStatements(inliner, stmt->as.forStmt.statements);
+            break;
+        case DEF_STMT:
+            if (collecting) {
+                ADD_ARRAY_ELEMENT((&inliner->defs), stmt, Stmt);
+                ExprArray *arguments = stmt->as.defStmt.arguments;
+                for(int i = 0; i < arguments->size; i++) {
+                    if (arguments->list[i]->type == IDENTIFIER_EXP) {
+                        addName(inliner, arguments->list[i]->as.identifierExp.string,
+                            arguments->list[i]->as.identifierExp.length);
+                    }
+                }
+            } else {
+                ADD_ARRAY_ELEMENT((&inliner->seen), stmt, Stmt);
+            }
+            walkStatements(inliner, stmt->as.defStmt.statements);
+            break;
+    }
+}
+
+static void walkStatements(Inliner *inliner, StmtArray *statements) {
+    for(int i = 0; i < statements->size; i++) {
+        walkStatement(inliner, statements->list[i]);
+    }
+}
+
+static void runPasses(StmtArray *program, InlinerPass last, FILE *out) {
+    Inliner inliner;
+    INIT_ARRAY((&inliner.defs), DefArray);
+    INIT_ARRAY((&inliner.seen), DefArray);
+    inliner.names = NULL;
+    inliner.lengths = NULL;
+    inliner.nameCount = 0;
+    inliner.nameCapacity = 0;
+    inliner.out = out;
+    initWalkStack(&inliner.stack);
+
+    inliner.pass = COLLECT_PASS;
+    walkStatements(&inliner, program);
+    inliner.pass = last;
+    walkStatements(&inliner, program);
+
+    free(inliner.defs.list);
+    free(inliner.seen.list);
+    free(inliner.names);
+    free(inliner.lengths);
+}
+
+void inlineCalls(StmtArray *program) {
+    runPasses(program, INLINE_PASS, NULL);
+}
+
+// Every call to a method defined in the program, inlined or why not.
+void reportInlining(FILE *out, StmtArray *program) {
+    runPasses(program, REPORT_PASS, out);
+}
@@ -0,0 +1,35 @@
+//
+//  inliner.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-25.
+//
+
+#ifndef inliner_h
+#define inliner_h
+
+#include <stdio.h>
+#include "parser.h"
+
+/*
+  Replaces calls to tiny methods with a copy of their body once the
+  program is parsed, so `def square(x) x * x end` makes square(n) evaluate
+  n * n right where it is, without the lookup, the arity check, the
+  environment and the statement loop of a call.
+
+  A method is inlined when its body is one expression of at most
+  INLINE_MAX_NODES numbers, booleans, arguments and operators, so it calls
+  nothing and can't recurse, and no variable anywhere shares its name.
+  The arguments are still evaluated first and in order, the copy reads
+  them by position (INLINED_ARGUMENT).
+
+  The body comes from the last def of the name before the call, or the
+  first one when the call comes first. Whether that def is the one in
+  effect is only known when the call is evaluated, see inlinedCallValid().
+*/
+#define INLINE_MAX_NODES 12
+
+void inlineCalls(StmtArray *program);
+void reportInlining(FILE *out, StmtArray *program);
+
+#endif /* inliner_h */
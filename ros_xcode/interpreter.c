@@ -8,280 +8,1114 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
 #include "interpreter.h"
 #include "token.h"
 #include "parser.h"
+#include "stats.h"
+#include "parallel.h"
+#include "thread_pool.h"
+#include "array_object.h"
+#include "builtins.h"
+#include "hash_object.h"
+#include "string_object.h"
+#include "block.h"
+#include "type_inference.h"
+#include "inliner.h"
+#include "unboxed.h"
+#include "segmented_stack.h"
+#include "gc.h"
+#include "scheduler.h"
+#include "isolate.h"
 
-void interpret(StmtArray *array, HashTable *env) {
+// Epochs are unique across interpreters since they share parsed programs.
+static long lastEpoch = 0;
+
+static long nextEpoch(void) {
+    return __atomic_add_fetch(&lastEpoch, 1, __ATOMIC_RELAXED);
+}
+
+Interpreter *newInterpreter(void) {
+    Interpreter *interp = malloc(sizeof(Interpreter));
+    initHeap(&interp->heap);
+    interp->heap.owner = interp;
+    interp->globals = initHashTable(&interp->heap);
+    interp->programs = malloc(sizeof(ProgramArray));
+    INIT_ARRAY(interp->programs, ProgramArray);
+    interp->out = stdout;
+    interp->errorJump = NULL;
+    interp->error[0] = '\0';
+    interp->line = 0;
+    interp->pool = NULL;
+    interp->threads = 0;
+    interp->parallelWorker = false;
+    interp->frame = NULL;
+    interp->frameCount = 0;
+    interp->epoch = nextEpoch();
+    interp->inlinedArguments = NULL;
+    interp->stackLimit = NULL;
+    interp->stackTop = NULL;
+    interp->stackBudget = DEFAULT_STACK_BUDGET;
+    interp->segments = NULL;
+    interp->fiber = NULL;
+    interp->budget = 0;
+    interp->isolates = NULL;
+    interp->ownsIsolates = false;
+    interp->lazyDefs = false;
+
+    return interp;
+}
+
+void freeInterpreter(Interpreter *interp) {
+    freeIsolateGroup(interp);
+    for(int i = 0; i < interp->programs->size; i++) {
+        Program *program = interp->programs->list[i];
+        freeStatements(program->statements);
+        free(program->statements->list);
+        free(program->statements);
+        free(program->source);
+        free(program);
+    }
+    free(interp->programs->list);
+    free(interp->programs);
+    if (interp->pool != NULL) {
+        freeThreadPool(interp->pool);
+    }
+    freeSegmentStack(interp);
+    freeCollector(&interp->heap);
+    freeHeap(&interp->heap);
+    free(interp);
+}
+
+void runtimeError(Interpreter *interp, int line, const char *format, ...) {
+    int length = snprintf(interp->error, ERROR_MESSAGE_SIZE, "line %d: ", line);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(interp->error + length, ERROR_MESSAGE_SIZE - length, format, args);
+    va_end(args);
+
+    raiseError(interp);
+}
+
+// Unwinds to the innermost error handler with whatever is in interp->error.
+void raiseError(Interpreter *interp) {
+    if (interp->errorJump != NULL) {
+        longjmp(*interp->errorJump, 1);
+    }
+
+    fprintf(stderr, "%s\n", interp->error);
+    exit(1);
+}
+
+// Everything that keeps a value (variables, arguments, arrays, hashes) goes
+// through here so string literals are never appended to in place.
+Object *ownValue(Interpreter *interp, Object *value) {
+    return value->type == STRING_OBJ ? ownString(&interp->heap, value) : value;
+}
+
+// Parses `source` and keeps it alive for as long as the interpreter.
+// On a syntax error returns NULL with the message in interp->error.
+StmtArray *parseProgram(Interpreter *interp, char *source) {
+    jmp_buf errorJump;
+    Scanner scanner;
+
+    if (setjmp(errorJump) != 0) {
+        memcpy(interp->error, scanner.error, ERROR_MESSAGE_SIZE);
+        return NULL;
+    }
+
+    long astBytes = stats.astBytes;
+    initScannerWithErrors(&scanner, source, &errorJump);
+    scanner.lazyDefs = interp->lazyDefs;
+    StmtArray *statements = parse(&scanner);
+    adoptProgram(interp, source, statements, stats.astBytes - astBytes);
+
+    return statements;
+}
+
+// `astBytes` are the bytes of nodes the program took, counted against the
+// heap's quota from then on.
+void adoptProgram(Interpreter *interp, char *source, StmtArray *statements, long astBytes) {
+    Program *program = malloc(sizeof(Program));
+    heapAccount(&interp->heap, astBytes, HEAP_AST);
+    program->source = source;
+    program->statements = statements;
+    ADD_ARRAY_ELEMENT(interp->programs, program, Program);
+}
+
+/*
+  Lazy defs are shared by every interpreter that runs their program, and
+  by the threads of parallel loops and isolates, so their bodies are
+  parsed under this lock, by whichever call comes first. Each method
+  object takes it once, to pick up the body and whether it is numeric.
+  The body goes through type inference and inlining on its own, so only
+  the method itself counts as defined in its program.
+*/
+static pthread_mutex_t lazyLock = PTHREAD_MUTEX_INITIALIZER;
+
+void parseLazyMethod(Interpreter *interp, Object *method) {
+    pthread_mutex_lock(&lazyLock);
+    Stmt *def = method->as.method.lazy;
+    if (def == NULL) {
+        pthread_mutex_unlock(&lazyLock);
+        return;
+    }
+
+    if (def->as.defStmt.body != NULL) {
+        long astBytes = stats.astBytes;
+        if (!parseMethodBody(def, interp->error)) {
+            pthread_mutex_unlock(&lazyLock);
+            raiseError(interp);
+        }
+        def->as.defStmt.body = NULL;
+        stats.lazyBodies++;
+
+        NumericMethod *skimmed = def->as.defStmt.numeric;
+        if (skimmed != NULL) {
+            free(skimmed->names);
+            free(skimmed->lengths);
+            free(skimmed);
+        }
+        Stmt *list[1] = {def};
+        StmtArray program = {list, 1, 1};
+        inferTypes(&program);
+        inlineCalls(&program);
+        heapAccount(&interp->heap, stats.astBytes - astBytes, HEAP_AST);
+    }
+
+    NumericMethod *numeric = def->as.defStmt.numeric;
+    method->as.method.numeric = numeric != NULL && numeric->numeric ? numeric : NULL;
+    __atomic_store_n(&method->as.method.lazy, NULL, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&lazyLock);
+}
+
+// Runs a parsed program against the interpreter's globals. Returns false
+// on a runtime error with the message in interp->error.
+bool runProgram(Interpreter *interp, StmtArray *statements) {
+    jmp_buf errorJump;
+    jmp_buf *enclosing = interp->errorJump;
+    Frame *frame = interp->frame;
+    Object **inlinedArguments = interp->inlinedArguments;
+
+    if (interp->stackLimit == NULL) {
+        initStackLimit(interp);
+    }
+    interp->errorJump = &errorJump;
+    if (setjmp(errorJump) != 0) {
+        interp->errorJump = enclosing;
+        interp->frame = frame;
+        interp->inlinedArguments = inlinedArguments;
+        fflush(interp->out);
+        return false;
+    }
+
+    interpret(interp, statements, interp->globals);
+    interp->errorJump = enclosing;
+    fflush(interp->out);
+
+    return true;
+}
+
+void interpret(Interpreter *interp, StmtArray *array, HashTable *env) {
     for(int i = 0; i < array->size; i++) {
-        execute(array->list[i], env);
+        execute(interp, array->list[i], env);
     }
 }
 
-Object *execute(Stmt *stmt, HashTable *env) {
-    Object *object = initObject(NIL_OBJECT);
+Object *execute(Interpreter *interp, Stmt *stmt, HashTable *env) {
+    if (stackLow(interp)) {
+        return executeOnNewSegment(interp, stmt, env);
+    }
+    interp->line = stmt->line;
+    Object *object = initObject(&interp->heap, NIL_OBJECT);
 
     switch (stmt->type) {
         case PUTS_STMT:
-            object = visitPuts(stmt, env);
+            object = visitPuts(interp, stmt, env);
             break;
         case IF_STMT:
-            object =visitIf(stmt, env);
+            object =visitIf(interp, stmt, env);
             break;
         case WHILE_STMT:
-            object =visitWhile(stmt, env);
+            object =visitWhile(interp, stmt, env);
             break;
         case FOR_STMT:
-            object =visitFor(stmt, env);
+            object =visitFor(interp, stmt, env);
             break;
         case DEF_STMT:
-            object = visitDef(stmt, env);
+            object = visitDef(interp, stmt, env);
+            break;
+        case PARALLEL_FOR_STMT:
+            object = visitParallelFor(interp, stmt, env);
             break;
         case EXPR_STMT:
-            object = evaluate(stmt->exprStmt, env);
+            object = evaluate(interp, stmt->exprStmt, env);
             break;
     }
 
     return object;
 }
 
-Object *visitPuts(Stmt *stmt, HashTable *env) {
-    Object *object = evaluate(stmt->as.puts.exp, env);
+// How a value shows up inside a printed Hash.
+static void inspectObject(FILE *out, Object *object) {
     switch (object->type) {
         case NUMBER_OBJ:
-            printf("%f\n", object->as.number.value);
+            fprintf(out, "%f", object->as.number.value);
             break;
         case STRING_OBJ:
-            for(int i = 1; i < object->as.string.length - 1; i++) {
-                printf("%c", object->as.string.value[i]);
+            fprintf(out, "\"%.*s\"", object->as.string.length, stringChars(object));
+            break;
+        case BOOLEAN_OBJ:
+            fprintf(out, object->as.boolean.value ? "true" : "false");
+            break;
+        case NIL_OBJECT:
+            fprintf(out, "nil");
+            break;
+        case ARRAY_OBJ:
+            fprintf(out, "[");
+            for(int i = 0; i < object->as.array.size; i++) {
+                if (i > 0) {
+                    fprintf(out, ", ");
+                }
+                if (object->as.array.kind == NUMBER_ARRAY) {
+                    fprintf(out, "%f", object->as.array.items.numbers[i]);
+                } else {
+                    inspectObject(out, object->as.array.items.values[i]);
+                }
+            }
+            fprintf(out, "]");
+            break;
+        case HASH_OBJ: {
+            HashMap *map = object->as.hash.map;
+            bool first = true;
+            fprintf(out, "{");
+            for(long i = 0; i < map->entryCount; i++) {
+                if (map->entries[i].key == NULL) {
+                    continue;
+                }
+                fprintf(out, first ? "" : ", ");
+                inspectObject(out, map->entries[i].key);
+                fprintf(out, "=>");
+                inspectObject(out, map->entries[i].value);
+                first = false;
             }
-            printf("\n");
+            fprintf(out, "}");
+            break;
+        }
+        default:
+            fprintf(out, "#<%s>", objectTypeName(object->type));
+            break;
+    }
+}
+
+// Arrays print one element per line, like Ruby.
+static void putsObject(Interpreter *interp, Object *object) {
+    switch (object->type) {
+        case NUMBER_OBJ:
+            fprintf(interp->out, "%f\n", object->as.number.value);
+            break;
+        case STRING_OBJ:
+            fwrite(stringChars(object), 1, object->as.string.length, interp->out);
+            fprintf(interp->out, "\n");
             break;
         case BOOLEAN_OBJ:
             if (object->as.boolean.value == 1) {
-                printf("true\n");
+                fprintf(interp->out, "true\n");
             } else {
-                printf("false\n");
+                fprintf(interp->out, "false\n");
             }
             break;
         case NIL_OBJECT:
-            printf("nil\n");
+            fprintf(interp->out, "nil\n");
+            break;
+        case ARRAY_OBJ:
+            if (object->as.array.size == 0) {
+                fprintf(interp->out, "\n");
+            }
+            for(int i = 0; i < object->as.array.size; i++) {
+                if (object->as.array.kind == NUMBER_ARRAY) {
+                    fprintf(interp->out, "%f\n", object->as.array.items.numbers[i]);
+                } else {
+                    putsObject(interp, object->as.array.items.values[i]);
+                }
+            }
+            break;
+        case HASH_OBJ:
+            inspectObject(interp->out, object);
+            fprintf(interp->out, "\n");
             break;
     }
+}
+
+Object *visitPuts(Interpreter *interp, Stmt *stmt, HashTable *env) {
+    Object *object = evaluate(interp, stmt->as.puts.exp, env);
+    putsObject(interp, object);
     
-    return initObject(NIL_OBJECT);
+    return initObject(&interp->heap, NIL_OBJECT);
 }
 
-Object *visitIf(Stmt *stmt, HashTable *env) {
+// Evaluates to the value of the last statement of the branch taken, which
+// is what a method ending in an if returns.
+Object *visitIf(Interpreter *interp, Stmt *stmt, HashTable *env) {
     int count = stmt->as.ifStmt.conditionals->size;
+    Object *result = NULL;
     
     for(int i = 0; i < count; i++) {
         Conditional *conditional = stmt->as.ifStmt.conditionals->list[i];
-        Object *conditionMet = evaluate(conditional->condition, env);
+        Object *conditionMet = evaluate(interp, conditional->condition, env);
         
-        if(conditionMet->as.boolean.value == true) {
+        if (isTruthy(conditionMet)) {
             int statementCount = conditional->statements->size;
             for(int i = 0; i < statementCount; i++) {
-                execute(conditional->statements->list[i], env);
+                result = execute(interp, conditional->statements->list[i], env);
             }
             break;
         }
     }
 
-    return initObject(NIL_OBJECT);
+    return result != NULL ? result : initObject(&interp->heap, NIL_OBJECT);
 }
 
-Object *visitWhile(Stmt *stmt, HashTable *env) {
-    while (evaluate(stmt->as.whileStmt.condition, env)->as.boolean.value) {
+Object *visitWhile(Interpreter *interp, Stmt *stmt, HashTable *env) {
+    while (isTruthy(evaluate(interp, stmt->as.whileStmt.condition, env))) {
         Stmt *statement;
+        preemptionPoint(interp);
 
         for(int i = 0; i < stmt->as.whileStmt.statements->size; i++) {
             statement = stmt->as.whileStmt.statements->list[i];
-            execute(statement, env);
+            execute(interp, statement, env);
         }
     }
     
-    return initObject(NIL_OBJECT);
+    return initObject(&interp->heap, NIL_OBJECT);
 }
 
-Object *visitFor(Stmt *stmt, HashTable *env) {
-    Expr *range = stmt->as.forStmt.range;
+// The range a for loop runs over, its bounds can be any expression.
+Object *forRange(Interpreter *interp, Stmt *stmt, HashTable *env) {
+    Object *range = evaluate(interp, stmt->as.forStmt.range, env);
+    if (range->type != RANGE_OBJ) {
+        runtimeError(interp, stmt->line, "can't iterate over %s in a for loop", objectTypeName(range->type));
+    }
+    return range;
+}
+
+Object *visitFor(Interpreter *interp, Stmt *stmt, HashTable *env) {
+    Object *range = forRange(interp, stmt, env);
     double end = strcmp(range->as.range.type, "inclusive") == 0 ? range->as.range.end + 1 : range->as.range.end;
     
-    char *name = stmt->as.forStmt.identifier->as.identifierExp.string;
-    int length = stmt->as.forStmt.identifier->as.identifierExp.length;
-    Object *object = initObject(NUMBER_OBJ);
     Stmt *statement;
     for(int i = range->as.range.start; i < end; i++) {
+        // A new one every time, the body can keep the one it was given.
+        Object *object = initObject(&interp->heap, NUMBER_OBJ);
         object->as.number.value = i;
-        insertEntry(env, name, length, object);
+        assignVariable(interp, stmt->as.forStmt.identifier, object, env);
+        preemptionPoint(interp);
 
         for(int j = 0; j < stmt->as.forStmt.statements->size; j++) {
             statement = stmt->as.forStmt.statements->list[j];
-            execute(statement, env);
+            execute(interp, statement, env);
         }
     }
     
-    return initObject(NIL_OBJECT);
+    return initObject(&interp->heap, NIL_OBJECT);
 }
 
-Object *visitDef(Stmt *stmt, HashTable *env) {
-    Object *object = initObject(METHOD_OBJ);
-    HashTable *defEnv = initHashTable();
+// Methods are always defined globally, even when the def runs inside
+// another method.
+Object *visitDef(Interpreter *interp, Stmt *stmt, HashTable *env) {
+    if (interp->parallelWorker) {
+        runtimeError(interp, stmt->line, "can't define methods inside a parallel for");
+    }
+
+    Object *object = initObject(&interp->heap, METHOD_OBJ);
 
     object->as.method.name = stmt->as.defStmt.name;
     object->as.method.nameLength = stmt->as.defStmt.nameLength;
 
     object->as.method.arguments = stmt->as.defStmt.arguments;
     object->as.method.statements = stmt->as.defStmt.statements;
-    object->as.method.env = defEnv;
+    NumericMethod *numeric = stmt->as.defStmt.numeric;
+    object->as.method.numeric = numeric != NULL && numeric->numeric ? numeric : NULL;
+    object->as.method.lazy = NULL;
+    if (stmt->as.defStmt.lazy) {
+        object->as.method.numeric = NULL;
+        object->as.method.lazy = stmt;
+    }
 
-    insertEntry(env, object->as.method.name,  object->as.method.nameLength, object);
+    insertEntry(interp->globals, object->as.method.name,  object->as.method.nameLength, object);
+    interp->epoch = nextEpoch();
     
-    return initObject(NIL_OBJECT);
+    return initObject(&interp->heap, NIL_OBJECT);
 }
 
-Object *visitVarAssignment(Expr *exp, HashTable *env) {
-    Object *object = evaluate(exp->as.varAssignment.value, env);
-    insertEntry(env, exp->as.varAssignment.name, exp->as.varAssignment.length, object);
+Object *visitVarAssignment(Interpreter *interp, Expr *exp, HashTable *env) {
+    Object *object = ownValue(interp, evaluate(interp, exp->as.varAssignment.value, env));
+
+    switch (exp->as.varAssignment.kind) {
+        case VARIABLE_NAMED:
+            insertEntry(env, exp->as.varAssignment.name, exp->as.varAssignment.length, object);
+            break;
+        case VARIABLE_LOCAL:
+            interp->frame->locals[exp->as.varAssignment.slot] = object;
+            break;
+        case VARIABLE_UPVALUE:
+            writeBarrier(&interp->heap, object);
+            *interp->frame->upvalues[exp->as.varAssignment.slot] = object;
+            break;
+    }
     return object;
 }
 
-Object *evaluate(Expr *exp, HashTable *env) {
+// Stores into the variable an identifier names, for the loop variable of a for.
+void assignVariable(Interpreter *interp, Expr *identifier, Object *value, HashTable *env) {
+    switch (identifier->as.identifierExp.kind) {
+        case VARIABLE_NAMED:
+            insertEntry(env, identifier->as.identifierExp.string, identifier->as.identifierExp.length, value);
+            break;
+        case VARIABLE_LOCAL:
+            interp->frame->locals[identifier->as.identifierExp.slot] = value;
+            break;
+        case VARIABLE_UPVALUE:
+            writeBarrier(&interp->heap, value);
+            *interp->frame->upvalues[identifier->as.identifierExp.slot] = value;
+            break;
+    }
+}
+
+Object *evaluate(Interpreter *interp, Expr *exp, HashTable *env) {
+    if (stackLow(interp)) {
+        return evaluateOnNewSegment(interp, exp, env);
+    }
+    interp->line = exp->line;
     switch (exp->type) {
         case BINARY:
-            return visitBinary(exp, env);
+            return visitBinary(interp, exp, env);
         case NUMBER_LITERAL:
-            return visitNumberLiteral(exp);
+            return visitNumberLiteral(interp, exp);
         case STRING_LITERAL:
-            return visitStringLiteral(exp);
+            return visitStringLiteral(interp, exp);
         case BOOLEAN:
-            return visitBoolean(exp);
+            return visitBoolean(interp, exp);
         case RANGE:
-            return visitRange(exp);
+            return visitRange(interp, exp, env);
         case IDENTIFIER_EXP:
-            return visitIdentifierExpression(exp, env);
+            return visitIdentifierExpression(interp, exp, env);
         case METHOD_CALL_EXP:
-            return visitMethodCall(exp, env);
+            return visitMethodCall(interp, exp, env);
         case VAR_ASSIGNMENT:
-            return visitVarAssignment(exp, env);
+            return visitVarAssignment(interp, exp, env);
+        case ARRAY_LITERAL:
+            return visitArrayLiteral(interp, exp, env);
+        case INDEX_EXP:
+            return visitIndex(interp, exp, env);
+        case INDEX_ASSIGNMENT:
+            return visitIndexAssignment(interp, exp, env);
+        case INVOKE_EXP:
+            return visitInvoke(interp, exp, env);
+        case HASH_LITERAL:
+            return visitHashLiteral(interp, exp, env);
+        case INTERPOLATION:
+            return visitInterpolation(interp, exp, env);
+        case LOGICAL:
+            return visitLogical(interp, exp, env);
+        case UNARY:
+            return visitUnary(interp, exp, env);
+        case INLINED_CALL:
+            return visitInlinedCall(interp, exp, env);
+        case INLINED_ARGUMENT:
+            return interp->inlinedArguments[exp->as.inlinedArgument.index];
   }
+
+  return initObject(&interp->heap, NIL_OBJECT);
 }
 
-Object *visitStringLiteral(Expr *exp) {
-    Object *object = initObject(STRING_OBJ);
-    object->as.string.value = exp->as.stringLiteral.string;
-    object->as.string.length = exp->as.stringLiteral.length;
-    return object;
+// Every evaluation shares the object the parser made.
+Object *visitStringLiteral(Interpreter *interp, Expr *exp) {
+    return exp->as.stringLiteral.object;
 }
 
-Object *visitNumberLiteral(Expr *exp) {
-    Object *object = initObject(NUMBER_OBJ);
+Object *visitNumberLiteral(Interpreter *interp, Expr *exp) {
+    Object *object = initObject(&interp->heap, NUMBER_OBJ);
     object->as.number.value = exp->as.numberLiteral.number;
     return object;
 }
 
-Object *visitBoolean(Expr *exp) {
-    Object *object = initObject(BOOLEAN_OBJ);
+Object *visitBoolean(Interpreter *interp, Expr *exp) {
+    Object *object = initObject(&interp->heap, BOOLEAN_OBJ);
     object->as.boolean.value = exp->as.boolExp.value;
     return object;
 }
 
-Object *visitRange(Expr *exp) {
-    Object *object = initObject(RANGE_OBJ);
+Object *visitRange(Interpreter *interp, Expr *exp, HashTable *env) {
+    Object *start = evaluate(interp, exp->as.range.start, env);
+    Object *end = evaluate(interp, exp->as.range.end, env);
+
+    if (start->type != NUMBER_OBJ || end->type != NUMBER_OBJ) {
+        runtimeError(interp, exp->line, "bad value for range (%s..%s)",
+            objectTypeName(start->type), objectTypeName(end->type));
+    }
+
+    Object *object = initObject(&interp->heap, RANGE_OBJ);
     object->as.range.type   = exp->as.range.type;
-    object->as.range.start  = exp->as.range.start;
-    object->as.range.end  = exp->as.range.end;
+    object->as.range.start  = start->as.number.value;
+    object->as.range.end  = end->as.number.value;
     return object;
 }
 
-Object *visitIdentifierExpression(Expr *exp, HashTable *env) {
+Object *visitIdentifierExpression(Interpreter *interp, Expr *exp, HashTable *env) {
 //    There's probably some work to do here to handle functions
     Object *object;
+
+    switch (exp->as.identifierExp.kind) {
+        case VARIABLE_LOCAL:
+            object = interp->frame->locals[exp->as.identifierExp.slot];
+            // Assigned further down the block but not yet.
+            return object != NULL ? object : initObject(&interp->heap, NIL_OBJECT);
+        case VARIABLE_UPVALUE:
+            object = *interp->frame->upvalues[exp->as.identifierExp.slot];
+            return object != NULL ? object : initObject(&interp->heap, NIL_OBJECT);
+        case VARIABLE_NAMED:
+            break;
+    }
+
     object = getEntry(exp->as.identifierExp.string, exp->as.identifierExp.length, env);
 
+    if (object == NULL) {
+        runtimeError(interp, exp->line, "undefined local variable or method '%.*s'",
+            exp->as.identifierExp.length, exp->as.identifierExp.string);
+    }
+
     return object;
 }
 
-Object *visitMethodCall(Expr *exp, HashTable *env) {
+static Object *callKernelFunction(Interpreter *interp, Expr *exp, HashTable *env, Builtin *function) {
+    ExprArray *values = exp->as.methodCall.arguments;
+    if (function->arity >= 0 && values->size != function->arity) {
+        runtimeError(interp, exp->line, "wrong number of arguments for '%s' (given %d, expected %d)",
+            function->name, values->size, function->arity);
+    }
+
+    Object *arguments[values->size + 1];
+    for(int i = 0; i < values->size; i++) {
+        arguments[i] = ownValue(interp, evaluate(interp, values->list[i], env));
+    }
+    return function->function(interp, exp, NULL, arguments);
+}
+
+Object *visitMethodCall(Interpreter *interp, Expr *exp, HashTable *env) {
     char *methodName = exp->as.methodCall.name;
     int nameLength = exp->as.methodCall.length;
+    stats.methodCalls++;
 
     Object *methodDefinition = getEntry(methodName, nameLength, env);
-    
+    if (methodDefinition == NULL || methodDefinition->type != METHOD_OBJ) {
+        methodDefinition = getEntry(methodName, nameLength, interp->globals);
+    }
+
+    if (methodDefinition == NULL || methodDefinition->type != METHOD_OBJ) {
+        Builtin *function = findKernelFunction(methodName, nameLength);
+        if (function != NULL) {
+            return callKernelFunction(interp, exp, env, function);
+        }
+        runtimeError(interp, exp->line, "undefined method '%.*s'", nameLength, methodName);
+    }
+    checkArguments(interp, exp, methodDefinition);
+    methodReady(interp, methodDefinition);
+
     ExprArray *values = exp->as.methodCall.arguments;
-    ExprArray *arguments = methodDefinition->as.method.arguments;
-    
-    if (arguments->size != values->size) {
-        printf("Arity does not match!");
-        exit(1);
+    Object *arguments[values->size + 1];
+    bool numbers = true;
+
+    for(int i = 0; i < values->size; i++) {
+        arguments[i] = ownValue(interp, evaluate(interp, values->list[i], env));
+        numbers = numbers && arguments[i]->type == NUMBER_OBJ;
     }
 
-    HashTable *methodEnv = methodDefinition->as.method.env;
-     
-    for(int i = 0; i < methodDefinition->as.method.arguments->size; i++) {
-        char *name = arguments->list[i]->as.methodCall.name;
-        int length = arguments->list[i]->as.methodCall.length;
-        Object *value = evaluate(values->list[i], env);
-        insertEntry(methodEnv, name, length, value);
+    // Numeric methods only need their arguments checked once, here.
+    if (methodDefinition->as.method.numeric != NULL && numbers) {
+        double unboxed[values->size + 1];
+        for(int i = 0; i < values->size; i++) {
+            unboxed[i] = arguments[i]->as.number.value;
+        }
+        stats.unboxedCalls++;
+
+        Object *result = initObject(&interp->heap, NUMBER_OBJ);
+        result->as.number.value = runNumericMethod(interp, methodDefinition, unboxed);
+        return result;
     }
-    
-    StmtArray *statements = methodDefinition->as.method.statements;
-    
+
+    return callMethod(interp, methodDefinition, arguments);
+}
+
+void checkArguments(Interpreter *interp, Expr *exp, Object *method) {
+    int given = exp->as.methodCall.arguments->size;
+    int expected = method->as.method.arguments->size;
+
+    if (given != expected) {
+        runtimeError(interp, exp->line, "wrong number of arguments for '%.*s' (given %d, expected %d)",
+            exp->as.methodCall.length, exp->as.methodCall.name, given, expected);
+    }
+}
+
+/*
+  An inlined body stands for the def it was copied from, which only holds
+  while that def made the method currently defined. The inliner makes
+  sure nothing but a def can change what the name is bound to, so the
+  answer only has to be looked up again once per epoch.
+*/
+bool inlinedCallValid(Interpreter *interp, Expr *exp) {
+    if (__atomic_load_n(&exp->as.inlined.epoch, __ATOMIC_RELAXED) == interp->epoch) {
+        return true;
+    }
+
+    Stmt *def = exp->as.inlined.def;
+    Object *method = getEntry(def->as.defStmt.name, def->as.defStmt.nameLength, interp->globals);
+    if (method == NULL || method->type != METHOD_OBJ || method->as.method.statements != def->as.defStmt.statements) {
+        return false;
+    }
+
+    __atomic_store_n(&exp->as.inlined.epoch, interp->epoch, __ATOMIC_RELAXED);
+    return true;
+}
+
+Object *visitInlinedCall(Interpreter *interp, Expr *exp, HashTable *env) {
+    if (!inlinedCallValid(interp, exp)) {
+        return visitMethodCall(interp, exp->as.inlined.call, env);
+    }
+
+    ExprArray *values = exp->as.inlined.call->as.methodCall.arguments;
+    Object *arguments[values->size + 1];
+    for(int i = 0; i < values->size; i++) {
+        arguments[i] = ownValue(interp, evaluate(interp, values->list[i], env));
+    }
+    stats.inlinedCalls++;
+
+    Object **enclosing = interp->inlinedArguments;
+    interp->inlinedArguments = arguments;
+    Object *result = evaluate(interp, exp->as.inlined.body, env);
+    interp->inlinedArguments = enclosing;
+
+    return result;
+}
+
+// Runs the boxed body of a method with arguments already evaluated.
+Object *callMethod(Interpreter *interp, Object *method, Object **arguments) {
+    ExprArray *names = method->as.method.arguments;
+    preemptionPoint(interp);
+    methodReady(interp, method);
+
+    // Every call gets its own environment so methods can recurse.
+    HashTable *methodEnv = initHashTable(&interp->heap);
+
+    for(int i = 0; i < names->size; i++) {
+        char *name = names->list[i]->as.methodCall.name;
+        int length = names->list[i]->as.methodCall.length;
+        insertEntry(methodEnv, name, length, arguments[i]);
+    }
+
+    StmtArray *statements = method->as.method.statements;
+
     if (statements->size == 0) {
-        return initObject(NIL_OBJECT);
+        return initObject(&interp->heap, NIL_OBJECT);
     }
-    
+
     Object *result;
     for (int i = 0; i < statements->size; i++) {
-        result = execute(statements->list[i], methodEnv);
+        result = execute(interp, statements->list[i], methodEnv);
     }
 
     return result;
 }
 
-Object *visitBinary(Expr *exp, HashTable *env) {
-    Object *object = initObject(NUMBER_OBJ);
-    switch (exp->as.binary.op) {
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Binary operators
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static Object *numberObject(Interpreter *interp, double value) {
+    Object *object = initObject(&interp->heap, NUMBER_OBJ);
+    object->as.number.value = value;
+    return object;
+}
+
+static Object *booleanObject(Interpreter *interp, bool value) {
+    Object *object = initObject(&interp->heap, BOOLEAN_OBJ);
+    object->as.boolean.value = value;
+    return object;
+}
+
+static const char *operatorName(TokenType op) {
+    switch (op) {
+        case PLUS: return "+";
+        case MINUS: return "-";
+        case STAR: return "*";
+        case FORWARD_SLASH: return "/";
+        case MODULO: return "%";
+        case GREATER: return ">";
+        case GREATER_EQUAL: return ">=";
+        case LESS: return "<";
+        case LESS_EQUAL: return "<=";
+        case EQUAL_EQUAL: return "==";
+        case BANG_EQUAL: return "!=";
+        case LESS_LESS: return "<<";
+        case STAR_STAR: return "**";
+        default: return "?";
+    }
+}
+
+static double numberModulo(Interpreter *interp, Expr *exp, double a, double b) {
+    if ((int)b == 0) {
+        runtimeError(interp, exp->line, "divided by 0");
+    }
+    return (int)a % (int)b;
+}
+
+// Every operator for every pair of types, and the errors for the pairs
+// that don't go together.
+static Object *genericBinary(Interpreter *interp, Expr *exp, Object *left, Object *right) {
+    TokenType op = exp->as.binary.op;
+
+    if (op == LESS_LESS) {
+        return appendOperation(interp, exp, left, right);
+    }
+    if ((op == EQUAL_EQUAL || op == BANG_EQUAL) && (left->type != NUMBER_OBJ || right->type != NUMBER_OBJ)) {
+        return booleanObject(interp, objectsEqual(left, right) == (op == EQUAL_EQUAL));
+    }
+    if (left->type == ARRAY_OBJ || right->type == ARRAY_OBJ) {
+        return arrayArithmetic(interp, exp, left, right);
+    }
+    if (left->type == STRING_OBJ || right->type == STRING_OBJ) {
+        return stringOperation(interp, exp, left, right);
+    }
+
+    bool comparison = op == GREATER || op == GREATER_EQUAL || op == LESS || op == LESS_EQUAL;
+    if (left->type != NUMBER_OBJ) {
+        runtimeError(interp, exp->line, "undefined method '%s' for %s",
+            operatorName(op), objectTypeName(left->type));
+    }
+    if (right->type != NUMBER_OBJ && comparison) {
+        runtimeError(interp, exp->line, "comparison of Number with %s failed", objectTypeName(right->type));
+    }
+    if (right->type != NUMBER_OBJ) {
+        runtimeError(interp, exp->line, "%s can't be coerced into Number", objectTypeName(right->type));
+    }
+
+    double a = left->as.number.value;
+    double b = right->as.number.value;
+    switch (op) {
         case PLUS:
-            object->as.number.value = evaluate(exp->as.binary.left, env)->as.number.value + evaluate(exp->as.binary.right, env)->as.number.value;
-            break;
+            return numberObject(interp, a + b);
         case MINUS:
-            object->as.number.value = evaluate(exp->as.binary.left, env)->as.number.value - evaluate(exp->as.binary.right, env)->as.number.value;
-            break;
+            return numberObject(interp, a - b);
         case STAR:
-            object->as.number.value = evaluate(exp->as.binary.left, env)->as.number.value * evaluate(exp->as.binary.right, env)->as.number.value;
-            break;
+            return numberObject(interp, a * b);
         case FORWARD_SLASH:
-            object->as.number.value = evaluate(exp->as.binary.left, env)->as.number.value / evaluate(exp->as.binary.right, env)->as.number.value;
-            break;
+            return numberObject(interp, a / b);
         case MODULO:
-            object->as.number.value = (int)evaluate(exp->as.binary.left, env)->as.number.value % (int)evaluate(exp->as.binary.right, env)->as.number.value;
-            break;
+            return numberObject(interp, numberModulo(interp, exp, a, b));
+        case STAR_STAR:
+            return numberObject(interp, pow(a, b));
         case GREATER:
-            object->type = BOOLEAN_OBJ;
-            object->as.boolean.value = evaluate(exp->as.binary.left, env)->as.number.value > evaluate(exp->as.binary.right, env)->as.number.value;
-            break;
+            return booleanObject(interp, a > b);
         case GREATER_EQUAL:
-            object->type = BOOLEAN_OBJ;            
-            object->as.boolean.value = evaluate(exp->as.binary.left, env)->as.number.value >= evaluate(exp->as.binary.right, env)->as.number.value;
-            break;
+            return booleanObject(interp, a >= b);
         case LESS:
-            object->type = BOOLEAN_OBJ;
-            object->as.boolean.value = evaluate(exp->as.binary.left, env)->as.number.value < evaluate(exp->as.binary.right, env)->as.number.value;
-            break;
+            return booleanObject(interp, a < b);
         case LESS_EQUAL:
-            object->type = BOOLEAN_OBJ;
-            object->as.boolean.value = evaluate(exp->as.binary.left, env)->as.number.value <= evaluate(exp->as.binary.right, env)->as.number.value;
-            break;
+            return booleanObject(interp, a <= b);
         case EQUAL_EQUAL:
-            object->type = BOOLEAN_OBJ;
-            object->as.boolean.value = evaluate(exp->as.binary.left, env)->as.number.value == evaluate(exp->as.binary.right, env)->as.number.value;
-            break;
+            return booleanObject(interp, a == b);
         case BANG_EQUAL:
-            object->type = BOOLEAN_OBJ;
-            object->as.boolean.value = evaluate(exp->as.binary.left, env)->as.number.value != evaluate(exp->as.binary.right, env)->as.number.value;
+            return booleanObject(interp, a != b);
+        default:
+            runtimeError(interp, exp->line, "undefined method '%s' for Number", operatorName(op));
+            return NULL;
+    }
+}
+
+// The kind a node settles on after seeing `left` and `right` every time.
+static BinaryKind specializedKind(TokenType op, ObjectType left, ObjectType right) {
+    if (left == STRING_OBJ && right == STRING_OBJ && op == PLUS) {
+        return ADD_STR_STR;
+    }
+    if (left != NUMBER_OBJ || right != NUMBER_OBJ) {
+        return BINARY_GENERIC;
+    }
+
+    switch (op) {
+        case PLUS: return ADD_NUM_NUM;
+        case MINUS: return SUBTRACT_NUM_NUM;
+        case STAR: return MULTIPLY_NUM_NUM;
+        case FORWARD_SLASH: return DIVIDE_NUM_NUM;
+        case MODULO: return MODULO_NUM_NUM;
+        case GREATER: return GREATER_NUM_NUM;
+        case GREATER_EQUAL: return GREATER_EQUAL_NUM_NUM;
+        case LESS: return LESS_NUM_NUM;
+        case LESS_EQUAL: return LESS_EQUAL_NUM_NUM;
+        case EQUAL_EQUAL: return EQUAL_NUM_NUM;
+        case BANG_EQUAL: return NOT_EQUAL_NUM_NUM;
+        case STAR_STAR: return POWER_NUM_NUM;
+        default: return BINARY_GENERIC;
+    }
+}
+
+static void rewriteBinary(Expr *exp, BinaryKind kind) {
+    __atomic_store_n(&exp->as.binary.kind, kind, __ATOMIC_RELAXED);
+    if (kind == BINARY_GENERIC) {
+        stats.binaryGeneric++;
+    } else {
+        stats.binarySpecialized++;
+    }
+}
+
+/*
+  Records the operand types of an unseen node. Threads racing here can at
+  worst specialize a node for the wrong types, which the guard catches.
+*/
+static void recordOperands(Expr *exp, Object *left, Object *right) {
+    unsigned char samples = __atomic_load_n(&exp->as.binary.samples, __ATOMIC_RELAXED);
+
+    if (samples == 0) {
+        __atomic_store_n(&exp->as.binary.leftType, left->type, __ATOMIC_RELAXED);
+        __atomic_store_n(&exp->as.binary.rightType, right->type, __ATOMIC_RELAXED);
+    } else if (__atomic_load_n(&exp->as.binary.leftType, __ATOMIC_RELAXED) != left->type ||
+               __atomic_load_n(&exp->as.binary.rightType, __ATOMIC_RELAXED) != right->type) {
+        rewriteBinary(exp, BINARY_GENERIC);
+        return;
+    }
+
+    if (samples + 1 < BINARY_WARMUP) {
+        __atomic_store_n(&exp->as.binary.samples, samples + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    rewriteBinary(exp, specializedKind(exp->as.binary.op, left->type, right->type));
+}
+
+#define NUMBER_CASE(kind, result) \
+    case kind: \
+        if (left->type == NUMBER_OBJ && right->type == NUMBER_OBJ) { \
+            double a = left->as.number.value; \
+            double b = right->as.number.value; \
+            return result; \
+        } \
+        break;
+
+// Specialized nodes check their guard and do the operation, when the guard
+// fails the node goes generic.
+Object *visitBinary(Interpreter *interp, Expr *exp, HashTable *env) {
+    Object *left = evaluate(interp, exp->as.binary.left, env);
+    Object *right = evaluate(interp, exp->as.binary.right, env);
+
+    switch (__atomic_load_n(&exp->as.binary.kind, __ATOMIC_RELAXED)) {
+        NUMBER_CASE(ADD_NUM_NUM, numberObject(interp, a + b))
+        NUMBER_CASE(SUBTRACT_NUM_NUM, numberObject(interp, a - b))
+        NUMBER_CASE(MULTIPLY_NUM_NUM, numberObject(interp, a * b))
+        NUMBER_CASE(DIVIDE_NUM_NUM, numberObject(interp, a / b))
+        NUMBER_CASE(MODULO_NUM_NUM, numberObject(interp, numberModulo(interp, exp, a, b)))
+        NUMBER_CASE(GREATER_NUM_NUM, booleanObject(interp, a > b))
+        NUMBER_CASE(GREATER_EQUAL_NUM_NUM, booleanObject(interp, a >= b))
+        NUMBER_CASE(LESS_NUM_NUM, booleanObject(interp, a < b))
+        NUMBER_CASE(LESS_EQUAL_NUM_NUM, booleanObject(interp, a <= b))
+        NUMBER_CASE(EQUAL_NUM_NUM, booleanObject(interp, a == b))
+        NUMBER_CASE(NOT_EQUAL_NUM_NUM, booleanObject(interp, a != b))
+        NUMBER_CASE(POWER_NUM_NUM, numberObject(interp, pow(a, b)))
+        case ADD_STR_STR:
+            if (left->type == STRING_OBJ && right->type == STRING_OBJ) {
+                return stringConcat(&interp->heap, left, right);
+            }
             break;
+        case BINARY_UNSEEN:
+            recordOperands(exp, left, right);
+            return genericBinary(interp, exp, left, right);
+        case BINARY_GENERIC:
+            return genericBinary(interp, exp, left, right);
     }
-    return object;
+
+    stats.binaryDeopts++;
+    rewriteBinary(exp, BINARY_GENERIC);
+    return genericBinary(interp, exp, left, right);
+}
+
+#undef NUMBER_CASE
+
+// Whichever side decided, so `a || default` works with any value.
+Object *visitLogical(Interpreter *interp, Expr *exp, HashTable *env) {
+    Object *left = evaluate(interp, exp->as.logical.left, env);
+    if (isTruthy(left) == (exp->as.logical.op == PIPE_PIPE)) {
+        return left;
+    }
+    return evaluate(interp, exp->as.logical.right, env);
+}
+
+Object *visitUnary(Interpreter *interp, Expr *exp, HashTable *env) {
+    Object *operand = evaluate(interp, exp->as.unary.operand, env);
+    if (exp->as.unary.op == BANG) {
+        return booleanObject(interp, !isTruthy(operand));
+    }
+    if (operand->type != NUMBER_OBJ) {
+        runtimeError(interp, exp->line, "undefined method '-@' for %s", objectTypeName(operand->type));
+    }
+    return numberObject(interp, -operand->as.number.value);
+}
+
+// Stays a number array as long as every element is a number.
+Object *visitArrayLiteral(Interpreter *interp, Expr *exp, HashTable *env) {
+    ExprArray *elements = exp->as.arrayLiteral.elements;
+    Object *array = newArray(&interp->heap, NUMBER_ARRAY, elements->size);
+
+    for(int i = 0; i < elements->size; i++) {
+        arrayPush(&interp->heap, array, ownValue(interp, evaluate(interp, elements->list[i], env)));
+    }
+    return array;
+}
+
+static int arrayIndex(Interpreter *interp, Expr *exp, Object *array, Object *index) {
+    if (array->type != ARRAY_OBJ) {
+        runtimeError(interp, exp->line, "undefined method '[]' for %s", objectTypeName(array->type));
+    }
+    if (index->type != NUMBER_OBJ) {
+        runtimeError(interp, exp->line, "no implicit conversion of %s into Integer", objectTypeName(index->type));
+    }
+    return (int)index->as.number.value;
+}
+
+Object *visitHashLiteral(Interpreter *interp, Expr *exp, HashTable *env) {
+    ExprArray *keys = exp->as.hashLiteral.keys;
+    ExprArray *values = exp->as.hashLiteral.values;
+    Object *hash = initObject(&interp->heap, HASH_OBJ);
+    hash->as.hash.map = newHashMap(&interp->heap);
+
+    for(int i = 0; i < keys->size; i++) {
+        Object *key = evaluate(interp, keys->list[i], env);
+        hashStore(interp, exp, hash, key, evaluate(interp, values->list[i], env));
+    }
+    return hash;
+}
+
+/*
+  Where the characters of an interpolated value come from. Short ones are
+  copied into `scratch` because a later part can still append to an inline
+  string, anything that doesn't fit is inspected into a buffer of its own.
+*/
+static int interpolatedChars(Object *object, char *scratch, char **inspected, const char **chars) {
+    int length;
+
+    switch (object->type) {
+        case STRING_OBJ:
+            length = object->as.string.length;
+            if (object->as.string.capacity != STRING_INLINE) {
+                *chars = stringChars(object);
+                return length;
+            }
+            memcpy(scratch, stringChars(object), length);
+            *chars = scratch;
+            return length;
+        case NUMBER_OBJ:
+            length = snprintf(scratch, INTERPOLATION_SCRATCH_SIZE, "%f", object->as.number.value);
+            if (length < INTERPOLATION_SCRATCH_SIZE) {
+                *chars = scratch;
+                return length;
+            }
+            break;
+        case BOOLEAN_OBJ:
+            *chars = object->as.boolean.value ? "true" : "false";
+            return (int)strlen(*chars);
+        case NIL_OBJECT:
+            *chars = "";
+            return 0;
+        default:
+            break;
+    }
+
+    size_t size;
+    FILE *out = open_memstream(inspected, &size);
+    inspectObject(out, object);
+    fclose(out);
+    *chars = *inspected;
+    return (int)size;
+}
+
+// The parts are turned into characters first so the result is allocated
+// once, at its final length.
+Object *visitInterpolation(Interpreter *interp, Expr *exp, HashTable *env) {
+    ExprArray *parts = exp->as.interpolation.parts;
+    int count = parts->size;
+    char scratch[count][INTERPOLATION_SCRATCH_SIZE];
+    char *inspected[count];
+    const char *chars[count];
+    int lengths[count];
+    long total = 0;
+
+    for(int i = 0; i < count; i++) {
+        inspected[i] = NULL;
+        Object *object = evaluate(interp, parts->list[i], env);
+        lengths[i] = interpolatedChars(object, scratch[i], &inspected[i], &chars[i]);
+        total += lengths[i];
+    }
+
+    if (total > INT_MAX) {
+        for(int i = 0; i < count; i++) {
+            free(inspected[i]);
+        }
+        runtimeError(interp, exp->line, "interpolated string too long");
+    }
+
+    Object *string = allocateString(&interp->heap, (int)total);
+    char *destination = stringChars(string);
+    for(int i = 0; i < count; i++) {
+        memcpy(destination, chars[i], lengths[i]);
+        destination += lengths[i];
+        free(inspected[i]);
+    }
+    return string;
+}
+
+Object *visitIndex(Interpreter *interp, Expr *exp, HashTable *env) {
+    Object *array = evaluate(interp, exp->as.index.object, env);
+    Object *index = evaluate(interp, exp->as.index.index, env);
+
+    if (array->type == HASH_OBJ) {
+        return hashLookup(interp, exp, array, index);
+    }
+    return arrayGet(&interp->heap, array, arrayIndex(interp, exp, array, index));
+}
+
+Object *visitIndexAssignment(Interpreter *interp, Expr *exp, HashTable *env) {
+    Object *array = evaluate(interp, exp->as.index.object, env);
+    Object *index = evaluate(interp, exp->as.index.index, env);
+    Object *value = ownValue(interp, evaluate(interp, exp->as.index.value, env));
+
+    if (array->type == HASH_OBJ) {
+        hashStore(interp, exp, array, index, value);
+        return value;
+    }
+
+    int position = arrayIndex(interp, exp, array, index);
+    checkModifiable(interp, exp, array);
+    if (!arraySet(&interp->heap, array, position, value)) {
+        runtimeError(interp, exp->line, "index %d too small for array; minimum: -%d", position, array->as.array.size);
+    }
+    return value;
+}
+
+Object *visitInvoke(Interpreter *interp, Expr *exp, HashTable *env) {
+    Object *receiver = evaluate(interp, exp->as.invoke.receiver, env);
+
+    ExprArray *values = exp->as.invoke.arguments;
+    Object *arguments[values->size > 0 ? values->size : 1];
+    for(int i = 0; i < values->size; i++) {
+        arguments[i] = evaluate(interp, values->list[i], env);
+    }
+
+    Block *block = exp->as.invoke.block;
+    if (block == NULL) {
+        return invokeBuiltin(interp, exp, receiver, arguments, values->size, NULL);
+    }
+
+    Object **upvalues[block->upvalues->size > 0 ? block->upvalues->size : 1];
+    Closure closure;
+    initClosure(interp, &closure, block, env, upvalues);
+    return invokeBuiltin(interp, exp, receiver, arguments, values->size, &closure);
 }
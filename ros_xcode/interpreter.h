@@ -8,27 +8,132 @@
 #ifndef interpreter_h
 #define interpreter_h
 
+#include <setjmp.h>
 #include "parser.h"
 #include "hash_table.h"
 #include "object.h"
+#include "heap.h"
 
-void interpret(StmtArray *array, HashTable *env);
+// Room on the stack for a number or short string inside "#{}".
+#define INTERPOLATION_SCRATCH_SIZE 32
+
+// Source buffer and AST of everything evaluated so far. Methods defined by
+// one evaluation can be called by later ones so both live as long as the
+// interpreter does.
+typedef struct Program {
+    char *source;
+    StmtArray *statements;
+} Program;
+
+typedef struct ProgramArray {
+    Program **list;
+    int size;
+    int capacity;
+} ProgramArray;
+
+/*
+  Everything a running script touches. Nothing in the interpreter is
+  process wide, so separate instances can run on separate threads.
+*/
+typedef struct Interpreter {
+    Heap heap;
+    HashTable *globals;
+    ProgramArray *programs;
+    FILE *out;
+    // Runtime errors jump here with the message in `error`.
+    jmp_buf *errorJump;
+    char error[ERROR_MESSAGE_SIZE];
+    // Line of the node running, for errors raised away from it, like
+    // running out of heap.
+    int line;
+
+    // Workers for `parallel for`, created the first time one runs.
+    // `threads` is the pool size, 0 means one per core.
+    struct ThreadPool *pool;
+    int threads;
+    // Set on the copies that run the body of a parallel loop.
+    bool parallelWorker;
+
+    // Locals and upvalues of the block running, NULL outside of blocks.
+    struct Frame *frame;
+    long frameCount;
+
+    // Changes on every def, see inlinedCallValid().
+    long epoch;
+    // Arguments of the inlined call whose body is running.
+    Object **inlinedArguments;
+
+    // Below this address evaluation moves to a new stack segment, see
+    // segmented_stack.h. The segments can't take more than stackBudget.
+    char *stackLimit;
+    // Highest address of the thread's own stack.
+    char *stackTop;
+    long stackBudget;
+    struct SegmentStack *segments;
+
+    // Set while the interpreter runs as a fiber, which yields once it
+    // has used up its budget, see scheduler.h.
+    struct Fiber *fiber;
+    long budget;
+
+    // Channels and isolates, shared with the isolates spawned from here
+    // and freed by the interpreter that made them, see isolate.h.
+    struct IsolateGroup *isolates;
+    bool ownsIsolates;
+
+    // Programs parsed from here on only skim the bodies of their defs,
+    // see parseDef().
+    bool lazyDefs;
+} Interpreter;
+
+Interpreter *newInterpreter(void);
+void freeInterpreter(Interpreter *interp);
+void runtimeError(Interpreter *interp, int line, const char *format, ...);
+void raiseError(Interpreter *interp);
+Object *ownValue(Interpreter *interp, Object *value);
+StmtArray *parseProgram(Interpreter *interp, char *source);
+void adoptProgram(Interpreter *interp, char *source, StmtArray *statements, long astBytes);
+bool runProgram(Interpreter *interp, StmtArray *statements);
+void parseLazyMethod(Interpreter *interp, Object *method);
+
+// Every way into a method goes through here before it looks at the body.
+static inline void methodReady(Interpreter *interp, Object *method) {
+    if (__atomic_load_n(&method->as.method.lazy, __ATOMIC_ACQUIRE) != NULL) {
+        parseLazyMethod(interp, method);
+    }
+}
+
+void interpret(Interpreter *interp, StmtArray *array, HashTable *env);
 // Returns a nil objevt for all these statements
-Object *execute(Stmt *stmt, HashTable *env);
-Object *visitPuts(Stmt *stmt, HashTable *env);
-Object *visitIf(Stmt *stmt, HashTable *env);
-Object *visitWhile(Stmt *stmt, HashTable *env);
-Object *visitFor(Stmt *stmt, HashTable *env);
-Object *visitDef(Stmt *stmt, HashTable *env);
-
-Object *visitVarAssignment(Expr *exp, HashTable *env);
-Object *evaluate(Expr *exp, HashTable *env);
-Object *visitStringLiteral(Expr *exp);
-Object *visitNumberLiteral(Expr *exp);
-Object *visitBoolean(Expr *exp);
-Object *visitRange(Expr *exp);
-Object *visitBinary(Expr *exp, HashTable *env);
-Object *visitIdentifierExpression(Expr *exp, HashTable *env);
-Object *visitMethodCall(Expr *exp, HashTable *env);
+Object *execute(Interpreter *interp, Stmt *stmt, HashTable *env);
+Object *visitPuts(Interpreter *interp, Stmt *stmt, HashTable *env);
+Object *visitIf(Interpreter *interp, Stmt *stmt, HashTable *env);
+Object *visitWhile(Interpreter *interp, Stmt *stmt, HashTable *env);
+Object *visitFor(Interpreter *interp, Stmt *stmt, HashTable *env);
+Object *forRange(Interpreter *interp, Stmt *stmt, HashTable *env);
+Object *visitDef(Interpreter *interp, Stmt *stmt, HashTable *env);
+void checkArguments(Interpreter *interp, Expr *exp, Object *method);
+Object *callMethod(Interpreter *interp, Object *method, Object **arguments);
+bool inlinedCallValid(Interpreter *interp, Expr *exp);
+Object *visitInlinedCall(Interpreter *interp, Expr *exp, HashTable *env);
+
+Object *visitVarAssignment(Interpreter *interp, Expr *exp, HashTable *env);
+Object *evaluate(Interpreter *interp, Expr *exp, HashTable *env);
+Object *visitStringLiteral(Interpreter *interp, Expr *exp);
+Object *visitNumberLiteral(Interpreter *interp, Expr *exp);
+Object *visitBoolean(Interpreter *interp, Expr *exp);
+Object *visitRange(Interpreter *interp, Expr *exp, HashTable *env);
+Object *visitBinary(Interpreter *interp, Expr *exp, HashTable *env);
+Object *visitLogical(Interpreter *interp, Expr *exp, HashTable *env);
+Object *visitUnary(Interpreter *interp, Expr *exp, HashTable *env);
+Object *visitIdentifierExpression(Interpreter *interp, Expr *exp, HashTable *env);
+Object *visitMethodCall(Interpreter *interp, Expr *exp, HashTable *env);
+Object *visitArrayLiteral(Interpreter *interp, Expr *exp, HashTable *env);
+Object *visitIndex(Interpreter *interp, Expr *exp, HashTable *env);
+Object *visitIndexAssignment(Interpreter *interp, Expr *exp, HashTable *env);
+Object *visitInvoke(Interpreter *interp, Expr *exp, HashTable *env);
+void assignVariable(Interpreter *interp, Expr *identifier, Object *value, HashTable *env);
+Object *visitHashLiteral(Interpreter *interp, Expr *exp, HashTable *env);
+Object *visitInterpolation(Interpreter *interp, Expr *exp, HashTable *env);
 
 #endif /* interpreter_h */
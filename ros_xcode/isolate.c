@@ -0,0 +1,503 @@
+//
+//  isolate.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-04-04.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "isolate.h"
+#include "array_object.h"
+#include "hash_object.h"
+#include "string_object.h"
+#include "segmented_stack.h"
+#include "gc.h"
+#include "stats.h"
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Messages
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+// Checked before anything is copied so an error leaves nothing half made.
+static void checkSendable(Interpreter *interp, int line, Object *value) {
+    switch (value->type) {
+        case NUMBER_OBJ:
+        case STRING_OBJ:
+        case BOOLEAN_OBJ:
+        case NIL_OBJECT:
+        case RANGE_OBJ:
+        case CHANNEL_OBJ:
+            return;
+        case ARRAY_OBJ:
+            if (value->as.array.kind == VALUE_ARRAY) {
+                for(int i = 0; i < value->as.array.size; i++) {
+                    checkSendable(interp, line, value->as.array.items.values[i]);
+                }
+            }
+            return;
+        case HASH_OBJ: {
+            HashMap *map = value->as.hash.map;
+            for(long i = 0; i < map->entryCount; i++) {
+                if (map->entries[i].key != NULL) {
+                    checkSendable(interp, line, map->entries[i].key);
+                    checkSendable(interp, line, map->entries[i].value);
+                }
+            }
+            return;
+        }
+        default:
+            runtimeError(interp, line, "can't send %s to another isolate", objectTypeName(value->type));
+    }
+}
+
+static Message *encode(Object *value) {
+    Message *message = malloc(sizeof(Message));
+    message->type = value->type;
+
+    switch (value->type) {
+        case NUMBER_OBJ:
+            message->as.number = value->as.number.value;
+            break;
+        case BOOLEAN_OBJ:
+            message->as.boolean = value->as.boolean.value;
+            break;
+        case STRING_OBJ: {
+            int length = value->as.string.length;
+            int capacity = value->as.string.capacity;
+            message->as.string.length = length;
+            message->as.string.shared = capacity == STRING_SHARED || capacity == STRING_BORROWED;
+            if (message->as.string.shared) {
+                message->as.string.chars = value->as.string.data.chars;
+            } else {
+                message->as.string.chars = malloc(length > 0 ? length : 1);
+                memcpy(message->as.string.chars, stringChars(value), length);
+            }
+            break;
+        }
+        case RANGE_OBJ:
+            message->as.range.type = value->as.range.type;
+            message->as.range.start = value->as.range.start;
+            message->as.range.end = value->as.range.end;
+            break;
+        case CHANNEL_OBJ:
+            message->as.channel = value->as.channel.channel;
+            break;
+        case ARRAY_OBJ: {
+            int count = value->as.array.size;
+            message->as.list.count = count;
+            message->as.list.items = NULL;
+            message->as.list.numbers = NULL;
+            if (value->as.array.kind == NUMBER_ARRAY) {
+                message->as.list.numbers = malloc((count > 0 ? count : 1) * sizeof(double));
+                memcpy(message->as.list.numbers, value->as.array.items.numbers, count * sizeof(double));
+            } else {
+                message->as.list.items = malloc((count > 0 ? count : 1) * sizeof(Message *));
+                for(int i = 0; i < count; i++) {
+                    message->as.list.items[i] = encode(value->as.array.items.values[i]);
+                }
+            }
+            break;
+        }
+        case HASH_OBJ: {
+            HashMap *map = value->as.hash.map;
+            message->as.list.count = 0;
+            message->as.list.numbers = NULL;
+            message->as.list.items = malloc((map->size > 0 ? 2 * map->size : 1) * sizeof(Message *));
+            for(long i = 0; i < map->entryCount; i++) {
+                if (map->entries[i].key != NULL) {
+                    message->as.list.items[message->as.list.count++] = encode(map->entries[i].key);
+                    message->as.list.items[message->as.list.count++] = encode(map->entries[i].value);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return message;
+}
+
+static Message *encodeValue(Interpreter *interp, int line, Object *value) {
+    checkSendable(interp, line, value);
+    return encode(value);
+}
+
+static Object *decode(Heap *heap, Message *message) {
+    Object *object;
+
+    switch (message->type) {
+        case STRING_OBJ:
+            if (!message->as.string.shared) {
+                return newString(heap, message->as.string.chars, message->as.string.length);
+            }
+            object = initObject(heap, STRING_OBJ);
+            object->as.string.length = message->as.string.length;
+            object->as.string.capacity = STRING_SHARED;
+            object->as.string.hash = 0;
+            object->as.string.frozen = false;
+            object->as.string.data.chars = message->as.string.chars;
+            return object;
+        case ARRAY_OBJ: {
+            int count = message->as.list.count;
+            if (message->as.list.numbers != NULL) {
+                object = newArray(heap, NUMBER_ARRAY, count);
+                memcpy(object->as.array.items.numbers, message->as.list.numbers, count * sizeof(double));
+                object->as.array.size = count;
+                return object;
+            }
+            object = newArray(heap, VALUE_ARRAY, count);
+            for(int i = 0; i < count; i++) {
+                arrayPush(heap, object, decode(heap, message->as.list.items[i]));
+            }
+            return object;
+        }
+        case HASH_OBJ:
+            object = initObject(heap, HASH_OBJ);
+            object->as.hash.map = newHashMap(heap);
+            for(int i = 0; i < message->as.list.count; i += 2) {
+                Object *key = decode(heap, message->as.list.items[i]);
+                hashMapSet(object->as.hash.map, key, decode(heap, message->as.list.items[i + 1]));
+            }
+            return object;
+        default:
+            break;
+    }
+
+    object = initObject(heap, message->type);
+    switch (message->type) {
+        case NUMBER_OBJ:
+            object->as.number.value = message->as.number;
+            break;
+        case BOOLEAN_OBJ:
+            object->as.boolean.value = message->as.boolean;
+            break;
+        case RANGE_OBJ:
+            object->as.range.type = message->as.range.type;
+            object->as.range.start = message->as.range.start;
+            object->as.range.end = message->as.range.end;
+            break;
+        case CHANNEL_OBJ:
+            object->as.channel.channel = message->as.channel;
+            break;
+        default:
+            break;
+    }
+    return object;
+}
+
+static void freeMessage(Message *message) {
+    if (message == NULL) {
+        return;
+    }
+
+    switch (message->type) {
+        case STRING_OBJ:
+            if (!message->as.string.shared) {
+                free(message->as.string.chars);
+            }
+            break;
+        case ARRAY_OBJ:
+        case HASH_OBJ:
+            if (message->as.list.items != NULL) {
+                for(int i = 0; i < message->as.list.count; i++) {
+                    freeMessage(message->as.list.items[i]);
+                }
+            }
+            free(message->as.list.items);
+            free(message->as.list.numbers);
+            break;
+        default:
+            break;
+    }
+    free(message);
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Channels
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+// Made by the first channel or isolate of an interpreter, which owns it.
+static IsolateGroup *groupOf(Interpreter *interp, int line, const char *what) {
+    if (interp->parallelWorker) {
+        runtimeError(interp, line, "can't %s inside a parallel for", what);
+    }
+
+    if (interp->isolates == NULL) {
+        IsolateGroup *group = malloc(sizeof(IsolateGroup));
+        pthread_mutex_init(&group->lock, NULL);
+        group->channels = malloc(sizeof(ChannelArray));
+        INIT_ARRAY(group->channels, ChannelArray);
+        group->isolates = malloc(sizeof(IsolateArray));
+        INIT_ARRAY(group->isolates, IsolateArray);
+        interp->isolates = group;
+        interp->ownsIsolates = true;
+    }
+    return interp->isolates;
+}
+
+Object *newChannel(Interpreter *interp, Expr *exp) {
+    IsolateGroup *group = groupOf(interp, exp->line, "make a channel");
+
+    Channel *channel = malloc(sizeof(Channel));
+    pthread_mutex_init(&channel->lock, NULL);
+    pthread_cond_init(&channel->ready, NULL);
+    channel->queue = NULL;
+    channel->head = 0;
+    channel->count = 0;
+    channel->capacity = 0;
+    channel->closed = false;
+
+    pthread_mutex_lock(&group->lock);
+    ADD_ARRAY_ELEMENT(group->channels, channel, Channel);
+    pthread_mutex_unlock(&group->lock);
+
+    Object *object = initObject(&interp->heap, CHANNEL_OBJ);
+    object->as.channel.channel = channel;
+    return object;
+}
+
+// Called with the channel locked.
+static void enqueue(Channel *channel, Message *message) {
+    if (channel->count == channel->capacity) {
+        long capacity = channel->capacity < 8 ? 8 : 2 * channel->capacity;
+        Message **queue = malloc(capacity * sizeof(Message *));
+        for(long i = 0; i < channel->count; i++) {
+            queue[i] = channel->queue[(channel->head + i) % channel->capacity];
+        }
+        free(channel->queue);
+        channel->queue = queue;
+        channel->head = 0;
+        channel->capacity = capacity;
+    }
+    channel->queue[(channel->head + channel->count) % channel->capacity] = message;
+    channel->count++;
+}
+
+void channelSend(Interpreter *interp, Expr *exp, Channel *channel, Object *value) {
+    Message *message = encodeValue(interp, exp->line, value);
+
+    pthread_mutex_lock(&channel->lock);
+    bool closed = channel->closed;
+    if (!closed) {
+        enqueue(channel, message);
+        pthread_cond_signal(&channel->ready);
+    }
+    pthread_mutex_unlock(&channel->lock);
+
+    if (closed) {
+        freeMessage(message);
+        runtimeError(interp, exp->line, "can't send to a closed channel");
+    }
+}
+
+// nil once the channel is closed and every value in it was received.
+Object *channelReceive(Interpreter *interp, Channel *channel) {
+    pthread_mutex_lock(&channel->lock);
+    while (channel->count == 0 && !channel->closed) {
+        pthread_cond_wait(&channel->ready, &channel->lock);
+    }
+    Message *message = NULL;
+    if (channel->count > 0) {
+        message = channel->queue[channel->head];
+        channel->head = (channel->head + 1) % channel->capacity;
+        channel->count--;
+    }
+    pthread_mutex_unlock(&channel->lock);
+
+    if (message == NULL) {
+        return initObject(&interp->heap, NIL_OBJECT);
+    }
+    Object *value = decode(&interp->heap, message);
+    freeMessage(message);
+    return value;
+}
+
+void channelClose(Channel *channel) {
+    pthread_mutex_lock(&channel->lock);
+    channel->closed = true;
+    pthread_cond_broadcast(&channel->ready);
+    pthread_mutex_unlock(&channel->lock);
+}
+
+static void freeChannel(Channel *channel) {
+    for(long i = 0; i < channel->count; i++) {
+        freeMessage(channel->queue[(channel->head + i) % channel->capacity]);
+    }
+    free(channel->queue);
+    pthread_mutex_destroy(&channel->lock);
+    pthread_cond_destroy(&channel->ready);
+    free(channel);
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Isolates
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+// Methods are the only globals an isolate starts with. Their bodies stay
+// in the programs of the interpreter that owns the group.
+static void copyMethods(Interpreter *from, Interpreter *to) {
+    HashTable *globals = from->globals;
+    for(int i = 0; i < globals->num_bins; i++) {
+        for(HashTableEntry *entry = globals->bins[i]; entry != NULL; entry = entry->next) {
+            if (entry->value->type != METHOD_OBJ) {
+                continue;
+            }
+            Object *method = initObject(&to->heap, METHOD_OBJ);
+            method->as.method = entry->value->as.method;
+            insertEntry(to->globals, entry->key, entry->keyLength, method);
+        }
+    }
+}
+
+static void *isolateMain(void *argument) {
+    Isolate *isolate = argument;
+    Interpreter *interp = isolate->interp;
+    jmp_buf errorJump;
+
+    initStackLimit(interp);
+    interp->errorJump = &errorJump;
+    // Reported right away like Ruby's threads do, whoever waits on a
+    // channel the isolate was going to send to would never know.
+    if (setjmp(errorJump) != 0) {
+        isolate->failed = true;
+        fflush(interp->out);
+        fprintf(stderr, "isolate terminated with %s\n", interp->error);
+        return takeStats();
+    }
+
+    Object *arguments[isolate->argumentCount + 1];
+    for(int i = 0; i < isolate->argumentCount; i++) {
+        arguments[i] = decode(&interp->heap, isolate->arguments[i]);
+    }
+    Object *result = callMethod(interp, isolate->method, arguments);
+    isolate->result = encodeValue(interp, isolate->line, result);
+    fflush(interp->out);
+    // Counted by whoever joins it.
+    return takeStats();
+}
+
+// spawn("name", arguments...)
+Object *spawnIsolate(Interpreter *interp, Expr *exp, Object **arguments, int count) {
+    IsolateGroup *group = groupOf(interp, exp->line, "spawn");
+    if (count < 1 || arguments[0]->type != STRING_OBJ) {
+        runtimeError(interp, exp->line, "spawn needs the name of a method");
+    }
+
+    Object *name = arguments[0];
+    Object *method = getEntry(stringChars(name), name->as.string.length, interp->globals);
+    if (method == NULL || method->type != METHOD_OBJ) {
+        runtimeError(interp, exp->line, "undefined method '%.*s'", name->as.string.length, stringChars(name));
+    }
+    int expected = method->as.method.arguments->size;
+    if (count - 1 != expected) {
+        runtimeError(interp, exp->line, "wrong number of arguments for '%.*s' (given %d, expected %d)",
+            name->as.string.length, stringChars(name), count - 1, expected);
+    }
+    for(int i = 1; i < count; i++) {
+        checkSendable(interp, exp->line, arguments[i]);
+    }
+
+    Isolate *isolate = malloc(sizeof(Isolate));
+    isolate->line = exp->line;
+    isolate->argumentCount = count - 1;
+    isolate->arguments = malloc(count * sizeof(Message *));
+    for(int i = 1; i < count; i++) {
+        isolate->arguments[i - 1] = encode(arguments[i]);
+    }
+    isolate->result = NULL;
+    isolate->failed = false;
+    isolate->joined = false;
+    isolate->error[0] = '\0';
+
+    Interpreter *child = newInterpreter();
+    child->out = interp->out;
+    child->threads = interp->threads;
+    child->stackBudget = interp->stackBudget;
+    child->heap.quota = interp->heap.quota;
+    if (interp->heap.collector != NULL) {
+        enableCollector(child, interp->heap.collector->pauseBudget);
+    }
+    child->isolates = group;
+    copyMethods(interp, child);
+    isolate->interp = child;
+    isolate->method = getEntry(stringChars(name), name->as.string.length, child->globals);
+
+    pthread_mutex_lock(&group->lock);
+    ADD_ARRAY_ELEMENT(group->isolates, isolate, Isolate);
+    pthread_mutex_unlock(&group->lock);
+    pthread_create(&isolate->thread, NULL, isolateMain, isolate);
+
+    Object *object = initObject(&interp->heap, ISOLATE_OBJ);
+    object->as.isolate.isolate = isolate;
+    return object;
+}
+
+static void joinIsolate(Isolate *isolate) {
+    if (isolate->joined) {
+        return;
+    }
+
+    Stats *counted;
+    pthread_join(isolate->thread, (void **)&counted);
+    addStats(&stats, counted);
+    free(counted);
+    isolate->joined = true;
+    memcpy(isolate->error, isolate->interp->error, ERROR_MESSAGE_SIZE);
+    freeInterpreter(isolate->interp);
+    isolate->interp = NULL;
+}
+
+// What the method returned, the first call waits for it.
+Object *isolateValue(Interpreter *interp, Expr *exp, Isolate *isolate) {
+    joinIsolate(isolate);
+    if (isolate->failed) {
+        memcpy(interp->error, isolate->error, ERROR_MESSAGE_SIZE);
+        raiseError(interp);
+    }
+    return decode(&interp->heap, isolate->result);
+}
+
+// Closing every channel first lets isolates still waiting on one finish.
+void freeIsolateGroup(Interpreter *interp) {
+    IsolateGroup *group = interp->isolates;
+    if (group == NULL || !interp->ownsIsolates) {
+        return;
+    }
+
+    // Isolates can still be making channels and spawning others, the
+    // lists are read again every time.
+    int closed = 0;
+    for(int i = 0; ; i++) {
+        pthread_mutex_lock(&group->lock);
+        for(; closed < group->channels->size; closed++) {
+            channelClose(group->channels->list[closed]);
+        }
+        Isolate *isolate = i < group->isolates->size ? group->isolates->list[i] : NULL;
+        pthread_mutex_unlock(&group->lock);
+        if (isolate == NULL) {
+            break;
+        }
+        joinIsolate(isolate);
+    }
+
+    for(int i = 0; i < group->isolates->size; i++) {
+        Isolate *isolate = group->isolates->list[i];
+        for(int j = 0; j < isolate->argumentCount; j++) {
+            freeMessage(isolate->arguments[j]);
+        }
+        free(isolate->arguments);
+        freeMessage(isolate->result);
+        free(isolate);
+    }
+    for(int i = 0; i < group->channels->size; i++) {
+        freeChannel(group->channels->list[i]);
+    }
+    free(group->isolates->list);
+    free(group->isolates);
+    free(group->channels->list);
+    free(group->channels);
+    pthread_mutex_destroy(&group->lock);
+    free(group);
+    interp->isolates = NULL;
+}
@@ -0,0 +1,116 @@
+//
+//  isolate.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-04-04.
+//
+
+#ifndef isolate_h
+#define isolate_h
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "interpreter.h"
+
+/*
+  spawn("name", arguments...) runs a method on a thread of its own, in an
+  isolate: an interpreter with its own heap and globals that only starts
+  out with the spawner's methods. Nothing else is shared, so isolates run
+  without any lock between them. channel() makes a Channel, the only way
+  values go from one isolate to another: send(value), receive, which
+  blocks until there is a value or the channel is closed, and close.
+
+  A value sent is copied into a Message outside of any heap and copied
+  again into the heap of whoever receives it, so the two never share an
+  object. Numbers, booleans, nil and ranges travel inside the message,
+  literal strings only by their characters, which live as long as the
+  program, and channels by reference, none of those is copied. Methods,
+  enumerators and isolates can't be sent.
+
+  isolate.value waits for the method to return and gives back a copy of
+  what it returned, or raises the error it failed with. Channels and
+  isolates belong to the interpreter that started the first of them,
+  which waits for every isolate before it goes away.
+*/
+typedef struct Message {
+    ObjectType type;
+    union {
+        double number;
+        bool boolean;
+        struct {
+            char *chars;
+            int length;
+            // The characters of a literal, not the message's.
+            bool shared;
+        } string;
+        struct {
+            char *type;
+            double start;
+            double end;
+        } range;
+        // Arrays, and hashes as key, value, key...
+        struct {
+            struct Message **items;
+            double *numbers;
+            int count;
+        } list;
+        struct Channel *channel;
+    } as;
+} Message;
+
+typedef struct Channel {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    // Ring buffer of messages not received yet.
+    Message **queue;
+    long head;
+    long count;
+    long capacity;
+    bool closed;
+} Channel;
+
+typedef struct Isolate {
+    pthread_t thread;
+    Interpreter *interp;
+    Object *method;
+    Message **arguments;
+    int argumentCount;
+    // Of the spawn.
+    int line;
+
+    Message *result;
+    bool failed;
+    bool joined;
+    char error[ERROR_MESSAGE_SIZE];
+} Isolate;
+
+typedef struct ChannelArray {
+    Channel **list;
+    int size;
+    int capacity;
+} ChannelArray;
+
+typedef struct IsolateArray {
+    Isolate **list;
+    int size;
+    int capacity;
+} IsolateArray;
+
+// Shared by an interpreter and every isolate spawned from it.
+typedef struct IsolateGroup {
+    pthread_mutex_t lock;
+    ChannelArray *channels;
+    IsolateArray *isolates;
+} IsolateGroup;
+
+Object *newChannel(Interpreter *interp, Expr *exp);
+void channelSend(Interpreter *interp, Expr *exp, Channel *channel, Object *value);
+Object *channelReceive(Interpreter *interp, Channel *channel);
+void channelClose(Channel *channel);
+
+Object *spawnIsolate(Interpreter *interp, Expr *exp, Object **arguments, int count);
+Object *isolateValue(Interpreter *interp, Expr *exp, Isolate *isolate);
+void freeIsolateGroup(Interpreter *interp);
+
+#endif /* isolate_h */
@@ -7,12 +7,24 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "scanner.h"
 #include "token.h"
 #include "parser.h"
 #include "interpreter.h"
 #include "file.h"
 #include "hash_table.h"
+#include "stats.h"
+#include "ast_cache.h"
+#include "server.h"
+#include "type_inference.h"
+#include "inliner.h"
+#include "segmented_stack.h"
+#include "gc.h"
+#include "scheduler.h"
+#include "stream.h"
 
 /*
   Feature list:
@@ -36,29 +48,253 @@
     - ">" "<" ">=" "<=" "==" "!="
   - control flow (if, for, while)
   - functions
-  - closures (blocks)
+  - [x] closures (blocks)
   Stage 3:
-  - arrays
-  - hashes
+  - [x] arrays
+  - [x] hashes
   - classes (optional)
 */
+// Every script on an interpreter of its own, all of them as fibers over
+// `threads` threads.
+static int runFibers(char **paths, int count, int threads, long stackBudget, size_t heapQuota,
+                     bool collect, long pauseBudget, bool lazyDefs) {
+    Scheduler *scheduler = newScheduler(threads);
+    Interpreter *interps[count];
+    bool failed = false;
+
+    for(int i = 0; i < count; i++) {
+        interps[i] = NULL;
+        char *buffer = readFile(paths[i]);
+        if (buffer == NULL) {
+            fprintf(stderr, "ros_xcode: can't read %s\n", paths[i]);
+            failed = true;
+            continue;
+        }
+
+        Interpreter *interp = newInterpreter();
+        interp->threads = threads;
+        interp->stackBudget = stackBudget;
+        interp->heap.quota = heapQuota;
+        interp->lazyDefs = lazyDefs;
+        if (collect) {
+            enableCollector(interp, pauseBudget);
+        }
+        interps[i] = interp;
+
+        StmtArray *statements = parseProgram(interp, buffer);
+        if (statements == NULL) {
+            fprintf(stderr, "ros_xcode: %s: %s\n", paths[i], interp->error);
+            failed = true;
+            continue;
+        }
+        spawnFiber(scheduler, interp, statements, paths[i]);
+    }
+
+    runScheduler(scheduler);
+
+    for(int i = 0; i < scheduler->fibers->size; i++) {
+        Fiber *fiber = scheduler->fibers->list[i];
+        if (!fiber->ok) {
+            fprintf(stderr, "ros_xcode: %s: %s\n", fiber->name, fiber->interp->error);
+            failed = true;
+        }
+    }
+    if (stats.enabled) {
+        fflush(stdout);
+        printFiberStats(stderr, scheduler);
+    }
+
+    freeScheduler(scheduler);
+    for(int i = 0; i < count; i++) {
+        if (interps[i] != NULL) {
+            freeInterpreter(interps[i]);
+        }
+    }
+    return failed ? 1 : 0;
+}
+
+// Runs the script as it is read, "-" reads it from stdin.
+static int runStreamed(char *path, int threads, long stackBudget, size_t heapQuota,
+                       bool collect, long pauseBudget, bool lazyDefs) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ros_xcode: can't read %s\n", path);
+        return 1;
+    }
+
+    Interpreter *interp = newInterpreter();
+    interp->threads = threads;
+    interp->stackBudget = stackBudget;
+    interp->heap.quota = heapQuota;
+    interp->lazyDefs = lazyDefs;
+    if (collect) {
+        enableCollector(interp, pauseBudget);
+    }
+
+    bool ok = runStream(interp, fd);
+    if (!ok) {
+        fprintf(stderr, "ros_xcode: %s\n", interp->error);
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+
+    if (stats.enabled) {
+        fflush(stdout);
+        printStats(stderr, &interp->heap);
+    }
+    freeInterpreter(interp);
+    return ok ? 0 : 1;
+}
+
 int main(int argc, char *argv[]) {
+    char *path = NULL;
+    bool useCache = false;
+    bool explain = false;
+    bool inlineReport = false;
+    char *socketPath = NULL;
+    int workers = DEFAULT_WORKERS;
+    int threads = 0;
+    long stackBudget = DEFAULT_STACK_BUDGET;
+    bool collect = false;
+    long pauseBudget = GC_DEFAULT_PAUSE;
+    size_t heapQuota = 0;
+    bool fibers = false;
+    bool streamed = false;
+    bool lazyDefs = false;
+    char *paths[argc];
+    int pathCount = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            stats.enabled = true;
+        } else if (strcmp(argv[i], "--explain-types") == 0) {
+            explain = true;
+        } else if (strcmp(argv[i], "--inline-report") == 0) {
+            inlineReport = true;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            useCache = true;
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            bool hasPath = i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0;
+            socketPath = hasPath ? argv[++i] : DEFAULT_SOCKET_PATH;
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fibers") == 0) {
+            fibers = true;
+        } else if (strcmp(argv[i], "--lazy-defs") == 0) {
+            lazyDefs = true;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            streamed = true;
+        } else if (strcmp(argv[i], "--gc") == 0) {
+            collect = true;
+        } else if (strcmp(argv[i], "--gc-pause") == 0 && i + 1 < argc) {
+            pauseBudget = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--heap-quota") == 0 && i + 1 < argc) {
+            heapQuota = (size_t)atol(argv[++i]) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--stack-budget") == 0 && i + 1 < argc) {
+            stackBudget = atol(argv[++i]) * 1024 * 1024;
+        } else {
+            path = argv[i];
+            paths[pathCount++] = argv[i];
+        }
+    }
+
+    if (socketPath != NULL) {
+        return serve(socketPath, workers > 0 ? workers : DEFAULT_WORKERS);
+    }
+
+    if (fibers && pathCount > 0) {
+        return runFibers(paths, pathCount, threads, stackBudget, heapQuota, collect, pauseBudget, lazyDefs);
+    }
+
+    if (streamed && path != NULL) {
+        return runStreamed(path, threads, stackBudget, heapQuota, collect, pauseBudget, lazyDefs);
+    }
+
+    if (path == NULL) {
+        printf("usage: ros_xcode [--stats] [--cache] [--threads n] [--stack-budget mb] [--heap-quota mb] [--gc] [--gc-pause us] [--lazy-defs] [--explain-types] [--inline-report] script.rb\n");
+        printf("       ros_xcode --stream [--stats] [--threads n] [--heap-quota mb] [--gc] script.rb|-\n");
+        printf("       ros_xcode --fibers [--threads n] [--stats] script.rb...\n");
+        printf("       ros_xcode --serve [socket] [--workers n]\n");
+        return 1;
+    }
+
     // Prep
-    char *buffer = readFile(argv[1]);
-    Scanner scanner;
-    
+    double start = currentTime();
+    char *buffer = readFile(path);
+    stats.readFileTime = currentTime() - start;
+    if (buffer == NULL) {
+        fprintf(stderr, "ros_xcode: can't read %s\n", path);
+        return 1;
+    }
+
+    Interpreter *interp = newInterpreter();
+    interp->threads = threads;
+    interp->stackBudget = stackBudget;
+    interp->heap.quota = heapQuota;
+    // The cache keeps whole trees, a skimmed body has none to keep.
+    interp->lazyDefs = lazyDefs && !useCache;
+    if (collect) {
+        enableCollector(interp, pauseBudget);
+    }
+    StmtArray *statements = NULL;
+    char *cachePath = NULL;
+
+    // A cache hit skips scanning and parsing entirely.
+    if (useCache) {
+        cachePath = astCachePath(path);
+        start = currentTime();
+        long astBytes = stats.astBytes;
+        statements = loadAstCache(cachePath, buffer);
+        stats.cacheLoadTime = currentTime() - start;
+        stats.cacheHit = statements != NULL;
+        if (statements != NULL) {
+            adoptProgram(interp, buffer, statements, stats.astBytes - astBytes);
+        }
+    }
+
+    if (statements == NULL) {
+        start = currentTime();
+        statements = parseProgram(interp, buffer);
+        // parse() pulls tokens from the scanner as it goes, so scanning
+        // time has to be taken out of it.
+        stats.parseTime = currentTime() - start - stats.scanTime;
+
+        if (statements == NULL) {
+            fprintf(stderr, "ros_xcode: %s\n", interp->error);
+            return 1;
+        }
+
+        if (useCache) {
+            writeAstCache(cachePath, buffer, statements);
+        }
+    }
+    free(cachePath);
+
+    if (explain) {
+        explainTypes(stderr, statements);
+    }
+    if (inlineReport) {
+        reportInlining(stderr, statements);
+    }
+
     // Interpret program
-    initScanner(&scanner, buffer);
-    StmtArray *statements = parse(&scanner);
-    HashTable *globalEnv = initHashTable();
-    interpret(statements, globalEnv);
-
-    // Free all objects
-    // Todo need to free the hash tables and its related
-    // value objects
-    freeStatements(statements);
-    free(statements->list);
-    free(buffer);
-
-    return 0;
+    start = currentTime();
+    bool ok = runProgram(interp, statements);
+    stats.interpretTime = currentTime() - start;
+
+    if (!ok) {
+        fprintf(stderr, "ros_xcode: %s\n", interp->error);
+    }
+
+    if (stats.enabled) {
+        fflush(stdout);
+        printStats(stderr, &interp->heap);
+    }
+
+    freeInterpreter(interp);
+
+    return ok ? 0 : 1;
 }
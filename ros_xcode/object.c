@@ -7,11 +7,101 @@
 
 #include <stdio.h>
 #include "object.h"
+#include "stats.h"
+#include "heap.h"
+#include "string_object.h"
 
-Object *initObject(ObjectType type) {
-    Object *object = malloc(sizeof(Object));
+Object *initObject(Heap *heap, ObjectType type) {
+    Object *object = heapAllocate(heap, sizeof(Object), HEAP_OBJECT);
     object->type = type;
-    
+    stats.objects++;
+    stats.objectBytes += sizeof(Object);
+
     return object;
 }
 
+// Name used in error messages.
+const char *objectTypeName(ObjectType type) {
+    switch (type) {
+        case NUMBER_OBJ:
+            return "Number";
+        case STRING_OBJ:
+            return "String";
+        case BOOLEAN_OBJ:
+            return "Boolean";
+        case RANGE_OBJ:
+            return "Range";
+        case METHOD_OBJ:
+            return "Method";
+        case NIL_OBJECT:
+            return "nil";
+        case ARRAY_OBJ:
+            return "Array";
+        case HASH_OBJ:
+            return "Hash";
+        case ENUMERATOR_OBJ:
+            return "Enumerator::Lazy";
+        case CHANNEL_OBJ:
+            return "Channel";
+        case ISOLATE_OBJ:
+            return "Isolate";
+    }
+
+    return "Object";
+}
+
+static bool arrayElementsEqual(Object *a, Object *b, int i) {
+    if (a->as.array.kind == NUMBER_ARRAY && b->as.array.kind == NUMBER_ARRAY) {
+        return a->as.array.items.numbers[i] == b->as.array.items.numbers[i];
+    }
+    if (a->as.array.kind == VALUE_ARRAY && b->as.array.kind == VALUE_ARRAY) {
+        return objectsEqual(a->as.array.items.values[i], b->as.array.items.values[i]);
+    }
+
+    if (a->as.array.kind == VALUE_ARRAY) {
+        Object *swap = a;
+        a = b;
+        b = swap;
+    }
+    Object *value = b->as.array.items.values[i];
+    return value->type == NUMBER_OBJ && value->as.number.value == a->as.array.items.numbers[i];
+}
+
+// Value equality for numbers, strings, booleans, nil and arrays of those,
+// identity for everything else.
+bool objectsEqual(Object *a, Object *b) {
+    if (a->type != b->type) {
+        return false;
+    }
+
+    switch (a->type) {
+        case NUMBER_OBJ:
+            return a->as.number.value == b->as.number.value;
+        case STRING_OBJ:
+            return stringEquals(a, b);
+        case BOOLEAN_OBJ:
+            return a->as.boolean.value == b->as.boolean.value;
+        case NIL_OBJECT:
+            return true;
+        case ARRAY_OBJ:
+            if (a->as.array.size != b->as.array.size) {
+                return false;
+            }
+            for (int i = 0; i < a->as.array.size; i++) {
+                if (!arrayElementsEqual(a, b, i)) {
+                    return false;
+                }
+            }
+            return true;
+        default:
+            return a == b;
+    }
+}
+
+// Everything but nil and false.
+bool isTruthy(Object *object) {
+    if (object->type == NIL_OBJECT) {
+        return false;
+    }
+    return object->type != BOOLEAN_OBJ || object->as.boolean.value;
+}
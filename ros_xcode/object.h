@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum ObjectType {
     NUMBER_OBJ,
@@ -18,12 +19,28 @@ typedef enum ObjectType {
     BOOLEAN_OBJ,
     RANGE_OBJ,
     METHOD_OBJ,
-    NIL_OBJECT
+    NIL_OBJECT,
+    ARRAY_OBJ,
+    HASH_OBJ,
+    ENUMERATOR_OBJ,
+    CHANNEL_OBJ,
+    ISOLATE_OBJ
 } ObjectType;
 
+// Arrays holding only numbers keep them unboxed in a double buffer, any
+// other value turns the array into a buffer of objects.
+typedef enum ArrayKind {
+    NUMBER_ARRAY,
+    VALUE_ARRAY
+} ArrayKind;
+
+#define STRING_INLINE_CAPACITY 16
+
 // Forward defintion so that we can also required object
 // from the object file.
 struct HashTable;
+struct Heap;
+struct NumericMethod;
 
 typedef struct Object {
     ObjectType type;
@@ -32,9 +49,16 @@ typedef struct Object {
            double value;
         } number;
 
+        // See string_object.h for where the characters are.
         struct {
             int length;
-            char *value;
+            int capacity;
+            uint32_t hash;
+            bool frozen;
+            union {
+                char *chars;
+                char inlined[STRING_INLINE_CAPACITY];
+            } data;
         } string;
 
         struct {
@@ -52,11 +76,46 @@ typedef struct Object {
             int nameLength;
             struct ExprArray *arguments;
             struct StmtArray *statements;
-            struct HashTable *env;
+            // Set when type inference proved the def numeric.
+            struct NumericMethod *numeric;
+            // The def while its body may not be parsed yet, see
+            // parseLazyMethod().
+            struct Stmt *lazy;
         } method;
+
+        struct {
+            ArrayKind kind;
+            int size;
+            int capacity;
+            union {
+                double *numbers;
+                struct Object **values;
+            } items;
+        } array;
+
+        struct {
+            struct HashMap *map;
+        } hash;
+
+        // See enumerator.h.
+        struct {
+            struct Enumerator *enumerator;
+        } enumerator;
+
+        // See isolate.h.
+        struct {
+            struct Channel *channel;
+        } channel;
+
+        struct {
+            struct Isolate *isolate;
+        } isolate;
     } as;
 } Object;
 
-Object *initObject(ObjectType type);
+Object *initObject(struct Heap *heap, ObjectType type);
+const char *objectTypeName(ObjectType type);
+bool objectsEqual(Object *a, Object *b);
+bool isTruthy(Object *object);
 
 #endif /* object_h */
@@ -0,0 +1,253 @@
+//
+//  parallel.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-11.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "parallel.h"
+#include "thread_pool.h"
+#include "segmented_stack.h"
+#include "gc.h"
+#include "stats.h"
+
+typedef struct ParallelWorker {
+    Interpreter interp;
+    HashTable *env;
+    bool started;
+    // Counters of the thread the worker runs on.
+    Stats *stats;
+} ParallelWorker;
+
+typedef struct ParallelLoop {
+    Interpreter *interp;
+    Stmt *stmt;
+    HashTable *env;
+    long start;
+    long count;
+    long chunkSize;
+    double *partials;
+    ParallelWorker *workers;
+
+    // First error raised by any chunk, the rest of the chunks are skipped.
+    bool failed;
+    pthread_mutex_t errorLock;
+    char error[ERROR_MESSAGE_SIZE];
+} ParallelLoop;
+
+static double identity(ReduceOp op) {
+    return op == REDUCE_PRODUCT ? 1 : 0;
+}
+
+static double fold(ReduceOp op, double acc, double value) {
+    switch (op) {
+        case REDUCE_PRODUCT:
+            return acc * value;
+        case REDUCE_SUM:
+        case REDUCE_COUNT:
+            return acc + value;
+        default:
+            return acc;
+    }
+}
+
+static bool truthy(Object *object) {
+    if (object == NULL || object->type == NIL_OBJECT) {
+        return false;
+    }
+    return object->type != BOOLEAN_OBJ || object->as.boolean.value;
+}
+
+// Value an iteration contributes to the reduction.
+static double contribution(Interpreter *interp, Stmt *stmt, Object *result) {
+    ReduceOp op = stmt->as.forStmt.reduceOp;
+    if (op == REDUCE_COUNT) {
+        return truthy(result) ? 1 : 0;
+    }
+    if (result == NULL || result->type != NUMBER_OBJ) {
+        runtimeError(interp, stmt->line, "reduce(%s) needs the loop body to end in a number",
+                     op == REDUCE_SUM ? "+" : "*");
+    }
+    return result->as.number.value;
+}
+
+static void startWorker(ParallelLoop *loop, ParallelWorker *worker, int id) {
+    // Shares globals, programs and output with the loop's interpreter.
+    worker->interp = *loop->interp;
+    initHeap(&worker->interp.heap);
+    // Each worker may use what the loop's interpreter has left.
+    Heap *heap = &loop->interp->heap;
+    if (heap->quota > 0) {
+        worker->interp.heap.quota = heap->live < heap->quota ? heap->quota - heap->live : 1;
+    }
+    worker->interp.heap.owner = &worker->interp;
+    worker->interp.pool = NULL;
+    worker->interp.parallelWorker = true;
+    // Workers can't yield, the loop's fiber waits for all of them.
+    worker->interp.fiber = NULL;
+    // Worker 0 runs on the loop's own thread and stack.
+    worker->interp.segments = NULL;
+    if (id != 0) {
+        initStackLimit(&worker->interp);
+    }
+
+    worker->env = NULL;
+    worker->started = true;
+    worker->stats = &stats;
+}
+
+// What the iteration about to run assigns to. A body that assigned
+// anything besides the loop variable gets a new one, so nothing carries
+// over from the iterations the worker ran before.
+static HashTable *iterationEnv(ParallelLoop *loop, ParallelWorker *worker) {
+    if (worker->env == NULL || worker->env->num_entries > 1) {
+        worker->env = initHashTable(&worker->interp.heap);
+        worker->env->parent = loop->env;
+    }
+    return worker->env;
+}
+
+static void recordError(ParallelLoop *loop, const char *error) {
+    pthread_mutex_lock(&loop->errorLock);
+    if (!loop->failed) {
+        strncpy(loop->error, error, ERROR_MESSAGE_SIZE - 1);
+        loop->error[ERROR_MESSAGE_SIZE - 1] = '\0';
+        __atomic_store_n(&loop->failed, true, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&loop->errorLock);
+}
+
+static void runChunk(void *context, int id, long chunk) {
+    ParallelLoop *loop = context;
+    if (__atomic_load_n(&loop->failed, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    ParallelWorker *worker = &loop->workers[id];
+    if (!worker->started) {
+        startWorker(loop, worker, id);
+    }
+
+    Stmt *stmt = loop->stmt;
+    char *name = stmt->as.forStmt.identifier->as.identifierExp.string;
+    int length = stmt->as.forStmt.identifier->as.identifierExp.length;
+    StmtArray *body = stmt->as.forStmt.statements;
+    ReduceOp op = stmt->as.forStmt.reduceOp;
+
+    jmp_buf errorJump;
+    worker->interp.errorJump = &errorJump;
+    if (setjmp(errorJump) != 0) {
+        recordError(loop, worker->interp.error);
+        return;
+    }
+
+    long from = chunk * loop->chunkSize;
+    long to = from + loop->chunkSize < loop->count ? from + loop->chunkSize : loop->count;
+    double partial = identity(op);
+    for (long i = from; i < to; i++) {
+        // A new one every time, the body can keep the one it was given.
+        Object *index = initObject(&worker->interp.heap, NUMBER_OBJ);
+        index->as.number.value = loop->start + i;
+        HashTable *env = iterationEnv(loop, worker);
+        insertEntry(env, name, length, index);
+
+        Object *result = NULL;
+        for (int j = 0; j < body->size; j++) {
+            result = execute(&worker->interp, body->list[j], env);
+        }
+        if (op != REDUCE_NONE) {
+            partial = fold(op, partial, contribution(&worker->interp, stmt, result));
+        }
+    }
+    loop->partials[chunk] = partial;
+}
+
+Object *visitParallelFor(Interpreter *interp, Stmt *stmt, HashTable *env) {
+    Object *range = forRange(interp, stmt, env);
+    double end = strcmp(range->as.range.type, "inclusive") == 0 ? range->as.range.end + 1 : range->as.range.end;
+
+    ParallelLoop loop;
+    loop.interp = interp;
+    loop.stmt = stmt;
+    loop.env = env;
+    loop.start = range->as.range.start;
+    loop.count = end > loop.start ? (long)end - loop.start : 0;
+    loop.failed = false;
+    loop.error[0] = '\0';
+    pthread_mutex_init(&loop.errorLock, NULL);
+
+    long chunks = loop.count < PARALLEL_MAX_CHUNKS ? loop.count : PARALLEL_MAX_CHUNKS;
+    loop.chunkSize = chunks > 0 ? (loop.count + chunks - 1) / chunks : 0;
+    chunks = chunks > 0 ? (loop.count + loop.chunkSize - 1) / loop.chunkSize : 0;
+    loop.partials = malloc(sizeof(double) * (chunks > 0 ? chunks : 1));
+
+    // A parallel loop nested in another one runs on the worker it is on.
+    int size = 1;
+    if (!interp->parallelWorker) {
+        if (interp->pool == NULL) {
+            interp->pool = newThreadPool(interp->threads > 0 ? interp->threads : defaultPoolSize());
+        }
+        size = interp->pool->size;
+    }
+    loop.workers = calloc(size, sizeof(ParallelWorker));
+    finishMarking(&interp->heap);
+
+    if (size == 1) {
+        for (long chunk = 0; chunk < chunks; chunk++) {
+            runChunk(&loop, 0, chunk);
+        }
+    } else {
+        runChunks(interp->pool, chunks, runChunk, &loop);
+    }
+
+    // Anything the body allocated now belongs to the loop's interpreter,
+    // and whatever the other threads counted is counted here.
+    for (int i = 0; i < size; i++) {
+        ParallelWorker *worker = &loop.workers[i];
+        if (worker->started) {
+            mergeHeap(&interp->heap, &worker->interp.heap);
+            freeSegmentStack(&worker->interp);
+        }
+        if (worker->started && worker->stats != &stats) {
+            addStats(&stats, worker->stats);
+            memset(worker->stats, 0, sizeof(Stats));
+        }
+    }
+    free(loop.workers);
+    pthread_mutex_destroy(&loop.errorLock);
+
+    if (loop.failed) {
+        free(loop.partials);
+        memcpy(interp->error, loop.error, ERROR_MESSAGE_SIZE);
+        raiseError(interp);
+    }
+
+    ReduceOp op = stmt->as.forStmt.reduceOp;
+    if (op != REDUCE_NONE) {
+        char *name = stmt->as.forStmt.reduceName;
+        int length = stmt->as.forStmt.reduceLength;
+
+        double total = identity(op);
+        Object *current = getEntry(name, length, env);
+        if (current != NULL) {
+            if (current->type != NUMBER_OBJ) {
+                free(loop.partials);
+                runtimeError(interp, stmt->line, "can't reduce into '%.*s', it isn't a number", length, name);
+            }
+            total = current->as.number.value;
+        }
+        for (long chunk = 0; chunk < chunks; chunk++) {
+            total = fold(op, total, loop.partials[chunk]);
+        }
+
+        Object *object = initObject(&interp->heap, NUMBER_OBJ);
+        object->as.number.value = total;
+        insertEntry(env, name, length, object);
+    }
+    free(loop.partials);
+
+    return initObject(&interp->heap, NIL_OBJECT);
+}
@@ -0,0 +1,30 @@
+//
+//  parallel.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-11.
+//
+
+#ifndef parallel_h
+#define parallel_h
+
+#include <stdio.h>
+#include "interpreter.h"
+
+/*
+  `parallel for i in a..b reduce(+, total)` splits the range into a fixed
+  number of chunks and runs them on the thread pool of the interpreter.
+
+  Each worker runs the body against a private copy of the interpreter with
+  its own heap and an environment layered over the one of the loop, so the
+  body can read the surrounding variables but its assignments stay local to
+  the iteration. The only thing that flows back out is the reduction:
+  every chunk folds its iterations in order and the chunk results are then
+  folded in chunk order, which keeps the result independent of how many
+  threads ran the loop.
+*/
+#define PARALLEL_MAX_CHUNKS 1024
+
+Object *visitParallelFor(Interpreter *interp, Stmt *stmt, HashTable *env);
+
+#endif /* parallel_h */
@@ -8,12 +8,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "scanner.h"
 #include "parser.h"
+#include "stats.h"
+#include "string_object.h"
+#include "type_inference.h"
+#include "inliner.h"
 
 
+static void skimBody(Scanner *scanner, Stmt *def);
+
 StmtArray *parse(Scanner *scanner) {
     StmtArray *array = initStmtArray();
+    Scope scope;
+    beginScope(scanner, &scope, NULL);
 
     Stmt *stmt;
     while(!atEnd(scanner)) {
@@ -21,10 +30,19 @@ StmtArray *parse(Scanner *scanner) {
         ADD_ARRAY_ELEMENT(array, stmt, Stmt);
     }
 
+    endScope(scanner, &scope);
+    inferTypes(array);
+    inlineCalls(array);
     return array;
 }
 
+static Stmt *statementOnNewSegment(Scanner *scanner);
+
 Stmt *statement(Scanner *scanner) {
+    if (walkStackLow(&scanner->stack)) {
+        return statementOnNewSegment(scanner);
+    }
+
     if(match(scanner, PUTS)) {
         return parsePuts(scanner);
     }
@@ -40,6 +58,10 @@ Stmt *statement(Scanner *scanner) {
     if (match(scanner, FOR)) {
         return parseFor(scanner);
     }
+
+    if (match(scanner, PARALLEL)) {
+        return parseParallelFor(scanner);
+    }
     
     if (match(scanner, DEF)) {
         return parseDef(scanner);
@@ -50,103 +72,263 @@ Stmt *statement(Scanner *scanner) {
     return stmt;
 }
 
+/*
+  Expressions are parsed by precedence climbing over `rules`, indexed by
+  the type of the token. A rule says what the token does at the start of
+  an expression, what it does after one and how tightly it binds there,
+  so every token is looked up once and an operator is one entry.
+*/
+typedef enum Precedence {
+    PREC_NONE,
+    PREC_ASSIGNMENT,
+    PREC_RANGE,
+    PREC_OR,
+    PREC_AND,
+    PREC_EQUALITY,
+    PREC_COMPARISON,
+    PREC_SHIFT,
+    PREC_TERM,
+    PREC_FACTOR,
+    // -x ** 2 is -(x ** 2)
+    PREC_UNARY,
+    PREC_POWER,
+    PREC_NOT,
+    PREC_CALL
+} Precedence;
+
+typedef enum Associativity {
+    LEFT_ASSOCIATIVE,
+    RIGHT_ASSOCIATIVE,
+    // 1..2..3 is an error, not a range of ranges.
+    NON_ASSOCIATIVE
+} Associativity;
+
+typedef Expr *(*PrefixRule)(Scanner *scanner, Token token);
+typedef Expr *(*InfixRule)(Scanner *scanner, Expr *left, Token token);
+
+typedef struct ParseRule {
+    PrefixRule prefix;
+    InfixRule infix;
+    Precedence precedence;
+    Associativity associativity;
+} ParseRule;
+
+static Expr *numberPrefix(Scanner *scanner, Token token);
+static Expr *stringPrefix(Scanner *scanner, Token token);
+static Expr *interpolationPrefix(Scanner *scanner, Token token);
+static Expr *truePrefix(Scanner *scanner, Token token);
+static Expr *falsePrefix(Scanner *scanner, Token token);
+static Expr *groupingPrefix(Scanner *scanner, Token token);
+static Expr *unaryPrefix(Scanner *scanner, Token token);
+static Expr *binaryInfix(Scanner *scanner, Expr *left, Token token);
+static Expr *logicalInfix(Scanner *scanner, Expr *left, Token token);
+static Expr *rangeInfix(Scanner *scanner, Expr *left, Token token);
+static Expr *assignmentInfix(Scanner *scanner, Expr *left, Token token);
+static Expr *indexInfix(Scanner *scanner, Expr *left, Token token);
+static Expr *invokeInfix(Scanner *scanner, Expr *left, Token token);
+
+static ParseRule rules[] = {
+    [NUMBER]              = {numberPrefix, NULL, PREC_NONE, LEFT_ASSOCIATIVE},
+    [STRING]              = {stringPrefix, NULL, PREC_NONE, LEFT_ASSOCIATIVE},
+    [INTERPOLATED_STRING] = {interpolationPrefix, NULL, PREC_NONE, LEFT_ASSOCIATIVE},
+    [TRUE_TOK]            = {truePrefix, NULL, PREC_NONE, LEFT_ASSOCIATIVE},
+    [FALSE_TOK]           = {falsePrefix, NULL, PREC_NONE, LEFT_ASSOCIATIVE},
+    [IDENTIFIER]          = {handleIdenfierExpression, NULL, PREC_NONE, LEFT_ASSOCIATIVE},
+    [LEFT_BRACE]          = {newHashLiteral, NULL, PREC_NONE, LEFT_ASSOCIATIVE},
+    [LEFT_PAREN]          = {groupingPrefix, NULL, PREC_NONE, LEFT_ASSOCIATIVE},
+    [BANG]                = {unaryPrefix, NULL, PREC_NONE, LEFT_ASSOCIATIVE},
+    [EQUAL]               = {NULL, assignmentInfix, PREC_ASSIGNMENT, RIGHT_ASSOCIATIVE},
+    [INCLUSIVE_RANGE]     = {NULL, rangeInfix, PREC_RANGE, NON_ASSOCIATIVE},
+    [EXCLUSIVE_RANGE]     = {NULL, rangeInfix, PREC_RANGE, NON_ASSOCIATIVE},
+    [PIPE_PIPE]           = {NULL, logicalInfix, PREC_OR, LEFT_ASSOCIATIVE},
+    [AND_AND]             = {NULL, logicalInfix, PREC_AND, LEFT_ASSOCIATIVE},
+    [EQUAL_EQUAL]         = {NULL, binaryInfix, PREC_EQUALITY, LEFT_ASSOCIATIVE},
+    [BANG_EQUAL]          = {NULL, binaryInfix, PREC_EQUALITY, LEFT_ASSOCIATIVE},
+    [GREATER]             = {NULL, binaryInfix, PREC_COMPARISON, LEFT_ASSOCIATIVE},
+    [GREATER_EQUAL]       = {NULL, binaryInfix, PREC_COMPARISON, LEFT_ASSOCIATIVE},
+    [LESS]                = {NULL, binaryInfix, PREC_COMPARISON, LEFT_ASSOCIATIVE},
+    [LESS_EQUAL]          = {NULL, binaryInfix, PREC_COMPARISON, LEFT_ASSOCIATIVE},
+    [LESS_LESS]           = {NULL, binaryInfix, PREC_SHIFT, LEFT_ASSOCIATIVE},
+    [PLUS]                = {NULL, binaryInfix, PREC_TERM, LEFT_ASSOCIATIVE},
+    [MINUS]               = {unaryPrefix, binaryInfix, PREC_TERM, LEFT_ASSOCIATIVE},
+    [STAR]                = {NULL, binaryInfix, PREC_FACTOR, LEFT_ASSOCIATIVE},
+    [FORWARD_SLASH]       = {NULL, binaryInfix, PREC_FACTOR, LEFT_ASSOCIATIVE},
+    [MODULO]              = {NULL, binaryInfix, PREC_FACTOR, LEFT_ASSOCIATIVE},
+    [STAR_STAR]           = {NULL, binaryInfix, PREC_POWER, RIGHT_ASSOCIATIVE},
+    [LEFT_BRACKET]        = {newArrayLiteral, indexInfix, PREC_CALL, LEFT_ASSOCIATIVE},
+    [DOT]                 = {NULL, invokeInfix, PREC_CALL, LEFT_ASSOCIATIVE},
+    // Every other token ends an expression, a zeroed rule is PREC_NONE.
+    [EMPTY_TOKEN]         = {NULL, NULL, PREC_NONE, LEFT_ASSOCIATIVE}
+};
+
+static Expr *parsePrecedence(Scanner *scanner, Precedence precedence);
+
+// What is left of a statement or an expression nested too deep for the
+// stack, parsed on a segment. Syntax errors are raised again once back.
+typedef struct DeepParse {
+    Scanner *scanner;
+    bool statement;
+    Precedence precedence;
+    Stmt *stmt;
+    Expr *exp;
+    bool failed;
+} DeepParse;
+
+static void parseSegment(void *context) {
+    DeepParse *parse = context;
+    Scanner *scanner = parse->scanner;
+    jmp_buf errorJump;
+    jmp_buf *enclosing = scanner->errorJump;
+
+    scanner->errorJump = &errorJump;
+    if (setjmp(errorJump) != 0) {
+        parse->failed = true;
+    } else if (parse->statement) {
+        parse->stmt = statement(scanner);
+    } else {
+        parse->exp = parsePrecedence(scanner, parse->precedence);
+    }
+    scanner->errorJump = enclosing;
+}
+
+static DeepParse parseOnNewSegment(Scanner *scanner, bool statement, Precedence precedence) {
+    DeepParse parse = {scanner, statement, precedence, NULL, NULL, false};
+    walkOnNewSegment(&scanner->stack, parseSegment, &parse);
+    if (parse.failed) {
+        raiseSyntaxError(scanner);
+    }
+    return parse;
+}
+
+static Stmt *statementOnNewSegment(Scanner *scanner) {
+    return parseOnNewSegment(scanner, true, PREC_NONE).stmt;
+}
+
 Expr *expression(Scanner *scanner) {
-    return assignment(scanner);
+    return parsePrecedence(scanner, PREC_ASSIGNMENT);
 }
 
-// assignment -> IDENTIFIER = expression
-Expr *assignment(Scanner *scanner) {
-    Expr *identifier = equality(scanner);
+// Parses an expression made of operators binding at least as tightly
+// as `precedence`.
+static Expr *parsePrecedence(Scanner *scanner, Precedence precedence) {
+    if (walkStackLow(&scanner->stack)) {
+        return parseOnNewSegment(scanner, false, precedence).exp;
+    }
+
+    Token token = advanceToken(scanner);
+    PrefixRule prefix = rules[token.type].prefix;
 
-    if (match(scanner, EQUAL)) {
-        // We probably need some validation here to ensure that we
-        // do not have some weird L value. It should just be identifier
-        Expr *value = assignment(scanner);
-        return newVarAssignment(scanner->line, identifier, value);
+    if (prefix == NULL) {
+        if (token.type == END_OF_FILE) {
+            syntaxError(scanner, token.line, "unexpected end of input");
+        }
+        syntaxError(scanner, token.line, "unexpected '%.*s'", token.length, token.lexeme);
     }
+    Expr *exp = prefix(scanner, token);
 
-    return identifier;
-}
+    while(precedence <= rules[scanner->peek.type].precedence) {
+        // Only an index when on the same line, a [ starting a new line
+        // is an array literal.
+        if (scanner->peek.type == LEFT_BRACKET && scanner->peek.line != scanner->peek_prev.line) {
+            break;
+        }
 
-// equality -> comparison((== | !=) comparison)*
-Expr *equality(Scanner *scanner) {
-    Expr *exp = comparison(scanner);
-    while(match(scanner, EQUAL_EQUAL) ||
-        match(scanner, BANG_EQUAL))
-    {
-      TokenType op = scanner->peek_prev.type;
-      exp = newBinary(exp, comparison(scanner), op, scanner->line);
+        ParseRule *rule = &rules[scanner->peek.type];
+        exp = rule->infix(scanner, exp, advanceToken(scanner));
+        if (rule->associativity == NON_ASSOCIATIVE && rules[scanner->peek.type].precedence == rule->precedence) {
+            syntaxError(scanner, scanner->peek.line, "unexpected '%.*s'", scanner->peek.length, scanner->peek.lexeme);
+        }
     }
+
     return exp;
 }
 
-// comparison -> term((> | < | >= | <=) term)*
-Expr *comparison(Scanner *scanner) {
-   Expr *exp = term(scanner);
-   while(match(scanner, GREATER) ||
-        match(scanner, GREATER_EQUAL) ||
-        match(scanner, LESS) ||
-        match(scanner, LESS_EQUAL))
-   {
-      TokenType op = scanner->peek_prev.type;
-      exp = newBinary(exp, term(scanner), op, scanner->line);
-   }
-   return exp;
-}
-
-// term -> factor ((+|-) factor)*
-Expr *term(Scanner *scanner) {
-    Expr *exp = factor(scanner);
-   
-    while(match(scanner, PLUS) || match(scanner, MINUS)) {
-        TokenType op = scanner->peek_prev.type;
-        exp = newBinary(exp, factor(scanner), op, scanner->line);
+// The right side of the operator `token`.
+static Expr *operand(Scanner *scanner, Token token) {
+    ParseRule *rule = &rules[token.type];
+    if (rule->associativity == RIGHT_ASSOCIATIVE) {
+        return parsePrecedence(scanner, rule->precedence);
     }
+    return parsePrecedence(scanner, rule->precedence + 1);
+}
+
+static Expr *numberPrefix(Scanner *scanner, Token token) {
+    return newNumberLiteral(&token);
+}
+
+static Expr *stringPrefix(Scanner *scanner, Token token) {
+    return newStringLiteral(&token);
+}
+
+static Expr *interpolationPrefix(Scanner *scanner, Token token) {
+    return newInterpolation(scanner, &token);
+}
+
+static Expr *truePrefix(Scanner *scanner, Token token) {
+    return newBooleanExpr(token, true);
+}
+
+static Expr *falsePrefix(Scanner *scanner, Token token) {
+    return newBooleanExpr(token, false);
+}
+
+static Expr *groupingPrefix(Scanner *scanner, Token token) {
+    Expr *exp = expression(scanner);
+    consume(scanner, RIGHT_PAREN);
     return exp;
 }
 
-// factor -> primary ((*|/|%) primary)*
-Expr *factor(Scanner *scanner) {
-    Expr *exp = primary(scanner);
-    
-    while(match(scanner, STAR) || match(scanner, FORWARD_SLASH) || match(scanner, MODULO)) {
-        TokenType op = scanner->peek_prev.type;
-        exp = newBinary(exp, primary(scanner), op, scanner->line);
+// -x or !x. A minus in front of a number is part of the literal.
+static Expr *unaryPrefix(Scanner *scanner, Token token) {
+    Expr *operand = parsePrecedence(scanner, token.type == MINUS ? PREC_UNARY : PREC_NOT);
+
+    if (token.type == MINUS && operand->type == NUMBER_LITERAL) {
+        operand->as.numberLiteral.number = -operand->as.numberLiteral.number;
+        return operand;
     }
+    return newUnary(operand, token.type, token.line);
+}
 
-    return exp;
+static Expr *binaryInfix(Scanner *scanner, Expr *left, Token token) {
+    int line = scanner->line;
+    return newBinary(left, operand(scanner, token), token.type, line);
 }
 
-// primary -> STRING | NUMBER | IDENTIFIER
-Expr *primary(Scanner *scanner) {
-    Token token = advanceToken(scanner);
-    Expr *exp;
-//    printf("got to primary with type %d\n", token.type);
-    switch (token.type) {
-        case STRING:
-            exp = newStringLiteral(&token);
-            break;
-        case NUMBER:
-            exp = newNumberLiteral(&token);
-            break;
-        case TRUE_TOK:
-            exp = newBooleanExpr(token, true);
-            break;
-        case FALSE_TOK:
-            exp = newBooleanExpr(token, false);
-            break;
-        case IDENTIFIER:
-            exp = handleIdenfierExpression(scanner, token);
-            break;
-        case INCLUSIVE_RANGE:
-            exp = newRangeExpression(token);
-            break;
-        case EXCLUSIVE_RANGE:
-            exp = newRangeExpression(token);
-            break;
+static Expr *logicalInfix(Scanner *scanner, Expr *left, Token token) {
+    Expr *right = operand(scanner, token);
+    return newLogical(left, right, token.type, token.line);
+}
+
+// start..end or start...end
+static Expr *rangeInfix(Scanner *scanner, Expr *left, Token token) {
+    int line = scanner->line;
+    return newRangeExpression(left, operand(scanner, token), token.type, line);
+}
+
+// name = value or object[index] = value
+static Expr *assignmentInfix(Scanner *scanner, Expr *left, Token token) {
+    if (left->type != IDENTIFIER_EXP && left->type != INDEX_EXP) {
+        syntaxError(scanner, token.line, "can't assign to %s", left->type == METHOD_CALL_EXP ? "a method call" : "an expression");
+    }
+
+    Expr *value = operand(scanner, token);
+    if (left->type == INDEX_EXP) {
+        return newIndexAssignment(left->line, left, value);
     }
+    return newVarAssignment(scanner, left, value);
+}
 
-  return exp;
+// object[index]
+static Expr *indexInfix(Scanner *scanner, Expr *left, Token token) {
+    Expr *index = expression(scanner);
+    consume(scanner, RIGHT_BRACKET);
+    return newIndexExpression(left, index, scanner->line);
+}
+
+// receiver.name, reduce is also a keyword, of parallel for.
+static Expr *invokeInfix(Scanner *scanner, Expr *left, Token token) {
+    Token name = match(scanner, REDUCE) ? scanner->peek_prev : consume(scanner, IDENTIFIER);
+    return newInvokeExpression(scanner, left, name);
 }
 
 // $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
@@ -210,12 +392,32 @@ Stmt *parseWhile(Scanner *scanner) {
 }
 
 Stmt *parseFor(Scanner *scanner) {
-    Stmt *forStmt = newStmt(scanner->line, FOR_STMT);
+    return parseForLoop(scanner, FOR_STMT);
+}
+
+// parallel for i in range [reduce(op, name)] ... end
+Stmt *parseParallelFor(Scanner *scanner) {
+    consume(scanner, FOR);
+    return parseForLoop(scanner, PARALLEL_FOR_STMT);
+}
+
+Stmt *parseForLoop(Scanner *scanner, StmtType type) {
+    Stmt *forStmt = newStmt(scanner->line, type);
     // This is a bit of hack. The identifier is a varexpression
     // but in reality we'll use it as var assignment in the interpreter
-    forStmt->as.forStmt.identifier = expression(scanner);
+    Expr *identifier = expression(scanner);
+    forStmt->as.forStmt.identifier = identifier;
+    if (type == FOR_STMT && identifier->type == IDENTIFIER_EXP) {
+        Token name = newToken(IDENTIFIER, identifier->line, identifier->as.identifierExp.length, identifier->as.identifierExp.string);
+        declareVariable(scanner, name, &identifier->as.identifierExp.kind, &identifier->as.identifierExp.slot);
+    }
     consume(scanner, IN);
     forStmt->as.forStmt.range = expression(scanner);
+    forStmt->as.forStmt.reduceOp = REDUCE_NONE;
+
+    if (type == PARALLEL_FOR_STMT && match(scanner, REDUCE)) {
+        parseReduce(scanner, forStmt);
+    }
 
     StmtArray *statements = initStmtArray();
     Stmt *stmt;
@@ -228,7 +430,29 @@ Stmt *parseFor(Scanner *scanner) {
     return forStmt;
 }
 
-// method definition.
+// reduce(+, total), reduce(*, total) or reduce(count, total)
+void parseReduce(Scanner *scanner, Stmt *forStmt) {
+    consume(scanner, LEFT_PAREN);
+    Token op = advanceToken(scanner);
+
+    if (op.type == PLUS) {
+        forStmt->as.forStmt.reduceOp = REDUCE_SUM;
+    } else if (op.type == STAR) {
+        forStmt->as.forStmt.reduceOp = REDUCE_PRODUCT;
+    } else if (op.type == IDENTIFIER && op.length == 5 && memcmp(op.lexeme, "count", 5) == 0) {
+        forStmt->as.forStmt.reduceOp = REDUCE_COUNT;
+    } else {
+        syntaxError(scanner, op.line, "unknown reduction '%.*s'", op.length, op.lexeme);
+    }
+
+    consume(scanner, COMMA);
+    Token name = consume(scanner, IDENTIFIER);
+    forStmt->as.forStmt.reduceName = name.lexeme;
+    forStmt->as.forStmt.reduceLength = name.length;
+    consume(scanner, RIGHT_PAREN);
+}
+
+// method definition. The body doesn't see the variables around the def.
 Stmt *parseDef(Scanner *scanner) {
     Stmt *defStmt = newStmt(scanner->line, DEF_STMT);
     Token identifier = consume(scanner, IDENTIFIER);
@@ -237,6 +461,8 @@ Stmt *parseDef(Scanner *scanner) {
     defStmt->as.defStmt.nameLength = identifier.length;
 
     ExprArray *arguments = initExprArray();
+    Scope scope;
+    beginScope(scanner, &scope, NULL);
 
     if (match(scanner, LEFT_PAREN)) {
         Expr *exp;
@@ -244,29 +470,280 @@ Stmt *parseDef(Scanner *scanner) {
         while(!match(scanner, RIGHT_PAREN)) {
             exp = expression(scanner);
             ADD_ARRAY_ELEMENT(arguments, exp, Expr);
+            if (exp->type == IDENTIFIER_EXP) {
+                Token name = newToken(IDENTIFIER, exp->line, exp->as.identifierExp.length, exp->as.identifierExp.string);
+                declareVariable(scanner, name, &exp->as.identifierExp.kind, &exp->as.identifierExp.slot);
+            }
             match(scanner, COMMA);
         }
     }
     defStmt->as.defStmt.arguments = arguments;
+    defStmt->as.defStmt.numeric = NULL;
+    defStmt->as.defStmt.lazy = false;
+    defStmt->as.defStmt.body = NULL;
 
     StmtArray *statements = initStmtArray();
     Stmt *stmt;
 
+    if (scanner->lazyDefs) {
+        defStmt->as.defStmt.statements = statements;
+        endScope(scanner, &scope);
+        skimBody(scanner, defStmt);
+        return defStmt;
+    }
+
     while(!match(scanner, END)) {
         stmt = statement(scanner);
         ADD_ARRAY_ELEMENT(statements, stmt, Stmt);
     }
 
     defStmt->as.defStmt.statements = statements;
+    endScope(scanner, &scope);
 
     return defStmt;
 }
 
-Expr *newVarAssignment(int line, Expr *identifier, Expr *value) {
-    Expr *exp = newExpr(line, VAR_ASSIGNMENT);
+/*
+  Moves past the body of a def up to and including the `end` that closes
+  it, only counting the keywords that open something `end` closes. Bad
+  characters and strings are still caught since every token is scanned,
+  anything else wrong with the body only comes up on the first call.
+*/
+static void skimBody(Scanner *scanner, Stmt *def) {
+    char *body = scanner->peek.lexeme;
+    int line = scanner->peek.line;
+    int depth = 1;
+
+    while(depth > 0) {
+        Token token = advanceToken(scanner);
+        switch (token.type) {
+            case DEF:
+            case IF:
+            case WHILE:
+            case FOR:
+            case DO:
+                depth++;
+                break;
+            case END:
+                depth--;
+                break;
+            case END_OF_FILE:
+                syntaxError(scanner, token.line, "unexpected end of input");
+                break;
+            default:
+                break;
+        }
+    }
+
+    def->as.defStmt.lazy = true;
+    def->as.defStmt.body = body;
+    def->as.defStmt.bodyLine = line;
+    if (scanner->peek_prev.lexeme - body < LAZY_BODY_MIN) {
+        char error[ERROR_MESSAGE_SIZE];
+        if (!parseMethodBody(def, error)) {
+            memcpy(scanner->error, error, ERROR_MESSAGE_SIZE);
+            raiseSyntaxError(scanner);
+        }
+        def->as.defStmt.lazy = false;
+        def->as.defStmt.body = NULL;
+    }
+}
+
+/*
+  Parses the body of a lazy def into its statements, leaving `body` for
+  the caller to clear. Returns false on a syntax error with the message
+  in `error`, the def is left as it was. Defs inside are skimmed too.
+*/
+bool parseMethodBody(Stmt *def, char *error) {
+    jmp_buf errorJump;
+    Scanner scanner;
+    Scope scope;
+    StmtArray *statements = initStmtArray();
+
+    if (setjmp(errorJump) != 0) {
+        memcpy(error, scanner.error, ERROR_MESSAGE_SIZE);
+        free(statements->list);
+        free(statements);
+        return false;
+    }
+
+    initScannerAtLine(&scanner, def->as.defStmt.body, def->as.defStmt.bodyLine, &errorJump);
+    scanner.lazyDefs = true;
+    beginScope(&scanner, &scope, NULL);
+
+    ExprArray *arguments = def->as.defStmt.arguments;
+    for(int i = 0; i < arguments->size; i++) {
+        Expr *exp = arguments->list[i];
+        if (exp->type == IDENTIFIER_EXP) {
+            Token name = newToken(IDENTIFIER, exp->line, exp->as.identifierExp.length, exp->as.identifierExp.string);
+            declareVariable(&scanner, name, &exp->as.identifierExp.kind, &exp->as.identifierExp.slot);
+        }
+    }
+
+    Stmt *stmt;
+    while(!match(&scanner, END)) {
+        stmt = statement(&scanner);
+        ADD_ARRAY_ELEMENT(statements, stmt, Stmt);
+    }
+    endScope(&scanner, &scope);
+
+    // The array itself stays, methods already defined point to it.
+    StmtArray *target = def->as.defStmt.statements;
+    free(target->list);
+    target->list = statements->list;
+    target->size = statements->size;
+    target->capacity = statements->capacity;
+    free(statements);
+    return true;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Blocks and scopes
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+void beginScope(Scanner *scanner, Scope *scope, Block *block) {
+    scope->enclosing = scanner->scope;
+    scope->block = block;
+    scope->names = NULL;
+    scope->size = 0;
+    scope->capacity = 0;
+    scanner->scope = scope;
+}
+
+void endScope(Scanner *scanner, Scope *scope) {
+    scanner->scope = scope->enclosing;
+    free(scope->names);
+}
+
+static int findName(Scope *scope, char *name, int length) {
+    for(int i = 0; i < scope->size; i++) {
+        if (scope->names[i].length == length && memcmp(scope->names[i].lexeme, name, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns the slot of the name, which is its position.
+static int addName(Scope *scope, Token name) {
+    if (scope->size + 1 > scope->capacity) {
+        scope->capacity = scope->capacity < 8 ? 8 : 2 * scope->capacity;
+        scope->names = realloc(scope->names, scope->capacity * sizeof(Token));
+    }
+    scope->names[scope->size] = name;
+    return scope->size++;
+}
+
+static int addUpvalue(Block *block, VariableKind source, int index, char *name, int length) {
+    UpvalueArray *upvalues = block->upvalues;
+    for(int i = 0; i < upvalues->size; i++) {
+        Upvalue *upvalue = upvalues->list[i];
+        if (upvalue->length == length && memcmp(upvalue->name, name, length) == 0) {
+            return i;
+        }
+    }
+
+    Upvalue *upvalue = malloc(sizeof(Upvalue));
+    upvalue->source = source;
+    upvalue->index = index;
+    upvalue->name = name;
+    upvalue->length = length;
+    ADD_ARRAY_ELEMENT(upvalues, upvalue, Upvalue);
+    return upvalues->size - 1;
+}
+
+/*
+  Where `name` lives as seen from `scope`. A variable from outside a block
+  becomes one of its upvalues, and one of every block in between. `slot`
+  is -1 for a name nothing has assigned so far, which is left to be
+  looked up by name when it runs.
+*/
+static VariableKind resolveVariable(Scope *scope, char *name, int length, int *slot) {
+    if (scope == NULL) {
+        *slot = -1;
+        return VARIABLE_NAMED;
+    }
+
+    int index = findName(scope, name, length);
+    if (scope->block == NULL || index >= 0) {
+        *slot = index;
+        return scope->block == NULL ? VARIABLE_NAMED : VARIABLE_LOCAL;
+    }
+
+    int outer;
+    VariableKind kind = resolveVariable(scope->enclosing, name, length, &outer);
+    if (outer < 0) {
+        *slot = -1;
+        return VARIABLE_NAMED;
+    }
+    *slot = addUpvalue(scope->block, kind, outer, name, length);
+    return VARIABLE_UPVALUE;
+}
+
+// For an assignment. A variable nothing has assigned so far belongs to the
+// innermost block, or to the method or top level outside of blocks.
+void declareVariable(Scanner *scanner, Token name, VariableKind *kind, int *slot) {
+    Scope *scope = scanner->scope;
+    *kind = resolveVariable(scope, name.lexeme, name.length, slot);
+    if (*slot >= 0 || scope == NULL) {
+        return;
+    }
+
+    *slot = addName(scope, name);
+    if (scope->block != NULL) {
+        scope->block->localCount = scope->size;
+        *kind = VARIABLE_LOCAL;
+    }
+}
+
+// do |a, b| ... end or { |a, b| ... }, from right after the do or the brace.
+Block *parseBlock(Scanner *scanner, TokenType closing) {
+    Block *block = malloc(sizeof(Block));
+    stats.astBytes += sizeof(Block);
+    block->line = scanner->peek_prev.line;
+    block->localCount = 0;
+    block->upvalues = initUpvalueArray();
+    block->statements = initStmtArray();
+
+    Scope scope;
+    beginScope(scanner, &scope, block);
+
+    // || is a block without params.
+    if (!match(scanner, PIPE_PIPE) && match(scanner, PIPE)) {
+        while(!match(scanner, PIPE)) {
+            Token param = consume(scanner, IDENTIFIER);
+            if (findName(&scope, param.lexeme, param.length) >= 0) {
+                syntaxError(scanner, param.line, "duplicated argument name '%.*s'", param.length, param.lexeme);
+            }
+            addName(&scope, param);
+            match(scanner, COMMA);
+        }
+    }
+    block->paramCount = scope.size;
+    block->localCount = scope.size;
+
+    Stmt *stmt;
+    while(!match(scanner, closing)) {
+        stmt = statement(scanner);
+        ADD_ARRAY_ELEMENT(block->statements, stmt, Stmt);
+    }
+
+    endScope(scanner, &scope);
+    return block;
+}
+
+Expr *newVarAssignment(Scanner *scanner, Expr *identifier, Expr *value) {
+    Expr *exp = newExpr(scanner->line, VAR_ASSIGNMENT);
     exp->as.varAssignment.name = identifier->as.identifierExp.string;
     exp->as.varAssignment.length = identifier->as.identifierExp.length;
     exp->as.varAssignment.value = value;
+
+    Token name = newToken(IDENTIFIER, identifier->line, exp->as.varAssignment.length, exp->as.varAssignment.name);
+    declareVariable(scanner, name, &exp->as.varAssignment.kind, &exp->as.varAssignment.slot);
+
+    // Only its name is kept.
+    stats.astBytes -= sizeof(*identifier);
+    free(identifier);
     return exp;
 }
 
@@ -276,11 +753,13 @@ Expr *newBooleanExpr(Token token, bool value) {
     return exp;
 }
 
+// A ( starting the next line is a parenthesized expression, not arguments.
 Expr *handleIdenfierExpression(Scanner *scanner, Token token) {
-    if (match(scanner, LEFT_PAREN)) {
+    if (scanner->peek.type == LEFT_PAREN && scanner->peek.line == token.line) {
+        advanceToken(scanner);
         return newMethodCallExpression(scanner, token);
     } else {
-        return newIdentifierExpression(token);
+        return newIdentifierExpression(scanner, token);
     }
 }
 
@@ -288,6 +767,12 @@ Expr *newMethodCallExpression(Scanner *scanner, Token token) {
     Expr *exp = newExpr(token.line, METHOD_CALL_EXP);
     exp->as.methodCall.name = token.lexeme;
     exp->as.methodCall.length = token.length;
+    exp->as.methodCall.arguments = parseArguments(scanner);
+    return exp;
+}
+
+// Arguments after the opening paren, up to and including the closing one.
+ExprArray *parseArguments(Scanner *scanner) {
     ExprArray *arguments = initExprArray();
 
     Expr *argumentExp;
@@ -297,14 +782,88 @@ Expr *newMethodCallExpression(Scanner *scanner, Token token) {
         match(scanner, COMMA);
     }
 
-    exp->as.methodCall.arguments = arguments;
+    return arguments;
+}
+
+// [1, 2, 3]
+Expr *newArrayLiteral(Scanner *scanner, Token token) {
+    Expr *exp = newExpr(token.line, ARRAY_LITERAL);
+    ExprArray *elements = initExprArray();
+
+    Expr *element;
+    while(!match(scanner, RIGHT_BRACKET)) {
+        element = expression(scanner);
+        ADD_ARRAY_ELEMENT(elements, element, Expr);
+        match(scanner, COMMA);
+    }
+
+    exp->as.arrayLiteral.elements = elements;
+    return exp;
+}
+
+// {key => value, ...}
+Expr *newHashLiteral(Scanner *scanner, Token token) {
+    Expr *exp = newExpr(token.line, HASH_LITERAL);
+    ExprArray *keys = initExprArray();
+    ExprArray *values = initExprArray();
+
+    Expr *key, *value;
+    while(!match(scanner, RIGHT_BRACE)) {
+        key = expression(scanner);
+        consume(scanner, FAT_ARROW);
+        value = expression(scanner);
+        ADD_ARRAY_ELEMENT(keys, key, Expr);
+        ADD_ARRAY_ELEMENT(values, value, Expr);
+        match(scanner, COMMA);
+    }
+
+    exp->as.hashLiteral.keys = keys;
+    exp->as.hashLiteral.values = values;
+    return exp;
+}
+
+Expr *newIndexExpression(Expr *object, Expr *index, int line) {
+    Expr *exp = newExpr(line, INDEX_EXP);
+    exp->as.index.object = object;
+    exp->as.index.index = index;
+    exp->as.index.value = NULL;
     return exp;
 }
 
-Expr *newIdentifierExpression(Token token) {
+// Takes over the object[index] parsed as the left hand side.
+Expr *newIndexAssignment(int line, Expr *target, Expr *value) {
+    Expr *exp = newExpr(line, INDEX_ASSIGNMENT);
+    exp->as.index.object = target->as.index.object;
+    exp->as.index.index = target->as.index.index;
+    exp->as.index.value = value;
+    free(target);
+    return exp;
+}
+
+// receiver.name or receiver.name(arguments), either followed by a block.
+// A { only starts a block on the same line.
+Expr *newInvokeExpression(Scanner *scanner, Expr *receiver, Token name) {
+    Expr *exp = newExpr(name.line, INVOKE_EXP);
+    exp->as.invoke.receiver = receiver;
+    exp->as.invoke.name = name.lexeme;
+    exp->as.invoke.length = name.length;
+    exp->as.invoke.arguments = match(scanner, LEFT_PAREN) ? parseArguments(scanner) : initExprArray();
+    exp->as.invoke.block = NULL;
+
+    if (match(scanner, DO)) {
+        exp->as.invoke.block = parseBlock(scanner, END);
+    } else if (scanner->peek.type == LEFT_BRACE && scanner->peek.line == scanner->peek_prev.line) {
+        advanceToken(scanner);
+        exp->as.invoke.block = parseBlock(scanner, RIGHT_BRACE);
+    }
+    return exp;
+}
+
+Expr *newIdentifierExpression(Scanner *scanner, Token token) {
     Expr *exp = newExpr(token.line, IDENTIFIER_EXP);
     exp->as.identifierExp.length = token.length;
     exp->as.identifierExp.string = token.lexeme;
+    exp->as.identifierExp.kind = resolveVariable(scanner->scope, token.lexeme, token.length, &exp->as.identifierExp.slot);
     
     return exp;
 }
@@ -314,35 +873,136 @@ Expr *newBinary(Expr *left, Expr *right, TokenType op, int line) {
     exp->as.binary.left = left;
     exp->as.binary.right = right;
     exp->as.binary.op = op;
+    exp->as.binary.kind = BINARY_UNSEEN;
+    exp->as.binary.samples = 0;
+    return exp;
+}
+
+Expr *newLogical(Expr *left, Expr *right, TokenType op, int line) {
+    Expr *exp = newExpr(line, LOGICAL);
+    exp->as.logical.left = left;
+    exp->as.logical.right = right;
+    exp->as.logical.op = op;
     return exp;
 }
 
+Expr *newUnary(Expr *operand, TokenType op, int line) {
+    Expr *exp = newExpr(line, UNARY);
+    exp->as.unary.operand = operand;
+    exp->as.unary.op = op;
+    return exp;
+}
+
+// Drops the underscores grouping the digits before converting.
 Expr *newNumberLiteral(Token *token) {
     Expr *exp = newExpr(token->line, NUMBER_LITERAL);
-    double number = strtod(token->lexeme, NULL);
-    exp->as.numberLiteral.number = number;
+    char digits[token->length + 1];
+    int length = 0;
+
+    for(int i = 0; i < token->length; i++) {
+        if (token->lexeme[i] != '_') {
+            digits[length++] = token->lexeme[i];
+        }
+    }
+    digits[length] = '\0';
+
+    exp->as.numberLiteral.number = strtod(digits, NULL);
     return exp;
 }
 
+// The token includes the quotes.
 Expr *newStringLiteral(Token *token) {
-    Expr *exp = newExpr(token->line, STRING_LITERAL);
-    exp->as.stringLiteral.string = token->lexeme;
-    exp->as.stringLiteral.length = token->length;
+    return newStringSlice(token->line, token->lexeme + 1, token->length - 2);
+}
+
+Expr *newStringSlice(int line, char *string, int length) {
+    Expr *exp = newExpr(line, STRING_LITERAL);
+    exp->as.stringLiteral.string = string;
+    exp->as.stringLiteral.length = length;
+    exp->as.stringLiteral.object = newSharedString(string, length);
     return exp;
 }
 
-Expr *newRangeExpression(Token token) {
-    Expr *exp = newExpr(token.line, RANGE);
-    char *type = token.type == INCLUSIVE_RANGE ? "inclusive" : "exclusive";
-    exp->as.range.type = type;
-    
-    int start, startSize, dotsSize, end;
+// "a #{b} c" becomes the parts "a ", b and " c".
+Expr *newInterpolation(Scanner *scanner, Token *token) {
+    Expr *exp = newExpr(token->line, INTERPOLATION);
+    ExprArray *parts = initExprArray();
+
+    char *current = token->lexeme + 1;
+    char *end = token->lexeme + token->length - 1;
+    char *constant = current;
+    int line = token->line;
+    Expr *part;
+
+    while(current < end) {
+        if (current[0] != '#' || current[1] != '{') {
+            line += current[0] == '\n';
+            current++;
+            continue;
+        }
+
+        if (current > constant) {
+            part = newStringSlice(token->line, constant, (int)(current - constant));
+            ADD_ARRAY_ELEMENT(parts, part, Expr);
+        }
+        char *code = current + 2;
+        part = interpolatedExpression(scanner, code, line, &current);
+        ADD_ARRAY_ELEMENT(parts, part, Expr);
+        for(; code < current; code++) {
+            line += code[0] == '\n';
+        }
+        constant = current;
+    }
+
+    if (end > constant) {
+        part = newStringSlice(token->line, constant, (int)(end - constant));
+        ADD_ARRAY_ELEMENT(parts, part, Expr);
+    }
+
+    exp->as.interpolation.parts = parts;
+    return exp;
+}
+
+/*
+  Parses the code of a #{} with a scanner of its own, `end` is left right
+  after the closing brace. The brace is swapped for a NUL while it runs so
+  the inner scanner can't read into the rest of the string.
+*/
+Expr *interpolatedExpression(Scanner *scanner, char *start, int line, char **end) {
+    Scanner probe = *scanner;
+    probe.current = start - 2;
+    skipInterpolation(&probe);
+    char *close = probe.current - 1;
+
+    Scanner inner;
+    jmp_buf errorJump;
+
+    *close = '\0';
+    if (setjmp(errorJump) != 0) {
+        *close = '}';
+        memcpy(scanner->error, inner.error, ERROR_MESSAGE_SIZE);
+        raiseSyntaxError(scanner);
+    }
+
+    initScannerAtLine(&inner, start, line, &errorJump);
+    inner.scope = scanner->scope;
+    if (inner.peek.type == END_OF_FILE) {
+        syntaxError(&inner, line, "empty string interpolation");
+    }
+    Expr *exp = expression(&inner);
+    if (inner.peek.type != END_OF_FILE) {
+        syntaxError(&inner, inner.peek.line, "expected '}' to close the interpolation, got '%.*s'",
+            inner.peek.length, inner.peek.lexeme);
+    }
+
+    *close = '}';
+    *end = close + 1;
+    return exp;
+}
 
-    start = strtod(token.lexeme, NULL);
-    startSize = (start == 0) ? 1 : (log10(start) + 1);
-    // 2 or 3 dots.
-    dotsSize = token.type == INCLUSIVE_RANGE ? 2 : 3;
-    end = strtod(token.lexeme + startSize + dotsSize, NULL);
+Expr *newRangeExpression(Expr *start, Expr *end, TokenType type, int line) {
+    Expr *exp = newExpr(line, RANGE);
+    exp->as.range.type = type == INCLUSIVE_RANGE ? "inclusive" : "exclusive";
     exp->as.range.start = start;
     exp->as.range.end = end;
 
@@ -353,6 +1013,8 @@ Stmt *newStmt(int line, StmtType type) {
     Stmt *stmt = (Stmt*)malloc(sizeof(*stmt));
     stmt->line = line;
     stmt->type = type;
+    stats.stmts[type]++;
+    stats.astBytes += sizeof(*stmt);
     return stmt;
 }
 
@@ -360,12 +1022,15 @@ Expr *newExpr(int line, ExprType type) {
     Expr *exp = (Expr*)malloc(sizeof(*exp));
     exp->line = line;
     exp->type = type;
+    stats.exprs[type]++;
+    stats.astBytes += sizeof(*exp);
     return exp;
 }
 
 Conditional *newConditional(void) {
     Conditional *conditional = (Conditional*)malloc(sizeof(*conditional));
     conditional->statements = initStmtArray();
+    stats.astBytes += sizeof(*conditional);
     return conditional;
 }
 
@@ -393,15 +1058,326 @@ void freeExpression(Expr *exp) {
             freeExpression(exp->as.binary.left);
             freeExpression(exp->as.binary.right);
             break;
+        case LOGICAL:
+            freeExpression(exp->as.logical.left);
+            freeExpression(exp->as.logical.right);
+            break;
+        case UNARY:
+            freeExpression(exp->as.unary.operand);
+            break;
         case NUMBER_LITERAL:
             free(exp);
             break;
         case STRING_LITERAL:
+            freeSharedString(exp->as.stringLiteral.object);
             free(exp);
             break;
   }
 }
 
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Releasing nodes
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static long freeExprTree(WalkStack *stack, Expr *exp);
+static long freeStmtTree(WalkStack *stack, Stmt *stmt);
+static bool exprKept(WalkStack *stack, Expr *exp);
+static bool stmtKept(WalkStack *stack, Stmt *stmt);
+
+// A statement or an expression nested too deep for the stack, freed or
+// looked at on a segment.
+typedef struct DeepTree {
+    WalkStack *stack;
+    Stmt *stmt;
+    Expr *exp;
+    long bytes;
+    bool kept;
+} DeepTree;
+
+static void freeSegment(void *context) {
+    DeepTree *tree = context;
+    tree->bytes = tree->stmt != NULL ? freeStmtTree(tree->stack, tree->stmt) : freeExprTree(tree->stack, tree->exp);
+}
+
+static void keptSegment(void *context) {
+    DeepTree *tree = context;
+    tree->kept = tree->stmt != NULL ? stmtKept(tree->stack, tree->stmt) : exprKept(tree->stack, tree->exp);
+}
+
+static DeepTree treeOnNewSegment(WalkStack *stack, WalkFunction function, Stmt *stmt, Expr *exp) {
+    DeepTree tree = {stack, stmt, exp, 0, false};
+    walkOnNewSegment(stack, function, &tree);
+    return tree;
+}
+
+static long freeExpressionList(WalkStack *stack, ExprArray *array) {
+    long bytes = 0;
+    for(int i = 0; i < array->size; i++) {
+        bytes += freeExprTree(stack, array->list[i]);
+    }
+    free(array->list);
+    free(array);
+    return bytes;
+}
+
+static long freeStatementList(WalkStack *stack, StmtArray *array) {
+    long bytes = 0;
+    for(int i = 0; i < array->size; i++) {
+        bytes += freeStmtTree(stack, array->list[i]);
+    }
+    free(array->list);
+    free(array);
+    return bytes;
+}
+
+static long freeBlock(WalkStack *stack, Block *block) {
+    for(int i = 0; i < block->upvalues->size; i++) {
+        free(block->upvalues->list[i]);
+    }
+    free(block->upvalues->list);
+    free(block->upvalues);
+
+    long bytes = sizeof(Block) + freeStatementList(stack, block->statements);
+    free(block);
+    return bytes;
+}
+
+static long freeExprTree(WalkStack *stack, Expr *exp) {
+    if (walkStackLow(stack)) {
+        return treeOnNewSegment(stack, freeSegment, NULL, exp).bytes;
+    }
+
+    long bytes = sizeof(Expr);
+
+    switch (exp->type) {
+        case BINARY:
+            bytes += freeExprTree(stack, exp->as.binary.left);
+            bytes += freeExprTree(stack, exp->as.binary.right);
+            break;
+        case STRING_LITERAL:
+            freeSharedString(exp->as.stringLiteral.object);
+            break;
+        case METHOD_CALL_EXP:
+            bytes += freeExpressionList(stack, exp->as.methodCall.arguments);
+            break;
+        case VAR_ASSIGNMENT:
+            bytes += freeExprTree(stack, exp->as.varAssignment.value);
+            break;
+        case LOGICAL:
+            bytes += freeExprTree(stack, exp->as.logical.left);
+            bytes += freeExprTree(stack, exp->as.logical.right);
+            break;
+        case UNARY:
+            bytes += freeExprTree(stack, exp->as.unary.operand);
+            break;
+        case RANGE:
+            bytes += freeExprTree(stack, exp->as.range.start);
+            bytes += freeExprTree(stack, exp->as.range.end);
+            break;
+        case ARRAY_LITERAL:
+            bytes += freeExpressionList(stack, exp->as.arrayLiteral.elements);
+            break;
+        case INDEX_EXP:
+        case INDEX_ASSIGNMENT:
+            bytes += freeExprTree(stack, exp->as.index.object);
+            bytes += freeExprTree(stack, exp->as.index.index);
+            if (exp->as.index.value != NULL) {
+                bytes += freeExprTree(stack, exp->as.index.value);
+            }
+            break;
+        case INVOKE_EXP:
+            bytes += freeExprTree(stack, exp->as.invoke.receiver);
+            bytes += freeExpressionList(stack, exp->as.invoke.arguments);
+            if (exp->as.invoke.block != NULL) {
+                bytes += freeBlock(stack, exp->as.invoke.block);
+            }
+            break;
+        case HASH_LITERAL:
+            bytes += freeExpressionList(stack, exp->as.hashLiteral.keys);
+            bytes += freeExpressionList(stack, exp->as.hashLiteral.values);
+            break;
+        case INTERPOLATION:
+            bytes += freeExpressionList(stack, exp->as.interpolation.parts);
+            break;
+        case INLINED_CALL:
+            bytes += freeExprTree(stack, exp->as.inlined.call);
+            bytes += freeExprTree(stack, exp->as.inlined.body);
+            break;
+        default:
+            break;
+    }
+
+    free(exp);
+    return bytes;
+}
+
+static long freeStmtTree(WalkStack *stack, Stmt *stmt) {
+    if (walkStackLow(stack)) {
+        return treeOnNewSegment(stack, freeSegment, stmt, NULL).bytes;
+    }
+
+    long bytes = sizeof(Stmt);
+    ConditionalArray *conditionals;
+
+    switch (stmt->type) {
+        case PUTS_STMT:
+            bytes += freeExprTree(stack, stmt->as.puts.exp);
+            break;
+        case EXPR_STMT:
+            bytes += freeExprTree(stack, stmt->exprStmt);
+            break;
+        case IF_STMT:
+            conditionals = stmt->as.ifStmt.conditionals;
+            for(int i = 0; i < conditionals->size; i++) {
+                bytes += sizeof(Conditional);
+                bytes += freeExprTree(stack, conditionals->list[i]->condition);
+                bytes += freeStatementList(stack, conditionals->list[i]->statements);
+                free(conditionals->list[i]);
+            }
+            free(conditionals->list);
+            free(conditionals);
+            break;
+        case WHILE_STMT:
+            bytes += freeExprTree(stack, stmt->as.whileStmt.condition);
+            bytes += freeStatementList(stack, stmt->as.whileStmt.statements);
+            break;
+        case FOR_STMT:
+        case PARALLEL_FOR_STMT:
+            bytes += freeExprTree(stack, stmt->as.forStmt.identifier);
+            bytes += freeExprTree(stack, stmt->as.forStmt.range);
+            bytes += freeStatementList(stack, stmt->as.forStmt.statements);
+            break;
+        case DEF_STMT:
+            bytes += freeExpressionList(stack, stmt->as.defStmt.arguments);
+            bytes += freeStatementList(stack, stmt->as.defStmt.statements);
+            break;
+    }
+
+    free(stmt);
+    return bytes;
+}
+
+static bool statementsKept(WalkStack *stack, StmtArray *array);
+
+static bool expressionsKept(WalkStack *stack, ExprArray *array) {
+    for(int i = 0; i < array->size; i++) {
+        if (exprKept(stack, array->list[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Blocks live on in closures and enumerators.
+static bool exprKept(WalkStack *stack, Expr *exp) {
+    if (walkStackLow(stack)) {
+        return treeOnNewSegment(stack, keptSegment, NULL, exp).kept;
+    }
+
+    switch (exp->type) {
+        case BINARY:
+            return exprKept(stack, exp->as.binary.left) || exprKept(stack, exp->as.binary.right);
+        case METHOD_CALL_EXP:
+            return expressionsKept(stack, exp->as.methodCall.arguments);
+        case VAR_ASSIGNMENT:
+            return exprKept(stack, exp->as.varAssignment.value);
+        case LOGICAL:
+            return exprKept(stack, exp->as.logical.left) || exprKept(stack, exp->as.logical.right);
+        case UNARY:
+            return exprKept(stack, exp->as.unary.operand);
+        case RANGE:
+            return exprKept(stack, exp->as.range.start) || exprKept(stack, exp->as.range.end);
+        case ARRAY_LITERAL:
+            return expressionsKept(stack, exp->as.arrayLiteral.elements);
+        case INDEX_EXP:
+        case INDEX_ASSIGNMENT:
+            return exprKept(stack, exp->as.index.object) || exprKept(stack, exp->as.index.index) ||
+                (exp->as.index.value != NULL && exprKept(stack, exp->as.index.value));
+        case INVOKE_EXP:
+            return exp->as.invoke.block != NULL || exprKept(stack, exp->as.invoke.receiver) ||
+                expressionsKept(stack, exp->as.invoke.arguments);
+        case HASH_LITERAL:
+            return expressionsKept(stack, exp->as.hashLiteral.keys) || expressionsKept(stack, exp->as.hashLiteral.values);
+        case INTERPOLATION:
+            return expressionsKept(stack, exp->as.interpolation.parts);
+        case INLINED_CALL:
+            return exprKept(stack, exp->as.inlined.call);
+        default:
+            return false;
+    }
+}
+
+// Whether anything can still use the statement once it has run. Methods
+// keep their def.
+static bool stmtKept(WalkStack *stack, Stmt *stmt) {
+    ConditionalArray *conditionals;
+
+    if (walkStackLow(stack)) {
+        return treeOnNewSegment(stack, keptSegment, stmt, NULL).kept;
+    }
+
+    switch (stmt->type) {
+        case PUTS_STMT:
+            return exprKept(stack, stmt->as.puts.exp);
+        case EXPR_STMT:
+            return exprKept(stack, stmt->exprStmt);
+        case IF_STMT:
+            conditionals = stmt->as.ifStmt.conditionals;
+            for(int i = 0; i < conditionals->size; i++) {
+                if (exprKept(stack, conditionals->list[i]->condition) ||
+                    statementsKept(stack, conditionals->list[i]->statements)) {
+                    return true;
+                }
+            }
+            return false;
+        case WHILE_STMT:
+            return exprKept(stack, stmt->as.whileStmt.condition) || statementsKept(stack, stmt->as.whileStmt.statements);
+        case FOR_STMT:
+        case PARALLEL_FOR_STMT:
+            return exprKept(stack, stmt->as.forStmt.range) || statementsKept(stack, stmt->as.forStmt.statements);
+        case DEF_STMT:
+            return true;
+    }
+    return true;
+}
+
+static bool statementsKept(WalkStack *stack, StmtArray *array) {
+    for(int i = 0; i < array->size; i++) {
+        if (stmtKept(stack, array->list[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+long freeStatementTree(Stmt *stmt) {
+    WalkStack stack;
+    initWalkStack(&stack);
+    return freeStmtTree(&stack, stmt);
+}
+
+long freeExpressionTree(Expr *exp) {
+    WalkStack stack;
+    initWalkStack(&stack);
+    return freeExprTree(&stack, exp);
+}
+
+bool statementKept(Stmt *stmt) {
+    WalkStack stack;
+    initWalkStack(&stack);
+    return stmtKept(&stack, stmt);
+}
+
+bool expressionKept(Expr *exp) {
+    WalkStack stack;
+    initWalkStack(&stack);
+    return exprKept(&stack, exp);
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Arrays
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
 StmtArray *initStmtArray(void) {
     StmtArray *array = malloc(sizeof(StmtArray));
     INIT_ARRAY(array, StmtArray);
@@ -416,6 +1392,13 @@ ExprArray *initExprArray(void) {
     return array;
 }
 
+UpvalueArray *initUpvalueArray(void) {
+    UpvalueArray *array = malloc(sizeof(UpvalueArray));
+    INIT_ARRAY(array, UpvalueArray);
+
+    return array;
+}
+
 ConditionalArray *initConditionalArray(void) {
     ConditionalArray *array = malloc(sizeof(ConditionalArray));
     INIT_ARRAY(array, ConditionalArray);
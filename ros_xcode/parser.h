@@ -13,6 +13,8 @@
 #include "token.h"
 #include "array.h"
 
+struct Object;
+
 typedef enum ExprType {
     BINARY,
     NUMBER_LITERAL,
@@ -21,9 +23,103 @@ typedef enum ExprType {
     IDENTIFIER_EXP,
     METHOD_CALL_EXP,
     VAR_ASSIGNMENT,
-    RANGE
+    RANGE,
+    ARRAY_LITERAL,
+    INDEX_EXP,
+    INDEX_ASSIGNMENT,
+    INVOKE_EXP,
+    HASH_LITERAL,
+    INTERPOLATION,
+    LOGICAL,
+    UNARY,
+    INLINED_CALL,
+    INLINED_ARGUMENT
 } ExprType;
 
+#define EXPR_TYPE_COUNT (INLINED_ARGUMENT + 1)
+
+/*
+  What a BINARY node has turned into. Every node starts BINARY_UNSEEN and
+  watches the types of its operands for its first BINARY_WARMUP
+  evaluations. If they were always the same pair it rewrites itself into
+  the kind for that operator and pair, which checks the types and does the
+  operation straight away. A node that sees anything else, either while
+  warming up or later when the check fails, becomes BINARY_GENERIC for good.
+*/
+typedef enum BinaryKind {
+    BINARY_UNSEEN,
+    BINARY_GENERIC,
+    ADD_NUM_NUM,
+    SUBTRACT_NUM_NUM,
+    MULTIPLY_NUM_NUM,
+    DIVIDE_NUM_NUM,
+    MODULO_NUM_NUM,
+    GREATER_NUM_NUM,
+    GREATER_EQUAL_NUM_NUM,
+    LESS_NUM_NUM,
+    LESS_EQUAL_NUM_NUM,
+    EQUAL_NUM_NUM,
+    NOT_EQUAL_NUM_NUM,
+    POWER_NUM_NUM,
+    ADD_STR_STR
+} BinaryKind;
+
+#define BINARY_WARMUP 2
+
+/*
+  Where a variable lives, worked out by the parser. Only variables used
+  inside blocks are resolved, everything else is looked up by name in the
+  environment of the method or the top level.
+*/
+typedef enum VariableKind {
+    VARIABLE_NAMED,
+    // A slot in the frame of the block running.
+    VARIABLE_LOCAL,
+    // Captured from outside the block when it is passed.
+    VARIABLE_UPVALUE
+} VariableKind;
+
+/*
+  A variable a block captures. `index` is a local slot or an upvalue of
+  the enclosing block depending on `source`, for VARIABLE_NAMED the name
+  is looked up where the block is passed.
+*/
+typedef struct Upvalue {
+    VariableKind source;
+    int index;
+    char *name;
+    int length;
+} Upvalue;
+
+typedef struct UpvalueArray {
+    Upvalue **list;
+    int size;
+    int capacity;
+} UpvalueArray;
+
+// do |params| ... end or { |params| ... }. The params are the first
+// locals, followed by the variables first assigned inside the block.
+typedef struct Block {
+    int line;
+    int paramCount;
+    int localCount;
+    struct UpvalueArray *upvalues;
+    struct StmtArray *statements;
+} Block;
+
+/*
+  What the parser knows about variables at the current point. Blocks
+  number their locals and see through to the enclosing scope, the top
+  level and method bodies only remember the names assigned so far.
+*/
+typedef struct Scope {
+    struct Scope *enclosing;
+    Block *block;
+    Token *names;
+    int size;
+    int capacity;
+} Scope;
+
 typedef struct Expr {
     ExprType type;
     int line;
@@ -32,20 +128,31 @@ typedef struct Expr {
             struct Expr *left;
             struct Expr *right;
             TokenType op;
+            // Type feedback, only ever changed through atomics since
+            // parallel loops share the tree. Not kept in the AST cache.
+            BinaryKind kind;
+            unsigned char leftType;
+            unsigned char rightType;
+            unsigned char samples;
         } binary;
 
         struct {
             double number;
         } numberLiteral;
 
+        // The characters between the quotes, and the String object every
+        // evaluation of the literal returns.
         struct {
             char *string;
             int length;
+            struct Object *object;
         } stringLiteral;
 
         struct {
             char *string;
             int length;
+            VariableKind kind;
+            int slot;
         } identifierExp;
         
         /*
@@ -62,17 +169,90 @@ typedef struct Expr {
             bool value;
         } boolExp;
 
+        // start..end or start...end
         struct {
             char *type;
-            double start;
-            double end;
+            struct Expr *start;
+            struct Expr *end;
         } range;
 
         struct {
             char *name;
             int length;
             struct Expr *value;
+            VariableKind kind;
+            int slot;
         } varAssignment;
+
+        struct {
+            struct ExprArray *elements;
+        } arrayLiteral;
+
+        /*
+            "total: #{n}" is compiled into the parts "total: " and n, the
+            constant ones are STRING_LITERAL.
+         */
+        struct {
+            struct ExprArray *parts;
+        } interpolation;
+
+        // {key => value}, keys and values are parallel arrays.
+        struct {
+            struct ExprArray *keys;
+            struct ExprArray *values;
+        } hashLiteral;
+
+        // left && right or left || right, the value of whichever side
+        // decided it. The right side only runs when the left doesn't.
+        struct {
+            struct Expr *left;
+            struct Expr *right;
+            TokenType op;
+        } logical;
+
+        // -operand or !operand
+        struct {
+            struct Expr *operand;
+            TokenType op;
+        } unary;
+
+        /*
+            object[index], value is only set for INDEX_ASSIGNMENT:
+            object[index] = value
+         */
+        struct {
+            struct Expr *object;
+            struct Expr *index;
+            struct Expr *value;
+        } index;
+
+        // Method called on a value: receiver.name(arguments) with an
+        // optional block.
+        struct {
+            struct Expr *receiver;
+            char *name;
+            int length;
+            struct ExprArray *arguments;
+            Block *block;
+        } invoke;
+
+        /*
+            A METHOD_CALL_EXP the inliner replaced with the body of the
+            method, see inliner.h. `call` is the original node, run when
+            the method the body came from is no longer the one defined.
+         */
+        struct {
+            struct Expr *call;
+            struct Expr *body;
+            struct Stmt *def;
+            // Epoch of the last interpreter state it was checked in.
+            long epoch;
+        } inlined;
+
+        // An argument of the inlined call being evaluated.
+        struct {
+            int index;
+        } inlinedArgument;
     } as;
 } Expr;
 
@@ -82,9 +262,27 @@ typedef enum StmtType {
     IF_STMT,
     WHILE_STMT,
     FOR_STMT,
-    DEF_STMT
+    DEF_STMT,
+    PARALLEL_FOR_STMT
 } StmtType;
 
+#define STMT_TYPE_COUNT (PARALLEL_FOR_STMT + 1)
+
+/*
+  Bodies of lazy defs shorter than this are parsed right away anyway.
+  Skimming them saves next to nothing and would keep the tiny ones from
+  being inlined.
+*/
+#define LAZY_BODY_MIN 64
+
+// How `parallel for ... reduce(op, name)` folds the value of each iteration.
+typedef enum ReduceOp {
+    REDUCE_NONE,
+    REDUCE_SUM,
+    REDUCE_PRODUCT,
+    REDUCE_COUNT
+} ReduceOp;
+
 
 typedef struct Stmt {
     StmtType type;
@@ -103,10 +301,17 @@ typedef struct Stmt {
             struct StmtArray *statements;
         } whileStmt;
         
+        /*
+            Also used by PARALLEL_FOR_STMT, the only one that
+            sets a reduction.
+         */
         struct {
             Expr *identifier;
             Expr *range;
             struct StmtArray *statements;
+            ReduceOp reduceOp;
+            char *reduceName;
+            int reduceLength;
         } forStmt;
 
         struct {
@@ -114,6 +319,14 @@ typedef struct Stmt {
             int nameLength;
             struct ExprArray *arguments;
             struct StmtArray *statements;
+            // Filled in by inferTypes(), see type_inference.h.
+            struct NumericMethod *numeric;
+            // Set when the body was only skimmed. It is parsed from
+            // `body` when the method is first called, `body` is NULL
+            // from then on, see parseMethodBody().
+            bool lazy;
+            char *body;
+            int bodyLine;
         } defStmt;
 
         struct {
@@ -159,30 +372,56 @@ Stmt *parseIf(Scanner *scanner);
 Stmt *parseWhile(Scanner *scanner);
 Stmt *newStmt(int line, StmtType type);
 Stmt *parseFor(Scanner *scanner);
+Stmt *parseParallelFor(Scanner *scanner);
+Stmt *parseForLoop(Scanner *scanner, StmtType type);
+void parseReduce(Scanner *scanner, Stmt *forStmt);
 Stmt *parseDef(Scanner *scanner);
+bool parseMethodBody(Stmt *def, char *error);
 
 Expr *expression(Scanner *scanner);
-Expr *assignment(Scanner *scanner);
-Expr *equality(Scanner *scanner);
-Expr *comparison(Scanner *scanner);
-Expr *term(Scanner *scanner);
-Expr *factor(Scanner *scanner);
-Expr *primary(Scanner *scanner);
 Expr *newExpr(int line, ExprType type);
 
 Conditional *newConditional(void);
 Expr *newBinary(Expr *left, Expr *right, TokenType op, int line);
+Expr *newLogical(Expr *left, Expr *right, TokenType op, int line);
+Expr *newUnary(Expr *operand, TokenType op, int line);
 Expr *newBooleanExpr(Token token, bool value);
 Expr *newNumberLiteral(Token *token);
 Expr *newStringLiteral(Token *token);
-Expr *newVarAssignment(int line, Expr *identifier, Expr *value);
-Expr *newRangeExpression(Token token);
+Expr *newStringSlice(int line, char *string, int length);
+Expr *newInterpolation(Scanner *scanner, Token *token);
+Expr *interpolatedExpression(Scanner *scanner, char *start, int line, char **end);
+Expr *newVarAssignment(Scanner *scanner, Expr *identifier, Expr *value);
+Expr *newRangeExpression(Expr *start, Expr *end, TokenType type, int line);
 Expr *newMethodCallExpression(Scanner *scanner, Token token);
-Expr *newIdentifierExpression(Token token);
+Expr *newIdentifierExpression(Scanner *scanner, Token token);
+Expr *newArrayLiteral(Scanner *scanner, Token token);
+Expr *newHashLiteral(Scanner *scanner, Token token);
+Expr *newIndexExpression(Expr *object, Expr *index, int line);
+Expr *newIndexAssignment(int line, Expr *target, Expr *value);
+Expr *newInvokeExpression(Scanner *scanner, Expr *receiver, Token name);
+ExprArray *parseArguments(Scanner *scanner);
+Block *parseBlock(Scanner *scanner, TokenType closing);
+UpvalueArray *initUpvalueArray(void);
+void beginScope(Scanner *scanner, Scope *scope, Block *block);
+void endScope(Scanner *scanner, Scope *scope);
+void declareVariable(Scanner *scanner, Token name, VariableKind *kind, int *slot);
 Expr *handleIdenfierExpression(Scanner *scanner, Token token);
 
 void freeStatements(StmtArray *array);
 void freeStatement(Stmt *stmt);
 void freeExpression(Expr *exp);
 
+/*
+  freeStatement() only frees part of a tree, these free all of it and
+  return the bytes of the nodes counted in stats.astBytes. Defs that went
+  through inferTypes() never get here.
+*/
+long freeStatementTree(Stmt *stmt);
+long freeExpressionTree(Expr *exp);
+// Whether anything can still use the node once it has run: methods keep
+// their def, closures and enumerators their block.
+bool statementKept(Stmt *stmt);
+bool expressionKept(Expr *exp);
+
 #endif /* parser_h */
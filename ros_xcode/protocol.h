@@ -0,0 +1,28 @@
+//
+//  protocol.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-06.
+//
+
+#ifndef protocol_h
+#define protocol_h
+
+/*
+  Wire format shared by `ros_xcode --serve` and the `ros` client.
+
+  Request, client -> server:
+    - int32 length followed by `length` bytes holding NUL separated strings:
+      the absolute script path and then its arguments. Scripts can't read
+      arguments, the server refuses a request with any.
+    - the client's stdin, stdout and stderr sent along as SCM_RIGHTS with the
+      length so the script writes straight to the caller's terminal or pipe.
+  Response, server -> client:
+    - a single status byte once the script is done. A worker that dies
+      mid-script just closes the connection.
+*/
+#define DEFAULT_SOCKET_PATH "/tmp/ros_xcode.sock"
+#define SOCKET_ENV "ROS_SOCKET"
+#define MAX_REQUEST_SIZE 65536
+
+#endif /* protocol_h */
@@ -0,0 +1,141 @@
+//
+//  ros.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-08.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "ros.h"
+#include "interpreter.h"
+#include "file.h"
+#include "scheduler.h"
+#include "session.h"
+
+Ros *ros_new(void) {
+    return newInterpreter();
+}
+
+static int evalSource(Ros *ros, char *source) {
+    ros->error[0] = '\0';
+    StmtArray *statements = parseProgram(ros, source);
+    if (statements == NULL) {
+        free(source);
+        return 1;
+    }
+
+    return runProgram(ros, statements) ? 0 : 1;
+}
+
+int ros_eval_file(Ros *ros, const char *path) {
+    char *source = readFile(path);
+    if (source == NULL) {
+        snprintf(ros->error, ERROR_MESSAGE_SIZE, "can't read %s", path);
+        return 1;
+    }
+
+    return evalSource(ros, source);
+}
+
+int ros_eval_string(Ros *ros, const char *source) {
+    return evalSource(ros, strdup(source));
+}
+
+const char *ros_error(Ros *ros) {
+    return ros->error;
+}
+
+void ros_set_output(Ros *ros, FILE *out) {
+    ros->out = out;
+}
+
+void ros_set_threads(Ros *ros, int threads) {
+    ros->threads = threads;
+}
+
+void ros_set_heap_quota(Ros *ros, size_t bytes) {
+    ros->heap.quota = bytes;
+}
+
+void ros_set_lazy_defs(Ros *ros, bool lazy) {
+    ros->lazyDefs = lazy;
+}
+
+size_t ros_heap_live(Ros *ros, const char *kind) {
+    if (kind == NULL) {
+        return ros->heap.live;
+    }
+    for(int i = 0; i < HEAP_KIND_COUNT; i++) {
+        if (strcmp(heapKindNames[i], kind) == 0) {
+            return ros->heap.kindBytes[i];
+        }
+    }
+    return 0;
+}
+
+void ros_free(Ros *ros) {
+    freeInterpreter(ros);
+}
+
+RosSession *ros_session_new(Ros *ros, const char *source) {
+    Session *session = newSession(ros, source);
+    memcpy(ros->error, session->error, ERROR_MESSAGE_SIZE);
+    return session;
+}
+
+int ros_session_edit(RosSession *session, size_t start, size_t end, const char *text) {
+    session->interp->error[0] = '\0';
+    return sessionEdit(session, start, end, text) ? 0 : 1;
+}
+
+int ros_session_run(RosSession *session) {
+    session->interp->error[0] = '\0';
+    return runSession(session) ? 0 : 1;
+}
+
+void ros_session_free(RosSession *session) {
+    freeSession(session);
+}
+
+static int spawnSource(RosScheduler *scheduler, Ros *ros, char *source) {
+    StmtArray *statements = parseProgram(ros, source);
+    if (statements == NULL) {
+        free(source);
+        return 1;
+    }
+
+    spawnFiber(scheduler, ros, statements, "");
+    return 0;
+}
+
+RosScheduler *ros_scheduler_new(int threads) {
+    return newScheduler(threads);
+}
+
+int ros_spawn_file(RosScheduler *scheduler, Ros *ros, const char *path) {
+    char *source = readFile(path);
+    if (source == NULL) {
+        snprintf(ros->error, ERROR_MESSAGE_SIZE, "can't read %s", path);
+        return 1;
+    }
+
+    return spawnSource(scheduler, ros, source);
+}
+
+int ros_spawn_string(RosScheduler *scheduler, Ros *ros, const char *source) {
+    return spawnSource(scheduler, ros, strdup(source));
+}
+
+void ros_scheduler_run(RosScheduler *scheduler) {
+    runScheduler(scheduler);
+}
+
+double ros_cpu_time(RosScheduler *scheduler, Ros *ros) {
+    Fiber *fiber = findFiber(scheduler, ros);
+    return fiber != NULL ? fiber->cpuTime : 0;
+}
+
+void ros_scheduler_free(RosScheduler *scheduler) {
+    freeScheduler(scheduler);
+}
@@ -0,0 +1,81 @@
+//
+//  ros.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-08.
+//
+
+#ifndef ros_h
+#define ros_h
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/*
+  Embedding API, built as libros.
+
+  Every instance is independent: it owns its globals, heap and output so
+  several of them can run at the same time on separate threads. A single
+  instance must only be used by one thread at a time.
+
+  The eval functions return 0 on success. On a syntax or runtime error they
+  return non zero and ros_error() describes what went wrong; the instance
+  stays usable and keeps whatever was defined before the error. After one
+  that succeeded ros_error() is empty, the same goes for the session
+  functions below.
+*/
+typedef struct Interpreter Ros;
+typedef struct Scheduler RosScheduler;
+
+Ros *ros_new(void);
+int ros_eval_file(Ros *ros, const char *path);
+int ros_eval_string(Ros *ros, const char *source);
+const char *ros_error(Ros *ros);
+// Where `puts` writes to, stdout by default.
+void ros_set_output(Ros *ros, FILE *out);
+// Threads used by `parallel for`, 0 (the default) means one per core.
+void ros_set_threads(Ros *ros, int threads);
+// Most bytes the instance's heap can have live, 0 (the default) means no
+// limit. An evaluation that needs more fails with a runtime error.
+void ros_set_heap_quota(Ros *ros, size_t bytes);
+// When set, later evaluations only parse the body of a method the first
+// time it is called. A syntax error in it is then raised by that call.
+void ros_set_lazy_defs(Ros *ros, bool lazy);
+// Bytes live in the instance's heap that are of `kind` ("object", "table",
+// "entry", "string", "array", "hash", "closure", "enumerator" or "ast"),
+// all of them when it is NULL.
+size_t ros_heap_live(Ros *ros, const char *kind);
+void ros_free(Ros *ros);
+
+/*
+  A script kept parsed between edits, for an editor or a REPL that runs it
+  again after every change. An edit only parses again the top-level
+  statements it touches, the rest keep their nodes. Runs happen in `ros`,
+  so whatever an earlier run assigned or defined is still there. A syntax
+  error an edit leaves in the text makes ros_session_run() fail with it
+  until another edit fixes it. Free the session before the instance.
+*/
+typedef struct Session RosSession;
+
+RosSession *ros_session_new(Ros *ros, const char *source);
+// Replaces the bytes from `start` up to `end` with `text`.
+int ros_session_edit(RosSession *session, size_t start, size_t end, const char *text);
+int ros_session_run(RosSession *session);
+void ros_session_free(RosSession *session);
+
+/*
+  Many instances can run at once as fibers over a few threads. A spawned
+  script is parsed right away and runs in ros_scheduler_run(), which
+  returns once all of them have finished. ros_error() is empty for the
+  ones that did without an error. An instance runs nothing else until
+  its script has run.
+*/
+RosScheduler *ros_scheduler_new(int threads);
+int ros_spawn_file(RosScheduler *scheduler, Ros *ros, const char *path);
+int ros_spawn_string(RosScheduler *scheduler, Ros *ros, const char *source);
+void ros_scheduler_run(RosScheduler *scheduler);
+// CPU seconds the last script spawned on `ros` took.
+double ros_cpu_time(RosScheduler *scheduler, Ros *ros);
+void ros_scheduler_free(RosScheduler *scheduler);
+
+#endif /* ros_h */
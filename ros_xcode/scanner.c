@@ -10,17 +10,55 @@
 #include <stdlib.h>
 #include "scanner.h"
 #include "token.h"
+#include "stats.h"
 #include <stdbool.h>
 #include <ctype.h>
+#include <stdarg.h>
 
 void initScanner(Scanner *scanner, char *code) {
+    initScannerWithErrors(scanner, code, NULL);
+}
+
+// The first token is scanned right away so `errorJump` has to be
+// in place before that happens.
+void initScannerWithErrors(Scanner *scanner, char *code, jmp_buf *errorJump) {
+    initScannerAtLine(scanner, code, 1, errorJump);
+}
+
+// For code that starts partway into a file, like an interpolation.
+void initScannerAtLine(Scanner *scanner, char *code, int line, jmp_buf *errorJump) {
     scanner->start = code;
     scanner->current = code;
-    scanner->line = 1;
+    scanner->line = line;
+    scanner->errorJump = errorJump;
+    scanner->error[0] = '\0';
+    scanner->scope = NULL;
+    scanner->lazyDefs = false;
+    initWalkStack(&scanner->stack);
     Token token = initToken(scanner);
     scanner->peek = token;
 }
 
+void syntaxError(Scanner *scanner, int line, const char *format, ...) {
+    int length = snprintf(scanner->error, ERROR_MESSAGE_SIZE, "line %d: ", line);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(scanner->error + length, ERROR_MESSAGE_SIZE - length, format, args);
+    va_end(args);
+
+    raiseSyntaxError(scanner);
+}
+
+// Unwinds with whatever is in scanner->error.
+void raiseSyntaxError(Scanner *scanner) {
+    if (scanner->errorJump != NULL) {
+        longjmp(*scanner->errorJump, 1);
+    }
+
+    fprintf(stderr, "%s\n", scanner->error);
+    exit(1);
+}
+
 Token newToken(TokenType type, int line, int length, char *lexeme) {
     Token token;
     token.type = type;
@@ -40,7 +78,13 @@ Token initToken(Scanner *scanner) {
 // Advances the token but returns the previously current token
 Token advanceToken(Scanner *scanner) {
     Token prev = scanner->peek;
-    scanner->peek = calculateToken(scanner);
+    if (stats.enabled) {
+        double start = currentTime();
+        scanner->peek = calculateToken(scanner);
+        stats.scanTime += currentTime() - start;
+    } else {
+        scanner->peek = calculateToken(scanner);
+    }
     scanner->peek_prev = prev;
     return prev;
 }
@@ -61,16 +105,11 @@ bool atEnd(Scanner *scanner) {
 }
 
 Token calculateToken(Scanner *scanner) {
-    // Handles white spaces,
-    
+    // Handles white spaces and new lines, counting the latter.
     while(isWhiteSpace(scanner->start[0])) {
-//        printf("white space skipped\n");
-        scanner->start++;
-    }
-
-    while(isNewLine(scanner->start[0])) {
-//        printf("new line skipped skipped\n");
-        scanner->line++;
+        if (isNewLine(scanner->start[0])) {
+            scanner->line++;
+        }
         scanner->start++;
     }
 
@@ -79,7 +118,6 @@ Token calculateToken(Scanner *scanner) {
         while(scanner->start[0] != '\n' && !atEnd(scanner)) {
             scanner->start++;
         }
-        scanner->line++;
         /*
           After we're out of a comments we need to re check all the other
           previous conditions again. This is not efficient because we're building
@@ -98,7 +136,12 @@ Token calculateToken(Scanner *scanner) {
             token = newToken(MINUS, scanner->line, 1, scanner->start);
             break;
         case '*':
-            token = newToken(STAR, scanner->line, 1, scanner->start);
+            if (scanner->current[0] == '*') {
+                token = newToken(STAR_STAR, scanner->line, 2, scanner->start);
+                scanner->current++;
+            } else {
+                token = newToken(STAR, scanner->line, 1, scanner->start);
+            }
             break;
         case '/':
             token = newToken(FORWARD_SLASH, scanner->line, 1, scanner->start);
@@ -115,6 +158,43 @@ Token calculateToken(Scanner *scanner) {
         case ',':
             token = newToken(COMMA, scanner->line, 1, scanner->start);
             break;
+        case '[':
+            token = newToken(LEFT_BRACKET, scanner->line, 1, scanner->start);
+            break;
+        case ']':
+            token = newToken(RIGHT_BRACKET, scanner->line, 1, scanner->start);
+            break;
+        case '.':
+            if (scanner->current[0] == '.' && scanner->current[1] == '.') {
+                token = newToken(EXCLUSIVE_RANGE, scanner->line, 3, scanner->start);
+                scanner->current += 2;
+            } else if (scanner->current[0] == '.') {
+                token = newToken(INCLUSIVE_RANGE, scanner->line, 2, scanner->start);
+                scanner->current++;
+            } else {
+                token = newToken(DOT, scanner->line, 1, scanner->start);
+            }
+            break;
+        case '{':
+            token = newToken(LEFT_BRACE, scanner->line, 1, scanner->start);
+            break;
+        case '}':
+            token = newToken(RIGHT_BRACE, scanner->line, 1, scanner->start);
+            break;
+        case '|':
+            if (scanner->current[0] == '|') {
+                token = newToken(PIPE_PIPE, scanner->line, 2, scanner->start);
+                scanner->current++;
+            } else {
+                token = newToken(PIPE, scanner->line, 1, scanner->start);
+            }
+            break;
+        case '&':
+            if (scanner->current[0] == '&') {
+                token = newToken(AND_AND, scanner->line, 2, scanner->start);
+                scanner->current++;
+            }
+            break;
         case '=':
             if (scanner->current[0] == '=') {
                 token = newToken(EQUAL_EQUAL, scanner->line, 1, scanner->start);
@@ -122,6 +202,9 @@ Token calculateToken(Scanner *scanner) {
                     account for the extra equal so that we do not parse it next time around
                 */
                 scanner->current++;
+            } else if (scanner->current[0] == '>') {
+                token = newToken(FAT_ARROW, scanner->line, 2, scanner->start);
+                scanner->current++;
             } else {
                 token = newToken(EQUAL, scanner->line, 1, scanner->start);
             }
@@ -146,6 +229,9 @@ Token calculateToken(Scanner *scanner) {
             if (scanner->current[0] == '=') {
                 token = newToken(LESS_EQUAL, scanner->line, 1, scanner->start);
                 scanner->current++;
+            } else if (scanner->current[0] == '<') {
+                token = newToken(LESS_LESS, scanner->line, 2, scanner->start);
+                scanner->current++;
             } else {
                 token = newToken(LESS, scanner->line, 1, scanner->start);
             }
@@ -156,9 +242,9 @@ Token calculateToken(Scanner *scanner) {
     }
 
     if (scanner->start[0] == '"') {
-        captureFullString(scanner);
+        bool interpolated = captureFullString(scanner);
         int length = (int)(scanner->current - scanner->start);
-        token = newToken(STRING, scanner->line, length, scanner->start);
+        token = newToken(interpolated ? INTERPOLATED_STRING : STRING, scanner->line, length, scanner->start);
     }
 
     if (isAlpha(scanner->start[0])) {
@@ -180,7 +266,7 @@ Token calculateToken(Scanner *scanner) {
     }
     
     if(isNumber(scanner->start[0])) {
-        token = handleNumberOrRange(scanner);
+        token = handleNumber(scanner);
     }
 
     if (!atEnd(scanner)) {
@@ -188,65 +274,91 @@ Token calculateToken(Scanner *scanner) {
     }
     
     if (token.type == EMPTY_TOKEN) {
-        printf("exiting character %c not recognized!\n", scanner->start[0]);
-        exit(1);
+        syntaxError(scanner, scanner->line, "character %c not recognized", token.lexeme[0]);
     }
     return token;
 }
 
+// Method names can end in a question mark: key?
 void captureFullIdentifier(Scanner *scanner) {
     while(isAllowedIdentifier(scanner->current[0])) {
         scanner->current++;
     }
+    if (scanner->current[0] == '?') {
+        scanner->current++;
+    }
 }
 
-void captureFullString(Scanner *scanner) {
+// Returns whether the string has #{} in it.
+bool captureFullString(Scanner *scanner) {
+    bool interpolated = false;
+
     while(scanner->current[0] != '"') {
+        if (scanner->current[0] == '\0') {
+            syntaxError(scanner, scanner->line, "unterminated string");
+        }
+        if (scanner->current[0] == '#' && scanner->current[1] == '{') {
+            skipInterpolation(scanner);
+            interpolated = true;
+            continue;
+        }
         scanner->current++;
     }
     // Moves past the "
     scanner->current++;
+    return interpolated;
 }
 
-Token handleNumberOrRange(Scanner *scanner) {
-    int length;
-    
-    while(isNumber(scanner->current[0])) {
+// Moves past the } that closes the #{ at current, the code in between can
+// have braces and strings of its own.
+void skipInterpolation(Scanner *scanner) {
+    int depth = 1;
+    scanner->current += 2;
+
+    while(depth > 0) {
+        switch (scanner->current[0]) {
+            case '\0':
+                syntaxError(scanner, scanner->line, "unterminated string interpolation");
+                break;
+            case '"':
+                scanner->current++;
+                captureFullString(scanner);
+                continue;
+            case '{':
+                depth++;
+                break;
+            case '}':
+                depth--;
+                break;
+        }
         scanner->current++;
     }
+}
 
-//      We have a ruby range.
-    if (scanner->current[0] == '.' && scanner->current[1]  == '.') {
-        scanner->current++;
-        scanner->current++;
-        TokenType type = INCLUSIVE_RANGE;
-
-        if (scanner->current[0] == '.') {
-            scanner->current++;
-            type = EXCLUSIVE_RANGE;
-        }
-        
-//        We need to resolve the second part of the range
-        while(isNumber(scanner->current[0])) {
-            scanner->current++;
-        }
+// Digits can be grouped with underscores: 10_000_000. The .. of a range
+// is a token of its own.
+Token handleNumber(Scanner *scanner) {
+    int length;
 
-        length = (int)(scanner->current - scanner->start);
-        return newToken(type, scanner->line, length, scanner->start);
-    }
+    captureDigits(scanner);
 
-    if (scanner->current[0] == '.') {
+    // Only a decimal point when a digit follows, 5.times is a method call.
+    if (scanner->current[0] == '.' && isNumber(scanner->current[1])) {
         scanner->current++;
 //          we resolve the decimal part of the number
-        while(isNumber(scanner->current[0])) {
-            scanner->current++;
-        }
+        captureDigits(scanner);
     }
 
     length = (int)(scanner->current - scanner->start);
     return newToken(NUMBER, scanner->line, length, scanner->start);
 }
 
+void captureDigits(Scanner *scanner) {
+    while(isNumber(scanner->current[0]) || (scanner->current[0] == '_' && isNumber(scanner->current[1]))) {
+        scanner->current++;
+    }
+}
+
 bool isNewLine(char c) {
     if(c == '\n' ) {
         return true;
@@ -281,8 +393,9 @@ Token consume(Scanner *scanner, TokenType type) {
         return scanner->peek_prev;
     }
 
-    printf("Expected token of type %d not found", type);
-    exit(1);
+    syntaxError(scanner, scanner->peek.line, "expected token of type %d, got '%.*s'",
+        type, scanner->peek.length, scanner->peek.lexeme);
+    return scanner->peek;
 }
 
 bool match(Scanner *scanner, TokenType type) {
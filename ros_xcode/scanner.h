@@ -11,6 +11,12 @@
 #include <stdio.h>
 #include "token.h"
 #include <stdbool.h>
+#include <setjmp.h>
+#include "walk_stack.h"
+
+#define ERROR_MESSAGE_SIZE 256
+
+struct Scope;
 
 typedef struct Scanner {
     char *start;
@@ -19,6 +25,17 @@ typedef struct Scanner {
     Token peek_prev;
     Token peek_next;
     int line;
+    // When set, syntax errors jump here with the message in `error`
+    // instead of exiting the process.
+    jmp_buf *errorJump;
+    char error[ERROR_MESSAGE_SIZE];
+    // Variables the parser knows about where it currently is, see Scope
+    // in parser.h.
+    struct Scope *scope;
+    // Only skim the bodies of defs, see parseDef().
+    bool lazyDefs;
+    // Where deeply nested code goes on on a segment.
+    WalkStack stack;
 } Scanner;
 
 typedef struct Keyword {
@@ -40,11 +57,18 @@ static Keyword keywords[] = {
     {"in", 2, IN},
     {"def", 3, DEF},
     {"return", 6, RETURN},
+    {"parallel", 8, PARALLEL},
+    {"reduce", 6, REDUCE},
+    {"do", 2, DO},
     // sentinel
     {NULL, 0, END_OF_FILE}
 };
 
 void initScanner(Scanner *scanner, char *code);
+void initScannerWithErrors(Scanner *scanner, char *code, jmp_buf *errorJump);
+void initScannerAtLine(Scanner *scanner, char *code, int line, jmp_buf *errorJump);
+void syntaxError(Scanner *scanner, int line, const char *format, ...);
+void raiseSyntaxError(Scanner *scanner);
 Token newToken(TokenType type, int line, int length, char *lexeme);
 Token initToken(Scanner *scanner);
 bool isWhiteSpace(char c);
@@ -60,8 +84,10 @@ bool isAlpha(char c);
 bool isAllowedIdentifier(char c);
 void captureFullIdentifier(Scanner *scanner);
 void captureFullNumber(Scanner *scanner);
-void captureFullString(Scanner *scanner);
-Token handleNumberOrRange(Scanner *scanner);
+bool captureFullString(Scanner *scanner);
+void skipInterpolation(Scanner *scanner);
+Token handleNumber(Scanner *scanner);
+void captureDigits(Scanner *scanner);
 void printIdentifier(char *identifier, int lenght);
 
 #endif /* scanner_h */
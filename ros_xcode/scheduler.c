@@ -0,0 +1,237 @@
+//
+//  scheduler.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-04-02.
+//
+
+// ucontext is only declared with _XOPEN_SOURCE on macOS.
+#ifdef __APPLE__
+#define _XOPEN_SOURCE 700
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include "scheduler.h"
+#include "segmented_stack.h"
+#include "thread_pool.h"
+#include "stats.h"
+
+typedef struct FiberContext {
+    ucontext_t running;
+    // The worker loop running the fiber, it goes back there to yield.
+    ucontext_t *home;
+} FiberContext;
+
+// makecontext() can only pass ints, the fiber is handed over through here.
+static _Thread_local Fiber *startingFiber;
+
+Scheduler *newScheduler(int size) {
+    Scheduler *scheduler = malloc(sizeof(Scheduler));
+    scheduler->size = size > 0 ? size : defaultPoolSize();
+    pthread_mutex_init(&scheduler->lock, NULL);
+    pthread_cond_init(&scheduler->wake, NULL);
+    scheduler->head = NULL;
+    scheduler->tail = NULL;
+    scheduler->pending = 0;
+    scheduler->fibers = malloc(sizeof(FiberArray));
+    INIT_ARRAY(scheduler->fibers, FiberArray);
+    return scheduler;
+}
+
+static double threadCpuTime(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Fibers
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+// The fiber's stack is left for good, the worker frees it.
+static void fiberMain(void) {
+    Fiber *fiber = startingFiber;
+    Interpreter *interp = fiber->interp;
+
+    fiber->ok = runProgram(interp, fiber->statements);
+    fiber->done = true;
+    interp->fiber = NULL;
+    interp->stackLimit = NULL;
+    interp->stackTop = NULL;
+    setcontext(fiber->context->home);
+}
+
+// The interpreter is the fiber's until it has run, and runs nothing else.
+Fiber *spawnFiber(Scheduler *scheduler, Interpreter *interp, StmtArray *statements, const char *name) {
+    Fiber *fiber = malloc(sizeof(Fiber));
+    fiber->interp = interp;
+    fiber->statements = statements;
+    fiber->name = name;
+    fiber->stack = malloc(FIBER_STACK_SIZE);
+    fiber->context = malloc(sizeof(FiberContext));
+    fiber->done = false;
+    fiber->ok = false;
+    fiber->cpuTime = 0;
+    fiber->slices = 0;
+    fiber->next = NULL;
+
+    getcontext(&fiber->context->running);
+    fiber->context->running.uc_stack.ss_sp = fiber->stack;
+    fiber->context->running.uc_stack.ss_size = FIBER_STACK_SIZE;
+    fiber->context->running.uc_link = NULL;
+    makecontext(&fiber->context->running, fiberMain, 0);
+
+    interp->fiber = fiber;
+    interp->stackLimit = fiber->stack + STACK_RESERVE;
+    interp->stackTop = fiber->stack + FIBER_STACK_SIZE;
+    interp->error[0] = '\0';
+
+    ADD_ARRAY_ELEMENT(scheduler->fibers, fiber, Fiber);
+    pthread_mutex_lock(&scheduler->lock);
+    if (scheduler->tail == NULL) {
+        scheduler->head = fiber;
+    } else {
+        scheduler->tail->next = fiber;
+    }
+    scheduler->tail = fiber;
+    scheduler->pending++;
+    pthread_mutex_unlock(&scheduler->lock);
+    return fiber;
+}
+
+void fiberYield(Interpreter *interp) {
+    FiberContext *context = interp->fiber->context;
+    swapcontext(&context->running, context->home);
+}
+
+Fiber *findFiber(Scheduler *scheduler, Interpreter *interp) {
+    for(int i = scheduler->fibers->size - 1; i >= 0; i--) {
+        if (scheduler->fibers->list[i]->interp == interp) {
+            return scheduler->fibers->list[i];
+        }
+    }
+    return NULL;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Workers
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static void runSlice(Fiber *fiber, ucontext_t *home) {
+    fiber->context->home = home;
+    fiber->interp->budget = FIBER_BUDGET;
+    if (fiber->slices == 0) {
+        startingFiber = fiber;
+    }
+
+    double start = threadCpuTime();
+    swapcontext(home, &fiber->context->running);
+    fiber->cpuTime += threadCpuTime() - start;
+    fiber->slices++;
+
+    if (fiber->done) {
+        free(fiber->stack);
+        fiber->stack = NULL;
+    }
+}
+
+static void *workLoop(void *argument) {
+    Scheduler *scheduler = argument;
+    ucontext_t home;
+
+    pthread_mutex_lock(&scheduler->lock);
+    while (true) {
+        while (scheduler->head == NULL && scheduler->pending > 0) {
+            pthread_cond_wait(&scheduler->wake, &scheduler->lock);
+        }
+        if (scheduler->head == NULL) {
+            break;
+        }
+
+        Fiber *fiber = scheduler->head;
+        scheduler->head = fiber->next;
+        if (scheduler->head == NULL) {
+            scheduler->tail = NULL;
+        }
+        fiber->next = NULL;
+        pthread_mutex_unlock(&scheduler->lock);
+
+        runSlice(fiber, &home);
+
+        pthread_mutex_lock(&scheduler->lock);
+        if (fiber->done) {
+            if (--scheduler->pending == 0) {
+                pthread_cond_broadcast(&scheduler->wake);
+            }
+        } else {
+            if (scheduler->tail == NULL) {
+                scheduler->head = fiber;
+            } else {
+                scheduler->tail->next = fiber;
+            }
+            scheduler->tail = fiber;
+            pthread_cond_signal(&scheduler->wake);
+        }
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+    return NULL;
+}
+
+// Hands what the fibers counted on it over to the thread that joins it.
+static void *workThread(void *argument) {
+    workLoop(argument);
+    return takeStats();
+}
+
+// Returns once every fiber spawned has finished. The calling thread is one
+// of the workers.
+void runScheduler(Scheduler *scheduler) {
+    pthread_t threads[scheduler->size];
+    for(int i = 1; i < scheduler->size; i++) {
+        pthread_create(&threads[i], NULL, workThread, scheduler);
+    }
+    workLoop(scheduler);
+    for(int i = 1; i < scheduler->size; i++) {
+        Stats *counted;
+        pthread_join(threads[i], (void **)&counted);
+        addStats(&stats, counted);
+        free(counted);
+    }
+}
+
+void freeScheduler(Scheduler *scheduler) {
+    for(int i = 0; i < scheduler->fibers->size; i++) {
+        Fiber *fiber = scheduler->fibers->list[i];
+        if (!fiber->done) {
+            fiber->interp->fiber = NULL;
+            fiber->interp->stackLimit = NULL;
+            fiber->interp->stackTop = NULL;
+        }
+        free(fiber->stack);
+        free(fiber->context);
+        free(fiber);
+    }
+    free(scheduler->fibers->list);
+    free(scheduler->fibers);
+    pthread_mutex_destroy(&scheduler->lock);
+    pthread_cond_destroy(&scheduler->wake);
+    free(scheduler);
+}
+
+// A JSON object with the CPU time and slices of every fiber.
+void printFiberStats(FILE *out, Scheduler *scheduler) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"threads\": %d,\n", scheduler->size);
+    fprintf(out, "  \"fibers\": [\n");
+    for(int i = 0; i < scheduler->fibers->size; i++) {
+        Fiber *fiber = scheduler->fibers->list[i];
+        fprintf(out, "    {\"name\": \"%s\", \"ok\": %s, \"cpu\": %.9f, \"slices\": %ld}%s\n",
+                fiber->name, fiber->ok ? "true" : "false", fiber->cpuTime, fiber->slices,
+                i < scheduler->fibers->size - 1 ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
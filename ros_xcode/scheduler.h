@@ -0,0 +1,82 @@
+//
+//  scheduler.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-04-02.
+//
+
+#ifndef scheduler_h
+#define scheduler_h
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "interpreter.h"
+
+/*
+  Runs many scripts, each on an interpreter of its own, as fibers shared
+  out over a fixed set of threads. A fiber starts on a FIBER_STACK_SIZE
+  stack and grows onto heap segments like any deep evaluation does (see
+  segmented_stack.h), so a script costs little more than its heap.
+
+  Scheduling is cooperative. Loop iterations and method and block calls
+  are preemption points, each one uses a tick of the fiber's budget and
+  once FIBER_BUDGET of them are used the fiber goes to the back of the
+  run queue. Whichever thread is free picks it up next, so the thread
+  local stats of a script are spread over the threads that ran it. The
+  CPU time of each fiber is taken from the thread's CPU clock around
+  every slice it runs.
+*/
+#define FIBER_STACK_SIZE (256 * 1024)
+#define FIBER_BUDGET 10000
+
+typedef struct Fiber {
+    Interpreter *interp;
+    StmtArray *statements;
+    const char *name;
+    char *stack;
+    struct FiberContext *context;
+    bool done;
+    bool ok;
+
+    double cpuTime;
+    long slices;
+
+    // Next in the run queue.
+    struct Fiber *next;
+} Fiber;
+
+typedef struct FiberArray {
+    Fiber **list;
+    int size;
+    int capacity;
+} FiberArray;
+
+typedef struct Scheduler {
+    int size;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    // Fibers ready to run, oldest first.
+    Fiber *head;
+    Fiber *tail;
+    // Fibers that haven't finished.
+    long pending;
+    FiberArray *fibers;
+} Scheduler;
+
+Scheduler *newScheduler(int size);
+Fiber *spawnFiber(Scheduler *scheduler, Interpreter *interp, StmtArray *statements, const char *name);
+void runScheduler(Scheduler *scheduler);
+void freeScheduler(Scheduler *scheduler);
+Fiber *findFiber(Scheduler *scheduler, Interpreter *interp);
+void printFiberStats(FILE *out, Scheduler *scheduler);
+
+void fiberYield(Interpreter *interp);
+
+static inline void preemptionPoint(Interpreter *interp) {
+    if (interp->fiber != NULL && --interp->budget <= 0) {
+        fiberYield(interp);
+    }
+}
+
+#endif /* scheduler_h */
@@ -0,0 +1,184 @@
+//
+//  segmented_stack.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-27.
+//
+
+// ucontext is only declared with _XOPEN_SOURCE on macOS, and
+// pthread_getattr_np with _GNU_SOURCE on Linux.
+#ifdef __APPLE__
+#define _XOPEN_SOURCE 700
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include "segmented_stack.h"
+#include "stats.h"
+
+// Anything more is most likely an unlimited rlimit, not memory that is there.
+#define MAX_THREAD_STACK (64L * 1024 * 1024)
+
+typedef struct SegmentCall {
+    Interpreter *interp;
+    SegmentFunction function;
+    void *context;
+    bool failed;
+    ucontext_t caller;
+} SegmentCall;
+
+// makecontext() can only pass ints, the call is handed over through here.
+static _Thread_local SegmentCall *startingCall;
+
+// Sets the limit for the stack of the calling thread.
+void initStackLimit(Interpreter *interp) {
+    char *here = __builtin_frame_address(0);
+    char *low;
+    char *high;
+
+#ifdef __APPLE__
+    pthread_t self = pthread_self();
+    high = pthread_get_stackaddr_np(self);
+    low = high - pthread_get_stacksize_np(self);
+#else
+    pthread_attr_t attributes;
+    void *address;
+    size_t size;
+    pthread_getattr_np(pthread_self(), &attributes);
+    pthread_attr_getstack(&attributes, &address, &size);
+    pthread_attr_destroy(&attributes);
+    low = address;
+    high = low + size;
+#endif
+
+    if (here - low > MAX_THREAD_STACK) {
+        low = here - MAX_THREAD_STACK;
+    }
+    interp->stackLimit = low + STACK_RESERVE;
+    interp->stackTop = high;
+}
+
+void freeSegmentStack(Interpreter *interp) {
+    SegmentStack *segments = interp->segments;
+    if (segments == NULL) {
+        return;
+    }
+
+    for(int i = 0; i < segments->size; i++) {
+        free(segments->list[i]);
+    }
+    free(segments->list);
+    free(segments->resume);
+    free(segments);
+    interp->segments = NULL;
+}
+
+static char *nextSegment(Interpreter *interp, int line) {
+    if (interp->segments == NULL) {
+        interp->segments = malloc(sizeof(SegmentStack));
+        INIT_ARRAY(interp->segments, SegmentStack);
+        interp->segments->depth = 0;
+        interp->segments->resume = NULL;
+    }
+
+    SegmentStack *segments = interp->segments;
+    if ((long)(segments->depth + 1) * STACK_SEGMENT_SIZE > interp->stackBudget) {
+        runtimeError(interp, line, "stack level too deep, the stack budget is %ld MB",
+            interp->stackBudget / (1024 * 1024));
+    }
+
+    if (segments->depth == segments->size) {
+        char *memory = malloc(STACK_SEGMENT_SIZE);
+        if (memory == NULL) {
+            runtimeError(interp, line, "stack level too deep, out of memory for the stack");
+        }
+        if (segments->size == segments->capacity) {
+            segments->capacity = segments->capacity < 8 ? 8 : 2 * segments->capacity;
+            segments->list = realloc(segments->list, segments->capacity * sizeof(char *));
+            segments->resume = realloc(segments->resume, segments->capacity * sizeof(char *));
+        }
+        segments->list[segments->size++] = memory;
+    }
+
+    char *segment = segments->list[segments->depth++];
+    if (segments->depth > stats.stackSegments) {
+        stats.stackSegments = segments->depth;
+    }
+    stats.stackSwitches++;
+    return segment;
+}
+
+// Errors can't unwind across stacks, they are caught here and raised
+// again from the caller's stack.
+static void segmentMain(void) {
+    SegmentCall *call = startingCall;
+    Interpreter *interp = call->interp;
+    jmp_buf errorJump;
+    jmp_buf *enclosing = interp->errorJump;
+
+    interp->errorJump = &errorJump;
+    if (setjmp(errorJump) == 0) {
+        call->function(interp, call->context);
+    } else {
+        call->failed = true;
+    }
+    interp->errorJump = enclosing;
+}
+
+void runOnNewSegment(Interpreter *interp, int line, SegmentFunction function, void *context) {
+    char *segment = nextSegment(interp, line);
+    char *enclosingLimit = interp->stackLimit;
+    SegmentCall call = {interp, function, context, false};
+
+    ucontext_t running;
+    getcontext(&running);
+    running.uc_stack.ss_sp = segment;
+    running.uc_stack.ss_size = STACK_SEGMENT_SIZE;
+    running.uc_link = &call.caller;
+    makecontext(&running, segmentMain, 0);
+
+    // The caller's registers end up in `call`, below it is free.
+    interp->segments->resume[interp->segments->depth - 1] =
+        (char *)&call < (char *)&running ? (char *)&call : (char *)&running;
+    interp->stackLimit = segment + STACK_RESERVE;
+    startingCall = &call;
+    swapcontext(&call.caller, &running);
+
+    interp->stackLimit = enclosingLimit;
+    interp->segments->depth--;
+    if (call.failed) {
+        raiseError(interp);
+    }
+}
+
+typedef struct Evaluation {
+    Expr *exp;
+    Stmt *stmt;
+    HashTable *env;
+    Object *result;
+} Evaluation;
+
+static void evaluateSegment(Interpreter *interp, void *context) {
+    Evaluation *evaluation = context;
+    evaluation->result = evaluate(interp, evaluation->exp, evaluation->env);
+}
+
+static void executeSegment(Interpreter *interp, void *context) {
+    Evaluation *evaluation = context;
+    evaluation->result = execute(interp, evaluation->stmt, evaluation->env);
+}
+
+Object *evaluateOnNewSegment(Interpreter *interp, Expr *exp, HashTable *env) {
+    Evaluation evaluation = {exp, NULL, env, NULL};
+    runOnNewSegment(interp, exp->line, evaluateSegment, &evaluation);
+    return evaluation.result;
+}
+
+Object *executeOnNewSegment(Interpreter *interp, Stmt *stmt, HashTable *env) {
+    Evaluation evaluation = {NULL, stmt, env, NULL};
+    runOnNewSegment(interp, stmt->line, executeSegment, &evaluation);
+    return evaluation.result;
+}
@@ -0,0 +1,55 @@
+//
+//  segmented_stack.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-27.
+//
+
+#ifndef segmented_stack_h
+#define segmented_stack_h
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "interpreter.h"
+
+/*
+  The evaluator recurses on the C stack as deep as the script does, so a
+  deep recursion or a deeply nested expression used to run off the end of
+  the thread's stack. evaluate(), execute() and numeric method calls
+  check how much stack is left first, and when it is less than
+  STACK_RESERVE the rest of the evaluation continues on a segment of
+  STACK_SEGMENT_SIZE bytes from the heap, switching back once it returns.
+
+  Segments are kept for the next time the evaluation gets that deep and
+  freed with the interpreter. Together they can't take more than the
+  interpreter's stackBudget, going past it is a runtime error instead of
+  a crash.
+*/
+#define STACK_SEGMENT_SIZE (1024 * 1024)
+#define STACK_RESERVE (64 * 1024)
+#define DEFAULT_STACK_BUDGET (512L * 1024 * 1024)
+
+typedef struct SegmentStack {
+    char **list;
+    int size;
+    int capacity;
+    // Segments in use, the running code is on list[depth - 1].
+    int depth;
+    // Where each stack in use was left for the next segment, the thread's
+    // own first. The collector scans them from there up.
+    char **resume;
+} SegmentStack;
+
+typedef void (*SegmentFunction)(Interpreter *interp, void *context);
+
+void initStackLimit(Interpreter *interp);
+void freeSegmentStack(Interpreter *interp);
+void runOnNewSegment(Interpreter *interp, int line, SegmentFunction function, void *context);
+Object *evaluateOnNewSegment(Interpreter *interp, Expr *exp, HashTable *env);
+Object *executeOnNewSegment(Interpreter *interp, Stmt *stmt, HashTable *env);
+
+static inline bool stackLow(Interpreter *interp) {
+    return (char *)__builtin_frame_address(0) < interp->stackLimit;
+}
+
+#endif /* segmented_stack_h */
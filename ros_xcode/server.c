@@ -0,0 +1,289 @@
+//
+//  server.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-06.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "server.h"
+#include "file.h"
+#include "scanner.h"
+#include "interpreter.h"
+
+static volatile sig_atomic_t stopping = 0;
+
+static void handleStop(int signal) {
+    stopping = 1;
+}
+
+// Returns the parsed program for `path`, reparsing it when the file changed
+// since it was cached. NULL with the reason in `error` when the file can't
+// be read or parsed. Only the text tells whether it changed, an edit can
+// keep the size and the timestamp.
+StmtArray *cachedProgram(ProgramCache *cache, const char *path, char *error) {
+    char *buffer = readFile(path);
+    if (buffer == NULL) {
+        snprintf(error, ERROR_MESSAGE_SIZE, "can't read %s", path);
+        return NULL;
+    }
+
+    CachedProgram *program = NULL;
+    for(int i = 0; i < cache->size; i++) {
+        if (strcmp(cache->list[i]->path, path) == 0) {
+            program = cache->list[i];
+            break;
+        }
+    }
+
+    if (program != NULL && program->buffer != NULL && strcmp(program->buffer, buffer) == 0) {
+        free(buffer);
+        return program->statements;
+    }
+
+    jmp_buf errorJump;
+    Scanner scanner;
+    if (setjmp(errorJump) != 0) {
+        memcpy(error, scanner.error, ERROR_MESSAGE_SIZE);
+        free(buffer);
+        return NULL;
+    }
+    initScannerWithErrors(&scanner, buffer, &errorJump);
+    StmtArray *statements = parse(&scanner);
+
+    if (program == NULL) {
+        program = malloc(sizeof(CachedProgram));
+        program->path = strdup(path);
+        program->buffer = NULL;
+        program->statements = NULL;
+        ADD_ARRAY_ELEMENT(cache, program, CachedProgram);
+    } else if (program->statements != NULL) {
+        // Every request runs with a fresh environment so nothing outside the
+        // cache points into the old program anymore.
+        freeStatements(program->statements);
+        free(program->statements->list);
+        free(program->statements);
+        free(program->buffer);
+    }
+
+    program->buffer = buffer;
+    program->statements = statements;
+
+    return program->statements;
+}
+
+static int listenOn(const char *socketPath) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", socketPath);
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(socketPath);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 128) != 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static bool readFully(int fd, char *buffer, size_t length) {
+    while(length > 0) {
+        ssize_t bytes = read(fd, buffer, length);
+        if (bytes <= 0) {
+            return false;
+        }
+        buffer += bytes;
+        length -= bytes;
+    }
+    return true;
+}
+
+/*
+  Reads the request header together with the client's stdio descriptors and
+  then the NUL separated payload. Returns the payload, the script path is
+  its first string, and sets `size` to its length.
+*/
+static char *receiveRequest(int conn, int fds[3], int32_t *size) {
+    int32_t length;
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec iov = {&length, sizeof(length)};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (recvmsg(conn, &message, 0) != sizeof(length)) {
+        return NULL;
+    }
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header == NULL || header->cmsg_type != SCM_RIGHTS ||
+        header->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+    {
+        return NULL;
+    }
+    memcpy(fds, CMSG_DATA(header), 3 * sizeof(int));
+
+    if (length <= 0 || length > MAX_REQUEST_SIZE) {
+        return NULL;
+    }
+
+    char *payload = malloc(length + 1);
+    if (!readFully(conn, payload, length)) {
+        free(payload);
+        return NULL;
+    }
+    payload[length] = '\0';
+    *size = length;
+
+    return payload;
+}
+
+static void handleRequest(ProgramCache *cache, int conn, int savedFds[3]) {
+    int fds[3] = {-1, -1, -1};
+    int32_t length = 0;
+    char *payload = receiveRequest(conn, fds, &length);
+    char status = 1;
+
+    if (payload != NULL) {
+        for(int i = 0; i < 3; i++) {
+            dup2(fds[i], i);
+        }
+
+        // Scripts have no way to read arguments, rather than dropping them
+        // the request is refused.
+        Interpreter *interp = newInterpreter();
+        StmtArray *statements = NULL;
+        if (strlen(payload) + 1 < (size_t)length) {
+            snprintf(interp->error, ERROR_MESSAGE_SIZE, "scripts can't take arguments");
+        } else {
+            statements = cachedProgram(cache, payload, interp->error);
+        }
+        if (statements != NULL && runProgram(interp, statements)) {
+            status = 0;
+        } else {
+            fprintf(stderr, "ros_xcode: %s\n", interp->error);
+        }
+        freeInterpreter(interp);
+
+        fflush(stdout);
+        fflush(stderr);
+        for(int i = 0; i < 3; i++) {
+            dup2(savedFds[i], i);
+        }
+    }
+
+    for(int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    free(payload);
+
+    write(conn, &status, 1);
+}
+
+static void runWorker(int listenFd) {
+    ProgramCache cache;
+    ProgramCache *programs = &cache;
+    INIT_ARRAY(programs, CachedProgram);
+
+    int savedFds[3];
+    for(int i = 0; i < 3; i++) {
+        savedFds[i] = dup(i);
+    }
+
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    // A client going away mid-script must not kill the worker.
+    signal(SIGPIPE, SIG_IGN);
+
+    for(int served = 0; served < MAX_REQUESTS_PER_WORKER; served++) {
+        int conn = accept(listenFd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            exit(1);
+        }
+        handleRequest(programs, conn, savedFds);
+        close(conn);
+    }
+
+    exit(0);
+}
+
+static pid_t spawnWorker(int listenFd) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        runWorker(listenFd);
+    }
+    return pid;
+}
+
+// Keeps `workers` processes accepting on the socket until SIGINT/SIGTERM.
+// Workers that exit, because they were recycled or a script
+// hit a fatal error, are replaced.
+int serve(const char *socketPath, int workers) {
+    int listenFd = listenOn(socketPath);
+    if (listenFd < 0) {
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleStop;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    pid_t *pids = calloc(workers, sizeof(pid_t));
+    for(int i = 0; i < workers; i++) {
+        pids[i] = spawnWorker(listenFd);
+    }
+
+    while(!stopping) {
+        pid_t pid = wait(NULL);
+        if (pid < 0) {
+            continue;
+        }
+        for(int i = 0; i < workers && !stopping; i++) {
+            if (pids[i] == pid) {
+                pids[i] = spawnWorker(listenFd);
+            }
+        }
+    }
+
+    for(int i = 0; i < workers; i++) {
+        kill(pids[i], SIGTERM);
+    }
+    while(wait(NULL) > 0);
+
+    close(listenFd);
+    unlink(socketPath);
+    free(pids);
+
+    return 0;
+}
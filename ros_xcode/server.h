@@ -0,0 +1,42 @@
+//
+//  server.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-06.
+//
+
+#ifndef server_h
+#define server_h
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "parser.h"
+#include "protocol.h"
+
+/*
+  `--serve` keeps a pool of pre-forked workers listening on a unix socket.
+  Each worker keeps the parsed programs it has seen warm, so a request only
+  pays for interpreting the script. See protocol.h for the wire format.
+*/
+#define DEFAULT_WORKERS 4
+// Workers are recycled after this many requests to bound how much a long
+// lived worker can grow.
+#define MAX_REQUESTS_PER_WORKER 1000
+
+typedef struct CachedProgram {
+    char *path;
+    // The text the statements were parsed from.
+    char *buffer;
+    StmtArray *statements;
+} CachedProgram;
+
+typedef struct ProgramCache {
+    CachedProgram **list;
+    int size;
+    int capacity;
+} ProgramCache;
+
+int serve(const char *socketPath, int workers);
+StmtArray *cachedProgram(ProgramCache *cache, const char *path, char *error);
+
+#endif /* server_h */
@@ -0,0 +1,743 @@
+//
+//  session.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-04-07.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "session.h"
+#include "stats.h"
+#include "type_inference.h"
+#include "inliner.h"
+
+typedef struct NameList {
+    Token *list;
+    int size;
+    int capacity;
+} NameList;
+
+// What parsing a range of spans again came up with.
+typedef struct Reparse {
+    char *source;
+    StmtArray *statements;
+    Span *spans;
+    NameList names;
+    // The first old span kept after the new ones, and how far its lines
+    // moved.
+    int resync;
+    int lineDelta;
+    long astBytes;
+} Reparse;
+
+// Shifts the lines of a tree by `delta` or adds the names it assigns to
+// `names`, going on on a new segment once the stack runs low.
+typedef struct TreeWalk {
+    WalkStack stack;
+    int delta;
+    NameList *names;
+} TreeWalk;
+
+// A statement or an expression nested too deep for the stack.
+typedef struct DeepNode {
+    TreeWalk *walk;
+    Stmt *stmt;
+    Expr *exp;
+} DeepNode;
+
+static void initTreeWalk(TreeWalk *walk, int delta, NameList *names) {
+    initWalkStack(&walk->stack);
+    walk->delta = delta;
+    walk->names = names;
+}
+
+static void walkDeep(TreeWalk *walk, WalkFunction function, Stmt *stmt, Expr *exp) {
+    DeepNode node = {walk, stmt, exp};
+    walkOnNewSegment(&walk->stack, function, &node);
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Lines
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static void shiftStatement(TreeWalk *walk, Stmt *stmt);
+static void shiftExpression(TreeWalk *walk, Expr *exp);
+
+static void shiftStatements(TreeWalk *walk, StmtArray *array) {
+    for(int i = 0; i < array->size; i++) {
+        shiftStatement(walk, array->list[i]);
+    }
+}
+
+static void shiftExpressions(TreeWalk *walk, ExprArray *array) {
+    for(int i = 0; i < array->size; i++) {
+        shiftExpression(walk, array->list[i]);
+    }
+}
+
+static void shiftSegment(void *context) {
+    DeepNode *node = context;
+    if (node->stmt != NULL) {
+        shiftStatement(node->walk, node->stmt);
+    } else {
+        shiftExpression(node->walk, node->exp);
+    }
+}
+
+static void shiftExpression(TreeWalk *walk, Expr *exp) {
+    if (walkStackLow(&walk->stack)) {
+        walkDeep(walk, shiftSegment, NULL, exp);
+        return;
+    }
+
+    exp->line += walk->delta;
+
+    switch (exp->type) {
+        case BINARY:
+            shiftExpression(walk, exp->as.binary.left);
+            shiftExpression(walk, exp->as.binary.right);
+            break;
+        case LOGICAL:
+            shiftExpression(walk, exp->as.logical.left);
+            shiftExpression(walk, exp->as.logical.right);
+            break;
+        case UNARY:
+            shiftExpression(walk, exp->as.unary.operand);
+            break;
+        case RANGE:
+            shiftExpression(walk, exp->as.range.start);
+            shiftExpression(walk, exp->as.range.end);
+            break;
+        case VAR_ASSIGNMENT:
+            shiftExpression(walk, exp->as.varAssignment.value);
+            break;
+        case METHOD_CALL_EXP:
+            shiftExpressions(walk, exp->as.methodCall.arguments);
+            break;
+        case ARRAY_LITERAL:
+            shiftExpressions(walk, exp->as.arrayLiteral.elements);
+            break;
+        case INDEX_EXP:
+        case INDEX_ASSIGNMENT:
+            shiftExpression(walk, exp->as.index.object);
+            shiftExpression(walk, exp->as.index.index);
+            if (exp->as.index.value != NULL) {
+                shiftExpression(walk, exp->as.index.value);
+            }
+            break;
+        case INVOKE_EXP:
+            shiftExpression(walk, exp->as.invoke.receiver);
+            shiftExpressions(walk, exp->as.invoke.arguments);
+            if (exp->as.invoke.block != NULL) {
+                exp->as.invoke.block->line += walk->delta;
+                shiftStatements(walk, exp->as.invoke.block->statements);
+            }
+            break;
+        case HASH_LITERAL:
+            shiftExpressions(walk, exp->as.hashLiteral.keys);
+            shiftExpressions(walk, exp->as.hashLiteral.values);
+            break;
+        case INTERPOLATION:
+            shiftExpressions(walk, exp->as.interpolation.parts);
+            break;
+        case INLINED_CALL:
+            shiftExpression(walk, exp->as.inlined.call);
+            shiftExpression(walk, exp->as.inlined.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static void shiftStatement(TreeWalk *walk, Stmt *stmt) {
+    ConditionalArray *conditionals;
+
+    if (walkStackLow(&walk->stack)) {
+        walkDeep(walk, shiftSegment, stmt, NULL);
+        return;
+    }
+    stmt->line += walk->delta;
+
+    switch (stmt->type) {
+        case PUTS_STMT:
+            shiftExpression(walk, stmt->as.puts.exp);
+            break;
+        case EXPR_STMT:
+            shiftExpression(walk, stmt->exprStmt);
+            break;
+        case IF_STMT:
+            conditionals = stmt->as.ifStmt.conditionals;
+            for(int i = 0; i < conditionals->size; i++) {
+                shiftExpression(walk, conditionals->list[i]->condition);
+                shiftStatements(walk, conditionals->list[i]->statements);
+            }
+            break;
+        case WHILE_STMT:
+            shiftExpression(walk, stmt->as.whileStmt.condition);
+            shiftStatements(walk, stmt->as.whileStmt.statements);
+            break;
+        case FOR_STMT:
+        case PARALLEL_FOR_STMT:
+            shiftExpression(walk, stmt->as.forStmt.identifier);
+            shiftExpression(walk, stmt->as.forStmt.range);
+            shiftStatements(walk, stmt->as.forStmt.statements);
+            break;
+        case DEF_STMT:
+            shiftExpressions(walk, stmt->as.defStmt.arguments);
+            shiftStatements(walk, stmt->as.defStmt.statements);
+            stmt->as.defStmt.bodyLine += walk->delta;
+            if (stmt->as.defStmt.numeric != NULL) {
+                stmt->as.defStmt.numeric->line += walk->delta;
+            }
+            break;
+    }
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Names
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static void addName(NameList *names, char *name, int length, int line) {
+    if (names->size + 1 > names->capacity) {
+        names->capacity = names->capacity < 8 ? 8 : 2 * names->capacity;
+        names->list = realloc(names->list, names->capacity * sizeof(Token));
+    }
+    names->list[names->size++] = newToken(IDENTIFIER, line, length, name);
+}
+
+static void collectStatementNames(TreeWalk *walk, Stmt *stmt);
+static void collectExpressionNames(TreeWalk *walk, Expr *exp);
+
+static void collectExpressionListNames(TreeWalk *walk, ExprArray *array) {
+    for(int i = 0; i < array->size; i++) {
+        collectExpressionNames(walk, array->list[i]);
+    }
+}
+
+static void collectStatementListNames(TreeWalk *walk, StmtArray *array) {
+    for(int i = 0; i < array->size; i++) {
+        collectStatementNames(walk, array->list[i]);
+    }
+}
+
+static void collectSegment(void *context) {
+    DeepNode *node = context;
+    if (node->stmt != NULL) {
+        collectStatementNames(node->walk, node->stmt);
+    } else {
+        collectExpressionNames(node->walk, node->exp);
+    }
+}
+
+// Blocks and defs have scopes of their own, whatever they assign isn't a
+// top-level name.
+static void collectExpressionNames(TreeWalk *walk, Expr *exp) {
+    if (walkStackLow(&walk->stack)) {
+        walkDeep(walk, collectSegment, NULL, exp);
+        return;
+    }
+
+    switch (exp->type) {
+        case BINARY:
+            collectExpressionNames(walk, exp->as.binary.left);
+            collectExpressionNames(walk, exp->as.binary.right);
+            break;
+        case LOGICAL:
+            collectExpressionNames(walk, exp->as.logical.left);
+            collectExpressionNames(walk, exp->as.logical.right);
+            break;
+        case UNARY:
+            collectExpressionNames(walk, exp->as.unary.operand);
+            break;
+        case RANGE:
+            collectExpressionNames(walk, exp->as.range.start);
+            collectExpressionNames(walk, exp->as.range.end);
+            break;
+        case VAR_ASSIGNMENT:
+            collectExpressionNames(walk, exp->as.varAssignment.value);
+            addName(walk->names, exp->as.varAssignment.name, exp->as.varAssignment.length, exp->line);
+            break;
+        case METHOD_CALL_EXP:
+            collectExpressionListNames(walk, exp->as.methodCall.arguments);
+            break;
+        case ARRAY_LITERAL:
+            collectExpressionListNames(walk, exp->as.arrayLiteral.elements);
+            break;
+        case INDEX_EXP:
+        case INDEX_ASSIGNMENT:
+            collectExpressionNames(walk, exp->as.index.object);
+            collectExpressionNames(walk, exp->as.index.index);
+            if (exp->as.index.value != NULL) {
+                collectExpressionNames(walk, exp->as.index.value);
+            }
+            break;
+        case INVOKE_EXP:
+            collectExpressionNames(walk, exp->as.invoke.receiver);
+            collectExpressionListNames(walk, exp->as.invoke.arguments);
+            break;
+        case HASH_LITERAL:
+            collectExpressionListNames(walk, exp->as.hashLiteral.keys);
+            collectExpressionListNames(walk, exp->as.hashLiteral.values);
+            break;
+        case INTERPOLATION:
+            collectExpressionListNames(walk, exp->as.interpolation.parts);
+            break;
+        case INLINED_CALL:
+            collectExpressionNames(walk, exp->as.inlined.call);
+            break;
+        default:
+            break;
+    }
+}
+
+static void collectStatementNames(TreeWalk *walk, Stmt *stmt) {
+    ConditionalArray *conditionals;
+    Expr *identifier;
+
+    if (walkStackLow(&walk->stack)) {
+        walkDeep(walk, collectSegment, stmt, NULL);
+        return;
+    }
+
+    switch (stmt->type) {
+        case PUTS_STMT:
+            collectExpressionNames(walk, stmt->as.puts.exp);
+            break;
+        case EXPR_STMT:
+            collectExpressionNames(walk, stmt->exprStmt);
+            break;
+        case IF_STMT:
+            conditionals = stmt->as.ifStmt.conditionals;
+            for(int i = 0; i < conditionals->size; i++) {
+                collectExpressionNames(walk, conditionals->list[i]->condition);
+                collectStatementListNames(walk, conditionals->list[i]->statements);
+            }
+            break;
+        case WHILE_STMT:
+            collectExpressionNames(walk, stmt->as.whileStmt.condition);
+            collectStatementListNames(walk, stmt->as.whileStmt.statements);
+            break;
+        case FOR_STMT:
+            identifier = stmt->as.forStmt.identifier;
+            if (identifier->type == IDENTIFIER_EXP) {
+                addName(walk->names, identifier->as.identifierExp.string, identifier->as.identifierExp.length, identifier->line);
+            }
+            collectExpressionNames(walk, stmt->as.forStmt.range);
+            collectStatementListNames(walk, stmt->as.forStmt.statements);
+            break;
+        default:
+            break;
+    }
+}
+
+static bool hasName(Token *names, int count, Token name) {
+    for(int i = 0; i < count; i++) {
+        if (names[i].length == name.length && memcmp(names[i].lexeme, name.lexeme, name.length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Adds to `changed` the names only one of `a` and `b` has.
+static void changedNames(NameList *changed, Token *a, int aCount, Token *b, int bCount) {
+    for(int i = 0; i < aCount; i++) {
+        if (!hasName(b, bCount, a[i]) && !hasName(changed->list, changed->size, a[i])) {
+            addName(changed, a[i].lexeme, a[i].length, a[i].line);
+        }
+    }
+    for(int i = 0; i < bCount; i++) {
+        if (!hasName(a, aCount, b[i]) && !hasName(changed->list, changed->size, b[i])) {
+            addName(changed, b[i].lexeme, b[i].length, b[i].line);
+        }
+    }
+}
+
+static bool identifierCharacter(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// Whether the text of span `index` has any of `names` as a word, the
+// blocks in it may have resolved them differently.
+static bool mentions(Session *session, int index, NameList *names) {
+    long start = session->spans[index].start;
+    long end = index + 1 < session->spanCount ? session->spans[index + 1].start : session->length;
+    char *text = session->text;
+
+    for(long i = start; i < end; i++) {
+        if (!identifierCharacter(text[i]) || (i > start && identifierCharacter(text[i - 1]))) {
+            continue;
+        }
+        long length = 0;
+        while (i + length < end && identifierCharacter(text[i + length])) {
+            length++;
+        }
+        for(int j = 0; j < names->size; j++) {
+            if (names->list[j].length == length && memcmp(names->list[j].lexeme, text + i, length) == 0) {
+                return true;
+            }
+        }
+        i += length - 1;
+    }
+    return false;
+}
+
+// Where the names of span `index` start in session->names.
+static int firstName(Session *session, int index) {
+    int first = 0;
+    for(int i = 0; i < index; i++) {
+        first += session->spans[i].nameCount;
+    }
+    return first;
+}
+
+// Whether parsing the statement depends on the names assigned before it.
+static bool scoped(Stmt *stmt) {
+    return stmt != NULL && stmt->type != DEF_STMT && statementKept(stmt);
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Parsing
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+// What was parsed of a statement the error stopped in is lost, like the
+// nodes of any program with a syntax error.
+static void discardReparse(Reparse *reparse) {
+    for(int i = 0; i < reparse->statements->size; i++) {
+        freeStatementTree(reparse->statements->list[i]);
+    }
+    stats.astBytes = reparse->astBytes;
+    free(reparse->statements->list);
+    free(reparse->statements);
+    free(reparse->spans);
+    free(reparse->names.list);
+    free(reparse->source);
+}
+
+/*
+  Parses the text from `from` to `to` as the spans from `first` to `last`,
+  and as many after them as it takes to end where an old span starts.
+  Returns false on a syntax error, with `cut` set when the error or the
+  last statement ran into `to` before the end of the text, so there may
+  be more of it.
+*/
+static bool parseSpans(Session *session, int first, int last, long from, long to, Reparse *reparse, bool *cut) {
+    jmp_buf errorJump;
+    Scanner scanner;
+    Scope scope;
+    long length = to - from;
+    // Both change after setjmp.
+    volatile int line = first < session->spanCount ? session->spans[first].line : 1;
+    volatile int capacity = 0;
+
+    reparse->source = malloc(length + 1);
+    memcpy(reparse->source, session->text + from, length);
+    reparse->source[length] = '\0';
+    reparse->statements = initStmtArray();
+    reparse->spans = NULL;
+    reparse->names.list = NULL;
+    reparse->names.size = 0;
+    reparse->names.capacity = 0;
+    reparse->resync = session->spanCount;
+    reparse->lineDelta = 0;
+    reparse->astBytes = stats.astBytes;
+
+    // Blocks see the names assigned by the spans before.
+    int names = firstName(session, first);
+    scope.enclosing = NULL;
+    scope.block = NULL;
+    scope.capacity = names + 8;
+    scope.names = malloc(scope.capacity * sizeof(Token));
+    scope.size = names;
+    memcpy(scope.names, session->names, names * sizeof(Token));
+
+    *cut = false;
+    if (setjmp(errorJump) != 0) {
+        free(scope.names);
+        *cut = to < session->length && (scanner.peek.type == END_OF_FILE || scanner.current[0] == '\0');
+        if (!*cut) {
+            memcpy(session->error, scanner.error, ERROR_MESSAGE_SIZE);
+        }
+        return false;
+    }
+
+    initScannerAtLine(&scanner, reparse->source, line, &errorJump);
+    scanner.scope = &scope;
+    scanner.lazyDefs = session->interp->lazyDefs;
+
+    // The old span a statement ending here would line up with.
+    int next = last + 1;
+    long start = from;
+
+    while(!atEnd(&scanner)) {
+        Stmt *stmt = statement(&scanner);
+        ADD_ARRAY_ELEMENT(reparse->statements, stmt, Stmt);
+        if (scanner.peek.type == END_OF_FILE && to < session->length) {
+            *cut = true;
+            break;
+        }
+
+        int index = reparse->statements->size - 1;
+        if (index == capacity) {
+            capacity = capacity < 8 ? 8 : 2 * capacity;
+            reparse->spans = realloc(reparse->spans, capacity * sizeof(Span));
+        }
+        Span *span = &reparse->spans[index];
+        span->start = start;
+        span->line = line;
+        span->stmt = stmt;
+        span->nameCount = reparse->names.size;
+        TreeWalk walk;
+        initTreeWalk(&walk, 0, &reparse->names);
+        collectStatementNames(&walk, stmt);
+        span->nameCount = reparse->names.size - span->nameCount;
+
+        // The scanner doesn't count the lines inside strings, so the line
+        // a statement ends on is the one its last token starts on.
+        start = scanner.peek_prev.lexeme + scanner.peek_prev.length - reparse->source + from;
+        line = scanner.peek_prev.line;
+
+        while (next < session->spanCount && session->spans[next].start < start) {
+            next++;
+        }
+        if (next < session->spanCount && session->spans[next].start == start) {
+            reparse->resync = next;
+            reparse->lineDelta = line - session->spans[next].line;
+            break;
+        }
+    }
+
+    free(scope.names);
+    if (*cut) {
+        return false;
+    }
+    reparse->astBytes = stats.astBytes - reparse->astBytes;
+    return true;
+}
+
+/*
+  Puts `spans` in place of the old ones from `first` up to `resync`, and
+  `names` in place of theirs. Adds the top-level names that came or went
+  to `changed`.
+*/
+static void replaceSpans(Session *session, int first, int resync, Span *spans, int count, NameList *names, NameList *changed) {
+    int namesFrom = firstName(session, first);
+    int oldNames = firstName(session, resync) - namesFrom;
+    changedNames(changed, session->names + namesFrom, oldNames, names->list, names->size);
+
+    int spanCount = session->spanCount - (resync - first) + count;
+    if (spanCount > session->spanCapacity) {
+        session->spanCapacity = spanCount * 2;
+        session->spans = realloc(session->spans, session->spanCapacity * sizeof(Span));
+    }
+    memmove(session->spans + first + count, session->spans + resync, (session->spanCount - resync) * sizeof(Span));
+    if (count > 0) {
+        memcpy(session->spans + first, spans, count * sizeof(Span));
+    }
+    session->spanCount = spanCount;
+
+    int nameCount = session->nameCount - oldNames + names->size;
+    if (nameCount > session->nameCapacity) {
+        session->nameCapacity = nameCount * 2;
+        session->names = realloc(session->names, session->nameCapacity * sizeof(Token));
+    }
+    memmove(session->names + namesFrom + names->size, session->names + namesFrom + oldNames,
+            (session->nameCount - namesFrom - oldNames) * sizeof(Token));
+    if (names->size > 0) {
+        memcpy(session->names + namesFrom, names->list, names->size * sizeof(Token));
+    }
+    session->nameCount = nameCount;
+}
+
+// A span without a statement in place of the old ones from `first` to
+// `last`, parsed again with the next edit.
+static void breakSpans(Session *session, int first, int last, long from, int line, NameList *changed) {
+    Span broken = {from, line, NULL, 0};
+    NameList names = {NULL, 0, 0};
+    replaceSpans(session, first, last + 1, &broken, 1, &names, changed);
+}
+
+/*
+  Parses the spans from `first` to `last` again, along with the span
+  after them so whether the last statement goes on is known. The text
+  grows by twice as many spans each time a statement runs past it.
+  `next` is set to the first span after the new ones, the top-level
+  names that came or went are added to `changed`.
+*/
+static bool reparseSpans(Session *session, int first, int last, NameList *changed, int *next) {
+    long from = first < session->spanCount ? session->spans[first].start : 0;
+    int line = first < session->spanCount ? session->spans[first].line : 1;
+    int ahead = 1;
+    Reparse reparse;
+    bool cut;
+
+    while (true) {
+        int until = last + 1 + ahead;
+        long to = until < session->spanCount ? session->spans[until].start : session->length;
+        if (parseSpans(session, first, last, from, to, &reparse, &cut)) {
+            break;
+        }
+        discardReparse(&reparse);
+        if (!cut) {
+            breakSpans(session, first, last, from, line, changed);
+            memcpy(session->interp->error, session->error, ERROR_MESSAGE_SIZE);
+            return false;
+        }
+        ahead *= 2;
+    }
+
+    inferTypes(reparse.statements);
+    inlineCalls(reparse.statements);
+    adoptProgram(session->interp, reparse.source, reparse.statements, reparse.astBytes);
+    int count = reparse.statements->size;
+    if (reparse.lineDelta != 0) {
+        TreeWalk walk;
+        initTreeWalk(&walk, reparse.lineDelta, NULL);
+        for(int i = reparse.resync; i < session->spanCount; i++) {
+            session->spans[i].line += reparse.lineDelta;
+            shiftStatement(&walk, session->spans[i].stmt);
+        }
+    }
+    replaceSpans(session, first, reparse.resync, reparse.spans, count, &reparse.names, changed);
+    *next = first + count;
+    free(reparse.spans);
+    free(reparse.names.list);
+    return true;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Editing
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+Session *newSession(Interpreter *interp, const char *source) {
+    Session *session = malloc(sizeof(Session));
+    session->interp = interp;
+    session->length = strlen(source);
+    session->capacity = session->length + 1;
+    session->text = malloc(session->capacity);
+    memcpy(session->text, source, session->length + 1);
+
+    session->spanCount = 0;
+    session->spanCapacity = 8;
+    session->spans = malloc(session->spanCapacity * sizeof(Span));
+    session->nameCount = 0;
+    session->nameCapacity = 8;
+    session->names = malloc(session->nameCapacity * sizeof(Token));
+    session->statements = initStmtArray();
+    session->error[0] = '\0';
+
+    NameList changed = {NULL, 0, 0};
+    int next;
+    reparseSpans(session, 0, -1, &changed, &next);
+    free(changed.list);
+    return session;
+}
+
+// The span the character at `offset` is part of, or -1 before the first.
+static int spanAt(Session *session, long offset) {
+    int low = 0;
+    int high = session->spanCount - 1;
+    int found = -1;
+
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (session->spans[middle].start <= offset) {
+            found = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return found;
+}
+
+static int brokenSpan(Session *session) {
+    for(int i = 0; i < session->spanCount; i++) {
+        if (session->spans[i].stmt == NULL) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool sessionEdit(Session *session, long start, long end, const char *text) {
+    if (start < 0 || end < start || end > session->length) {
+        snprintf(session->interp->error, ERROR_MESSAGE_SIZE, "edit from %ld to %ld is out of the text", start, end);
+        return false;
+    }
+
+    // The statement before the edit may go on into it.
+    int first = spanAt(session, start) - 1;
+    int last = spanAt(session, end);
+    first = first < 0 ? 0 : first;
+    int broken = brokenSpan(session);
+    if (broken >= 0) {
+        first = broken < first ? broken : first;
+        last = broken > last ? broken : last;
+    }
+
+    long inserted = strlen(text);
+    long delta = inserted - (end - start);
+
+    if (session->length + delta + 1 > session->capacity) {
+        session->capacity = 2 * (session->length + delta + 1);
+        session->text = realloc(session->text, session->capacity);
+    }
+    memmove(session->text + start + inserted, session->text + end, session->length - end + 1);
+    memcpy(session->text + start, text, inserted);
+    session->length += delta;
+
+    for(int i = last + 1; i < session->spanCount; i++) {
+        session->spans[i].start += delta;
+    }
+
+    NameList changed = {NULL, 0, 0};
+    int next;
+    bool ok = reparseSpans(session, first, last, &changed, &next);
+
+    // Their text is the same, only the names they see changed. Parsing
+    // one again doesn't change its names.
+    NameList same = {NULL, 0, 0};
+    for(int i = next; ok && changed.size > 0 && i < session->spanCount; i = next) {
+        next = i + 1;
+        if (scoped(session->spans[i].stmt) && mentions(session, i, &changed)) {
+            ok = reparseSpans(session, i, i, &same, &next);
+        }
+    }
+    free(changed.list);
+    free(same.list);
+    return ok;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Running
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+bool runSession(Session *session) {
+    if (brokenSpan(session) >= 0) {
+        memcpy(session->interp->error, session->error, ERROR_MESSAGE_SIZE);
+        return false;
+    }
+
+    StmtArray *statements = session->statements;
+    statements->size = 0;
+    for(int i = 0; i < session->spanCount; i++) {
+        ADD_ARRAY_ELEMENT(statements, session->spans[i].stmt, Stmt);
+    }
+
+    double start = currentTime();
+    bool ok = runProgram(session->interp, statements);
+    stats.interpretTime += currentTime() - start;
+    return ok;
+}
+
+void freeSession(Session *session) {
+    free(session->text);
+    free(session->spans);
+    free(session->names);
+    free(session->statements->list);
+    free(session->statements);
+    free(session);
+}
@@ -0,0 +1,79 @@
+//
+//  session.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-04-07.
+//
+
+#ifndef session_h
+#define session_h
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "interpreter.h"
+
+/*
+  A script kept parsed between edits, for an editor or a REPL that runs it
+  again after every change. The text is split into spans, one per
+  top-level statement, each running from the end of the statement before
+  it to the end of its own, so comments and blank lines go with the
+  statement after them and the text after the last statement goes with it.
+
+  An edit parses again the spans it touches, and the one before them since
+  a statement only ends once the token after it is known. Parsing goes on
+  past them until a statement ends where an old span did, every span from
+  there on keeps its nodes, its type inference and its inlining. What was
+  parsed again goes through inference and inlining on its own, like a
+  program evaluated later, so a call into a def that wasn't parsed again
+  isn't inlined.
+
+  Blocks at the top level see the variables assigned before them, a span
+  with one is parsed again when an edit adds or removes a name assigned at
+  the top level that its text has. Edits that add or remove lines move
+  the line numbers of the nodes after them.
+
+  Like every program of an interpreter, the nodes and text of the spans an
+  edit replaced are kept as long as the interpreter, methods and closures
+  from earlier runs may still use them.
+*/
+typedef struct Span {
+    long start;
+    int line;
+    // NULL for text with a syntax error, which is parsed again with the
+    // next edit.
+    Stmt *stmt;
+    // Names the statement assigns at the top level, see Session.
+    int nameCount;
+} Span;
+
+typedef struct Session {
+    Interpreter *interp;
+    char *text;
+    long length;
+    long capacity;
+
+    Span *spans;
+    int spanCount;
+    int spanCapacity;
+    // The names of every span, in the order of the spans.
+    Token *names;
+    int nameCount;
+    int nameCapacity;
+
+    // What runs, the statements of the spans.
+    StmtArray *statements;
+    // The syntax error of the span without a statement, if there is one.
+    char error[ERROR_MESSAGE_SIZE];
+} Session;
+
+// Parses all of `source`. A syntax error in it is kept in `error` until
+// an edit fixes it.
+Session *newSession(Interpreter *interp, const char *source);
+// Replaces the characters from `start` up to `end` with `text` and parses
+// what changed. Returns false with the message in interp->error when the
+// text has a syntax error or the range is out of the text.
+bool sessionEdit(Session *session, long start, long end, const char *text);
+bool runSession(Session *session);
+void freeSession(Session *session);
+
+#endif /* session_h */
@@ -0,0 +1,218 @@
+//
+//  stats.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-02.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+#include "segmented_stack.h"
+
+_Thread_local Stats stats;
+
+static const char *exprTypeNames[EXPR_TYPE_COUNT] = {
+    "BINARY",
+    "NUMBER_LITERAL",
+    "STRING_LITERAL",
+    "BOOLEAN",
+    "IDENTIFIER_EXP",
+    "METHOD_CALL_EXP",
+    "VAR_ASSIGNMENT",
+    "RANGE",
+    "ARRAY_LITERAL",
+    "INDEX_EXP",
+    "INDEX_ASSIGNMENT",
+    "INVOKE_EXP",
+    "HASH_LITERAL",
+    "INTERPOLATION",
+    "LOGICAL",
+    "UNARY",
+    "INLINED_CALL",
+    "INLINED_ARGUMENT"
+};
+
+static const char *stmtTypeNames[STMT_TYPE_COUNT] = {
+    "PUTS_STMT",
+    "EXPR_STMT",
+    "IF_STMT",
+    "WHILE_STMT",
+    "FOR_STMT",
+    "DEF_STMT",
+    "PARALLEL_FOR_STMT"
+};
+
+double currentTime(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+Stats *takeStats(void) {
+    Stats *taken = malloc(sizeof(Stats));
+    *taken = stats;
+    memset(&stats, 0, sizeof(Stats));
+    stats.enabled = taken->enabled;
+    return taken;
+}
+
+// Only the counters, the timings and the cache are the ones of the
+// thread that ran the script.
+void addStats(Stats *into, Stats *from) {
+    into->objects += from->objects;
+    into->objectBytes += from->objectBytes;
+    for(int i = 0; i < EXPR_TYPE_COUNT; i++) {
+        into->exprs[i] += from->exprs[i];
+    }
+    for(int i = 0; i < STMT_TYPE_COUNT; i++) {
+        into->stmts[i] += from->stmts[i];
+    }
+    into->astBytes += from->astBytes;
+
+    into->lookups += from->lookups;
+    into->lookupProbes += from->lookupProbes;
+    into->methodCalls += from->methodCalls;
+    into->unboxedCalls += from->unboxedCalls;
+    into->inlinedCalls += from->inlinedCalls;
+    into->lazyBodies += from->lazyBodies;
+    into->binarySpecialized += from->binarySpecialized;
+    into->binaryGeneric += from->binaryGeneric;
+    into->binaryDeopts += from->binaryDeopts;
+
+    if (from->stackSegments > into->stackSegments) {
+        into->stackSegments = from->stackSegments;
+    }
+    into->stackSwitches += from->stackSwitches;
+
+    into->slabs += from->slabs;
+    for(int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        into->slotsLive[i] += from->slotsLive[i];
+        into->slotsFree[i] += from->slotsFree[i];
+    }
+    into->slotsReused += from->slotsReused;
+    into->slotRequested += from->slotRequested;
+    into->slotGranted += from->slotGranted;
+    into->largeBlocks += from->largeBlocks;
+    into->largeBytes += from->largeBytes;
+
+    into->gcCycles += from->gcCycles;
+    into->gcSlices += from->gcSlices;
+    for(int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        into->gcPauses[i] += from->gcPauses[i];
+    }
+    if (from->gcMaxPause > into->gcMaxPause) {
+        into->gcMaxPause = from->gcMaxPause;
+    }
+    into->gcFreedSlots += from->gcFreedSlots;
+    into->gcFreedBytes += from->gcFreedBytes;
+}
+
+// Prints everything as a single JSON object so it can be scraped. The
+// memory section is the one of `heap`.
+void printStats(FILE *out, Heap *heap) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"time\": {\n");
+    fprintf(out, "    \"read_file\": %.9f,\n", stats.readFileTime);
+    fprintf(out, "    \"scan\": %.9f,\n", stats.scanTime);
+    fprintf(out, "    \"parse\": %.9f,\n", stats.parseTime);
+    fprintf(out, "    \"interpret\": %.9f,\n", stats.interpretTime);
+    fprintf(out, "    \"cache_load\": %.9f\n", stats.cacheLoadTime);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"cache_hit\": %s,\n", stats.cacheHit ? "true" : "false");
+
+    fprintf(out, "  \"objects\": {\n");
+    fprintf(out, "    \"count\": %ld,\n", stats.objects);
+    fprintf(out, "    \"bytes\": %ld\n", stats.objectBytes);
+    fprintf(out, "  },\n");
+
+    fprintf(out, "  \"exprs\": {\n");
+    for(int i = 0; i < EXPR_TYPE_COUNT; i++) {
+        fprintf(out, "    \"%s\": %ld%s\n", exprTypeNames[i], stats.exprs[i], i < EXPR_TYPE_COUNT - 1 ? "," : "");
+    }
+    fprintf(out, "  },\n");
+
+    fprintf(out, "  \"stmts\": {\n");
+    for(int i = 0; i < STMT_TYPE_COUNT; i++) {
+        fprintf(out, "    \"%s\": %ld%s\n", stmtTypeNames[i], stats.stmts[i], i < STMT_TYPE_COUNT - 1 ? "," : "");
+    }
+    fprintf(out, "  },\n");
+
+    double averageChain = stats.lookups == 0 ? 0 : (double)stats.lookupProbes / stats.lookups;
+    fprintf(out, "  \"lookups\": {\n");
+    fprintf(out, "    \"count\": %ld,\n", stats.lookups);
+    fprintf(out, "    \"probes\": %ld,\n", stats.lookupProbes);
+    fprintf(out, "    \"average_chain\": %.3f\n", averageChain);
+    fprintf(out, "  },\n");
+
+    fprintf(out, "  \"method_calls\": %ld,\n", stats.methodCalls);
+    fprintf(out, "  \"unboxed_calls\": %ld,\n", stats.unboxedCalls);
+    fprintf(out, "  \"inlined_calls\": %ld,\n", stats.inlinedCalls);
+    fprintf(out, "  \"lazy_bodies\": %ld,\n", stats.lazyBodies);
+
+    fprintf(out, "  \"binary_nodes\": {\n");
+    fprintf(out, "    \"specialized\": %ld,\n", stats.binarySpecialized);
+    fprintf(out, "    \"generic\": %ld,\n", stats.binaryGeneric);
+    fprintf(out, "    \"deopts\": %ld\n", stats.binaryDeopts);
+    fprintf(out, "  },\n");
+
+    fprintf(out, "  \"stack\": {\n");
+    fprintf(out, "    \"peak_segments\": %ld,\n", stats.stackSegments);
+    fprintf(out, "    \"peak_segment_bytes\": %ld,\n", stats.stackSegments * STACK_SEGMENT_SIZE);
+    fprintf(out, "    \"switches\": %ld\n", stats.stackSwitches);
+    fprintf(out, "  },\n");
+
+    // Occupancy is the share of slab memory in live slots, fragmentation
+    // the share of the slot bytes handed out that nobody asked for.
+    long slabBytes = stats.slabs * SLAB_SIZE;
+    long slotBytes = 0;
+    for(int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        slotBytes += stats.slotsLive[i] * sizeClasses[i];
+    }
+    fprintf(out, "  \"heap\": {\n");
+    fprintf(out, "    \"slabs\": %ld,\n", stats.slabs);
+    fprintf(out, "    \"slab_bytes\": %ld,\n", slabBytes);
+    fprintf(out, "    \"occupancy\": %.3f,\n", slabBytes == 0 ? 0 : (double)slotBytes / slabBytes);
+    fprintf(out, "    \"fragmentation\": %.3f,\n", stats.slotGranted == 0 ? 0 : 1 - (double)stats.slotRequested / stats.slotGranted);
+    fprintf(out, "    \"reused\": %ld,\n", stats.slotsReused);
+    fprintf(out, "    \"large_blocks\": %ld,\n", stats.largeBlocks);
+    fprintf(out, "    \"large_bytes\": %ld,\n", stats.largeBytes);
+    fprintf(out, "    \"classes\": {\n");
+    for(int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        fprintf(out, "      \"%d\": {\"live\": %ld, \"free\": %ld}%s\n", sizeClasses[i],
+                stats.slotsLive[i], stats.slotsFree[i], i < SIZE_CLASS_COUNT - 1 ? "," : "");
+    }
+    fprintf(out, "    }\n");
+    fprintf(out, "  },\n");
+
+    fprintf(out, "  \"gc\": {\n");
+    fprintf(out, "    \"cycles\": %ld,\n", stats.gcCycles);
+    fprintf(out, "    \"slices\": %ld,\n", stats.gcSlices);
+    fprintf(out, "    \"freed_slots\": %ld,\n", stats.gcFreedSlots);
+    fprintf(out, "    \"freed_bytes\": %ld,\n", stats.gcFreedBytes);
+    fprintf(out, "    \"max_pause_us\": %.1f,\n", stats.gcMaxPause);
+    fprintf(out, "    \"pauses_us\": {\n");
+    for(int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        if (i < GC_PAUSE_BUCKETS - 1) {
+            fprintf(out, "      \"<=%ld\": %ld,\n", pauseBuckets[i], stats.gcPauses[i]);
+        } else {
+            fprintf(out, "      \">%ld\": %ld\n", pauseBuckets[i - 1], stats.gcPauses[i]);
+        }
+    }
+    fprintf(out, "    }\n");
+    fprintf(out, "  },\n");
+
+    fprintf(out, "  \"memory\": {\n");
+    fprintf(out, "    \"live\": %zu,\n", heap->live);
+    fprintf(out, "    \"peak\": %zu,\n", heap->peak);
+    fprintf(out, "    \"quota\": %zu,\n", heap->quota);
+    fprintf(out, "    \"kinds\": {\n");
+    for(int i = 0; i < HEAP_KIND_COUNT; i++) {
+        fprintf(out, "      \"%s\": %zu%s\n", heapKindNames[i], heap->kindBytes[i], i < HEAP_KIND_COUNT - 1 ? "," : "");
+    }
+    fprintf(out, "    }\n");
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+}
@@ -0,0 +1,94 @@
+//
+//  stats.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-02.
+//
+
+#ifndef stats_h
+#define stats_h
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "parser.h"
+#include "gc.h"
+
+/*
+  Counters collected while running a script. Counting is always on since
+  it is just an increment; the clock is only read when `--stats` is passed.
+  Each thread counts into its own copy so interpreters running on
+  different threads never share them. Threads doing the work of another
+  one (parallel for workers, scheduler threads and isolates) hand what
+  they counted over to it with takeStats() and addStats().
+*/
+typedef struct Stats {
+    bool enabled;
+
+    // Phase timings in seconds
+    double readFileTime;
+    double scanTime;
+    double parseTime;
+    double interpretTime;
+    double cacheLoadTime;
+
+    bool cacheHit;
+
+    long objects;
+    long objectBytes;
+
+    long exprs[EXPR_TYPE_COUNT];
+    long stmts[STMT_TYPE_COUNT];
+    // Bytes of the nodes above and of blocks, see adoptProgram().
+    long astBytes;
+
+    long lookups;
+    long lookupProbes;
+
+    long methodCalls;
+    // Calls into numeric methods from boxed code, see unboxed.h.
+    long unboxedCalls;
+    // Calls that ran an inlined body instead, see inliner.h.
+    long inlinedCalls;
+    // Bodies of lazy defs parsed on their first call, see parseDef().
+    long lazyBodies;
+
+    // BINARY nodes rewritten after warming up, see BinaryKind.
+    long binarySpecialized;
+    long binaryGeneric;
+    long binaryDeopts;
+
+    // Most heap stack segments in use at once, and switches onto one,
+    // see segmented_stack.h.
+    long stackSegments;
+    long stackSwitches;
+
+    // Slab allocator, see heap.h. Slots in use and on free lists by size
+    // class, and the bytes asked for against the ones handed out.
+    long slabs;
+    long slotsLive[SIZE_CLASS_COUNT];
+    long slotsFree[SIZE_CLASS_COUNT];
+    long slotsReused;
+    long slotRequested;
+    long slotGranted;
+    long largeBlocks;
+    long largeBytes;
+
+    // Collector, see gc.h. Pauses are counted in the buckets of
+    // pauseBuckets.
+    long gcCycles;
+    long gcSlices;
+    long gcPauses[GC_PAUSE_BUCKETS];
+    double gcMaxPause;
+    long gcFreedSlots;
+    long gcFreedBytes;
+} Stats;
+
+extern _Thread_local Stats stats;
+
+double currentTime(void);
+// This thread's counters, which start over from zero.
+Stats *takeStats(void);
+void addStats(Stats *into, Stats *from);
+void printStats(FILE *out, Heap *heap);
+
+#endif /* stats_h */
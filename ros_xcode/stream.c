@@ -0,0 +1,243 @@
+//
+//  stream.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-04-05.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "stream.h"
+#include "stats.h"
+#include "string_object.h"
+#include "type_inference.h"
+#include "inliner.h"
+
+typedef struct Stream {
+    Interpreter *interp;
+    int fd;
+    bool ended;
+    // Read but not part of a statement that has run, starting on `line`.
+    char *text;
+    long length;
+    long capacity;
+    int line;
+    // How long `text` has to get before a statement cut off is parsed again.
+    long retryLength;
+    // The top level, carried from one batch to the next.
+    Scope scope;
+
+    // Where the statement being parsed starts, parsing picks up from
+    // there when the input cuts it off.
+    char *mark;
+    int markLine;
+    int markScopeSize;
+    long markAstBytes;
+} Stream;
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Reading and parsing
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static bool readChunk(Stream *stream) {
+    if (stream->length + STREAM_CHUNK + 1 > stream->capacity) {
+        while (stream->length + STREAM_CHUNK + 1 > stream->capacity) {
+            stream->capacity *= 2;
+        }
+        stream->text = realloc(stream->text, stream->capacity);
+    }
+
+    double start = currentTime();
+    ssize_t count;
+    do {
+        count = read(stream->fd, stream->text + stream->length, STREAM_CHUNK);
+    } while (count < 0 && errno == EINTR);
+    stats.readFileTime += currentTime() - start;
+
+    if (count < 0) {
+        snprintf(stream->interp->error, ERROR_MESSAGE_SIZE, "can't read the script: %s", strerror(errno));
+        return false;
+    }
+    if (count == 0) {
+        stream->ended = true;
+    }
+    stream->length += count;
+    stream->text[stream->length] = '\0';
+    return true;
+}
+
+// Up to the end of the last whole line, everything once the input ended.
+static long parseableLength(Stream *stream) {
+    if (stream->ended) {
+        return stream->length;
+    }
+    for(long i = stream->length - 1; i >= 0; i--) {
+        if (stream->text[i] == '\n') {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+static void markStatement(Stream *stream, Scanner *scanner) {
+    stream->mark = scanner->peek.lexeme;
+    stream->markLine = scanner->peek.line;
+    stream->markScopeSize = stream->scope.size;
+    stream->markAstBytes = stats.astBytes;
+}
+
+// Whether the scanner ran into the end of the text, so what it was in the
+// middle of may go on in the input not read yet.
+static bool cutOff(Scanner *scanner) {
+    return scanner->peek.type == END_OF_FILE || scanner->current[0] == '\0';
+}
+
+// The statements completed by the first `length` characters of the text.
+// Returns NULL on a syntax error.
+static StmtArray *parseBatch(Stream *stream, long length) {
+    jmp_buf errorJump;
+    Scanner scanner;
+    StmtArray *batch = initStmtArray();
+    char after = stream->text[length];
+    bool cut = false;
+
+    stream->text[length] = '\0';
+    stream->mark = stream->text;
+    stream->markLine = stream->line;
+    stream->markScopeSize = stream->scope.size;
+    stream->markAstBytes = stats.astBytes;
+
+    if (setjmp(errorJump) != 0) {
+        if (stream->ended || !cutOff(&scanner)) {
+            memcpy(stream->interp->error, scanner.error, ERROR_MESSAGE_SIZE);
+            free(batch->list);
+            free(batch);
+            return NULL;
+        }
+        // What was parsed of the statement is lost, like the nodes of any
+        // program with a syntax error.
+        stats.astBytes = stream->markAstBytes;
+        cut = true;
+    } else {
+        initScannerAtLine(&scanner, stream->text, stream->line, &errorJump);
+        scanner.scope = &stream->scope;
+        scanner.lazyDefs = stream->interp->lazyDefs;
+        while(!atEnd(&scanner)) {
+            markStatement(stream, &scanner);
+            Stmt *stmt = statement(&scanner);
+            if (scanner.peek.type == END_OF_FILE && !stream->ended) {
+                stats.astBytes -= freeStatementTree(stmt);
+                cut = true;
+                break;
+            }
+            ADD_ARRAY_ELEMENT(batch, stmt, Stmt);
+        }
+        if (!cut) {
+            markStatement(stream, &scanner);
+        }
+    }
+
+    stream->text[length] = after;
+    stream->scope.size = stream->markScopeSize;
+
+    // The nodes of the batch point into the text it was parsed from, so
+    // what is left moves to a buffer of its own.
+    long consumed = stream->mark - stream->text;
+    long left = stream->length - consumed;
+    if (batch->size > 0) {
+        char *text = malloc(stream->capacity);
+        memcpy(text, stream->mark, left + 1);
+        stream->text = text;
+    } else {
+        memmove(stream->text, stream->mark, left + 1);
+    }
+    stream->length = left;
+    stream->line = stream->markLine;
+    stream->retryLength = cut ? 2 * left : 0;
+
+    return batch;
+}
+
+// Runs the batch, then frees every statement nothing can use anymore.
+static bool runBatch(Stream *stream, StmtArray *batch) {
+    Interpreter *interp = stream->interp;
+
+    double start = currentTime();
+    bool ok = runProgram(interp, batch);
+    stats.interpretTime += currentTime() - start;
+    if (!ok) {
+        return false;
+    }
+
+    long released = 0;
+    int kept = 0;
+    for(int i = 0; i < batch->size; i++) {
+        if (statementKept(batch->list[i])) {
+            batch->list[kept++] = batch->list[i];
+        } else {
+            released += freeStatementTree(batch->list[i]);
+        }
+    }
+    batch->size = kept;
+    heapRelease(&interp->heap, released, HEAP_AST);
+    return true;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Running
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+bool runStream(Interpreter *interp, int fd) {
+    Stream stream;
+    stream.interp = interp;
+    stream.fd = fd;
+    stream.ended = false;
+    stream.capacity = STREAM_CHUNK + 1;
+    stream.text = malloc(stream.capacity);
+    stream.text[0] = '\0';
+    stream.length = 0;
+    stream.line = 1;
+    stream.retryLength = 0;
+    stream.scope.enclosing = NULL;
+    stream.scope.block = NULL;
+    stream.scope.names = NULL;
+    stream.scope.size = 0;
+    stream.scope.capacity = 0;
+
+    bool ok = true;
+    while (ok && !stream.ended) {
+        ok = readChunk(&stream);
+        long length = parseableLength(&stream);
+        if (!ok || length == 0 || (!stream.ended && stream.length < stream.retryLength)) {
+            continue;
+        }
+
+        char *source = stream.text;
+        double start = currentTime();
+        double scanTime = stats.scanTime;
+        long astBytes = stats.astBytes;
+        StmtArray *batch = parseBatch(&stream, length);
+        if (batch == NULL) {
+            ok = false;
+            continue;
+        }
+        if (batch->size == 0) {
+            free(batch->list);
+            free(batch);
+            continue;
+        }
+
+        inferTypes(batch);
+        inlineCalls(batch);
+        adoptProgram(interp, source, batch, stats.astBytes - astBytes);
+        stats.parseTime += currentTime() - start - (stats.scanTime - scanTime);
+
+        ok = runBatch(&stream, batch);
+    }
+
+    free(stream.text);
+    free(stream.scope.names);
+    return ok;
+}
@@ -0,0 +1,39 @@
+//
+//  stream.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-04-05.
+//
+
+#ifndef stream_h
+#define stream_h
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "interpreter.h"
+
+/*
+  Runs a script while it is still being read, so the first output doesn't
+  wait for the whole file to be parsed and piped input runs as it comes.
+  Input is read STREAM_CHUNK bytes at a time. The top-level statements
+  completed by what has been read so far are parsed, go through type
+  inference and inlining together as one program, and run before the
+  next chunk is read.
+
+  A statement is only complete once the token after it is known, since an
+  expression can carry on at the start of the next line, and only whole
+  lines are parsed so no token is ever cut in two. A statement the input
+  cut off is parsed again once there is more of it, but only after the
+  text it starts has doubled, so a long def isn't parsed over and over.
+
+  Sources are kept as long as the interpreter, identifiers and literals
+  point into them. So are defs and statements with blocks, which methods
+  and closures go on using. The rest have their nodes freed once they ran.
+*/
+#define STREAM_CHUNK (64 * 1024)
+
+// Reads `fd` until it ends. Returns false on a syntax or runtime error,
+// with the message in interp->error, after running everything before it.
+bool runStream(Interpreter *interp, int fd);
+
+#endif /* stream_h */
@@ -0,0 +1,214 @@
+//
+//  string_object.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-17.
+//
+
+#include <string.h>
+#include "string_object.h"
+#include "stats.h"
+
+// Leaves the characters for the caller to fill in.
+Object *allocateString(Heap *heap, int length) {
+    Object *string = initObject(heap, STRING_OBJ);
+    string->as.string.length = length;
+    string->as.string.hash = 0;
+    string->as.string.frozen = false;
+
+    if (length <= STRING_INLINE_CAPACITY) {
+        string->as.string.capacity = STRING_INLINE;
+    } else {
+        string->as.string.capacity = length;
+        string->as.string.data.chars = heapAllocate(heap, length, HEAP_STRING);
+        stats.objectBytes += length;
+    }
+    return string;
+}
+
+Object *newString(Heap *heap, const char *chars, int length) {
+    Object *string = allocateString(heap, length);
+    memcpy(stringChars(string), chars, length);
+    return string;
+}
+
+/*
+  Literals are created once by the parser and handed out every time they
+  are evaluated. They outlive any interpreter and can be read by several
+  threads at once, so the hash is worked out up front.
+*/
+Object *newSharedString(char *chars, int length) {
+    Object *string = malloc(sizeof(Object));
+    string->type = STRING_OBJ;
+    string->as.string.length = length;
+    string->as.string.capacity = STRING_BORROWED;
+    string->as.string.data.chars = chars;
+    string->as.string.hash = 0;
+    string->as.string.frozen = true;
+    stringHash(string);
+    return string;
+}
+
+void freeSharedString(Object *string) {
+    free(string);
+}
+
+// FNV-1a followed by the murmur3 finalizer to spread the bits.
+static uint64_t hashBytes(const char *bytes, int length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Threads of a parallel loop can hash the same string, they all store the
+// same value.
+uint64_t stringHash(Object *string) {
+    uint32_t hash = __atomic_load_n(&string->as.string.hash, __ATOMIC_RELAXED);
+    if (hash == 0) {
+        hash = (uint32_t)hashBytes(stringChars(string), string->as.string.length);
+        hash = hash == 0 ? 1 : hash;
+        __atomic_store_n(&string->as.string.hash, hash, __ATOMIC_RELAXED);
+    }
+    return hash;
+}
+
+bool stringEquals(Object *a, Object *b) {
+    if (a == b) {
+        return true;
+    }
+    if (a->as.string.length != b->as.string.length) {
+        return false;
+    }
+
+    // Known hashes that differ settle it without looking at the characters.
+    uint32_t hashA = __atomic_load_n(&a->as.string.hash, __ATOMIC_RELAXED);
+    uint32_t hashB = __atomic_load_n(&b->as.string.hash, __ATOMIC_RELAXED);
+    if (hashA != 0 && hashB != 0 && hashA != hashB) {
+        return false;
+    }
+    return memcmp(stringChars(a), stringChars(b), a->as.string.length) == 0;
+}
+
+// Byte wise, a prefix sorts first.
+int stringCompare(Object *a, Object *b) {
+    int lengthA = a->as.string.length;
+    int lengthB = b->as.string.length;
+    int result = memcmp(stringChars(a), stringChars(b), lengthA < lengthB ? lengthA : lengthB);
+    if (result != 0) {
+        return result;
+    }
+    return (lengthA > lengthB) - (lengthA < lengthB);
+}
+
+Object *stringConcat(Heap *heap, Object *a, Object *b) {
+    int lengthA = a->as.string.length;
+    Object *string = allocateString(heap, lengthA + b->as.string.length);
+    char *chars = stringChars(string);
+    memcpy(chars, stringChars(a), lengthA);
+    memcpy(chars + lengthA, stringChars(b), b->as.string.length);
+    return string;
+}
+
+// A header of its own over the characters of a literal.
+static Object *shareLiteral(Heap *heap, Object *literal, bool frozen) {
+    Object *copy = initObject(heap, STRING_OBJ);
+    copy->as.string = literal->as.string;
+    copy->as.string.capacity = STRING_SHARED;
+    copy->as.string.frozen = frozen;
+    return copy;
+}
+
+// What a variable, array or hash holds when given `string`.
+Object *ownString(Heap *heap, Object *string) {
+    if (string->as.string.capacity != STRING_BORROWED) {
+        return string;
+    }
+    return shareLiteral(heap, string, false);
+}
+
+// `string` itself if it can't change, otherwise a frozen copy of it.
+Object *frozenString(Heap *heap, Object *string) {
+    if (string->as.string.capacity == STRING_BORROWED) {
+        return shareLiteral(heap, string, true);
+    }
+    if (string->as.string.frozen) {
+        return string;
+    }
+
+    Object *copy = newString(heap, stringChars(string), string->as.string.length);
+    copy->as.string.hash = string->as.string.hash;
+    copy->as.string.frozen = true;
+    return copy;
+}
+
+// Moves the characters to a heap buffer of at least `capacity` bytes.
+static void reserve(Heap *heap, Object *string, int capacity) {
+    int current = string->as.string.capacity;
+    if (current > 0 && current >= capacity) {
+        return;
+    }
+    if (current == STRING_INLINE && capacity <= STRING_INLINE_CAPACITY) {
+        return;
+    }
+
+    int newCapacity = current > 0 ? current * 2 : 32;
+    while (newCapacity < capacity) {
+        newCapacity *= 2;
+    }
+
+    char *chars = heapAllocate(heap, newCapacity, HEAP_STRING);
+    memcpy(chars, stringChars(string), string->as.string.length);
+    if (current > 0) {
+        heapFree(heap, string->as.string.data.chars, current);
+    }
+    string->as.string.data.chars = chars;
+    string->as.string.capacity = newCapacity;
+    stats.objectBytes += newCapacity;
+}
+
+// string << suffix, doubling the buffer whenever it runs out so a loop of
+// appends takes linear time.
+void stringAppend(Heap *heap, Object *string, Object *suffix) {
+    int length = string->as.string.length;
+    int suffixLength = suffix->as.string.length;
+
+    // Growing an inline string overwrites its characters, which could be
+    // the ones being appended.
+    char inlined[STRING_INLINE_CAPACITY];
+    const char *chars = stringChars(suffix);
+    if (suffix->as.string.capacity == STRING_INLINE) {
+        memcpy(inlined, chars, suffixLength);
+        chars = inlined;
+    }
+
+    // Shared characters are read only, the first append copies them.
+    if (string->as.string.capacity == STRING_SHARED) {
+        const char *shared = string->as.string.data.chars;
+        if (length <= STRING_INLINE_CAPACITY) {
+            string->as.string.capacity = STRING_INLINE;
+            memmove(string->as.string.data.inlined, shared, length);
+        } else {
+            string->as.string.data.chars = heapAllocate(heap, length, HEAP_STRING);
+            memcpy(string->as.string.data.chars, shared, length);
+            string->as.string.capacity = length;
+        }
+    }
+
+    reserve(heap, string, length + suffixLength);
+    // s << s, the old characters were just given back.
+    if (suffix == string) {
+        chars = stringChars(string);
+    }
+    memcpy(stringChars(string) + length, chars, suffixLength);
+    string->as.string.length = length + suffixLength;
+    string->as.string.hash = 0;
+}
@@ -0,0 +1,57 @@
+//
+//  string_object.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-17.
+//
+
+#ifndef string_object_h
+#define string_object_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include "object.h"
+#include "heap.h"
+
+/*
+  Strings know their length and are not NUL terminated. Where the characters
+  live depends on `capacity`:
+
+  STRING_INLINE    up to STRING_INLINE_CAPACITY of them inside the object.
+  STRING_BORROWED  in the source buffer of the program. Only the frozen
+                   object the parser makes for a literal, which every
+                   evaluation of the literal shares.
+  STRING_SHARED    the source characters again, in a copy of a literal.
+                   Appending copies them first.
+  anything else    a heap buffer of `capacity` bytes, grown geometrically
+                   by `<<`.
+
+  Storing a literal anywhere goes through ownString(), which gives the
+  place its own unfrozen header over the same characters, so only strings
+  that are actually appended to get copied.
+
+  The hash is computed the first time it is needed and kept, 0 means it
+  hasn't been yet. Appending resets it.
+*/
+#define STRING_INLINE 0
+#define STRING_SHARED (-1)
+#define STRING_BORROWED (-2)
+
+static inline char *stringChars(Object *string) {
+    return string->as.string.capacity == STRING_INLINE ?
+        string->as.string.data.inlined : string->as.string.data.chars;
+}
+
+Object *allocateString(Heap *heap, int length);
+Object *newString(Heap *heap, const char *chars, int length);
+Object *newSharedString(char *chars, int length);
+void freeSharedString(Object *string);
+uint64_t stringHash(Object *string);
+bool stringEquals(Object *a, Object *b);
+int stringCompare(Object *a, Object *b);
+Object *stringConcat(Heap *heap, Object *a, Object *b);
+Object *ownString(Heap *heap, Object *string);
+Object *frozenString(Heap *heap, Object *string);
+void stringAppend(Heap *heap, Object *string, Object *suffix);
+
+#endif /* string_object_h */
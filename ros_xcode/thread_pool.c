@@ -0,0 +1,180 @@
+//
+//  thread_pool.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-11.
+//
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "thread_pool.h"
+
+typedef struct WorkerStart {
+    ThreadPool *pool;
+    int id;
+} WorkerStart;
+
+int defaultPoolSize(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+static bool takeChunk(ThreadPool *pool, int worker, long *chunk) {
+    ChunkQueue *own = &pool->queues[worker];
+
+    pthread_mutex_lock(&own->lock);
+    if (own->next < own->end) {
+        *chunk = own->next++;
+        pthread_mutex_unlock(&own->lock);
+        return true;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    for(int i = 1; i < pool->size; i++) {
+        ChunkQueue *victim = &pool->queues[(worker + i) % pool->size];
+
+        pthread_mutex_lock(&victim->lock);
+        long left = victim->end - victim->next;
+        if (left <= 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        // Take the back half, rounding up so a single chunk can be stolen.
+        long start = victim->end - (left + 1) / 2;
+        long end = victim->end;
+        victim->end = start;
+        pthread_mutex_unlock(&victim->lock);
+
+        *chunk = start;
+        pthread_mutex_lock(&own->lock);
+        own->next = start + 1;
+        own->end = end;
+        pthread_mutex_unlock(&own->lock);
+        return true;
+    }
+
+    return false;
+}
+
+static void workLoop(ThreadPool *pool, int worker) {
+    long chunk;
+    while(takeChunk(pool, worker, &chunk)) {
+        pool->function(pool->context, worker, chunk);
+
+        if (__atomic_sub_fetch(&pool->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+            pthread_mutex_lock(&pool->lock);
+            pthread_cond_broadcast(&pool->done);
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+}
+
+static void *workerMain(void *argument) {
+    WorkerStart *start = argument;
+    ThreadPool *pool = start->pool;
+    long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while(true) {
+        while(pool->generation == seen && !pool->stopping) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stopping) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        workLoop(pool, start->id);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->busy--;
+        if (pool->busy == 0) {
+            pthread_cond_broadcast(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+ThreadPool *newThreadPool(int size) {
+    ThreadPool *pool = malloc(sizeof(ThreadPool));
+    pool->size = size < 1 ? 1 : size;
+    pool->threads = malloc(pool->size * sizeof(pthread_t));
+    pool->starts = malloc(pool->size * sizeof(WorkerStart));
+    pool->queues = malloc(pool->size * sizeof(ChunkQueue));
+    pool->generation = 0;
+    pool->stopping = false;
+    pool->remaining = 0;
+    pool->busy = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for(int i = 0; i < pool->size; i++) {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+        pool->queues[i].next = 0;
+        pool->queues[i].end = 0;
+        pool->starts[i].pool = pool;
+        pool->starts[i].id = i;
+    }
+
+    for(int i = 1; i < pool->size; i++) {
+        pthread_create(&pool->threads[i], NULL, workerMain, &pool->starts[i]);
+    }
+
+    return pool;
+}
+
+// Runs `function` for every chunk in [0, chunks) and returns once all of
+// them are done and no worker is still looking at the job.
+void runChunks(ThreadPool *pool, long chunks, ChunkFunction function, void *context) {
+    if (chunks <= 0) {
+        return;
+    }
+
+    for(int i = 0; i < pool->size; i++) {
+        pool->queues[i].next = chunks * i / pool->size;
+        pool->queues[i].end = chunks * (i + 1) / pool->size;
+    }
+    pool->function = function;
+    pool->context = context;
+    pool->remaining = chunks;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->busy = pool->size - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    workLoop(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while(__atomic_load_n(&pool->remaining, __ATOMIC_ACQUIRE) > 0 || pool->busy > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void freeThreadPool(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(int i = 1; i < pool->size; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for(int i = 0; i < pool->size; i++) {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+
+    free(pool->threads);
+    free(pool->starts);
+    free(pool->queues);
+    free(pool);
+}
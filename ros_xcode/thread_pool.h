@@ -0,0 +1,56 @@
+//
+//  thread_pool.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-11.
+//
+
+#ifndef thread_pool_h
+#define thread_pool_h
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/*
+  Fixed set of workers that run numbered chunks of a job. The thread that
+  submits the job works as worker 0, so a pool of size 1 starts no threads.
+
+  Chunks are dealt out as one contiguous run per worker. A worker takes
+  chunks from the front of its own run and, once it is empty, steals the
+  back half of the run of another worker.
+*/
+typedef void (*ChunkFunction)(void *context, int worker, long chunk);
+
+typedef struct ChunkQueue {
+    pthread_mutex_t lock;
+    long next;
+    long end;
+} ChunkQueue;
+
+typedef struct ThreadPool {
+    int size;
+    pthread_t *threads;
+    struct WorkerStart *starts;
+    ChunkQueue *queues;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    long generation;
+    bool stopping;
+
+    // The job being run
+    ChunkFunction function;
+    void *context;
+    long remaining;
+    // Background workers that haven't left the current job yet.
+    int busy;
+} ThreadPool;
+
+int defaultPoolSize(void);
+ThreadPool *newThreadPool(int size);
+void runChunks(ThreadPool *pool, long chunks, ChunkFunction function, void *context);
+void freeThreadPool(ThreadPool *pool);
+
+#endif /* thread_pool_h */
@@ -45,6 +45,21 @@ typedef enum TokenType {
     COMMA,
     RETURN,
     EXCLUSIVE_RANGE,
+    PARALLEL,
+    REDUCE,
+    LEFT_BRACKET,
+    RIGHT_BRACKET,
+    DOT,
+    LEFT_BRACE,
+    RIGHT_BRACE,
+    FAT_ARROW,
+    LESS_LESS,
+    INTERPOLATED_STRING,
+    DO,
+    PIPE,
+    STAR_STAR,
+    AND_AND,
+    PIPE_PIPE,
     EMPTY_TOKEN
 } TokenType;
 
@@ -0,0 +1,580 @@
+//
+//  type_inference.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-23.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include "type_inference.h"
+#include "walk_stack.h"
+
+typedef enum InferredType {
+    NUMBER_TYPE,
+    BOOLEAN_TYPE
+} InferredType;
+
+typedef struct DefArray {
+    Stmt **list;
+    int size;
+    int capacity;
+} DefArray;
+
+// The def being checked. Failing anywhere jumps straight back out.
+typedef struct Inference {
+    DefArray *defs;
+    NumericMethod *method;
+    bool *assigned;
+    WalkStack stack;
+    jmp_buf jump;
+} Inference;
+
+static void reject(Inference *inference, int line, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(inference->method->reason, INFERENCE_REASON_SIZE, format, args);
+    va_end(args);
+    inference->method->line = line;
+
+    longjmp(inference->jump, 1);
+}
+
+static const char *typeName(InferredType type) {
+    return type == NUMBER_TYPE ? "Number" : "Boolean";
+}
+
+// Code nested deeper than the walk stack allows runs boxed, the
+// interpreter grows its stack as it goes.
+static void checkDepth(Inference *inference, int line) {
+    if (walkStackLow(&inference->stack)) {
+        reject(inference, line, "nests too deep");
+    }
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Slots
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static int findSlot(NumericMethod *method, char *name, int length) {
+    for(int i = 0; i < method->slotCount; i++) {
+        if (method->lengths[i] == length && memcmp(method->names[i], name, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void addSlot(NumericMethod *method, char *name, int length) {
+    if (findSlot(method, name, length) >= 0) {
+        return;
+    }
+    if (method->slotCount == method->capacity) {
+        method->capacity = method->capacity < 8 ? 8 : method->capacity * 2;
+        method->names = realloc(method->names, method->capacity * sizeof(char *));
+        method->lengths = realloc(method->lengths, method->capacity * sizeof(int));
+    }
+    method->names[method->slotCount] = name;
+    method->lengths[method->slotCount] = length;
+    method->slotCount++;
+}
+
+static void collectStatements(Inference *inference, StmtArray *statements);
+
+static void collectExpression(Inference *inference, Expr *exp) {
+    checkDepth(inference, exp->line);
+
+    switch (exp->type) {
+        case BINARY:
+            collectExpression(inference, exp->as.binary.left);
+            collectExpression(inference, exp->as.binary.right);
+            break;
+        case LOGICAL:
+            collectExpression(inference, exp->as.logical.left);
+            collectExpression(inference, exp->as.logical.right);
+            break;
+        case UNARY:
+            collectExpression(inference, exp->as.unary.operand);
+            break;
+        case VAR_ASSIGNMENT:
+            collectExpression(inference, exp->as.varAssignment.value);
+            addSlot(inference->method, exp->as.varAssignment.name, exp->as.varAssignment.length);
+            break;
+        case METHOD_CALL_EXP:
+            for(int i = 0; i < exp->as.methodCall.arguments->size; i++) {
+                collectExpression(inference, exp->as.methodCall.arguments->list[i]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void collectStatement(Inference *inference, Stmt *stmt) {
+    checkDepth(inference, stmt->line);
+
+    switch (stmt->type) {
+        case PUTS_STMT:
+            collectExpression(inference, stmt->as.puts.exp);
+            break;
+        case EXPR_STMT:
+            collectExpression(inference, stmt->exprStmt);
+            break;
+        case IF_STMT:
+            for(int i = 0; i < stmt->as.ifStmt.conditionals->size; i++) {
+                Conditional *conditional = stmt->as.ifStmt.conditionals->list[i];
+                collectExpression(inference, conditional->condition);
+                collectStatements(inference, conditional->statements);
+            }
+            break;
+        case WHILE_STMT:
+            collectExpression(inference, stmt->as.whileStmt.condition);
+            collectStatements(inference, stmt->as.whileStmt.statements);
+            break;
+        default:
+            break;
+    }
+}
+
+static void collectStatements(Inference *inference, StmtArray *statements) {
+    for(int i = 0; i < statements->size; i++) {
+        collectStatement(inference, statements->list[i]);
+    }
+}
+
+static NumericMethod *newNumericMethod(Stmt *def) {
+    NumericMethod *method = malloc(sizeof(NumericMethod));
+    method->numeric = true;
+    method->argumentCount = def->as.defStmt.arguments->size;
+    method->slotCount = 0;
+    method->capacity = 0;
+    method->names = NULL;
+    method->lengths = NULL;
+    method->line = def->line;
+    method->reason[0] = '\0';
+
+    ExprArray *arguments = def->as.defStmt.arguments;
+    for(int i = 0; i < arguments->size; i++) {
+        Expr *argument = arguments->list[i];
+        if (argument->type != IDENTIFIER_EXP) {
+            // Leaves the slots lined up with the arguments, the check
+            // rejects the method anyway.
+            addSlot(method, "", 0);
+            continue;
+        }
+        addSlot(method, argument->as.identifierExp.string, argument->as.identifierExp.length);
+    }
+
+    Inference inference;
+    inference.method = method;
+    initWalkStack(&inference.stack);
+    if (setjmp(inference.jump) != 0) {
+        method->numeric = false;
+        return method;
+    }
+    collectStatements(&inference, def->as.defStmt.statements);
+
+    return method;
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// Checking
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static const char *expressionName(Expr *exp) {
+    switch (exp->type) {
+        case STRING_LITERAL:
+        case INTERPOLATION:
+            return "a String";
+        case RANGE:
+            return "a Range";
+        case ARRAY_LITERAL:
+            return "an Array";
+        case HASH_LITERAL:
+            return "a Hash";
+        case INDEX_EXP:
+        case INDEX_ASSIGNMENT:
+            return "indexing";
+        case INVOKE_EXP:
+            return "a method called on a value";
+        default:
+            return "an expression";
+    }
+}
+
+// Only called once the method is known to be numeric.
+static void checkCall(Inference *inference, Expr *exp) {
+    char *name = exp->as.methodCall.name;
+    int length = exp->as.methodCall.length;
+    int count = exp->as.methodCall.arguments->size;
+    bool defined = false;
+
+    for(int i = 0; i < inference->defs->size; i++) {
+        Stmt *def = inference->defs->list[i];
+        if (def->as.defStmt.nameLength != length || memcmp(def->as.defStmt.name, name, length) != 0) {
+            continue;
+        }
+        defined = true;
+
+        if (def->as.defStmt.arguments->size != count) {
+            reject(inference, exp->line, "'%.*s' is called with %d arguments, the def on line %d takes %d",
+                length, name, count, def->line, def->as.defStmt.arguments->size);
+        }
+        if (!def->as.defStmt.numeric->numeric) {
+            reject(inference, exp->line, "calls '%.*s', which isn't numeric", length, name);
+        }
+    }
+
+    if (!defined) {
+        reject(inference, exp->line, "calls '%.*s', which isn't defined in this program", length, name);
+    }
+}
+
+static InferredType checkExpression(Inference *inference, Expr *exp) {
+    int slot;
+    InferredType left, right;
+
+    checkDepth(inference, exp->line);
+
+    switch (exp->type) {
+        case NUMBER_LITERAL:
+            return NUMBER_TYPE;
+        case BOOLEAN:
+            return BOOLEAN_TYPE;
+        case IDENTIFIER_EXP:
+            slot = findSlot(inference->method, exp->as.identifierExp.string, exp->as.identifierExp.length);
+            if (exp->as.identifierExp.kind != VARIABLE_NAMED || slot < 0) {
+                reject(inference, exp->line, "'%.*s' isn't an argument or a variable of the method",
+                    exp->as.identifierExp.length, exp->as.identifierExp.string);
+            }
+            if (!inference->assigned[slot]) {
+                reject(inference, exp->line, "'%.*s' can be read before it is assigned",
+                    exp->as.identifierExp.length, exp->as.identifierExp.string);
+            }
+            exp->as.identifierExp.slot = slot;
+            return NUMBER_TYPE;
+        case VAR_ASSIGNMENT:
+            if (checkExpression(inference, exp->as.varAssignment.value) != NUMBER_TYPE) {
+                reject(inference, exp->line, "'%.*s' is assigned a Boolean",
+                    exp->as.varAssignment.length, exp->as.varAssignment.name);
+            }
+            slot = findSlot(inference->method, exp->as.varAssignment.name, exp->as.varAssignment.length);
+            inference->assigned[slot] = true;
+            exp->as.varAssignment.slot = slot;
+            return NUMBER_TYPE;
+        case METHOD_CALL_EXP:
+            for(int i = 0; i < exp->as.methodCall.arguments->size; i++) {
+                if (checkExpression(inference, exp->as.methodCall.arguments->list[i]) != NUMBER_TYPE) {
+                    reject(inference, exp->line, "argument %d of '%.*s' is a Boolean",
+                        i + 1, exp->as.methodCall.length, exp->as.methodCall.name);
+                }
+            }
+            checkCall(inference, exp);
+            return NUMBER_TYPE;
+        case BINARY:
+            left = checkExpression(inference, exp->as.binary.left);
+            right = checkExpression(inference, exp->as.binary.right);
+
+            switch (exp->as.binary.op) {
+                case PLUS:
+                case MINUS:
+                case STAR:
+                case FORWARD_SLASH:
+                case MODULO:
+                case STAR_STAR:
+                    if (left != NUMBER_TYPE || right != NUMBER_TYPE) {
+                        reject(inference, exp->line, "arithmetic on a Boolean");
+                    }
+                    return NUMBER_TYPE;
+                case GREATER:
+                case GREATER_EQUAL:
+                case LESS:
+                case LESS_EQUAL:
+                    if (left != NUMBER_TYPE || right != NUMBER_TYPE) {
+                        reject(inference, exp->line, "comparison of a Boolean");
+                    }
+                    return BOOLEAN_TYPE;
+                case EQUAL_EQUAL:
+                case BANG_EQUAL:
+                    if (left != right) {
+                        reject(inference, exp->line, "a %s is compared with a %s", typeName(left), typeName(right));
+                    }
+                    return BOOLEAN_TYPE;
+                default:
+                    reject(inference, exp->line, "uses an operator that isn't numeric");
+                    break;
+            }
+            break;
+        case LOGICAL: {
+            // Whatever the right side assigns may never run.
+            int count = inference->method->slotCount;
+            bool before[count + 1];
+
+            if (checkExpression(inference, exp->as.logical.left) != BOOLEAN_TYPE) {
+                reject(inference, exp->line, "a Number is used as a condition");
+            }
+            memcpy(before, inference->assigned, count);
+            if (checkExpression(inference, exp->as.logical.right) != BOOLEAN_TYPE) {
+                reject(inference, exp->line, "a Number is used as a condition");
+            }
+            memcpy(inference->assigned, before, count);
+            return BOOLEAN_TYPE;
+        }
+        case UNARY:
+            left = checkExpression(inference, exp->as.unary.operand);
+            if (exp->as.unary.op == BANG) {
+                if (left != BOOLEAN_TYPE) {
+                    reject(inference, exp->line, "a Number is negated with !");
+                }
+                return BOOLEAN_TYPE;
+            }
+            if (left != NUMBER_TYPE) {
+                reject(inference, exp->line, "arithmetic on a Boolean");
+            }
+            return NUMBER_TYPE;
+        default:
+            reject(inference, exp->line, "uses %s", expressionName(exp));
+    }
+    return NUMBER_TYPE;
+}
+
+static void checkCondition(Inference *inference, Expr *condition) {
+    if (checkExpression(inference, condition) != BOOLEAN_TYPE) {
+        reject(inference, condition->line, "a condition is a Number, not a comparison");
+    }
+}
+
+static void checkStatements(Inference *inference, StmtArray *statements);
+
+static void checkStatement(Inference *inference, Stmt *stmt) {
+    int count = inference->method->slotCount;
+    bool before[count + 1];
+    bool after[count + 1];
+
+    checkDepth(inference, stmt->line);
+    switch (stmt->type) {
+        case PUTS_STMT:
+            checkExpression(inference, stmt->as.puts.exp);
+            break;
+        case EXPR_STMT:
+            checkExpression(inference, stmt->exprStmt);
+            break;
+        case IF_STMT: {
+            // A variable is assigned after the if when every branch
+            // assigns it, and there is an else.
+            ConditionalArray *conditionals = stmt->as.ifStmt.conditionals;
+            bool exhaustive = false;
+
+            for(int i = 0; i < conditionals->size; i++) {
+                Conditional *conditional = conditionals->list[i];
+                checkCondition(inference, conditional->condition);
+                memcpy(before, inference->assigned, count);
+
+                checkStatements(inference, conditional->statements);
+                for(int j = 0; j < count; j++) {
+                    after[j] = i == 0 ? inference->assigned[j] : after[j] && inference->assigned[j];
+                }
+                memcpy(inference->assigned, before, count);
+
+                Expr *condition = conditional->condition;
+                exhaustive = condition->type == BOOLEAN && condition->as.boolExp.value;
+                if (exhaustive) {
+                    break;
+                }
+            }
+
+            if (exhaustive) {
+                memcpy(inference->assigned, after, count);
+            }
+            break;
+        }
+        case WHILE_STMT:
+            checkCondition(inference, stmt->as.whileStmt.condition);
+            memcpy(before, inference->assigned, count);
+            checkStatements(inference, stmt->as.whileStmt.statements);
+            memcpy(inference->assigned, before, count);
+            break;
+        case FOR_STMT:
+        case PARALLEL_FOR_STMT:
+            reject(inference, stmt->line, "uses a for loop");
+            break;
+        case DEF_STMT:
+            reject(inference, stmt->line, "defines a method");
+            break;
+    }
+}
+
+static void checkStatements(Inference *inference, StmtArray *statements) {
+    for(int i = 0; i < statements->size; i++) {
+        checkStatement(inference, statements->list[i]);
+    }
+}
+
+// What the last statement evaluates to is what the method returns, it has
+// to be a number on every path.
+static void checkReturn(Inference *inference, StmtArray *statements, int line) {
+    if (statements->size == 0) {
+        reject(inference, line, "returns nil");
+    }
+
+    Stmt *last = statements->list[statements->size - 1];
+    ConditionalArray *conditionals;
+
+    switch (last->type) {
+        case EXPR_STMT:
+            if (checkExpression(inference, last->exprStmt) != NUMBER_TYPE) {
+                reject(inference, last->line, "returns a Boolean");
+            }
+            break;
+        case IF_STMT:
+            conditionals = last->as.ifStmt.conditionals;
+            for(int i = 0; i < conditionals->size; i++) {
+                Expr *condition = conditionals->list[i]->condition;
+                // The rest never run, visitIf stops at the first true one.
+                checkReturn(inference, conditionals->list[i]->statements, last->line);
+                if (condition->type == BOOLEAN && condition->as.boolExp.value) {
+                    return;
+                }
+            }
+            reject(inference, last->line, "returns nil when no branch of the if is taken");
+            break;
+        default:
+            reject(inference, last->line, "returns nil");
+            break;
+    }
+}
+
+/*
+  The return check runs on its own, without the assignments, since every
+  expression in the body has already been checked by then and only the
+  types of the last ones matter.
+*/
+static bool checkMethod(DefArray *defs, Stmt *def) {
+    NumericMethod *method = def->as.defStmt.numeric;
+    Inference inference;
+    bool assigned[method->slotCount + 1];
+
+    inference.defs = defs;
+    inference.method = method;
+    inference.assigned = assigned;
+    initWalkStack(&inference.stack);
+
+    if (setjmp(inference.jump) != 0) {
+        return false;
+    }
+
+    if (def->as.defStmt.body != NULL) {
+        reject(&inference, def->line, "isn't parsed until it is first called");
+    }
+
+    ExprArray *arguments = def->as.defStmt.arguments;
+    for(int i = 0; i < method->slotCount; i++) {
+        assigned[i] = i < arguments->size;
+    }
+    for(int i = 0; i < arguments->size; i++) {
+        if (arguments->list[i]->type != IDENTIFIER_EXP) {
+            reject(&inference, def->line, "has an argument that isn't a name");
+        }
+        arguments->list[i]->as.identifierExp.slot = i;
+    }
+
+    checkStatements(&inference, def->as.defStmt.statements);
+    for(int i = 0; i < method->slotCount; i++) {
+        assigned[i] = true;
+    }
+    checkReturn(&inference, def->as.defStmt.statements, def->line);
+
+    return true;
+}
+
+static void collectDefs(DefArray *defs, StmtArray *statements) {
+    for(int i = 0; i < statements->size; i++) {
+        Stmt *stmt = statements->list[i];
+
+        switch (stmt->type) {
+            case DEF_STMT:
+                ADD_ARRAY_ELEMENT(defs, stmt, Stmt);
+                collectDefs(defs, stmt->as.defStmt.statements);
+                break;
+            case IF_STMT:
+                for(int j = 0; j < stmt->as.ifStmt.conditionals->size; j++) {
+                    collectDefs(defs, stmt->as.ifStmt.conditionals->list[j]->statements);
+                }
+                break;
+            case WHILE_STMT:
+                collectDefs(defs, stmt->as.whileStmt.statements);
+                break;
+            case FOR_STMT:
+            case PARALLEL_FOR_STMT:
+                collectDefs(defs, stmt->as.forStmt.statements);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Starts out assuming every method is numeric and takes that back from
+// the ones that aren't until nothing changes, so recursion works out.
+void inferTypes(StmtArray *program) {
+    DefArray defs;
+    INIT_ARRAY((&defs), DefArray);
+    collectDefs(&defs, program);
+    for(int i = 0; i < defs.size; i++) {
+        defs.list[i]->as.defStmt.numeric = newNumericMethod(defs.list[i]);
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for(int i = 0; i < defs.size; i++) {
+            NumericMethod *method = defs.list[i]->as.defStmt.numeric;
+            if (method->numeric && !checkMethod(&defs, defs.list[i])) {
+                method->numeric = false;
+                changed = true;
+            }
+        }
+    }
+
+    free(defs.list);
+}
+
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+// --explain-types
+// $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
+
+static void explainMethod(FILE *out, Stmt *def) {
+    NumericMethod *method = def->as.defStmt.numeric;
+
+    fprintf(out, "def %.*s (line %d): ", def->as.defStmt.nameLength, def->as.defStmt.name, def->line);
+    if (!method->numeric) {
+        fprintf(out, "boxed\n");
+        fprintf(out, "  line %d: %s\n", method->line, method->reason);
+        return;
+    }
+
+    fprintf(out, "unboxed\n");
+    for(int i = 0; i < method->slotCount; i++) {
+        fprintf(out, "  %.*s: Number (%s)\n", method->lengths[i], method->names[i],
+            i < method->argumentCount ? "argument" : "variable");
+    }
+    fprintf(out, "  returns Number\n");
+}
+
+void explainTypes(FILE *out, StmtArray *program) {
+    DefArray defs;
+    INIT_ARRAY((&defs), DefArray);
+
+    collectDefs(&defs, program);
+
+    for(int i = 0; i < defs.size; i++) {
+        explainMethod(out, defs.list[i]);
+    }
+    if (defs.size == 0) {
+        fprintf(out, "no methods defined\n");
+    }
+
+    free(defs.list);
+}
@@ -0,0 +1,45 @@
+//
+//  type_inference.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-23.
+//
+
+#ifndef type_inference_h
+#define type_inference_h
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "parser.h"
+
+#define INFERENCE_REASON_SIZE 160
+
+/*
+  What inferTypes() worked out about one def. A numeric method only ever
+  has numbers in its arguments and variables and always returns one, so
+  it can run on plain doubles (see unboxed.h). Arguments come first in the
+  slots, then the variables in the order they are first assigned, and
+  every variable of the body has its `slot` set to its index.
+
+  Proving it is flow insensitive: every assignment to a variable has to
+  be a number, every condition a comparison, and every method called has
+  to be numeric itself for each def of its name in the program. The only
+  thing that follows the order of the code is checking that no variable
+  can be read before it is assigned.
+*/
+typedef struct NumericMethod {
+    bool numeric;
+    int argumentCount;
+    int slotCount;
+    int capacity;
+    char **names;
+    int *lengths;
+    // Why it isn't numeric, for --explain-types.
+    int line;
+    char reason[INFERENCE_REASON_SIZE];
+} NumericMethod;
+
+void inferTypes(StmtArray *program);
+void explainTypes(FILE *out, StmtArray *program);
+
+#endif /* type_inference_h */
@@ -0,0 +1,272 @@
+//
+//  unboxed.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-23.
+//
+
+#include <stdlib.h>
+#include <math.h>
+#include "unboxed.h"
+#include "type_inference.h"
+#include "stats.h"
+#include "segmented_stack.h"
+#include "scheduler.h"
+
+static double numericExpression(Interpreter *interp, Expr *exp, double *slots);
+
+// The only expressions inference types Boolean.
+static bool isCondition(Expr *exp) {
+    if (exp->type == BOOLEAN || exp->type == LOGICAL) {
+        return true;
+    }
+    if (exp->type == UNARY) {
+        return exp->as.unary.op == BANG;
+    }
+    if (exp->type != BINARY) {
+        return false;
+    }
+
+    switch (exp->as.binary.op) {
+        case GREATER:
+        case GREATER_EQUAL:
+        case LESS:
+        case LESS_EQUAL:
+        case EQUAL_EQUAL:
+        case BANG_EQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool numericCondition(Interpreter *interp, Expr *exp, double *slots) {
+    if (exp->type == BOOLEAN) {
+        return exp->as.boolExp.value;
+    }
+    if (exp->type == LOGICAL) {
+        bool decided = numericCondition(interp, exp->as.logical.left, slots);
+        if (decided == (exp->as.logical.op == PIPE_PIPE)) {
+            return decided;
+        }
+        return numericCondition(interp, exp->as.logical.right, slots);
+    }
+    if (exp->type == UNARY) {
+        return !numericCondition(interp, exp->as.unary.operand, slots);
+    }
+
+    Expr *left = exp->as.binary.left;
+    Expr *right = exp->as.binary.right;
+    TokenType op = exp->as.binary.op;
+
+    if ((op == EQUAL_EQUAL || op == BANG_EQUAL) && isCondition(left)) {
+        bool a = numericCondition(interp, left, slots);
+        bool b = numericCondition(interp, right, slots);
+        return (a == b) == (op == EQUAL_EQUAL);
+    }
+
+    double a = numericExpression(interp, left, slots);
+    double b = numericExpression(interp, right, slots);
+    switch (op) {
+        case GREATER:
+            return a > b;
+        case GREATER_EQUAL:
+            return a >= b;
+        case LESS:
+            return a < b;
+        case LESS_EQUAL:
+            return a <= b;
+        case EQUAL_EQUAL:
+            return a == b;
+        default:
+            return a != b;
+    }
+}
+
+/*
+  Inference only proves what the defs of this program look like, a method
+  defined by an earlier program of the same interpreter can still be the
+  one called. Those go through the boxed path.
+*/
+static double numericCall(Interpreter *interp, Expr *exp, double *slots) {
+    char *name = exp->as.methodCall.name;
+    int length = exp->as.methodCall.length;
+    ExprArray *values = exp->as.methodCall.arguments;
+    stats.methodCalls++;
+
+    Object *method = getEntry(name, length, interp->globals);
+    if (method == NULL || method->type != METHOD_OBJ) {
+        runtimeError(interp, exp->line, "undefined method '%.*s'", length, name);
+    }
+    checkArguments(interp, exp, method);
+    methodReady(interp, method);
+
+    double arguments[values->size + 1];
+    for(int i = 0; i < values->size; i++) {
+        arguments[i] = numericExpression(interp, values->list[i], slots);
+    }
+
+    if (method->as.method.numeric != NULL) {
+        return runNumericMethod(interp, method, arguments);
+    }
+
+    Object *boxed[values->size + 1];
+    for(int i = 0; i < values->size; i++) {
+        boxed[i] = initObject(&interp->heap, NUMBER_OBJ);
+        boxed[i]->as.number.value = arguments[i];
+    }
+    Object *result = callMethod(interp, method, boxed);
+    if (result->type != NUMBER_OBJ) {
+        runtimeError(interp, exp->line, "'%.*s' returned %s where a Number was expected",
+            length, name, objectTypeName(result->type));
+    }
+    return result->as.number.value;
+}
+
+// The body only reads the arguments, so they make its whole frame.
+static double numericInlinedCall(Interpreter *interp, Expr *exp, double *slots) {
+    Expr *call = exp->as.inlined.call;
+    if (!inlinedCallValid(interp, exp)) {
+        return numericCall(interp, call, slots);
+    }
+
+    ExprArray *values = call->as.methodCall.arguments;
+    double arguments[values->size + 1];
+    for(int i = 0; i < values->size; i++) {
+        arguments[i] = numericExpression(interp, values->list[i], slots);
+    }
+    stats.inlinedCalls++;
+
+    return numericExpression(interp, exp->as.inlined.body, arguments);
+}
+
+static double numericExpression(Interpreter *interp, Expr *exp, double *slots) {
+    double a, b;
+
+    switch (exp->type) {
+        case NUMBER_LITERAL:
+            return exp->as.numberLiteral.number;
+        case IDENTIFIER_EXP:
+            return slots[exp->as.identifierExp.slot];
+        case VAR_ASSIGNMENT:
+            return slots[exp->as.varAssignment.slot] = numericExpression(interp, exp->as.varAssignment.value, slots);
+        case METHOD_CALL_EXP:
+            return numericCall(interp, exp, slots);
+        case INLINED_CALL:
+            return numericInlinedCall(interp, exp, slots);
+        case INLINED_ARGUMENT:
+            return slots[exp->as.inlinedArgument.index];
+        case BINARY:
+            a = numericExpression(interp, exp->as.binary.left, slots);
+            b = numericExpression(interp, exp->as.binary.right, slots);
+
+            switch (exp->as.binary.op) {
+                case PLUS:
+                    return a + b;
+                case MINUS:
+                    return a - b;
+                case STAR:
+                    return a * b;
+                case FORWARD_SLASH:
+                    return a / b;
+                case MODULO:
+                    if ((int)b == 0) {
+                        runtimeError(interp, exp->line, "divided by 0");
+                    }
+                    return (int)a % (int)b;
+                case STAR_STAR:
+                    return pow(a, b);
+                default:
+                    break;
+            }
+            break;
+        case UNARY:
+            return -numericExpression(interp, exp->as.unary.operand, slots);
+        default:
+            break;
+    }
+
+    // Inference never lets anything else through.
+    runtimeError(interp, exp->line, "unboxed method can't evaluate this expression");
+    return 0;
+}
+
+static double numericStatements(Interpreter *interp, StmtArray *statements, double *slots);
+
+// Evaluates to what the statement would in the boxed path, as long as
+// that is a number.
+static double numericStatement(Interpreter *interp, Stmt *stmt, double *slots) {
+    Expr *exp;
+    ConditionalArray *conditionals;
+
+    switch (stmt->type) {
+        case EXPR_STMT:
+            exp = stmt->exprStmt;
+            if (isCondition(exp)) {
+                numericCondition(interp, exp, slots);
+                return 0;
+            }
+            return numericExpression(interp, exp, slots);
+        case PUTS_STMT:
+            exp = stmt->as.puts.exp;
+            if (isCondition(exp)) {
+                fprintf(interp->out, numericCondition(interp, exp, slots) ? "true\n" : "false\n");
+            } else {
+                fprintf(interp->out, "%f\n", numericExpression(interp, exp, slots));
+            }
+            return 0;
+        case IF_STMT:
+            conditionals = stmt->as.ifStmt.conditionals;
+            for(int i = 0; i < conditionals->size; i++) {
+                if (numericCondition(interp, conditionals->list[i]->condition, slots)) {
+                    return numericStatements(interp, conditionals->list[i]->statements, slots);
+                }
+            }
+            return 0;
+        case WHILE_STMT:
+            while (numericCondition(interp, stmt->as.whileStmt.condition, slots)) {
+                preemptionPoint(interp);
+                numericStatements(interp, stmt->as.whileStmt.statements, slots);
+            }
+            return 0;
+        default:
+            runtimeError(interp, stmt->line, "unboxed method can't run this statement");
+            return 0;
+    }
+}
+
+static double numericStatements(Interpreter *interp, StmtArray *statements, double *slots) {
+    double result = 0;
+    for(int i = 0; i < statements->size; i++) {
+        result = numericStatement(interp, statements->list[i], slots);
+    }
+    return result;
+}
+
+typedef struct NumericCall {
+    Object *method;
+    double *arguments;
+    double result;
+} NumericCall;
+
+static void numericSegment(Interpreter *interp, void *context) {
+    NumericCall *call = context;
+    call->result = runNumericMethod(interp, call->method, call->arguments);
+}
+
+double runNumericMethod(Interpreter *interp, Object *method, double *arguments) {
+    NumericMethod *numeric = method->as.method.numeric;
+    preemptionPoint(interp);
+    if (stackLow(interp)) {
+        NumericCall call = {method, arguments, 0};
+        runOnNewSegment(interp, numeric->line, numericSegment, &call);
+        return call.result;
+    }
+
+    double slots[numeric->slotCount + 1];
+
+    for(int i = 0; i < numeric->argumentCount; i++) {
+        slots[i] = arguments[i];
+    }
+    return numericStatements(interp, method->as.method.statements, slots);
+}
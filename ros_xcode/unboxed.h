@@ -0,0 +1,22 @@
+//
+//  unboxed.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-23.
+//
+
+#ifndef unboxed_h
+#define unboxed_h
+
+#include <stdio.h>
+#include "interpreter.h"
+
+/*
+  Runs the body of a method type inference proved numeric (see
+  type_inference.h) on doubles in a frame of slots on the C stack, without
+  making an object or checking a type. Calls to other methods stay
+  unboxed too, only the call coming from boxed code boxes the result.
+*/
+double runNumericMethod(Interpreter *interp, Object *method, double *arguments);
+
+#endif /* unboxed_h */
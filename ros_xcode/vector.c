@@ -0,0 +1,207 @@
+//
+//  vector.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-13.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "vector.h"
+
+typedef double double2 __attribute__((vector_size(16)));
+typedef int64_t mask2 __attribute__((vector_size(16)));
+
+// Buffers are only 8 byte aligned, memcpy compiles down to unaligned loads.
+static inline double2 load2(const double *values) {
+    double2 vector;
+    memcpy(&vector, values, sizeof(vector));
+    return vector;
+}
+
+static inline void store2(double *values, double2 vector) {
+    memcpy(values, &vector, sizeof(vector));
+}
+
+static inline double2 select2(mask2 mask, double2 a, double2 b) {
+    return (double2)((mask & (mask2)a) | (~mask & (mask2)b));
+}
+
+static inline double2 min2(double2 a, double2 b) {
+    return select2((mask2)(a < b), a, b);
+}
+
+static inline double2 max2(double2 a, double2 b) {
+    return select2((mask2)(a > b), a, b);
+}
+
+double vectorSum(const double *values, long count) {
+    // Separate accumulators so consecutive adds don't wait on each other.
+    double2 a = {0, 0};
+    double2 b = {0, 0};
+    long i = 0;
+    for (; i + 4 <= count; i += 4) {
+        a += load2(values + i);
+        b += load2(values + i + 2);
+    }
+    a += b;
+
+    double sum = a[0] + a[1];
+    for (; i < count; i++) {
+        sum += values[i];
+    }
+    return sum;
+}
+
+double vectorMin(const double *values, long count) {
+    double min = values[0];
+    long i = 0;
+    if (count >= 4) {
+        double2 a = load2(values);
+        double2 b = load2(values + 2);
+        for (i = 4; i + 4 <= count; i += 4) {
+            a = min2(load2(values + i), a);
+            b = min2(load2(values + i + 2), b);
+        }
+        a = min2(a, b);
+        min = a[0] < a[1] ? a[0] : a[1];
+    }
+    for (; i < count; i++) {
+        min = values[i] < min ? values[i] : min;
+    }
+    return min;
+}
+
+double vectorMax(const double *values, long count) {
+    double max = values[0];
+    long i = 0;
+    if (count >= 4) {
+        double2 a = load2(values);
+        double2 b = load2(values + 2);
+        for (i = 4; i + 4 <= count; i += 4) {
+            a = max2(load2(values + i), a);
+            b = max2(load2(values + i + 2), b);
+        }
+        a = max2(a, b);
+        max = a[0] > a[1] ? a[0] : a[1];
+    }
+    for (; i < count; i++) {
+        max = values[i] > max ? values[i] : max;
+    }
+    return max;
+}
+
+void vectorAdd(double *out, const double *a, const double *b, long count) {
+    long i = 0;
+    for (; i + 2 <= count; i += 2) {
+        store2(out + i, load2(a + i) + load2(b + i));
+    }
+    for (; i < count; i++) {
+        out[i] = a[i] + b[i];
+    }
+}
+
+void vectorMultiply(double *out, const double *a, const double *b, long count) {
+    long i = 0;
+    for (; i + 2 <= count; i += 2) {
+        store2(out + i, load2(a + i) * load2(b + i));
+    }
+    for (; i < count; i++) {
+        out[i] = a[i] * b[i];
+    }
+}
+
+void vectorAddScalar(double *out, const double *a, double b, long count) {
+    double2 scalar = {b, b};
+    long i = 0;
+    for (; i + 2 <= count; i += 2) {
+        store2(out + i, load2(a + i) + scalar);
+    }
+    for (; i < count; i++) {
+        out[i] = a[i] + b;
+    }
+}
+
+void vectorMultiplyScalar(double *out, const double *a, double b, long count) {
+    double2 scalar = {b, b};
+    long i = 0;
+    for (; i + 2 <= count; i += 2) {
+        store2(out + i, load2(a + i) * scalar);
+    }
+    for (; i < count; i++) {
+        out[i] = a[i] * b;
+    }
+}
+
+// Maps a double to an integer with the same ordering: flip every bit of
+// negatives and only the sign bit of everything else.
+static inline uint64_t sortKey(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits >> 63) ? ~bits : bits ^ (1ULL << 63);
+}
+
+static inline double fromSortKey(uint64_t key) {
+    uint64_t bits = (key >> 63) ? key ^ (1ULL << 63) : ~key;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES 6
+
+/*
+  Least significant digit radix sort on the keys above. Linear and branch
+  free, so it beats a comparison sort by a wide margin on the sizes where
+  sorting takes any time at all. `buffer` has room for 2 * count keys.
+*/
+void vectorSort(double *values, uint64_t *buffer, long count) {
+    if (count < 2) {
+        return;
+    }
+
+    uint64_t *keys = buffer;
+    uint64_t *scratch = buffer + count;
+    long (*counts)[RADIX_SIZE] = calloc(RADIX_PASSES, sizeof(*counts));
+
+    // One pass builds the histograms of every digit.
+    for (long i = 0; i < count; i++) {
+        keys[i] = sortKey(values[i]);
+        for (int pass = 0; pass < RADIX_PASSES; pass++) {
+            counts[pass][(keys[i] >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+        }
+    }
+
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        long *digitCounts = counts[pass];
+        int shift = pass * RADIX_BITS;
+
+        // Every key has the same digit, the pass wouldn't move anything.
+        if (digitCounts[(keys[0] >> shift) & (RADIX_SIZE - 1)] == count) {
+            continue;
+        }
+
+        long offset = 0;
+        for (int digit = 0; digit < RADIX_SIZE; digit++) {
+            long digitCount = digitCounts[digit];
+            digitCounts[digit] = offset;
+            offset += digitCount;
+        }
+        for (long i = 0; i < count; i++) {
+            scratch[digitCounts[(keys[i] >> shift) & (RADIX_SIZE - 1)]++] = keys[i];
+        }
+
+        uint64_t *swap = keys;
+        keys = scratch;
+        scratch = swap;
+    }
+
+    for (long i = 0; i < count; i++) {
+        values[i] = fromSortKey(keys[i]);
+    }
+
+    free(counts);
+}
@@ -0,0 +1,28 @@
+//
+//  vector.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-13.
+//
+
+#ifndef vector_h
+#define vector_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+  Bulk operations over unboxed number buffers, used by the Array built-ins.
+  They work on pairs of doubles with the compiler's vector extensions,
+  which map to SSE2 or NEON registers depending on the target.
+*/
+double vectorSum(const double *values, long count);
+double vectorMin(const double *values, long count);
+double vectorMax(const double *values, long count);
+void vectorAdd(double *out, const double *a, const double *b, long count);
+void vectorMultiply(double *out, const double *a, const double *b, long count);
+void vectorAddScalar(double *out, const double *a, double b, long count);
+void vectorMultiplyScalar(double *out, const double *a, double b, long count);
+void vectorSort(double *values, uint64_t *buffer, long count);
+
+#endif /* vector_h */
@@ -0,0 +1,54 @@
+//
+//  walk_stack.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-27.
+//
+
+// ucontext is only declared with _XOPEN_SOURCE on macOS.
+#ifdef __APPLE__
+#define _XOPEN_SOURCE 700
+#endif
+
+#include <stdlib.h>
+#include <ucontext.h>
+#include "walk_stack.h"
+#include "segmented_stack.h"
+
+typedef struct WalkCall {
+    WalkFunction function;
+    void *context;
+    ucontext_t caller;
+} WalkCall;
+
+// makecontext() can only pass ints, the call is handed over through here.
+static _Thread_local WalkCall *startingWalk;
+
+void initWalkStack(WalkStack *stack) {
+    stack->limit = (char *)__builtin_frame_address(0) - WALK_STACK_DEPTH;
+}
+
+static void walkMain(void) {
+    WalkCall *call = startingWalk;
+    call->function(call->context);
+}
+
+void walkOnNewSegment(WalkStack *stack, WalkFunction function, void *context) {
+    char *segment = malloc(STACK_SEGMENT_SIZE);
+    char *enclosingLimit = stack->limit;
+    WalkCall call = {function, context};
+
+    ucontext_t running;
+    getcontext(&running);
+    running.uc_stack.ss_sp = segment;
+    running.uc_stack.ss_size = STACK_SEGMENT_SIZE;
+    running.uc_link = &call.caller;
+    makecontext(&running, walkMain, 0);
+
+    stack->limit = segment + STACK_RESERVE;
+    startingWalk = &call;
+    swapcontext(&call.caller, &running);
+
+    stack->limit = enclosingLimit;
+    free(segment);
+}
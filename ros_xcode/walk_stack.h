@@ -0,0 +1,40 @@
+//
+//  walk_stack.h
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-03-27.
+//
+
+#ifndef walk_stack_h
+#define walk_stack_h
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/*
+  The parser and the passes over the tree after it (type inference and
+  inlining) recurse as deep as the program is nested, like the evaluator
+  does (see segmented_stack.h). They run on whatever stack their caller is
+  on, an interpreter's or not, so each walk keeps a limit of its own,
+  WALK_STACK_DEPTH bytes below where it started. Once past it the walk
+  goes on on a segment of STACK_SEGMENT_SIZE bytes, freed as soon as it
+  returns. Walks are started where at least STACK_RESERVE bytes are left.
+*/
+#define WALK_STACK_DEPTH (32 * 1024)
+
+typedef struct WalkStack {
+    char *limit;
+} WalkStack;
+
+typedef void (*WalkFunction)(void *context);
+
+void initWalkStack(WalkStack *stack);
+// Errors can't unwind across stacks, `function` has to catch its own and
+// leave them for the caller to raise again once it is back.
+void walkOnNewSegment(WalkStack *stack, WalkFunction function, void *context);
+
+static inline bool walkStackLow(WalkStack *stack) {
+    return (char *)__builtin_frame_address(0) < stack->limit;
+}
+
+#endif /* walk_stack_h */
@@ -0,0 +1,33 @@
+# Objects of every size class and blocks too big for the slabs, all
+# still holding what was put in them.
+small = []
+i = 0
+while i < 20000
+  small.push([i])
+  i = i + 1
+end
+puts small.length
+puts small[19999][0]
+
+strings = []
+j = 0
+while j < 2000
+  s = "a string long enough to leave the object #{j}"
+  strings.push(s)
+  j = j + 1
+end
+puts strings[1234]
+
+big = []
+k = 0
+while k < 200000
+  big.push(k)
+  k = k + 1
+end
+puts big.sum
+
+h = {}
+for n in 0...5000
+  h[n] = [n, n * 2]
+end
+puts h[4999][1]
@@ -0,0 +1,27 @@
+s = "a"
+s << "b"
+s << "c" << "d"
+puts s
+puts s.length
+
+# Appending in a loop grows the buffer as it goes.
+out = ""
+i = 0
+while i < 10000
+  out << "xy"
+  i = i + 1
+end
+puts out.length
+
+# A literal isn't changed by appending to what was built from it.
+j = 0
+while j < 2
+  t = "start"
+  t << "!"
+  puts t
+  j = j + 1
+end
+
+a = [1]
+a << 2
+puts a
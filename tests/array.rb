@@ -0,0 +1,37 @@
+a = [3, 1, 2]
+puts a.length
+puts a[0]
+puts a[5]
+a[1] = 10
+puts a.sum
+puts a.min
+puts a.max
+puts a.sort
+
+# Elementwise on numbers, which stay unboxed.
+b = [1, 2, 3] + [10, 20, 30]
+puts b
+puts [1, 2, 3] * [4, 5, 6]
+
+# Falls back to generic storage once a non number goes in.
+mixed = [1, 2]
+mixed.push("three")
+puts mixed
+puts mixed.length
+
+# Values pushed from a for loop keep the value they were pushed with.
+pushed = ["s"]
+for i in 0..2
+  pushed.push(i)
+end
+puts pushed
+
+big = []
+for i in 0...100000
+  big.push(100000 - i)
+end
+puts big.length
+puts big.sum
+puts big.sort[0]
+puts big.min
+puts big.max
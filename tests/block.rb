@@ -0,0 +1,31 @@
+total = 0
+5.times do |i|
+  total = total + i
+end
+puts total
+
+sum = 0
+(1..4).each { |x| sum = sum + x }
+puts sum
+
+words = ""
+["a", "b", "c"].each do |w|
+  words << w
+end
+puts words
+
+# Blocks nest and see the variables of the ones around them.
+count = 0
+3.times do |i|
+  2.times do |j|
+    count = count + i * j
+  end
+end
+puts count
+
+# A variable assigned in the block stays in the block.
+2.times do |i|
+  inner = i
+end
+puts total
+puts inner
@@ -0,0 +1,20 @@
+def down(n)
+  if n == 0
+    0
+  else
+    1 + down(n - 1)
+  end
+end
+
+def build(n)
+  if n == 0
+    []
+  else
+    a = build(n - 1)
+    a.push(n)
+    a
+  end
+end
+
+puts down(200000)
+puts build(50000).length
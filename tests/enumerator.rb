@@ -0,0 +1,14 @@
+puts (1..10).step(3).to_a
+puts (1..10).map { |x| x * x }.select { |x| x > 20 }.to_a
+puts (1..100).select { |x| x % 7 == 0 }.first(3)
+puts (0...5).reduce(0) { |acc, x| acc + x }
+
+n = 4
+puts (n..n * 2).to_a.length
+
+# Never builds the range, only the running total is kept.
+puts (1..3000000).step(3).select { |x| x % 2 == 0 }.reduce(0) { |acc, x| acc + x }
+
+(1..3).map { |x| x * 10 }.each do |x|
+  puts x
+end
@@ -0,0 +1,30 @@
+# flags: --fibers
+def depth(n)
+  if n == 0
+    0
+  else
+    1 + depth(n - 1)
+  end
+end
+
+def square(x)
+  x * x
+end
+
+total = 0
+i = 0
+while i < 100000
+  total = total + square(i % 10)
+  i = i + 1
+end
+puts total
+
+sum = 0
+for j in 0...50000
+  sum = sum + j
+end
+puts sum
+
+doubled = (1..3).map { |x| x * 2 }.to_a
+puts doubled[2]
+puts depth(20000)
@@ -0,0 +1,15 @@
+# flags: --gc --gc-pause 50
+keep = []
+i = 0
+while i < 300000
+  garbage = [i, i + 1, i + 2]
+  text = "garbage #{i}"
+  if i % 1000 == 0
+    keep.push([i, "kept #{i}"])
+  end
+  i = i + 1
+end
+puts keep.length
+puts keep[0][1]
+puts keep[299][0]
+puts keep[299][1]
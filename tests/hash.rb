@@ -0,0 +1,40 @@
+h = {"one" => 1, 2 => "two"}
+puts h["one"]
+puts h[2]
+puts h["missing"]
+h["three"] = 3
+puts h.key?("three")
+puts h.key?(3)
+h.delete("one")
+puts h.length
+puts h.keys
+puts h.values
+
+# Keys taken from a for loop keep the value they were inserted with.
+squares = {}
+for i in 0..4
+  squares[i] = i * i
+end
+puts squares
+puts squares.length
+puts squares[3]
+
+# Grows, deletes and grows again without losing entries.
+big = {}
+for i in 0...100000
+  big[i] = i
+end
+for i in 0...50000
+  big.delete(i * 2)
+end
+puts big.length
+puts big[99999]
+puts big.key?(500)
+puts big.key?(501)
+
+names = {}
+for i in 0...1000
+  names["key#{i}"] = i
+end
+puts names["key#{999}"]
+puts names.length
@@ -0,0 +1,14 @@
+# flags: --gc --heap-quota 1
+small = [3, 1, 2].sort
+puts small[0]
+puts small[2]
+numbers = []
+i = 0
+while i < 40000
+  numbers.push(40000 - i)
+  i = i + 1
+end
+puts numbers.length
+puts numbers.sum
+sorted = numbers.sort
+puts sorted[0]
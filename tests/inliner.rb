@@ -0,0 +1,30 @@
+# flags: --inline-report
+def double(x)
+  x * 2
+end
+
+def twice_then_one(x)
+  double(x) + 1
+end
+
+def long(x)
+  y = x + 1
+  y * 2
+end
+
+total = 0
+i = 0
+while i < 1000
+  total = total + double(i)
+  i = i + 1
+end
+puts total
+puts twice_then_one(5)
+puts long(1)
+
+# Redefining a method takes back the calls inlined from the old body.
+def double(x)
+  x * 3
+end
+puts double(2)
+puts twice_then_one(5)
@@ -0,0 +1,14 @@
+name = "world"
+puts "hello #{name}"
+puts "#{1 + 2} is three"
+puts "#{name}#{name}"
+puts "nested #{"in #{name}"}"
+puts "no parts"
+puts "#{[1, 2].length} items and #{true}"
+s = "a #{name} b"
+puts s.length
+i = 0
+while i < 3
+  puts "line #{i}"
+  i = i + 1
+end
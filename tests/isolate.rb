@@ -0,0 +1,59 @@
+def produce(out, count)
+  i = 0
+  while i < count
+    out.send(i)
+    i = i + 1
+  end
+  out.send(-1)
+  count
+end
+
+def consume(input, results)
+  total = 0
+  value = input.receive
+  while value >= 0
+    total = total + value
+    value = input.receive
+  end
+  results.send(total)
+  "done"
+end
+
+def square_all(numbers)
+  squares = []
+  for i in 0...numbers.length
+    squares.push(numbers[i] * numbers[i])
+  end
+  squares
+end
+
+def broken(n)
+  n + "text"
+end
+
+work = channel()
+results = channel()
+producer = spawn("produce", work, 1000)
+consumer = spawn("consume", work, results)
+puts producer.value
+puts consumer.value
+puts results.receive
+
+# What is sent is a copy, changing it on one side leaves the other alone.
+numbers = [1, 2, 3]
+squares = spawn("square_all", numbers).value
+numbers.push(4)
+puts squares
+puts numbers.length
+
+copies = channel()
+hash = {"a" => [1, 2], "b" => "text"}
+copies.send(hash)
+received = copies.receive
+received["a"].push(3)
+puts hash["a"].length
+puts received["a"].length
+puts received["b"]
+
+# An isolate's error comes back out of value.
+puts spawn("broken", 1).value
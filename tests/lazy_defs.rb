@@ -0,0 +1,55 @@
+# flags: --lazy-defs
+def add(a, b)
+  a + b
+end
+
+# Never called, so its syntax error is never found.
+def never_called(x)
+  first = x * 2
+  second = first + 1
+  third = second + first
+  x + * 2
+end
+
+def fib(n)
+  if n < 2
+    n
+  else
+    fib(n - 1) + fib(n - 2)
+  end
+end
+
+# Long enough to be skimmed, parsed on the first call and reused after.
+def weighted(a, b)
+  first = a * 2
+  second = first + b
+  third = second + first
+  third + a
+end
+
+def outer(n)
+  def inner(m)
+    m * 3
+  end
+  inner(n) + 1
+end
+
+puts add(1, 2)
+puts add(3, 4)
+puts fib(20)
+puts weighted(1, 2)
+puts weighted(2, 3)
+puts outer(2)
+puts inner(5)
+puts [1, 2, 3].length
+
+def broken(x)
+  first = x * 2
+  second = first + 1
+  third = second + first
+  fourth = third +
+end
+
+puts "before the call"
+puts broken(1)
+puts "not reached"
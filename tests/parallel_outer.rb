@@ -0,0 +1,18 @@
+# A parallel for body can read the arrays and hashes around it and build
+# its own, but changing an outer one is an error.
+numbers = ["a", "b"]
+numbers[0] = 4
+numbers[1] = 5
+parallel for i in 0...100 reduce(+, total)
+  mine = [i]
+  mine << numbers.sum
+  counts = {}
+  counts[i] = numbers.max
+  mine.sum + counts[i]
+end
+puts total
+
+seen = {}
+parallel for i in 0...100
+  seen[i] = true
+end
@@ -0,0 +1,21 @@
+# Assignments in a parallel for stay in the iteration, so the reductions
+# come out the same whatever the number of threads.
+y = 0
+acc = 0
+parallel for i in 0...10000 reduce(+, acc)
+  y = y + 1
+  y
+end
+puts acc
+
+total = 0
+parallel for i in 1..200000 reduce(+, total)
+  total = total + i
+end
+puts total
+
+parallel for i in 1..1000 reduce(count, odd)
+  rest = i % 2
+  rest == 1
+end
+puts odd
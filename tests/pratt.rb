@@ -0,0 +1,58 @@
+# Precedence and associativity.
+puts 1 + 2 * 3
+puts (1 + 2) * 3
+puts 10 - 4 - 3
+puts 2 * 3 + 4 * 5
+puts 100 / 10 / 5
+puts 7 % 4 + 1
+puts -2 * 3
+puts 1 + 2 < 4
+puts 1 < 2 == true
+puts !true || true
+puts true || false && false
+a = b = 4
+puts a + b
+
+# && and || give back the operand that decided.
+puts 1 && 2
+puts false || "fallback"
+puts nothing_yet = false || 5
+puts 3 && false
+
+# Any value but false and nil is true in a condition.
+if 1 && 2
+  puts "then"
+else
+  puts "else"
+end
+if false || 0
+  puts "zero is true"
+end
+if false && 1
+  puts "not printed"
+elsif "text"
+  puts "elsif"
+end
+
+x = 3
+count = 0
+while x
+  count = count + 1
+  if count == 3
+    x = false
+  end
+end
+puts count
+
+def first_positive(a, b)
+  if a > 0 && a
+    a
+  elsif b > 0 || false
+    b
+  else
+    0
+  end
+end
+puts first_positive(-1, 2)
+puts first_positive(5, 2)
+puts first_positive(-1, -2)
@@ -0,0 +1,111 @@
+#!/bin/sh
+#
+#  run_tests.sh
+#  ros_xcode
+#
+#  Runs every tests/*.rb with the interpreter given as the first argument
+#  and compares what it prints with tests/*.out. Each script runs with
+#  one thread and with several, the output has to be the same for both.
+#  A first line like `# flags: --gc` gives the flags to run it with.
+#  session.c is built against the sources with $CC, or cc, and run.
+#  Scripts too big to keep around, like the deeply nested ones, are made
+#  on the fly.
+#
+#  usage: tests/run_tests.sh path/to/ros
+#
+
+ROS=${1:?usage: run_tests.sh path/to/ros}
+DIR=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+failed=0
+
+# usage: check name script expected [flags...]
+check() {
+    name=$1 script=$2 expected=$3
+    shift 3
+    echo "$expected" > "$TMP/expected"
+    for threads in 1 4; do
+        actual=$("$ROS" "$@" --threads "$threads" "$script" 2>&1)
+        if [ "$actual" != "$expected" ]; then
+            echo "FAIL $name $* (--threads $threads)"
+            echo "$actual" | diff "$TMP/expected" - | head -20
+            failed=1
+        fi
+    done
+}
+
+for script in "$DIR"/*.rb; do
+    name=$(basename "$script" .rb)
+    flags=$(sed -n '1s/^# flags: //p' "$script")
+    check "$name" "$script" "$(cat "$DIR/$name.out")" $flags
+done
+
+# 100000 terms, parsed, inlined and type checked without running out of stack.
+awk 'BEGIN { printf "x = 1"; for (i = 1; i < 100000; i++) printf " + 1"; print ""; print "puts x" }' > "$TMP/deep_sum.rb"
+check deep_sum "$TMP/deep_sum.rb" "100000.000000"
+
+awk 'BEGIN { print "def f(y)"; printf "  y"; for (i = 0; i < 100000; i++) printf " + 1"; print ""; print "end"; print "puts f(1)" }' > "$TMP/deep_def.rb"
+check deep_def "$TMP/deep_def.rb" "100001.000000"
+
+awk 'BEGIN { printf "x = "; for (i = 0; i < 100000; i++) printf "("; printf "1"; for (i = 0; i < 100000; i++) printf ")"; print ""; print "puts x" }' > "$TMP/deep_parens.rb"
+check deep_parens "$TMP/deep_parens.rb" "1.000000"
+
+# The first run writes the cache and the second one reads it.
+check deep_sum "$TMP/deep_sum.rb" "100000.000000" --cache
+check deep_def "$TMP/deep_def.rb" "100001.000000" --cache
+check deep_parens "$TMP/deep_parens.rb" "1.000000" --cache
+
+# --stream frees each statement once it ran, and has to do it without
+# running out of stack either.
+awk 'BEGIN { printf "x = 1"; for (i = 1; i < 200000; i++) printf " + 1"; print ""; print "puts x" }' > "$TMP/stream_sum.rb"
+check stream_sum "$TMP/stream_sum.rb" "200000.000000" --stream
+check deep_parens "$TMP/deep_parens.rb" "1.000000" --stream
+
+# --stats counts the calls made on every worker thread.
+printf 'def twice(n)\n  [n, n]\nend\nparallel for i in 0...100000\n  twice(i)\nend\n' > "$TMP/parallel_stats.rb"
+one=$("$ROS" --stats --threads 1 "$TMP/parallel_stats.rb" 2>&1 | grep '"method_calls"')
+four=$("$ROS" --stats --threads 4 "$TMP/parallel_stats.rb" 2>&1 | grep '"method_calls"')
+if [ "$one" != '  "method_calls": 100000,' ] || [ "$four" != "$one" ]; then
+    echo "FAIL parallel_stats"
+    echo "$one"
+    echo "$four"
+    failed=1
+fi
+
+# Fibers share the threads and take turns, so lines of different scripts
+# interleave but each script still prints all of its own.
+expected=$(cat "$DIR/fibers.out" "$DIR/fibers.out" "$DIR/fibers.out" | sort)
+actual=$("$ROS" --fibers --threads 2 "$DIR/fibers.rb" "$DIR/fibers.rb" "$DIR/fibers.rb" 2>&1 | sort)
+if [ "$actual" != "$expected" ]; then
+    echo "FAIL fibers"
+    echo "$actual" | head -20
+    failed=1
+fi
+
+# Sessions only have the embedding API, session.c drives one through it.
+sources=$(ls "$DIR"/../ros_xcode/*.c | grep -v '/main\.c$')
+if ${CC:-cc} -std=gnu11 -w -O2 -o "$TMP/session" "$DIR/session.c" $sources -lm -lpthread; then
+    actual=$("$TMP/session" 2>&1)
+    if [ "$actual" != "$(cat "$DIR/session.out")" ]; then
+        echo "FAIL session"
+        echo "$actual" | diff "$DIR/session.out" - | head -20
+        failed=1
+    fi
+else
+    echo "FAIL session doesn't build"
+    failed=1
+fi
+
+# A small pause budget still has to finish collections while the script
+# keeps allocating, so the garbage gets freed instead of piling up.
+stats=$("$ROS" --gc --gc-pause 50 --stats "$DIR/gc.rb" 2>&1)
+freed=$(echo "$stats" | sed -n 's/.*"freed_bytes": \([0-9]*\).*/\1/p')
+peak=$(echo "$stats" | sed -n 's/.*"peak": \([0-9]*\).*/\1/p')
+if [ "${freed:-0}" -eq 0 ] || [ "${peak:-0}" -gt 100000000 ]; then
+    echo "FAIL gc_pause freed $freed bytes, peak $peak bytes"
+    failed=1
+fi
+
+[ $failed -eq 0 ] && echo "all tests passed"
+exit $failed
@@ -0,0 +1,115 @@
+//
+//  session.c
+//  ros_xcode
+//
+//  Created by Eduardo Poleo on 2023-04-07.
+//
+//  Edits a session through the embedding API and prints what every run
+//  printed, or the error it failed with. Built and run by run_tests.sh,
+//  its output is compared with session.out.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../ros_xcode/ros.h"
+
+static Ros *ros;
+static RosSession *session;
+static char *text;
+
+static void run(const char *label) {
+    printf("-- %s\n", label);
+    fflush(stdout);
+    if (ros_session_run(session) != 0) {
+        printf("error: %s\n", ros_error(ros));
+    }
+    fflush(stdout);
+}
+
+// Replaces the first `old` in the text with `new`, like an editor would.
+static void edit(const char *old, const char *new) {
+    char *at = strstr(text, old);
+    if (at == NULL) {
+        printf("no '%s' to edit\n", old);
+        exit(1);
+    }
+    size_t start = at - text;
+    size_t end = start + strlen(old);
+    if (ros_session_edit(session, start, end, new) != 0) {
+        printf("edit error: %s\n", ros_error(ros));
+    }
+
+    char *edited = malloc(strlen(text) - (end - start) + strlen(new) + 1);
+    memcpy(edited, text, start);
+    strcpy(edited + start, new);
+    strcat(edited, text + end);
+    free(text);
+    text = edited;
+}
+
+static void start(const char *source) {
+    free(text);
+    text = strdup(source);
+    session = ros_session_new(ros, source);
+    if (session == NULL) {
+        printf("error: %s\n", ros_error(ros));
+        exit(1);
+    }
+}
+
+// x = 1 + 1 + ... with `terms` ones, after a first line of its own.
+static char *deepSum(int terms) {
+    char *source = malloc(4 * terms + 32);
+    char *end = source + sprintf(source, "puts 0\nx = 1");
+    for(int i = 1; i < terms; i++) {
+        end += sprintf(end, " + 1");
+    }
+    sprintf(end, "\nputs x\n");
+    return source;
+}
+
+int main(void) {
+    ros = ros_new();
+    ros_set_threads(ros, 1);
+
+    start("x = 1\nputs x\ndef twice(n)\n  n * 2\nend\nputs twice(x)\n");
+    run("first run");
+    edit("x = 1", "x = 20");
+    run("a statement edited");
+    edit("n * 2", "n * 3");
+    run("a method edited");
+    edit("puts x\n", "puts x +\n");
+    run("a syntax error");
+    edit("puts x +\n", "puts x + 1\n");
+    run("fixed again");
+
+    // A block resolves names against what was assigned before it.
+    edit("puts twice(x)\n", "puts twice(x)\n[1, 2].each { |i| puts i + y }\n");
+    run("a name not assigned yet");
+    edit("x = 20\n", "x = 20\ny = 100\n");
+    run("the name assigned");
+
+    // Lines after an edit move, errors still point at the right one.
+    edit("puts twice(x)\n", "puts twice(x)\nputs \"one more line\"\nputs \"and another\"\n");
+    edit("n * 3", "n * missing");
+    run("lines moved");
+    edit("x = 20\n", "x = 20\n\n\n");
+    run("lines moved before the error");
+    ros_session_free(session);
+
+    // Nested deeper than any stack walk would allow.
+    char *source = deepSum(200000);
+    start(source);
+    free(source);
+    run("a deep expression");
+    edit("puts 0\n", "puts 0\nputs 1\n");
+    run("lines moved above a deep expression");
+    edit("x = 1 +", "x = 2 +");
+    run("the deep expression edited");
+    ros_session_free(session);
+
+    free(text);
+    ros_free(ros);
+    return 0;
+}
@@ -0,0 +1,5 @@
+# flags: --stack-budget 4
+def forever(n)
+  forever(n + 1) + 1
+end
+puts forever(0)
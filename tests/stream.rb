@@ -0,0 +1,26 @@
+# flags: --stream
+def double(x)
+  x * 2
+end
+
+puts double(21)
+total = 0
+i = 0
+while i < 1000
+  total = total + i
+  i = i + 1
+end
+puts total
+
+# The block outlives its statement, the method and the enumerator keep it.
+squares = (1..5).map { |x| x * x }
+puts squares.to_a
+if total > 10 && double(1) == 2
+  puts "kept #{total}"
+end
+names = {"a" => 1}
+names["b"] = double(names["a"])
+puts names["b"]
+
+# Everything before it already ran when the error is read.
+puts 1 +
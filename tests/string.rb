@@ -0,0 +1,26 @@
+a = "hello"
+b = "hel" + "lo"
+puts a == b
+puts a != "world"
+puts a < "help"
+puts "b" > "a"
+puts b.length
+puts "" + a + ""
+
+# Long enough not to be stored inline.
+long = "a string too long to fit in the object itself"
+puts long + "!"
+puts (long + "!").length
+
+# A literal evaluated again is the same string every time.
+i = 0
+while i < 3
+  s = "same"
+  puts s == "same"
+  i = i + 1
+end
+
+# Equal strings are the same key whichever way they were made.
+h = {}
+h["ab"] = 1
+puts h["a" + "b"]
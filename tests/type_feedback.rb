@@ -0,0 +1,26 @@
+def add(a, b)
+  a + b
+end
+
+# Warms up on numbers, then has to give up the specialized node.
+i = 0
+while i < 100
+  x = add(i, 1)
+  i = i + 1
+end
+puts x
+puts add("a", "b")
+puts add(1.5, 2)
+
+def less(a, b)
+  a < b
+end
+j = 0
+while j < 100
+  less(j, 50)
+  j = j + 1
+end
+puts less(1, 2)
+puts less("b", "a")
+puts 1 == "1"
+puts 1 + "a"
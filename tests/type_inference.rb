@@ -0,0 +1,33 @@
+# flags: --explain-types
+def fib(n)
+  if n < 2
+    n
+  else
+    fib(n - 1) + fib(n - 2)
+  end
+end
+
+def square_sum(a, b)
+  s = a * a
+  s + b * b
+end
+
+def describe(n)
+  if n > 0
+    "positive"
+  else
+    "not positive"
+  end
+end
+
+def maybe(n)
+  if n > 0
+    y = 1
+  end
+  y
+end
+
+puts fib(20)
+puts square_sum(3, 4)
+puts describe(2)
+puts describe(-1)